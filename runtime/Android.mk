@@ -40,6 +40,19 @@ LIBART_COMMON_SRC_FILES := \
   check_jni.cc \
   class_linker.cc \
   unpack_dump.cc \
+  unpack_arena.cc \
+  unpack_budget.cc \
+  unpack_class_filter.cc \
+  unpack_collection_state.cc \
+  unpack_config.cc \
+  unpack_container.cc \
+  unpack_dedup_index.cc \
+  unpack_dex_memo.cc \
+  unpack_explore.cc \
+  unpack_force_branch.cc \
+  unpack_intern.cc \
+  unpack_metrics.cc \
+  unpack_writer.cc \
   common_throws.cc \
   debugger.cc \
   dex_file.cc \
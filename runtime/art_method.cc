@@ -366,85 +366,6 @@ uintptr_t ArtMethod::NativeQuickPcOffset(const uintptr_t pc, const void* quick_e
 }
 #endif
 
-bool ArtMethod::ShouldManipulate() {
-  const EntryHookInfo* info = GetHookInfo();
-  // const EntryHookInfo* info = nullptr;
-//  if (dex_method_index_ <= 35) {
-//    LOG(ERROR) << "ShouldManipulate";
-//    const DexFile* dex_file = GetDexFile();
-//    LOG(ERROR) << "got dex file";
-//    if (dex_file) {
-//      if (nullptr != info) {
-//        char tmp[30];
-//        sprintf(tmp, "%p", info);
-//        LOG(ERROR) << "ShouldManipulate " << tmp << " " << dex_method_index_
-//            << " " << dex_file->GetMethodName(dex_file->GetMethodId(dex_method_index_));
-//      } else {
-//        LOG(ERROR) << "ShouldManipulate " << dex_method_index_  << " null "
-//            << dex_file->GetMethodName(dex_file->GetMethodId(dex_method_index_));
-//      }
-//    } else {
-//      if (nullptr != info) {
-//        char tmp[30];
-//        sprintf(tmp, "%p", info);
-//        LOG(ERROR) << "ShouldManipulate " << info << " " << dex_method_index_;
-//      } else {
-//        LOG(ERROR) << "ShouldManipulate null " << dex_method_index_;
-//      }
-//    }
-//  }
-  if (nullptr != info) {
-    return true;
-  }
-  return false;
-}
-
-EntryHookInfo* ArtMethod::GetHookInfo() const {
-  size_t pointer_size = sizeof(void*);
-//  if (dex_method_index_ <= 35) {
-//    LOG(ERROR) << "GetHookInfo";
-//  }
-  // void* entry = GetEntryPointFromQuickCompiledCodePtrSizeWithoutCheck(pointer_size);
-  const auto addr = reinterpret_cast<uintptr_t>(this) + EntryPointFromInterpreterOffset(pointer_size).Uint32Value();
-  EntryPointFromInterpreter* entry;
-  if (pointer_size == sizeof(uint32_t)) {
-    entry = reinterpret_cast<EntryPointFromInterpreter*>(*reinterpret_cast<const uint32_t*>(addr));
-  } else {
-    auto v = *reinterpret_cast<const uint64_t*>(addr);
-    DCHECK_EQ(reinterpret_cast<uint64_t>(reinterpret_cast<EntryPointFromInterpreter*>(v)), v) << "Conversion lost bits";
-    entry = reinterpret_cast<EntryPointFromInterpreter*>(v);
-  }
-
-//  if (dex_method_index_ <= 35) {
-//    LOG(ERROR) << "get entry ";
-//    if (nullptr != entry) {
-//      char tmp[30];
-//      sprintf(tmp, "entry: %p", entry);
-//      LOG(ERROR) << tmp;
-//    } else {
-//      LOG(ERROR) << "empty entry";
-//    }
-//  }
-
-  EntryHookInfo* hook = reinterpret_cast<EntryHookInfo*>(entry);
-//  if (dex_method_index_ <= 35) {
-//    if (nullptr != hook) {
-//      char tmp[30];
-//      sprintf(tmp, "hook: %p", hook);
-//      LOG(ERROR) << tmp;
-//    } else {
-//      LOG(ERROR) << "empty hook";
-//    }
-//  }
-  if (nullptr == hook || strncmp(hook->magic, "droidreveal", strlen("droidreveal")) != 0) {
-//    if (dex_method_index_ <= 35) {
-//      LOG(ERROR) << "not hooked ";
-//    }
-    return nullptr;
-  }
-  return hook;
-}
-
 void ArtMethod::addHookReal(size_t pointer_size) {
   const auto addr = reinterpret_cast<uintptr_t>(this) + EntryPointFromInterpreterOffset(pointer_size).Uint32Value();
   EntryPointFromInterpreter* ori_interpreter_entry;
@@ -458,6 +379,8 @@ void ArtMethod::addHookReal(size_t pointer_size) {
 
   EntryHookInfo* info = reinterpret_cast<EntryHookInfo*>(malloc(sizeof(EntryHookInfo)));
   info->ori_interpreter_entry = ori_interpreter_entry;
+  info->collection_state = nullptr;
+  info->force_branches = 0;
   strncpy(info->magic, "droidreveal", strlen("droidreveal"));
   // SetEntryPointFromQuickCompiledCodePtrSizeWithoutCheck(info, pointer_size);
   if (pointer_size == sizeof(uint32_t)) {
@@ -470,9 +393,10 @@ void ArtMethod::addHookReal(size_t pointer_size) {
 }
 
 void ArtMethod::SetShouldManipulate() {
-  EntryHookInfo* info = GetHookInfo();
-  if (info == nullptr) {
+  if (!ShouldManipulate()) {
     addHookReal(sizeof(void*));
+    // Only once the hook is in place, so GetHookInfo() never sees the flag without it.
+    access_flags_ |= kAccCollect;
   }
 }
 
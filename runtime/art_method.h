@@ -18,6 +18,8 @@
 #define ART_RUNTIME_ART_METHOD_H_
 
 #include <inttypes.h>
+#include <string.h>
+
 #include "dex_file.h"
 #include "gc_root.h"
 #include "invoke_type.h"
@@ -34,6 +36,7 @@
 namespace art {
 
 union JValue;
+class CollectionState;
 class ScopedObjectAccessAlreadyRunnable;
 class StringPiece;
 class ShadowFrame;
@@ -50,6 +53,11 @@ typedef void (EntryPointFromInterpreter)(Thread* self, const DexFile::CodeItem*
 struct PACKED(4) EntryHookInfo {
   char magic[12];
   EntryPointFromInterpreter* ori_interpreter_entry;
+  // Set once when the hook is installed, before the method can run.
+  CollectionState* collection_state;
+  // Whether force_branches has an entry for the method, tagged with the generation of the
+  // ForceBranchIndex that answered; see Dumper::ResolveForceBranches.
+  uint32_t force_branches;
 };
 
 class ArtMethod FINAL {
@@ -279,7 +287,11 @@ class ArtMethod FINAL {
 
   void SetShouldManipulate();
 
-  bool ShouldManipulate() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+  // Checked on every interpreted entry, so it reads the flag directly rather than going through
+  // GetAccessFlags() and its declaring class checks.
+  bool ShouldManipulate() const {
+    return (access_flags_ & kAccCollect) != 0;
+  }
 
   void Invoke(Thread* self, uint32_t* args, uint32_t args_size, JValue* result, const char* shorty)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
@@ -311,7 +323,18 @@ class ArtMethod FINAL {
 
   void* GetHookTrampoline();
 
-  EntryHookInfo* GetHookInfo() const;
+  // The hook installed by SetShouldManipulate() in place of the interpreter entry point, or
+  // nullptr. kAccCollect is set exactly when the hook is installed; ArtMethod copies carry both.
+  EntryHookInfo* GetHookInfo() const {
+    if (!ShouldManipulate()) {
+      return nullptr;
+    }
+    const auto addr = reinterpret_cast<uintptr_t>(this) +
+        EntryPointFromInterpreterOffset(sizeof(void*)).Uint32Value();
+    EntryHookInfo* hook = *reinterpret_cast<EntryHookInfo* const*>(addr);
+    DCHECK(hook != nullptr && strncmp(hook->magic, "droidreveal", strlen("droidreveal")) == 0);
+    return hook;
+  }
 
   void SetEntryPointFromQuickCompiledCode(const void* entry_point_from_quick_compiled_code) {
     SetEntryPointFromQuickCompiledCodePtrSize(entry_point_from_quick_compiled_code,
@@ -53,6 +53,18 @@ MemStats ArenaStack::GetPeakStats() const {
                   bottom_arena_);
 }
 
+size_t ArenaStack::BytesInUse() const {
+  size_t bytes = 0;
+  for (Arena* arena = bottom_arena_; arena != nullptr; arena = arena->next_) {
+    if (arena == top_arena_) {
+      bytes += static_cast<size_t>(top_ptr_ - arena->Begin());
+      break;
+    }
+    bytes += arena->Size();
+  }
+  return bytes;
+}
+
 uint8_t* ArenaStack::AllocateFromNextArena(size_t rounded_bytes) {
   UpdateBytesAllocated();
   size_t allocation_size = std::max(Arena::kDefaultSize, rounded_bytes);
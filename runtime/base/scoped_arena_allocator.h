@@ -45,6 +45,10 @@ class ArenaStack : private DebugStackRefCounter {
 
   MemStats GetPeakStats() const;
 
+  // Bytes between the bottom of the stack and the current top, counting the arenas below the top
+  // one as full. Unlike PeakBytesAllocated() this does not depend on allocation counting.
+  size_t BytesInUse() const;
+
  private:
   struct Peak;
   struct Current;
@@ -24,7 +24,6 @@
 #include <unistd.h>
 #include <utility>
 #include <vector>
-#include <fstream>
 
 #include "art_field-inl.h"
 #include "art_method-inl.h"
@@ -2190,65 +2189,6 @@ void ClassLinker::FixupStaticTrampolines(mirror::Class* klass) {
   // Ignore virtual methods on the iterator.
 }
 
-// bool dump = false;
-static std::map<pid_t, bool> pid_map;
-
-bool shouldDump2();
-bool shouldDump2() {
-  char fname[128];
-  char fname2[128];
-  char buff[1024];
-  pid_t pid = getpid();
-  std::map<pid_t, bool>::iterator it = pid_map.find(pid);
-  if (it != pid_map.end()) {
-    return it->second;
-  }
-
-  sprintf(fname, "/proc/%d/cmdline", pid);
-  FILE *fp = fopen(fname, "r");
-  if (fp != NULL) {
-    // LOG(ERROR) << "get into get pid " << pid;
-    while (fgets(buff, 1024, fp)) {
-      // LOG(ERROR) << "fgets:" << buff;
-      // if (!strncmp(buff, "Name:", 5)) {
-        std::string pkg_name = std::string(buff);
-        size_t pos = pkg_name.find(":");
-        if (pos != std::string::npos) {
-          pkg_name = pkg_name.substr(0, pos);
-        }
-        sprintf(fname2, "/data/data/%s/reveal_filter", pkg_name.c_str());
-        std::ifstream filter(fname2);
-        if (filter.fail()) {
-          if (strstr(buff, "zhenyu") || strstr(buff, "ecspride") || strstr(buff, "mit")
-              || strstr(buff, "example") || strstr(buff, "cert") || strstr(buff, "snt")
-              || strstr(buff, "wayne")) {
-            LOG(ERROR) << "default filter in classlinker";
-            pid_map.insert(std::pair<pid_t, bool>(pid, true));
-            fclose(fp);
-            return true;
-          }
-        } else {
-          LOG(ERROR) << "file filter in classlinker";
-          std::string line_filter;
-          while (std::getline(filter, line_filter)) {
-            if (strstr(buff, line_filter.c_str())) {
-              pid_map.insert(std::pair<pid_t, bool>(pid, true));
-              fclose(fp);
-              return true;
-            }
-          }
-        }
-        break;
-      // }
-    }
-    fclose(fp);
-  } else {
-    LOG(ERROR) << "file not found for pid " << pid;
-  }
-  pid_map.insert(std::pair<pid_t, bool>(pid, false));
-  return false;
-}
-
 void ClassLinker::LinkCode(ArtMethod* method, const OatFile::OatClass* oat_class,
                            uint32_t class_def_method_index, bool dump) {
   Runtime* const runtime = Runtime::Current();
@@ -2310,11 +2250,18 @@ void ClassLinker::LinkCode(ArtMethod* method, const OatFile::OatClass* oat_class
 
   if (manipulate) {
     method->SetShouldManipulate();
-    const EntryHookInfo* info = method->GetHookInfo();
+    EntryHookInfo* info = method->GetHookInfo();
     if (nullptr == info) {
       LOG(FATAL) << "hook failed";
     } else {
       // LOG(ERROR) << "hook succeed";
+      if (nullptr == info->collection_state) {
+        info->collection_state = Dumper::Instance()->NewCollectionState();
+      }
+      // Match force_branches against the method's dex file now rather than at its branches.
+      if (Dumper::Instance()->ForceExecution()) {
+        Dumper::Instance()->ResolveForceBranches(method);
+      }
     }
   }
 }
@@ -2347,7 +2294,7 @@ void ClassLinker::LoadClass(Thread* self, const DexFile& dex_file,
   const char* descriptor = dex_file.GetClassDescriptor(dex_class_def);
   // std::string desString(descriptor);
   // dump = desString.find("zhenyu") != std::string::npos && desString.find("MainActivity") != std::string::npos;
-  bool dump = shouldDump2();
+  bool dump = Dumper::InitializeIfTarget();
   // dump = Dumper::Instance()->shouldDump();
   // if (desString.find("zhenyu") != std::string::npos) {
   std::string location = dex_file.GetLocation();
@@ -3791,7 +3738,7 @@ bool ClassLinker::InitializeClass(Thread* self, Handle<mirror::Class> klass,
 
     std::string location = dex_file.GetLocation();
     // bool shouldDump = Dumper::Instance()->shouldDump() && location.compare(0, 8, "/system/") != 0;
-    bool shouldDump = shouldDump2() && location.compare(0, 8, "/system/") != 0;
+    bool shouldDump = Dumper::InitializeIfTarget() && location.compare(0, 8, "/system/") != 0;
     if (shouldDump) {
       std::string store;
       const char* descriptor = klass->GetDescriptor(&store);
@@ -43,6 +43,7 @@ namespace mirror {
 class ArtField;
 class ArtMethod;
 class ClassLinker;
+class DumpDexMemo;
 class MemMap;
 class OatDexFile;
 class Signature;
@@ -919,6 +920,16 @@ class DexFile {
     return oat_dex_file_;
   }
 
+  // DexLego: the indexes this file's ids were dumped at, or null before the first one is dumped.
+  DumpDexMemo* GetDumpMemo() const {
+    return dump_memo_.load(std::memory_order_acquire);
+  }
+
+  // Installs memo unless another thread did first. Returns whether memo was installed.
+  bool CasDumpMemo(DumpDexMemo* memo) const {
+    return dump_memo_.CompareExchangeStrongSequentiallyConsistent(nullptr, memo);
+  }
+
  private:
   // Opens a .dex file
   static std::unique_ptr<const DexFile> OpenFile(int fd, const char* location,
@@ -1046,6 +1057,9 @@ class DexFile {
   typedef HashMap<const char*, const ClassDef*, UTF16EmptyFn, UTF16HashCmp, UTF16HashCmp> Index;
   mutable Atomic<Index*> class_def_index_;
 
+  // Owned by the Dumper, which keeps it for its stats.
+  mutable Atomic<DumpDexMemo*> dump_memo_;
+
   // If this dex file was loaded from an oat file, oat_dex_file_ contains a
   // pointer to the OatDexFile it was loaded from. Otherwise oat_dex_file_ is
   // null.
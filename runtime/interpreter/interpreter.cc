@@ -234,30 +234,65 @@ static constexpr InterpreterImplKind kInterpreterImplKind = kComputedGotoImplKin
 #else
 // Clang 3.4 fails to build the goto interpreter implementation.
 static constexpr InterpreterImplKind kInterpreterImplKind = kSwitchImpl;
-template<bool do_access_check, bool transaction_active>
+template<bool do_access_check, bool transaction_active, bool collect>
 JValue ExecuteGotoImpl(Thread*, const DexFile::CodeItem*, ShadowFrame&, JValue) {
   LOG(FATAL) << "UNREACHABLE";
   UNREACHABLE();
 }
 // Explicit definitions of ExecuteGotoImpl.
 template<> SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteGotoImpl<true, false>(Thread* self, const DexFile::CodeItem* code_item,
-                                    ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<true, false, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                           ShadowFrame& shadow_frame, JValue result_register);
+template<> SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+JValue ExecuteGotoImpl<false, false, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                            ShadowFrame& shadow_frame, JValue result_register);
+template<> SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+JValue ExecuteGotoImpl<true, false, true>(Thread* self, const DexFile::CodeItem* code_item,
+                                          ShadowFrame& shadow_frame, JValue result_register);
 template<> SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteGotoImpl<false, false>(Thread* self, const DexFile::CodeItem* code_item,
-                                     ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<false, false, true>(Thread* self, const DexFile::CodeItem* code_item,
+                                           ShadowFrame& shadow_frame, JValue result_register);
 template<> SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteGotoImpl<true, true>(Thread* self,  const DexFile::CodeItem* code_item,
-                                   ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<true, true, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                          ShadowFrame& shadow_frame, JValue result_register);
 template<> SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteGotoImpl<false, true>(Thread* self, const DexFile::CodeItem* code_item,
-                                    ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<false, true, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                           ShadowFrame& shadow_frame, JValue result_register);
 #endif
 
 static JValue Execute(Thread* self, const DexFile::CodeItem* code_item, ShadowFrame& shadow_frame,
                       JValue result_register)
     SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+// Methods hooked for collection run the instantiation with the DexLego collection hooks
+// compiled in; every other method runs the stock interpreter loop. Transactions only run while
+// dex2oat initializes image classes, where nothing is collected, so there is no transactional
+// collecting loop.
+template<bool do_access_check, bool transaction_active>
+static inline JValue ExecuteImpl(Thread* self, const DexFile::CodeItem* code_item,
+                                 ShadowFrame& shadow_frame, JValue result_register)
+    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  bool collect = !transaction_active && shadow_frame.GetMethod()->ShouldManipulate();
+  if (kInterpreterImplKind == kSwitchImpl) {
+    if (UNLIKELY(collect)) {
+      return ExecuteSwitchImpl<do_access_check, false, true>(
+          self, code_item, shadow_frame, result_register);
+    } else {
+      return ExecuteSwitchImpl<do_access_check, transaction_active, false>(
+          self, code_item, shadow_frame, result_register);
+    }
+  } else {
+    DCHECK_EQ(kInterpreterImplKind, kComputedGotoImplKind);
+    if (UNLIKELY(collect)) {
+      return ExecuteGotoImpl<do_access_check, false, true>(
+          self, code_item, shadow_frame, result_register);
+    } else {
+      return ExecuteGotoImpl<do_access_check, transaction_active, false>(
+          self, code_item, shadow_frame, result_register);
+    }
+  }
+}
+
 static inline JValue Execute(Thread* self, const DexFile::CodeItem* code_item,
                              ShadowFrame& shadow_frame, JValue result_register) {
   DCHECK(!shadow_frame.GetMethod()->IsAbstract());
@@ -267,35 +302,17 @@ static inline JValue Execute(Thread* self, const DexFile::CodeItem* code_item,
   bool transaction_active = Runtime::Current()->IsActiveTransaction();
   if (LIKELY(shadow_frame.GetMethod()->IsPreverified())) {
     // Enter the "without access check" interpreter.
-    if (kInterpreterImplKind == kSwitchImpl) {
-      if (transaction_active) {
-        return ExecuteSwitchImpl<false, true>(self, code_item, shadow_frame, result_register);
-      } else {
-        return ExecuteSwitchImpl<false, false>(self, code_item, shadow_frame, result_register);
-      }
+    if (transaction_active) {
+      return ExecuteImpl<false, true>(self, code_item, shadow_frame, result_register);
     } else {
-      DCHECK_EQ(kInterpreterImplKind, kComputedGotoImplKind);
-      if (transaction_active) {
-        return ExecuteGotoImpl<false, true>(self, code_item, shadow_frame, result_register);
-      } else {
-        return ExecuteGotoImpl<false, false>(self, code_item, shadow_frame, result_register);
-      }
+      return ExecuteImpl<false, false>(self, code_item, shadow_frame, result_register);
     }
   } else {
     // Enter the "with access check" interpreter.
-    if (kInterpreterImplKind == kSwitchImpl) {
-      if (transaction_active) {
-        return ExecuteSwitchImpl<true, true>(self, code_item, shadow_frame, result_register);
-      } else {
-        return ExecuteSwitchImpl<true, false>(self, code_item, shadow_frame, result_register);
-      }
+    if (transaction_active) {
+      return ExecuteImpl<true, true>(self, code_item, shadow_frame, result_register);
     } else {
-      DCHECK_EQ(kInterpreterImplKind, kComputedGotoImplKind);
-      if (transaction_active) {
-        return ExecuteGotoImpl<true, true>(self, code_item, shadow_frame, result_register);
-      } else {
-        return ExecuteGotoImpl<true, false>(self, code_item, shadow_frame, result_register);
-      }
+      return ExecuteImpl<true, false>(self, code_item, shadow_frame, result_register);
     }
   }
 }
@@ -60,13 +60,14 @@ using ::art::mirror::Throwable;
 namespace art {
 namespace interpreter {
 
-// External references to both interpreter implementations.
+// External references to both interpreter implementations. The `collect` instantiations carry
+// the DexLego collection hooks; the others are the stock interpreter loop.
 
-template<bool do_access_check, bool transaction_active>
+template<bool do_access_check, bool transaction_active, bool collect>
 extern JValue ExecuteSwitchImpl(Thread* self, const DexFile::CodeItem* code_item,
                                 ShadowFrame& shadow_frame, JValue result_register);
 
-template<bool do_access_check, bool transaction_active>
+template<bool do_access_check, bool transaction_active, bool collect>
 extern JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item,
                               ShadowFrame& shadow_frame, JValue result_register);
 
@@ -130,7 +130,7 @@ namespace interpreter {
  * ---------------------+---------------+
  *
  */
-template<bool do_access_check, bool transaction_active>
+template<bool do_access_check, bool transaction_active, bool collect>
 JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowFrame& shadow_frame,
                        JValue result_register) {
   // Define handler tables:
@@ -1357,7 +1357,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(IGET_BOOLEAN) {
     bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimBoolean, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
 
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
@@ -1365,294 +1365,294 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(IGET_BYTE) {
     bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimByte, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_CHAR) {
     bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimChar, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_SHORT) {
     bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimShort, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET) {
     bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimInt, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_WIDE) {
     bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimLong, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_OBJECT) {
     bool success = DoFieldGet<InstanceObjectRead, Primitive::kPrimNot, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimInt>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimInt>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_BOOLEAN_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimBoolean>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimBoolean>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_BYTE_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimByte>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimByte>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_CHAR_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimChar>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimChar>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_SHORT_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimShort>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimShort>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_WIDE_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimLong>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimLong>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IGET_OBJECT_QUICK) {
-    bool success = DoIGetQuick<Primitive::kPrimNot>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+    bool success = DoIGetQuick<Primitive::kPrimNot>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET_BOOLEAN) {
     bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimBoolean, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET_BYTE) {
     bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimByte, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET_CHAR) {
     bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimChar, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET_SHORT) {
     bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimShort, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET) {
     bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimInt, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET_WIDE) {
     bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimLong, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SGET_OBJECT) {
     bool success = DoFieldGet<StaticObjectRead, Primitive::kPrimNot, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_BOOLEAN) {
     bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimBoolean, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_BYTE) {
     bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimByte, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_CHAR) {
     bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimChar, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_SHORT) {
     bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimShort, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT) {
     bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimInt, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_WIDE) {
     bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimLong, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_OBJECT) {
     bool success = DoFieldPut<InstanceObjectWrite, Primitive::kPrimNot, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimInt, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_BOOLEAN_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimBoolean, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_BYTE_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimByte, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_CHAR_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimChar, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_SHORT_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimShort, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_WIDE_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimLong, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(IPUT_OBJECT_QUICK) {
     bool success = DoIPutQuick<Primitive::kPrimNot, transaction_active>(
-        shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT_BOOLEAN) {
     bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimBoolean, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT_BYTE) {
     bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimByte, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT_CHAR) {
     bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimChar, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT_SHORT) {
     bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimShort, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT) {
     bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimInt, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT_WIDE) {
     bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimLong, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(SPUT_OBJECT) {
     bool success = DoFieldPut<StaticObjectWrite, Primitive::kPrimNot, do_access_check,
-        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 2);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(INVOKE_VIRTUAL) {
     bool success = DoInvoke<kVirtual, false, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(INVOKE_VIRTUAL_RANGE) {
     bool success = DoInvoke<kVirtual, true, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1660,7 +1660,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_SUPER) {
     bool success = DoInvoke<kSuper, false, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1668,7 +1668,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_SUPER_RANGE) {
     bool success = DoInvoke<kSuper, true, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1676,7 +1676,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_DIRECT) {
     bool success = DoInvoke<kDirect, false, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1684,7 +1684,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_DIRECT_RANGE) {
     bool success = DoInvoke<kDirect, true, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1692,7 +1692,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_INTERFACE) {
     bool success = DoInvoke<kInterface, false, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1700,7 +1700,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_INTERFACE_RANGE) {
     bool success = DoInvoke<kInterface, true, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1708,7 +1708,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_STATIC) {
     bool success = DoInvoke<kStatic, false, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -1716,23 +1716,25 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
   HANDLE_INSTRUCTION_START(INVOKE_STATIC_RANGE) {
     bool success = DoInvoke<kStatic, true, do_access_check>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(INVOKE_VIRTUAL_QUICK) {
+    HANDLE_INVOKE_QUICK_EDGE(false);
     bool success = DoInvokeVirtualQuick<false>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
   HANDLE_INSTRUCTION_END();
 
   HANDLE_INSTRUCTION_START(INVOKE_VIRTUAL_RANGE_QUICK) {
+    HANDLE_INVOKE_QUICK_EDGE(true);
     bool success = DoInvokeVirtualQuick<true>(
-        self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+        self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
     UPDATE_HANDLER_TABLE();
     POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, 3);
   }
@@ -2716,6 +2718,7 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
     instrumentation::Instrumentation* instrumentation = Runtime::Current()->GetInstrumentation();
     uint32_t found_dex_pc = FindNextInstructionFollowingException(self, shadow_frame, dex_pc,
                                                                   instrumentation);
+    HANDLE_EXCEPTION_EDGE(found_dex_pc);
     if (found_dex_pc == DexFile::kDexNoIndex) {
       HANDLE_EXCEPTION_RETURN();
       return JValue(); /* Handled in caller. */
@@ -2750,17 +2753,23 @@ JValue ExecuteGotoImpl(Thread* self, const DexFile::CodeItem* code_item, ShadowF
 
 // Explicit definitions of ExecuteGotoImpl.
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) HOT_ATTR
-JValue ExecuteGotoImpl<true, false>(Thread* self, const DexFile::CodeItem* code_item,
-                                    ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<true, false, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                           ShadowFrame& shadow_frame, JValue result_register);
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) HOT_ATTR
-JValue ExecuteGotoImpl<false, false>(Thread* self, const DexFile::CodeItem* code_item,
-                                     ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<false, false, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                            ShadowFrame& shadow_frame, JValue result_register);
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteGotoImpl<true, true>(Thread* self, const DexFile::CodeItem* code_item,
-                                   ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<true, false, true>(Thread* self, const DexFile::CodeItem* code_item,
+                                          ShadowFrame& shadow_frame, JValue result_register);
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteGotoImpl<false, true>(Thread* self, const DexFile::CodeItem* code_item,
-                                    ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteGotoImpl<false, false, true>(Thread* self, const DexFile::CodeItem* code_item,
+                                           ShadowFrame& shadow_frame, JValue result_register);
+template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+JValue ExecuteGotoImpl<true, true, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                          ShadowFrame& shadow_frame, JValue result_register);
+template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+JValue ExecuteGotoImpl<false, true, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                           ShadowFrame& shadow_frame, JValue result_register);
 
 }  // namespace interpreter
 }  // namespace art
@@ -28,6 +28,7 @@ namespace interpreter {
     uint32_t found_dex_pc = FindNextInstructionFollowingException(self, shadow_frame,           \
                                                                   inst->GetDexPc(insns),        \
                                                                   instrumentation);             \
+    HANDLE_EXCEPTION_EDGE(found_dex_pc);                                                        \
     if (found_dex_pc == DexFile::kDexNoIndex) {                                                 \
       if (IGNORE_EXCEPTION) {                                                                   \
         self->ClearException();                                                                 \
@@ -60,7 +61,7 @@ namespace interpreter {
     }                                                                                           \
   } while (false)
 
-template<bool do_access_check, bool transaction_active>
+template<bool do_access_check, bool transaction_active, bool collect>
 JValue ExecuteSwitchImpl(Thread* self, const DexFile::CodeItem* code_item,
                          ShadowFrame& shadow_frame, JValue result_register) {
   bool do_assignability_check = do_access_check;
@@ -1311,35 +1312,35 @@ JValue ExecuteSwitchImpl(Thread* self, const DexFile::CodeItem* code_item,
       case Instruction::IGET_BOOLEAN: {
         PREAMBLE();
         bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimBoolean, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_BYTE: {
         PREAMBLE();
         bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimByte, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_CHAR: {
         PREAMBLE();
         bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimChar, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_SHORT: {
         PREAMBLE();
         bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimShort, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET: {
         PREAMBLE();
         bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimInt, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
 
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
@@ -1347,336 +1348,338 @@ JValue ExecuteSwitchImpl(Thread* self, const DexFile::CodeItem* code_item,
       case Instruction::IGET_WIDE: {
         PREAMBLE();
         bool success = DoFieldGet<InstancePrimitiveRead, Primitive::kPrimLong, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_OBJECT: {
         PREAMBLE();
         bool success = DoFieldGet<InstanceObjectRead, Primitive::kPrimNot, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimInt>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimInt>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_WIDE_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimLong>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimLong>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_OBJECT_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimNot>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimNot>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_BOOLEAN_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimBoolean>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimBoolean>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_BYTE_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimByte>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimByte>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_CHAR_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimChar>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimChar>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IGET_SHORT_QUICK: {
         PREAMBLE();
-        bool success = DoIGetQuick<Primitive::kPrimShort>(shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+        bool success = DoIGetQuick<Primitive::kPrimShort>(shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET_BOOLEAN: {
         PREAMBLE();
         bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimBoolean, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET_BYTE: {
         PREAMBLE();
         bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimByte, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET_CHAR: {
         PREAMBLE();
         bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimChar, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET_SHORT: {
         PREAMBLE();
         bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimShort, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET: {
         PREAMBLE();
         bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimInt, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET_WIDE: {
         PREAMBLE();
         bool success = DoFieldGet<StaticPrimitiveRead, Primitive::kPrimLong, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SGET_OBJECT: {
         PREAMBLE();
         bool success = DoFieldGet<StaticObjectRead, Primitive::kPrimNot, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_BOOLEAN: {
         PREAMBLE();
         bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimBoolean, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_BYTE: {
         PREAMBLE();
         bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimByte, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_CHAR: {
         PREAMBLE();
         bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimChar, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_SHORT: {
         PREAMBLE();
         bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimShort, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT: {
         PREAMBLE();
         bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimInt, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_WIDE: {
         PREAMBLE();
         bool success = DoFieldPut<InstancePrimitiveWrite, Primitive::kPrimLong, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_OBJECT: {
         PREAMBLE();
         bool success = DoFieldPut<InstanceObjectWrite, Primitive::kPrimNot, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimInt, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_BOOLEAN_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimBoolean, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_BYTE_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimByte, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_CHAR_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimChar, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_SHORT_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimShort, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_WIDE_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimLong, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::IPUT_OBJECT_QUICK: {
         PREAMBLE();
         bool success = DoIPutQuick<Primitive::kPrimNot, transaction_active>(
-            shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT_BOOLEAN: {
         PREAMBLE();
         bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimBoolean, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT_BYTE: {
         PREAMBLE();
         bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimByte, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT_CHAR: {
         PREAMBLE();
         bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimChar, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT_SHORT: {
         PREAMBLE();
         bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimShort, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT: {
         PREAMBLE();
         bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimInt, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT_WIDE: {
         PREAMBLE();
         bool success = DoFieldPut<StaticPrimitiveWrite, Primitive::kPrimLong, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::SPUT_OBJECT: {
         PREAMBLE();
         bool success = DoFieldPut<StaticObjectWrite, Primitive::kPrimNot, do_access_check,
-            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr);
+            transaction_active>(self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_2xx);
         break;
       }
       case Instruction::INVOKE_VIRTUAL: {
         PREAMBLE();
         bool success = DoInvoke<kVirtual, false, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_VIRTUAL_RANGE: {
         PREAMBLE();
         bool success = DoInvoke<kVirtual, true, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_SUPER: {
         PREAMBLE();
         bool success = DoInvoke<kSuper, false, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_SUPER_RANGE: {
         PREAMBLE();
         bool success = DoInvoke<kSuper, true, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_DIRECT: {
         PREAMBLE();
         bool success = DoInvoke<kDirect, false, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_DIRECT_RANGE: {
         PREAMBLE();
         bool success = DoInvoke<kDirect, true, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_INTERFACE: {
         PREAMBLE();
         bool success = DoInvoke<kInterface, false, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_INTERFACE_RANGE: {
         PREAMBLE();
         bool success = DoInvoke<kInterface, true, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_STATIC: {
         PREAMBLE();
         bool success = DoInvoke<kStatic, false, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_STATIC_RANGE: {
         PREAMBLE();
         bool success = DoInvoke<kStatic, true, do_access_check>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_VIRTUAL_QUICK: {
         PREAMBLE();
+        HANDLE_INVOKE_QUICK_EDGE(false);
         bool success = DoInvokeVirtualQuick<false>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
       case Instruction::INVOKE_VIRTUAL_RANGE_QUICK: {
         PREAMBLE();
+        HANDLE_INVOKE_QUICK_EDGE(true);
         bool success = DoInvokeVirtualQuick<true>(
-            self, shadow_frame, inst, inst_data, map_and_list, map_and_list ? &code_item->insns_[dex_pc] : nullptr, &result_register);
+            self, shadow_frame, inst, inst_data, map_and_list, COLLECTING ? &code_item->insns_[dex_pc] : nullptr, &result_register);
         POSSIBLY_HANDLE_PENDING_EXCEPTION(!success, Next_3xx);
         break;
       }
@@ -2571,17 +2574,23 @@ JValue ExecuteSwitchImpl(Thread* self, const DexFile::CodeItem* code_item,
 
 // Explicit definitions of ExecuteSwitchImpl.
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) HOT_ATTR
-JValue ExecuteSwitchImpl<true, false>(Thread* self, const DexFile::CodeItem* code_item,
-                                      ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteSwitchImpl<true, false, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                             ShadowFrame& shadow_frame, JValue result_register);
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) HOT_ATTR
-JValue ExecuteSwitchImpl<false, false>(Thread* self, const DexFile::CodeItem* code_item,
-                                       ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteSwitchImpl<false, false, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                              ShadowFrame& shadow_frame, JValue result_register);
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteSwitchImpl<true, true>(Thread* self, const DexFile::CodeItem* code_item,
-                                     ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteSwitchImpl<true, false, true>(Thread* self, const DexFile::CodeItem* code_item,
+                                            ShadowFrame& shadow_frame, JValue result_register);
 template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-JValue ExecuteSwitchImpl<false, true>(Thread* self, const DexFile::CodeItem* code_item,
-                                      ShadowFrame& shadow_frame, JValue result_register);
+JValue ExecuteSwitchImpl<false, false, true>(Thread* self, const DexFile::CodeItem* code_item,
+                                             ShadowFrame& shadow_frame, JValue result_register);
+template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+JValue ExecuteSwitchImpl<true, true, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                            ShadowFrame& shadow_frame, JValue result_register);
+template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+JValue ExecuteSwitchImpl<false, true, false>(Thread* self, const DexFile::CodeItem* code_item,
+                                             ShadowFrame& shadow_frame, JValue result_register);
 
 }  // namespace interpreter
 }  // namespace art
@@ -46,6 +46,9 @@ static constexpr uint32_t kAccClassIsProxy =         0x00040000;  // class  (dex
 static constexpr uint32_t kAccPreverified =          0x00080000;  // class (runtime),
                                                                   // method (dex only)
 static constexpr uint32_t kAccFastNative =           0x00080000;  // method (dex only)
+// DexLego: set by ClassLinker::LinkCode on methods whose invocations are collected, so the
+// interpreter can decide on entry with a single load instead of inspecting the entry point.
+static constexpr uint32_t kAccCollect =              0x00100000;  // method (runtime)
 static constexpr uint32_t kAccMiranda =              0x00200000;  // method (dex only)
 
 // Flag is set if the compiler decides it is not worth trying
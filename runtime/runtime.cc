@@ -127,6 +127,8 @@
 #include "thread_list.h"
 #include "trace.h"
 #include "transaction.h"
+#include "unpack_config.h"
+#include "unpack_dump.h"
 #include "verifier/method_verifier.h"
 #include "well_known_classes.h"
 
@@ -632,6 +634,11 @@ bool Runtime::InitZygote() {
 
 void Runtime::DidForkFromZygote(JNIEnv* env, NativeBridgeAction action, const char* isa) {
   is_zygote_ = false;
+  // The zygote's collection configuration says it is no target; the child looks itself up.
+  // A process started without the zygote is named already and builds its Dumper here; a child
+  // of the zygote does on its first class load after the framework names it.
+  CollectionConfig::ResetAfterFork();
+  Dumper::InitializeIfTarget();
 
   if (is_native_bridge_loaded_) {
     switch (action) {
@@ -809,6 +816,9 @@ bool Runtime::Init(const RuntimeOptions& raw_options, bool ignore_unrecognized)
   patchoat_executable_ = runtime_options.ReleaseOrDefault(Opt::PatchOat);
   must_relocate_ = runtime_options.GetOrDefault(Opt::Relocate);
   is_zygote_ = runtime_options.Exists(Opt::Zygote);
+  if (is_zygote_) {
+    CollectionConfig::InitializeForZygote();
+  }
   is_explicit_gc_disabled_ = runtime_options.Exists(Opt::DisableExplicitGC);
   dex2oat_enabled_ = runtime_options.GetOrDefault(Opt::Dex2Oat);
   image_dex2oat_enabled_ = runtime_options.GetOrDefault(Opt::ImageDex2Oat);
@@ -1223,6 +1233,7 @@ void Runtime::DumpForSigQuit(std::ostream& os) {
   GetJavaVM()->DumpForSigQuit(os);
   GetHeap()->DumpForSigQuit(os);
   TrackedAllocators::Dump(os);
+  Dumper::DumpForSigQuit(os);
   os << "\n";
 
   thread_list_->DumpForSigQuit(os);
@@ -1306,6 +1317,8 @@ void Runtime::BlockSignals() {
   signals.Add(SIGQUIT);
   // SIGUSR1 is used to initiate a GC.
   signals.Add(SIGUSR1);
+  // Makes a target process reread force_branches.
+  signals.Add(kForceBranchReloadSignal);
   signals.Block();
 }
 
@@ -38,6 +38,7 @@
 #include "signal_set.h"
 #include "thread.h"
 #include "thread_list.h"
+#include "unpack_dump.h"
 #include "utils.h"
 
 namespace art {
@@ -158,6 +159,15 @@ void SignalCatcher::HandleSigUsr1() {
   Runtime::Current()->GetHeap()->CollectGarbage(false);
 }
 
+void SignalCatcher::HandleForceBranchReload(Thread* self) {
+  Dumper* dumper = Dumper::Instance();
+  if (dumper == nullptr) {
+    LOG(INFO) << "No force branches to reload outside a target process";
+    return;
+  }
+  dumper->ReloadForceBranch(self);
+}
+
 int SignalCatcher::WaitForSignal(Thread* self, SignalSet& signals) {
   ScopedThreadStateChange tsc(self, kWaitingInMainSignalCatcherLoop);
 
@@ -198,6 +208,7 @@ void* SignalCatcher::Run(void* arg) {
   SignalSet signals;
   signals.Add(SIGQUIT);
   signals.Add(SIGUSR1);
+  signals.Add(kForceBranchReloadSignal);
 
   while (true) {
     int signal_number = signal_catcher->WaitForSignal(self, signals);
@@ -213,6 +224,9 @@ void* SignalCatcher::Run(void* arg) {
     case SIGUSR1:
       signal_catcher->HandleSigUsr1();
       break;
+    case kForceBranchReloadSignal:
+      signal_catcher->HandleForceBranchReload(self);
+      break;
     default:
       LOG(ERROR) << "Unexpected signal %d" << signal_number;
       break;
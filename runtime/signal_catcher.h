@@ -44,6 +44,7 @@ class SignalCatcher {
   static void* Run(void* arg);
 
   void HandleSigUsr1();
+  void HandleForceBranchReload(Thread* self);
   void Output(const std::string& s);
   void SetHaltFlag(bool new_value);
   bool ShouldHalt();
@@ -76,6 +76,7 @@ class Context;
 struct DebugInvokeReq;
 class DeoptimizationReturnValueRecord;
 class DexFile;
+class Dumper;
 class JavaVMExt;
 struct JNIEnvExt;
 class Monitor;
@@ -946,6 +947,16 @@ class Thread {
 
   void InitStringEntryPoints();
 
+  // The collector of a target process, or null. Cached here so that the interpreter reaches it
+  // from self with a single load.
+  Dumper* GetDumper() const {
+    return tlsPtr_.dumper;
+  }
+
+  void SetDumper(Dumper* dumper) {
+    tlsPtr_.dumper = dumper;
+  }
+
  private:
   explicit Thread(bool daemon);
   ~Thread() LOCKS_EXCLUDED(Locks::mutator_lock_,
@@ -1144,7 +1155,8 @@ class Thread {
       last_no_thread_suspension_cause(nullptr), thread_local_start(nullptr),
       thread_local_pos(nullptr), thread_local_end(nullptr), thread_local_objects(0),
       thread_local_alloc_stack_top(nullptr), thread_local_alloc_stack_end(nullptr),
-      nested_signal_state(nullptr), flip_function(nullptr), method_verifier(nullptr) {
+      nested_signal_state(nullptr), flip_function(nullptr), method_verifier(nullptr),
+      dumper(nullptr) {
       std::fill(held_mutexes, held_mutexes + kLockLevelCount, nullptr);
     }
 
@@ -1268,6 +1280,10 @@ class Thread {
 
     // Current method verifier, used for root marking.
     verifier::MethodVerifier* method_verifier;
+
+    // The Dumper::Instance() of a target process. Set under the thread list lock, for every
+    // registered thread when the Dumper is built and for threads registered after.
+    Dumper* dumper;
   } tlsPtr_;
 
   // Guards the 'interrupted_' and 'wait_monitor_' members.
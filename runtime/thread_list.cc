@@ -39,6 +39,7 @@
 #include "scoped_thread_state_change.h"
 #include "thread.h"
 #include "trace.h"
+#include "unpack_dump.h"
 #include "well_known_classes.h"
 
 namespace art {
@@ -1102,6 +1103,7 @@ void ThreadList::Register(Thread* self) {
   }
   CHECK(!Contains(self));
   list_.push_back(self);
+  self->SetDumper(Dumper::Instance());
 }
 
 void ThreadList::Unregister(Thread* self) {
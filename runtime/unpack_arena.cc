@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_arena.h"
+
+#include "unpack_dump.h"
+
+namespace art {
+
+ScopedArenaAllocator* CollectionArenaScope::Open() {
+  DCHECK(allocator_ == nullptr);
+  arena_ = Dumper::Instance()->GetCollectionArena();
+  allocator_ = ScopedArenaAllocator::Create(&arena_->stack_);
+  arena_->invocations_.StoreRelaxed(arena_->invocations_.LoadRelaxed() + 1);
+  return allocator_;
+}
+
+void CollectionArenaScope::Close() {
+  if (allocator_ == nullptr) {
+    return;
+  }
+  size_t bytes = arena_->stack_.BytesInUse();
+  if (bytes > arena_->peak_bytes_.LoadRelaxed()) {
+    arena_->peak_bytes_.StoreRelaxed(bytes);
+  }
+  // Create()d allocators are destroyed but not deallocated; the destructor rewinds the stack.
+  delete allocator_;
+  allocator_ = nullptr;
+
+  DumpMemoryBudget* budget = Dumper::Instance()->Budget();
+  if (bytes > arena_->charged_bytes_) {
+    budget->Charge(kDumpBudgetTrace, bytes - arena_->charged_bytes_);
+    arena_->charged_bytes_ = bytes;
+  }
+  // Only the outermost scope may reset the stack.
+  if (arena_->stack_.BytesInUse() == 0 && budget->ShouldTrimArena()) {
+    arena_->stack_.Reset();
+    budget->Release(kDumpBudgetTrace, arena_->charged_bytes_);
+    arena_->charged_bytes_ = 0;
+  }
+}
+
+}  // namespace art
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_ARENA_H_
+#define ART_RUNTIME_UNPACK_ARENA_H_
+
+#include <sys/types.h>
+
+#include "atomic.h"
+#include "base/scoped_arena_allocator.h"
+
+namespace art {
+
+// Per-thread arena the MapAndList trees of collected invocations are carved from. The arenas
+// stay with the thread between invocations, so a hot collected method reuses the same memory
+// instead of going through malloc for every container.
+struct CollectionArena {
+  pid_t tid_;
+  ArenaStack stack_;
+  // Highest BytesInUse() seen when closing a scope. Written by the owning thread only.
+  Atomic<size_t> peak_bytes_;
+  Atomic<uint64_t> invocations_;
+  // Bytes charged to the memory budget for the arenas the stack keeps. Owning thread only.
+  size_t charged_bytes_;
+
+  CollectionArena(pid_t tid, ArenaPool* pool) : tid_(tid), stack_(pool), charged_bytes_(0) {}
+};
+
+// Opens a ScopedArenaAllocator on the calling thread's CollectionArena for one collected
+// invocation. Nested collected invocations open nested scopes; since a scope lives in the
+// interpreter frame, scopes always close in stack order, including when the frame is left by an
+// exception.
+class CollectionArenaScope {
+  public:
+    CollectionArenaScope() : arena_(nullptr), allocator_(nullptr) {}
+
+    ~CollectionArenaScope() {
+      if (allocator_ != nullptr) {
+        Close();
+      }
+    }
+
+    ScopedArenaAllocator* Open();
+
+    // Rewinds the arena to where it was before Open(). Everything allocated since is gone. When
+    // the memory budget is under pressure, closing the outermost scope also gives the arenas
+    // back to the pool.
+    void Close();
+
+  private:
+    CollectionArena* arena_;
+    ScopedArenaAllocator* allocator_;
+
+    DISALLOW_COPY_AND_ASSIGN(CollectionArenaScope);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_ARENA_H_
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_budget.h"
+
+#include "base/time_utils.h"
+
+namespace art {
+
+static const char* const kDumpBudgetUserNames[kDumpBudgetUsers] = {
+  "queue", "intern", "trace"
+};
+
+DumpMemoryBudget::DumpMemoryBudget(size_t limit) {
+  SetLimit(limit);
+  total_.StoreRelaxed(0);
+  for (int user = 0; user < kDumpBudgetUsers; ++user) {
+    used_[user].StoreRelaxed(0);
+  }
+  sample_ticket_.StoreRelaxed(0);
+  sampled_out_.StoreRelaxed(0);
+  blocked_.StoreRelaxed(0);
+  blocked_ms_.StoreRelaxed(0);
+  trimmed_.StoreRelaxed(0);
+}
+
+void DumpMemoryBudget::WaitForQueue() {
+  uint64_t waited_ms = 0;
+  while (ShouldWaitForQueue() && waited_ms < kDumpBudgetMaxBlockMs) {
+    if (waited_ms == 0) {
+      blocked_.FetchAndAddSequentiallyConsistent(1);
+    }
+    NanoSleep(MsToNs(1));
+    ++waited_ms;
+  }
+  blocked_ms_.FetchAndAddSequentiallyConsistent(waited_ms);
+}
+
+DumpBudgetStats DumpMemoryBudget::GetStats() const {
+  DumpBudgetStats stats;
+  stats.limit_ = limit_;
+  for (int user = 0; user < kDumpBudgetUsers; ++user) {
+    stats.used_[user] = used_[user].LoadRelaxed();
+  }
+  stats.sampled_out_ = sampled_out_.LoadRelaxed();
+  stats.blocked_ = blocked_.LoadRelaxed();
+  stats.blocked_ms_ = blocked_ms_.LoadRelaxed();
+  stats.trimmed_ = trimmed_.LoadRelaxed();
+  return stats;
+}
+
+void DumpMemoryBudget::Dump(std::ostream& os) const {
+  DumpBudgetStats stats = GetStats();
+  os << "budget stats limit=" << stats.limit_ << " used=" << Used();
+  for (int user = 0; user < kDumpBudgetUsers; ++user) {
+    os << " " << kDumpBudgetUserNames[user] << "=" << stats.used_[user];
+  }
+  os << " sampled_out=" << stats.sampled_out_ << " blocked=" << stats.blocked_
+      << " blocked_ms=" << stats.blocked_ms_ << " trimmed=" << stats.trimmed_ << "\n";
+}
+
+}  // namespace art
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_BUDGET_H_
+#define ART_RUNTIME_UNPACK_BUDGET_H_
+
+#include <stdint.h>
+#include <ostream>
+
+#include "atomic.h"
+#include "base/logging.h"
+#include "base/macros.h"
+
+namespace art {
+
+static constexpr size_t kDumpBudgetDefaultLimit = 64 * 1024 * 1024;
+// Above this share of the limit, in percent, only one invocation in kDumpBudgetSampleRate is
+// traced.
+static constexpr size_t kDumpBudgetSamplePercent = 75;
+static constexpr uint32_t kDumpBudgetSampleRate = 16;
+// Longest a producer waits at the limit for the recording thread to drain the queue.
+static constexpr uint64_t kDumpBudgetMaxBlockMs = 50;
+// Intern table bytes charged per entry on top of its key: a slot, at a load factor between a
+// quarter and a half.
+static constexpr size_t kDumpBudgetInternEntryBytes = 64;
+
+// The parts of the collector that hold memory on behalf of collected items.
+enum DumpBudgetUser {
+  kDumpBudgetQueue = 0,  // Items waiting for the recording thread.
+  kDumpBudgetIntern,     // Intern table keys and slots. Never released, so not limited.
+  kDumpBudgetTrace,      // Arenas kept by threads for their MapAndList trees.
+  kDumpBudgetUsers
+};
+
+struct DumpBudgetStats {
+  uint64_t limit_;
+  uint64_t used_[kDumpBudgetUsers];
+  uint64_t sampled_out_;  // Invocations not traced because of sampling.
+  uint64_t blocked_;      // Producers that waited for the queue to drain.
+  uint64_t blocked_ms_;
+  uint64_t trimmed_;      // Trace arenas given back to the pool when closed.
+
+  DumpBudgetStats() : limit_(0), sampled_out_(0), blocked_(0), blocked_ms_(0), trimmed_(0) {
+    for (int user = 0; user < kDumpBudgetUsers; ++user) {
+      used_[user] = 0;
+    }
+  }
+};
+
+// A byte budget for the memory the collector holds: queued items, intern tables and trace
+// arenas. The accounting is approximate; it exists to notice a collector outgrowing the app.
+// Only the memory collection gives back, queued items and trace arenas, counts toward the limit.
+// Intern tables never shrink, so degrading collection would not bring them down; their usage is
+// reported only. Nothing is refused outright. As usage approaches the limit, collection degrades
+// in steps:
+//  - past kDumpBudgetSamplePercent, only one invocation in kDumpBudgetSampleRate is traced, and
+//    threads give their trace arenas back to the pool after each trace instead of keeping them;
+//  - at the limit, a thread about to trace first waits, up to kDumpBudgetMaxBlockMs, for the
+//    recording thread to drain the queue. There is no wait once the queue is empty.
+class DumpMemoryBudget {
+  public:
+    explicit DumpMemoryBudget(size_t limit = kDumpBudgetDefaultLimit);
+
+    // Must be called before the first Charge().
+    void SetLimit(size_t limit) {
+      limit_ = limit;
+      sample_limit_ = limit / 100 * kDumpBudgetSamplePercent;
+    }
+
+    size_t Limit() const {
+      return limit_;
+    }
+
+    void Charge(DumpBudgetUser user, size_t bytes) {
+      used_[user].FetchAndAddSequentiallyConsistent(bytes);
+      if (user != kDumpBudgetIntern) {
+        total_.FetchAndAddSequentiallyConsistent(bytes);
+      }
+    }
+
+    void Release(DumpBudgetUser user, size_t bytes) {
+      DCHECK_NE(user, kDumpBudgetIntern);
+      used_[user].FetchAndSubSequentiallyConsistent(bytes);
+      total_.FetchAndSubSequentiallyConsistent(bytes);
+    }
+
+    // The usage that counts toward the limit: every user but kDumpBudgetIntern.
+    size_t Used() const {
+      return total_.LoadRelaxed();
+    }
+
+    size_t Used(DumpBudgetUser user) const {
+      return used_[user].LoadRelaxed();
+    }
+
+    bool UnderPressure() const {
+      return Used() >= sample_limit_;
+    }
+
+    // Whether an invocation may be traced. Always true below the sampling threshold.
+    bool AdmitTrace() {
+      if (LIKELY(!UnderPressure())) {
+        return true;
+      }
+      if (sample_ticket_.FetchAndAddSequentiallyConsistent(1) % kDumpBudgetSampleRate == 0) {
+        return true;
+      }
+      sampled_out_.FetchAndAddSequentiallyConsistent(1);
+      return false;
+    }
+
+    // Whether a trace arena should be given back to the pool now. Counts it if so.
+    bool ShouldTrimArena() {
+      if (LIKELY(!UnderPressure())) {
+        return false;
+      }
+      trimmed_.FetchAndAddSequentiallyConsistent(1);
+      return true;
+    }
+
+    // Whether usage is at the limit with queued items that waiting would free.
+    bool ShouldWaitForQueue() const {
+      return UNLIKELY(Used() >= limit_) && used_[kDumpBudgetQueue].LoadRelaxed() != 0;
+    }
+
+    // Waits, at most kDumpBudgetMaxBlockMs, while ShouldWaitForQueue(). A mutator thread must
+    // call this in a suspended state, so that it does not hold off a suspension.
+    void WaitForQueue();
+
+    DumpBudgetStats GetStats() const;
+
+    // Writes the usage and how often each degradation engaged.
+    void Dump(std::ostream& os) const;
+
+  private:
+    size_t limit_;
+    size_t sample_limit_;
+    Atomic<size_t> total_;
+    Atomic<size_t> used_[kDumpBudgetUsers];
+    Atomic<uint32_t> sample_ticket_;
+    Atomic<uint64_t> sampled_out_;
+    Atomic<uint64_t> blocked_;
+    Atomic<uint64_t> blocked_ms_;
+    Atomic<uint64_t> trimmed_;
+
+    DISALLOW_COPY_AND_ASSIGN(DumpMemoryBudget);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_BUDGET_H_
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_budget.h"
+
+#include <pthread.h>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+#include "base/time_utils.h"
+
+namespace art {
+
+TEST(DumpMemoryBudgetTest, Sampling) {
+  DumpMemoryBudget budget(1000);
+  // Intern tables never shrink, so they never degrade collection, however large.
+  budget.Charge(kDumpBudgetIntern, 5000);
+  budget.Charge(kDumpBudgetQueue, 700);
+  EXPECT_EQ(700u, budget.Used());
+  EXPECT_FALSE(budget.UnderPressure());
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(budget.AdmitTrace());
+  }
+  EXPECT_FALSE(budget.ShouldTrimArena());
+
+  budget.Charge(kDumpBudgetTrace, 50);
+  EXPECT_TRUE(budget.UnderPressure());
+  uint32_t admitted = 0;
+  for (uint32_t i = 0; i < 10 * kDumpBudgetSampleRate; ++i) {
+    admitted += budget.AdmitTrace() ? 1 : 0;
+  }
+  EXPECT_EQ(10u, admitted);
+  EXPECT_TRUE(budget.ShouldTrimArena());
+
+  budget.Release(kDumpBudgetTrace, 50);
+  EXPECT_FALSE(budget.UnderPressure());
+  EXPECT_TRUE(budget.AdmitTrace());
+
+  DumpBudgetStats stats = budget.GetStats();
+  EXPECT_EQ(1000u, stats.limit_);
+  EXPECT_EQ(5000u, stats.used_[kDumpBudgetIntern]);
+  EXPECT_EQ(0u, stats.used_[kDumpBudgetTrace]);
+  EXPECT_EQ(10 * kDumpBudgetSampleRate - 10, stats.sampled_out_);
+  EXPECT_EQ(1u, stats.trimmed_);
+
+  std::ostringstream os;
+  budget.Dump(os);
+  EXPECT_NE(std::string::npos,
+            os.str().find("budget stats limit=1000 used=700 queue=700 intern=5000 trace=0"));
+}
+
+TEST(DumpMemoryBudgetTest, NoWaitWithoutQueue) {
+  DumpMemoryBudget budget(1000);
+  // Over the limit, but nothing queued would free memory by waiting.
+  budget.Charge(kDumpBudgetTrace, 2000);
+  budget.Charge(kDumpBudgetIntern, 2000);
+  EXPECT_FALSE(budget.ShouldWaitForQueue());
+  uint64_t start = NanoTime();
+  budget.WaitForQueue();
+  EXPECT_LT(NanoTime() - start, MsToNs(kDumpBudgetMaxBlockMs));
+  EXPECT_EQ(0u, budget.GetStats().blocked_);
+}
+
+static void* DrainQueue(void* arg) {
+  DumpMemoryBudget* budget = reinterpret_cast<DumpMemoryBudget*>(arg);
+  NanoSleep(MsToNs(5));
+  budget->Release(kDumpBudgetQueue, 600);
+  return nullptr;
+}
+
+TEST(DumpMemoryBudgetTest, WaitsForQueue) {
+  DumpMemoryBudget budget(1000);
+  budget.Charge(kDumpBudgetTrace, 500);
+  budget.Charge(kDumpBudgetQueue, 600);
+  EXPECT_TRUE(budget.ShouldWaitForQueue());
+  pthread_t consumer;
+  ASSERT_EQ(0, pthread_create(&consumer, nullptr, DrainQueue, &budget));
+  budget.WaitForQueue();
+  EXPECT_LT(budget.Used(), budget.Limit());
+  ASSERT_EQ(0, pthread_join(consumer, nullptr));
+  DumpBudgetStats stats = budget.GetStats();
+  EXPECT_EQ(1u, stats.blocked_);
+  EXPECT_NE(0u, stats.blocked_ms_);
+
+  // A queue that never drains holds a producer for kDumpBudgetMaxBlockMs at most.
+  budget.Charge(kDumpBudgetQueue, 600);
+  budget.WaitForQueue();
+  stats = budget.GetStats();
+  EXPECT_EQ(2u, stats.blocked_);
+  EXPECT_GE(stats.blocked_ms_, kDumpBudgetMaxBlockMs);
+}
+
+}  // namespace art
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_class_filter.h"
+
+#include <string.h>
+#include <deque>
+
+namespace art {
+
+static constexpr uint32_t kNoState = 0xffffffff;
+
+ClassFilterMatcher::ClassFilterMatcher() : patterns_(0), columns_(1), next_(1, 0), accept_(1, 0) {
+  memset(columns_of_bytes_, 0, sizeof(columns_of_bytes_));
+}
+
+void ClassFilterMatcher::Build(const std::vector<std::string>& patterns) {
+  patterns_ = patterns.size();
+  // Column 0 stands for every byte that occurs in no pattern.
+  memset(columns_of_bytes_, 0, sizeof(columns_of_bytes_));
+  columns_ = 1;
+  for (const std::string& pattern : patterns) {
+    for (char c : pattern) {
+      uint8_t byte = static_cast<uint8_t>(c);
+      if (columns_of_bytes_[byte] == 0) {
+        columns_of_bytes_[byte] = columns_++;
+      }
+    }
+  }
+
+  // The trie of the patterns.
+  next_.assign(columns_, kNoState);
+  accept_.assign(1, 0);
+  for (const std::string& pattern : patterns) {
+    uint32_t state = 0;
+    for (char c : pattern) {
+      uint32_t column = columns_of_bytes_[static_cast<uint8_t>(c)];
+      if (next_[state * columns_ + column] == kNoState) {
+        next_[state * columns_ + column] = accept_.size();
+        accept_.push_back(0);
+        next_.resize(next_.size() + columns_, kNoState);
+      }
+      state = next_[state * columns_ + column];
+    }
+    accept_[state] = 1;
+  }
+
+  // Breadth first, every missing transition of a state becomes that of its failure state, which
+  // is shallower and thus complete already. A state accepts if its failure state does.
+  std::vector<uint32_t> fail(accept_.size(), 0);
+  std::deque<uint32_t> queue;
+  for (uint32_t column = 0; column < columns_; ++column) {
+    uint32_t& child = next_[column];
+    if (child == kNoState) {
+      child = 0;
+    } else {
+      queue.push_back(child);
+    }
+  }
+  while (!queue.empty()) {
+    uint32_t state = queue.front();
+    queue.pop_front();
+    accept_[state] |= accept_[fail[state]];
+    for (uint32_t column = 0; column < columns_; ++column) {
+      uint32_t& child = next_[state * columns_ + column];
+      uint32_t fallback = next_[fail[state] * columns_ + column];
+      if (child == kNoState) {
+        child = fallback;
+      } else {
+        fail[child] = fallback;
+        queue.push_back(child);
+      }
+    }
+  }
+}
+
+}  // namespace art
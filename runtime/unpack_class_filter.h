@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_CLASS_FILTER_H_
+#define ART_RUNTIME_UNPACK_CLASS_FILTER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace art {
+
+// Tells whether a class descriptor contains any line of class_filter or included_class, as a
+// strstr() against each line would, in a single pass over the descriptor.
+//
+// The lines are compiled into an Aho-Corasick automaton whose failure links are folded into a
+// complete transition table, so every byte of the descriptor costs one table lookup whatever the
+// number of lines. Bytes that occur in no line share one column of the table. Immutable once
+// built, so any number of class loading threads may match concurrently.
+class ClassFilterMatcher {
+  public:
+    ClassFilterMatcher();
+
+    // Replaces the patterns. An empty pattern matches every descriptor, as it does for strstr.
+    void Build(const std::vector<std::string>& patterns);
+
+    bool Empty() const {
+      return patterns_ == 0;
+    }
+
+    size_t Patterns() const {
+      return patterns_;
+    }
+
+    size_t States() const {
+      return accept_.size();
+    }
+
+    bool Matches(const char* descriptor) const {
+      if (accept_[0]) {
+        return true;
+      }
+      uint32_t state = 0;
+      for (const uint8_t* p = reinterpret_cast<const uint8_t*>(descriptor); *p != 0; ++p) {
+        state = next_[state * columns_ + columns_of_bytes_[*p]];
+        if (accept_[state]) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    size_t patterns_;
+    uint32_t columns_;
+    uint16_t columns_of_bytes_[256];
+    // next_[state * columns_ + column] is the state after reading a byte of that column.
+    std::vector<uint32_t> next_;
+    // Whether a pattern ends at the state, or at a state its failure link chain reaches.
+    std::vector<uint8_t> accept_;
+
+    DISALLOW_COPY_AND_ASSIGN(ClassFilterMatcher);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_CLASS_FILTER_H_
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_class_filter.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace art {
+
+// shouldFilterClass before the automaton, kept as the reference the matcher must agree with.
+static bool StrstrMatches(const std::vector<std::string>& patterns, const char* descriptor) {
+  for (const std::string& pattern : patterns) {
+    if (strstr(descriptor, pattern.c_str())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TEST(ClassFilterMatcherTest, Substrings) {
+  ClassFilterMatcher matcher;
+  EXPECT_TRUE(matcher.Empty());
+  EXPECT_FALSE(matcher.Matches("Lcom/example/Main;"));
+
+  std::vector<std::string> patterns = { "Lcom/baidu/", "tencent", "he", "she", "hers", "$a;" };
+  matcher.Build(patterns);
+  EXPECT_EQ(patterns.size(), matcher.Patterns());
+  EXPECT_TRUE(matcher.Matches("Lcom/baidu/mobads/Ad;"));
+  EXPECT_FALSE(matcher.Matches("Lcom/baidu;"));
+  EXPECT_TRUE(matcher.Matches("Lcom/qq/tencent/X;"));
+  // Found through failure links: "she" ends inside "ushers", "he" inside "she".
+  EXPECT_TRUE(matcher.Matches("Lushers;"));
+  EXPECT_TRUE(matcher.Matches("Lx/Outer$a;"));
+  EXPECT_FALSE(matcher.Matches("Lx/Outer$b;"));
+  EXPECT_FALSE(matcher.Matches(""));
+
+  // An empty line matches everything, as strstr does.
+  matcher.Build({ "Lcom/", "" });
+  EXPECT_TRUE(matcher.Matches("Lorg/Main;"));
+  EXPECT_TRUE(matcher.Matches(""));
+
+  matcher.Build({});
+  EXPECT_TRUE(matcher.Empty());
+  EXPECT_FALSE(matcher.Matches("Lcom/baidu/mobads/Ad;"));
+}
+
+TEST(ClassFilterMatcherTest, AgreesWithStrstr) {
+  static const char kAlphabet[] = "Lab/;$";
+  uint32_t seed = 12345;
+  auto next = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+  };
+  for (uint32_t round = 0; round < 50; ++round) {
+    std::vector<std::string> patterns;
+    for (uint32_t i = next() % 8 + 1; i > 0; --i) {
+      std::string pattern;
+      for (uint32_t j = next() % 5 + 1; j > 0; --j) {
+        pattern += kAlphabet[next() % (sizeof(kAlphabet) - 1)];
+      }
+      patterns.push_back(pattern);
+    }
+    ClassFilterMatcher matcher;
+    matcher.Build(patterns);
+    for (uint32_t i = 0; i < 200; ++i) {
+      std::string descriptor;
+      for (uint32_t j = next() % 16; j > 0; --j) {
+        descriptor += kAlphabet[next() % (sizeof(kAlphabet) - 1)];
+      }
+      ASSERT_EQ(StrstrMatches(patterns, descriptor.c_str()), matcher.Matches(descriptor.c_str()))
+          << descriptor;
+    }
+  }
+}
+
+// A filter list of SDK packages against the classes of a packed app, some of them in the SDKs.
+TEST(ClassFilterMatcherTest, AgreesWithStrstrOnPackages) {
+  static constexpr uint32_t kPatterns = 40;
+  static constexpr uint32_t kClasses = 300;
+  std::vector<std::string> patterns;
+  for (uint32_t i = 0; i < kPatterns; ++i) {
+    patterns.push_back("Lcom/sdk" + std::to_string(i) + "/");
+  }
+  ClassFilterMatcher matcher;
+  matcher.Build(patterns);
+  size_t hits = 0;
+  for (uint32_t i = 0; i < kClasses; ++i) {
+    const char* package = i % 3 == 0 ? "com/sdk" : "com/example/app/module";
+    std::string descriptor = "L" + std::string(package) + std::to_string(i % 97) + "/sub/Class" +
+        std::to_string(i) + "$Inner;";
+    bool matches = matcher.Matches(descriptor.c_str());
+    ASSERT_EQ(StrstrMatches(patterns, descriptor.c_str()), matches) << descriptor;
+    hits += matches ? 1 : 0;
+  }
+  EXPECT_NE(0u, hits);
+  EXPECT_NE(kClasses, hits);
+}
+
+}  // namespace art
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "art_method.h"
+
+#include <string.h>
+
+#include <gtest/gtest.h>
+#include "gc_root-inl.h"
+
+namespace art {
+
+static void FakeInterpreterEntry(Thread*, const DexFile::CodeItem*, ShadowFrame*, JValue*) {}
+static void OtherInterpreterEntry(Thread*, const DexFile::CodeItem*, ShadowFrame*, JValue*) {}
+
+// The entry check ShouldManipulate() used before kAccCollect, which the flag must agree with:
+// reinterpret the interpreter entry point and look for the hook magic.
+static bool MagicShouldManipulate(const ArtMethod* method) {
+  const auto addr = reinterpret_cast<uintptr_t>(method) +
+      ArtMethod::EntryPointFromInterpreterOffset(sizeof(void*)).Uint32Value();
+  const EntryHookInfo* hook = *reinterpret_cast<EntryHookInfo* const*>(addr);
+  return hook != nullptr && strncmp(hook->magic, "droidreveal", strlen("droidreveal")) == 0;
+}
+
+TEST(CollectFlagTest, FlagFollowsHook) {
+  ArtMethod method;
+  method.SetAccessFlags(kAccPublic | kAccFinal);
+  method.SetEntryPointFromInterpreter(FakeInterpreterEntry);
+  EXPECT_FALSE(method.ShouldManipulate());
+  EXPECT_EQ(nullptr, method.GetHookInfo());
+
+  method.SetShouldManipulate();
+  EXPECT_TRUE(method.ShouldManipulate());
+  EntryHookInfo* hook = method.GetHookInfo();
+  ASSERT_NE(nullptr, hook);
+  EXPECT_TRUE(MagicShouldManipulate(&method));
+  EXPECT_EQ(nullptr, hook->collection_state);
+  // Callers still see the original entry point, and updates go to the hook.
+  EXPECT_EQ(FakeInterpreterEntry, method.GetEntryPointFromInterpreter());
+  method.SetEntryPointFromInterpreter(OtherInterpreterEntry);
+  EXPECT_EQ(OtherInterpreterEntry, method.GetEntryPointFromInterpreter());
+  EXPECT_EQ(hook, method.GetHookInfo());
+
+  // Installing twice keeps the first hook.
+  method.SetShouldManipulate();
+  EXPECT_EQ(hook, method.GetHookInfo());
+  // The flag stays out of the bits written to dumped dex files.
+  EXPECT_EQ(0u, kAccCollect & 0x3ffff);
+  free(hook);
+}
+
+}  // namespace art
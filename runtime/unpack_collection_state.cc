@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_collection_state.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "base/logging.h"
+
+namespace art {
+
+void CollectionSampling::Configure(const std::vector<std::string>& lines) {
+  max_period_ = kCollectionSampleMaxPeriod;
+  for (const std::string& line : lines) {
+    std::istringstream fields(line);
+    std::string key;
+    uint32_t value;
+    if (!(fields >> key)) {
+      continue;
+    }
+    if (!(fields >> value) || value == 0) {
+      LOG(ERROR) << "sampling line without a positive value: " << line;
+    } else if (key == "warmup") {
+      warmup_ = value;
+    } else if (key == "halving") {
+      halving_ = value;
+    } else if (key == "max_period") {
+      max_period_ = value;
+    } else {
+      LOG(ERROR) << "unknown sampling key " << key;
+    }
+  }
+}
+
+CollectionState::CollectionState(const CollectionSampling& sampling)
+    : table_(nullptr), size_(0), sampling_(sampling), saturated_(false), quiet_traces_(0),
+      period_(0), countdown_(0), quiet_samples_(0), traced_(0), skipped_(0), sampled_(0),
+      resumed_(0) {
+  pthread_mutex_init(&lock_, NULL);
+}
+
+CollectionState::~CollectionState() {
+  for (Table* table : tables_) {
+    delete[] table->edges_;
+    delete table;
+  }
+  pthread_mutex_destroy(&lock_);
+}
+
+CollectionState::Table* CollectionState::NewTable(size_t capacity) {
+  Table* table = new Table;
+  table->mask_ = capacity - 1;
+  table->edges_ = new Atomic<uint64_t>[capacity];
+  for (size_t i = 0; i < capacity; ++i) {
+    table->edges_[i].StoreRelaxed(kNoEdge);
+  }
+  return table;
+}
+
+bool CollectionState::HasEdge(uint64_t edge) const {
+  const Table* table = table_.load(std::memory_order_acquire);
+  if (table == nullptr) {
+    return false;
+  }
+  for (size_t i = Slot(edge, table->mask_); ; i = (i + 1) & table->mask_) {
+    uint64_t slot_edge = table->edges_[i].load(std::memory_order_acquire);
+    if (slot_edge == edge) {
+      return true;
+    }
+    if (slot_edge == kNoEdge) {
+      return false;
+    }
+  }
+}
+
+void CollectionState::Grow() {
+  Table* old_table = table_.LoadRelaxed();
+  Table* new_table = NewTable(old_table == nullptr ? kCollectionEdgeInitialCapacity
+                                                   : (old_table->mask_ + 1) * 2);
+  if (old_table != nullptr) {
+    for (size_t i = 0; i <= old_table->mask_; ++i) {
+      uint64_t edge = old_table->edges_[i].LoadRelaxed();
+      if (edge == kNoEdge) {
+        continue;
+      }
+      size_t j = Slot(edge, new_table->mask_);
+      while (new_table->edges_[j].LoadRelaxed() != kNoEdge) {
+        j = (j + 1) & new_table->mask_;
+      }
+      new_table->edges_[j].StoreRelaxed(edge);
+    }
+  }
+  // Publishes the filled table to lock-free readers.
+  table_.StoreRelease(new_table);
+  tables_.push_back(new_table);
+}
+
+bool CollectionState::AddEdge(uint64_t edge) {
+  if (HasEdge(edge)) {
+    return false;
+  }
+  pthread_mutex_lock(&lock_);
+  Table* table = table_.LoadRelaxed();
+  // Keep the load factor at or below one half so probe sequences stay short.
+  if (table == nullptr || (size_ + 1) * 2 > table->mask_ + 1) {
+    Grow();
+    table = table_.LoadRelaxed();
+  }
+  size_t i = Slot(edge, table->mask_);
+  for (; ; i = (i + 1) & table->mask_) {
+    uint64_t slot_edge = table->edges_[i].LoadRelaxed();
+    if (slot_edge == edge) {
+      // Another traced invocation added it since the lock-free lookup.
+      pthread_mutex_unlock(&lock_);
+      return false;
+    }
+    if (slot_edge == kNoEdge) {
+      break;
+    }
+  }
+  table->edges_[i].StoreRelease(edge);
+  ++size_;
+  pthread_mutex_unlock(&lock_);
+  return true;
+}
+
+void CollectionState::EndTrace(uint32_t new_edges) {
+  traced_.StoreRelaxed(traced_.LoadRelaxed() + 1);
+  if (IsSaturated()) {
+    // A sample.
+    if (new_edges != 0) {
+      Desaturate();
+      return;
+    }
+    uint32_t quiet_samples = quiet_samples_.LoadRelaxed() + 1;
+    quiet_samples_.StoreRelaxed(quiet_samples);
+    if (quiet_samples % sampling_.halving_ == 0) {
+      period_.StoreRelaxed(std::min(period_.LoadRelaxed() * 2, sampling_.max_period_));
+    }
+    return;
+  }
+  if (new_edges != 0) {
+    quiet_traces_.StoreRelaxed(0);
+    return;
+  }
+  uint32_t quiet_traces = quiet_traces_.LoadRelaxed() + 1;
+  quiet_traces_.StoreRelaxed(quiet_traces);
+  if (quiet_traces >= sampling_.warmup_) {
+    period_.StoreRelaxed(std::min(2u, sampling_.max_period_));
+    countdown_.StoreRelaxed(period_.LoadRelaxed());
+    quiet_samples_.StoreRelaxed(0);
+    saturated_.StoreRelaxed(true);
+  }
+}
+
+void CollectionState::Desaturate() {
+  quiet_traces_.StoreRelaxed(0);
+  saturated_.StoreRelaxed(false);
+  resumed_.StoreRelaxed(resumed_.LoadRelaxed() + 1);
+}
+
+void CollectionState::AddStats(CollectionStateStats* stats) {
+  pthread_mutex_lock(&lock_);
+  stats->edges_ += size_;
+  pthread_mutex_unlock(&lock_);
+  stats->methods_++;
+  stats->saturated_ += IsSaturated() ? 1 : 0;
+  stats->traced_ += traced_.LoadRelaxed();
+  stats->skipped_ += skipped_.LoadRelaxed();
+  stats->sampled_ += sampled_.LoadRelaxed();
+  stats->resumed_ += resumed_.LoadRelaxed();
+}
+
+}  // namespace art
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_COLLECTION_STATE_H_
+#define ART_RUNTIME_UNPACK_COLLECTION_STATE_H_
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+
+namespace art {
+
+// Traced invocations in a row that must add no new edge before a method counts as saturated.
+static constexpr uint32_t kCollectionSaturationThreshold = 16;
+// Defaults of a package's sampling file: quiet samples per doubling of the sampling period, and
+// the longest period.
+static constexpr uint32_t kCollectionSampleHalving = 8;
+static constexpr uint32_t kCollectionSampleMaxPeriod = 1024;
+static constexpr size_t kCollectionEdgeInitialCapacity = 16;  // Power of two.
+// Set in the dex_pc half of edges taken by exceptions, so they cannot equal an edge of the
+// throwing instruction itself (e.g. the target of an invoke).
+static constexpr uint32_t kCollectionExceptionEdgeBit = 0x80000000;
+
+struct CollectionStateStats {
+  uint64_t methods_;
+  uint64_t saturated_;
+  uint64_t edges_;
+  uint64_t traced_;   // Invocations that built a trace tree.
+  uint64_t skipped_;  // Invocations that ran on the fast path instead.
+  uint64_t sampled_;  // Traced invocations of saturated methods, admitted by sampling.
+  uint64_t resumed_;  // Invocations that took a new edge and desaturated the method.
+
+  CollectionStateStats()
+      : methods_(0), saturated_(0), edges_(0), traced_(0), skipped_(0), sampled_(0),
+        resumed_(0) {}
+};
+
+// How saturated methods are sampled. Without a sampling file they are not: a saturated method is
+// only traced again once a fast path invocation takes a new edge.
+struct CollectionSampling {
+  uint32_t warmup_;      // Traced invocations in a row without a new edge before saturation.
+  uint32_t halving_;     // Samples in a row without a new edge per doubling of the period.
+  uint32_t max_period_;  // Longest sampling period, in invocations. 0 disables sampling.
+
+  CollectionSampling()
+      : warmup_(kCollectionSaturationThreshold), halving_(kCollectionSampleHalving),
+        max_period_(0) {}
+
+  // Enables sampling, with thresholds read from lines of the form "warmup <n>", "halving <n>"
+  // and "max_period <n>".
+  void Configure(const std::vector<std::string>& lines);
+};
+
+// Per-method record of the control-flow edges collected invocations have taken: if outcomes,
+// switch keys, exception handlers and the targets of quickened invokes, each keyed by dex_pc.
+//
+// A method is traced until warmup traced invocations in a row add no edge. From then on it is
+// saturated and its invocations only look their edges up, since a trace along known edges is one
+// GeneralDump would find to be a duplicate anyway. The first unknown edge desaturates the method,
+// so the next invocations trace it again. The invocation that hit the edge is not traced itself;
+// its path is picked up when it repeats.
+//
+// With sampling, a saturated method still traces one invocation per period, to catch edges its
+// fast path cannot see, such as those of callees it inlines through quickened invokes. The period
+// starts at 2 and doubles after every halving samples in a row that add no edge, up to
+// max_period, so the rate decays exponentially; a sample with a new edge desaturates the method.
+//
+// Edges are kept in an open-addressing set that the fast path probes without a lock. Inserts and
+// resizes take the lock; tables replaced by a resize are kept since a reader may still use them.
+// The invocation counters are statistics only and are updated without synchronization.
+class CollectionState {
+  public:
+    explicit CollectionState(const CollectionSampling& sampling = CollectionSampling());
+    ~CollectionState();
+
+    static uint64_t Edge(uint32_t dex_pc, int32_t value) {
+      return (static_cast<uint64_t>(dex_pc) << 32) | static_cast<uint32_t>(value);
+    }
+
+    static uint64_t ExceptionEdge(uint32_t dex_pc, uint32_t handler_dex_pc) {
+      return Edge(dex_pc | kCollectionExceptionEdgeBit, static_cast<int32_t>(handler_dex_pc));
+    }
+
+    bool IsSaturated() const {
+      return saturated_.LoadRelaxed();
+    }
+
+    // Adds the edge taken by a traced invocation. Returns whether it was new.
+    bool AddEdge(uint64_t edge);
+
+    bool HasEdge(uint64_t edge) const;
+
+    // Ends a traced invocation that added new_edges edges.
+    void EndTrace(uint32_t new_edges);
+
+    void CountSkipped() {
+      skipped_.StoreRelaxed(skipped_.LoadRelaxed() + 1);
+    }
+
+    // Whether an invocation of the saturated method is traced as a sample. Racing invocations
+    // may both take the same sample; the countdown only sets the rate.
+    bool SampleTrace() {
+      if (sampling_.max_period_ == 0) {
+        return false;
+      }
+      uint32_t countdown = countdown_.LoadRelaxed();
+      if (countdown > 1) {
+        countdown_.StoreRelaxed(countdown - 1);
+        return false;
+      }
+      countdown_.StoreRelaxed(period_.LoadRelaxed());
+      sampled_.StoreRelaxed(sampled_.LoadRelaxed() + 1);
+      return true;
+    }
+
+    // The current sampling period. 0 until the method first saturates, and without sampling.
+    uint32_t SamplePeriod() const {
+      return period_.LoadRelaxed();
+    }
+
+    // Called by an invocation that took an edge the method did not know.
+    void Desaturate();
+
+    // Adds this method's numbers to stats.
+    void AddStats(CollectionStateStats* stats);
+
+  private:
+    struct Table {
+      size_t mask_;
+      Atomic<uint64_t>* edges_;
+    };
+
+    static constexpr uint64_t kNoEdge = ~static_cast<uint64_t>(0);
+
+    static size_t Slot(uint64_t edge, size_t mask) {
+      uint64_t h = edge * UINT64_C(0x9E3779B97F4A7C15);
+      return static_cast<size_t>(h ^ (h >> 32)) & mask;
+    }
+
+    static Table* NewTable(size_t capacity);
+    void Grow();
+
+    Atomic<Table*> table_;
+    size_t size_;
+    pthread_mutex_t lock_;
+    std::vector<Table*> tables_;
+    const CollectionSampling sampling_;
+    Atomic<bool> saturated_;
+    Atomic<uint32_t> quiet_traces_;
+    Atomic<uint32_t> period_;
+    Atomic<uint32_t> countdown_;
+    Atomic<uint32_t> quiet_samples_;
+    Atomic<uint64_t> traced_;
+    Atomic<uint64_t> skipped_;
+    Atomic<uint64_t> sampled_;
+    Atomic<uint64_t> resumed_;
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_COLLECTION_STATE_H_
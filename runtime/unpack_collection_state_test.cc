@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_collection_state.h"
+
+#include <pthread.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "base/logging.h"
+
+namespace art {
+
+TEST(CollectionStateTest, Edges) {
+  CollectionState state;
+  EXPECT_FALSE(state.HasEdge(CollectionState::Edge(4, 2)));
+  EXPECT_TRUE(state.AddEdge(CollectionState::Edge(4, 2)));
+  EXPECT_FALSE(state.AddEdge(CollectionState::Edge(4, 2)));
+  EXPECT_TRUE(state.HasEdge(CollectionState::Edge(4, 2)));
+  // Other outcome of the same if, and a negative switch key.
+  EXPECT_FALSE(state.HasEdge(CollectionState::Edge(4, -6)));
+  EXPECT_TRUE(state.AddEdge(CollectionState::Edge(4, -6)));
+  // An exception leaving dex_pc 4 is not the edge of the instruction itself.
+  EXPECT_FALSE(state.HasEdge(CollectionState::ExceptionEdge(4, 2)));
+  for (int32_t key = 0; key < 1000; ++key) {
+    ASSERT_TRUE(state.AddEdge(CollectionState::Edge(10, key)));
+  }
+  for (int32_t key = 0; key < 1000; ++key) {
+    ASSERT_TRUE(state.HasEdge(CollectionState::Edge(10, key)));
+  }
+  CollectionStateStats stats;
+  state.AddStats(&stats);
+  EXPECT_EQ(1002u, stats.edges_);
+}
+
+TEST(CollectionStateTest, Saturation) {
+  CollectionState state;
+  // A trace that finds a new edge restarts the count.
+  for (uint32_t i = 0; i + 1 < kCollectionSaturationThreshold; ++i) {
+    state.EndTrace(0);
+  }
+  state.EndTrace(1);
+  EXPECT_FALSE(state.IsSaturated());
+  for (uint32_t i = 0; i + 1 < kCollectionSaturationThreshold; ++i) {
+    state.EndTrace(0);
+    EXPECT_FALSE(state.IsSaturated());
+  }
+  state.EndTrace(0);
+  EXPECT_TRUE(state.IsSaturated());
+  state.CountSkipped();
+
+  state.Desaturate();
+  EXPECT_FALSE(state.IsSaturated());
+  for (uint32_t i = 0; i < kCollectionSaturationThreshold; ++i) {
+    state.EndTrace(0);
+  }
+  EXPECT_TRUE(state.IsSaturated());
+
+  CollectionStateStats stats;
+  state.AddStats(&stats);
+  EXPECT_EQ(1u, stats.methods_);
+  EXPECT_EQ(1u, stats.saturated_);
+  EXPECT_EQ(3 * kCollectionSaturationThreshold, stats.traced_);
+  EXPECT_EQ(1u, stats.skipped_);
+  EXPECT_EQ(1u, stats.resumed_);
+}
+
+TEST(CollectionStateTest, Sampling) {
+  CollectionSampling sampling;
+  sampling.Configure({ "warmup 4", "halving 2", "max_period 8", "bogus 1", "halving 0" });
+  EXPECT_EQ(4u, sampling.warmup_);
+  EXPECT_EQ(2u, sampling.halving_);
+  EXPECT_EQ(8u, sampling.max_period_);
+  CollectionState state(sampling);
+  for (uint32_t i = 0; i < 4; ++i) {
+    EXPECT_FALSE(state.IsSaturated());
+    state.EndTrace(0);
+  }
+  EXPECT_TRUE(state.IsSaturated());
+
+  // The period doubles every two quiet samples, up to 8. A sample has already set the countdown
+  // to the next one when it ends, so each doubling shows one sample later.
+  std::vector<uint32_t> sampled_at;
+  for (uint32_t i = 1; i <= 64; ++i) {
+    if (state.SampleTrace()) {
+      sampled_at.push_back(i);
+      state.EndTrace(0);
+    }
+  }
+  EXPECT_EQ(std::vector<uint32_t>({ 2, 4, 6, 10, 14, 22, 30, 38, 46, 54, 62 }), sampled_at);
+  EXPECT_EQ(8u, state.SamplePeriod());
+
+  // A sample that finds an edge ends sampling; the method warms up again from its next trace.
+  while (!state.SampleTrace()) {
+  }
+  state.EndTrace(1);
+  EXPECT_FALSE(state.IsSaturated());
+  for (uint32_t i = 0; i < 4; ++i) {
+    state.EndTrace(0);
+  }
+  EXPECT_TRUE(state.IsSaturated());
+  EXPECT_EQ(2u, state.SamplePeriod());
+
+  CollectionStateStats stats;
+  state.AddStats(&stats);
+  EXPECT_EQ(12u, stats.sampled_);
+  EXPECT_EQ(20u, stats.traced_);
+  EXPECT_EQ(1u, stats.resumed_);
+
+  // Without a sampling file, a saturated method is never sampled.
+  CollectionState unsampled;
+  for (uint32_t i = 0; i < kCollectionSaturationThreshold; ++i) {
+    unsampled.EndTrace(0);
+  }
+  for (uint32_t i = 0; i < 100; ++i) {
+    EXPECT_FALSE(unsampled.SampleTrace());
+  }
+}
+
+static constexpr int32_t kEdges = 20000;
+
+static void* AddEdges(void* arg) {
+  CollectionState* state = reinterpret_cast<CollectionState*>(arg);
+  for (int32_t key = 0; key < kEdges; ++key) {
+    state->AddEdge(CollectionState::Edge(key % 64, key));
+    // Edges added by this thread are visible to it right away.
+    CHECK(state->HasEdge(CollectionState::Edge(key % 64, key)));
+  }
+  return nullptr;
+}
+
+TEST(CollectionStateTest, ConcurrentAdd) {
+  static constexpr size_t kThreads = 8;
+  CollectionState state;
+  pthread_t threads[kThreads];
+  for (size_t i = 0; i < kThreads; ++i) {
+    CHECK_PTHREAD_CALL(pthread_create, (&threads[i], nullptr, AddEdges, &state), "edges");
+  }
+  for (size_t i = 0; i < kThreads; ++i) {
+    CHECK_PTHREAD_CALL(pthread_join, (threads[i], nullptr), "edges");
+  }
+  CollectionStateStats stats;
+  state.AddStats(&stats);
+  EXPECT_EQ(static_cast<uint64_t>(kEdges), stats.edges_);
+}
+
+}  // namespace art
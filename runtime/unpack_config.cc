@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+
+namespace art {
+
+// Packages collected when they have no reveal_filter, matched against the command line.
+static const char* const kDefaultRevealFilter[] = {
+  "zhenyu", "ecspride", "mit", "example", "cert", "snt", "wayne"
+};
+
+Atomic<const CollectionConfig*> CollectionConfig::sCurrent(nullptr);
+
+CollectionConfig::CollectionConfig() : target_(false), pid_(0) {}
+
+const CollectionConfig* CollectionConfig::NotTarget() {
+  static const CollectionConfig* not_target = new CollectionConfig();
+  return not_target;
+}
+
+void CollectionConfig::InitializeForZygote() {
+  sCurrent.StoreSequentiallyConsistent(NotTarget());
+}
+
+void CollectionConfig::ResetAfterFork() {
+  sCurrent.StoreSequentiallyConsistent(nullptr);
+}
+
+const CollectionConfig* CollectionConfig::Publish() {
+  std::ifstream cmdline_file("/proc/self/cmdline");
+  std::string cmdline;
+  if (cmdline_file.fail() || !std::getline(cmdline_file, cmdline, '\0')) {
+    LOG(ERROR) << "no cmdline for pid " << getpid();
+    cmdline.clear();
+  }
+  // A child of the zygote keeps its name until the framework renames it, shortly after the fork.
+  if (cmdline.empty() || cmdline.compare(0, 6, "zygote") == 0 || cmdline == "<pre-initialized>") {
+    return NotTarget();
+  }
+  CollectionConfig* config = Create(cmdline, getpid(), kCollectionDataDir);
+  if (!sCurrent.CompareExchangeStrongSequentiallyConsistent(nullptr, config)) {
+    delete config;
+    return sCurrent.LoadSequentiallyConsistent();
+  }
+  return config;
+}
+
+CollectionConfig* CollectionConfig::Create(const std::string& cmdline, pid_t pid,
+                                           const char* data_dir) {
+  CollectionConfig* config = new CollectionConfig();
+  std::string package_name = cmdline.substr(0, cmdline.find(':'));
+  std::string package_dir = StringPrintf("%s/%s/", data_dir, package_name.c_str());
+  std::vector<std::string> reveal_filter;
+  if (ReadLines(package_dir + "reveal_filter", &reveal_filter)) {
+    for (const std::string& line : reveal_filter) {
+      if (strstr(cmdline.c_str(), line.c_str()) != nullptr) {
+        config->target_ = true;
+        break;
+      }
+    }
+  } else {
+    for (const char* line : kDefaultRevealFilter) {
+      if (strstr(cmdline.c_str(), line) != nullptr) {
+        config->target_ = true;
+        break;
+      }
+    }
+  }
+  if (!config->target_) {
+    return config;
+  }
+  config->package_name_ = package_name;
+  config->pid_ = pid;
+  ReadLines(package_dir + "class_filter", &config->class_filter_);
+  ReadLines(package_dir + "included_class", &config->included_class_);
+  ReadLines(package_dir + "force_branches", &config->force_branches_);
+  LOG(ERROR) << "collection config " << cmdline << " pid=" << pid
+      << " class_filter=" << config->class_filter_.size()
+      << " included_class=" << config->included_class_.size()
+      << " force_branches=" << config->force_branches_.size();
+  return config;
+}
+
+bool CollectionConfig::ReadLines(const std::string& path, std::vector<std::string>* lines) {
+  std::ifstream file(path);
+  if (file.fail()) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    lines->push_back(line);
+  }
+  return true;
+}
+
+}  // namespace art
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_CONFIG_H_
+#define ART_RUNTIME_UNPACK_CONFIG_H_
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+#include "base/macros.h"
+
+namespace art {
+
+// The directory holding a package's configuration files, as in /data/data/<pkg>/reveal_filter.
+static constexpr const char* kCollectionDataDir = "/data/data";
+
+// What the process collects, read once per process: whether it is a target, from its command
+// line and the package's reveal_filter, and the class_filter, included_class and force_branches
+// lines of the package. Immutable once built. Published through a single atomic pointer, so that
+// class loading asks Current() instead of probing /proc and the package directory.
+class CollectionConfig {
+  public:
+    // The configuration of the calling process. Never null. The first call after a fork builds
+    // and publishes it; until the forked process is named, a non-target configuration is
+    // returned without being published.
+    static const CollectionConfig* Current() {
+      const CollectionConfig* config = sCurrent.LoadSequentiallyConsistent();
+      if (LIKELY(config != nullptr)) {
+        return config;
+      }
+      return Publish();
+    }
+
+    // Publishes a non-target configuration, for the zygote, which is never a target and loads
+    // too many classes to look itself up for each.
+    static void InitializeForZygote();
+
+    // Drops the configuration inherited from the zygote. Called in the child after a fork.
+    static void ResetAfterFork();
+
+    // Builds the configuration of a process of that command line, reading the package's files
+    // under data_dir.
+    static CollectionConfig* Create(const std::string& cmdline, pid_t pid, const char* data_dir);
+
+    // Reads the lines of a file into lines. Returns false if the file cannot be opened.
+    static bool ReadLines(const std::string& path, std::vector<std::string>* lines);
+
+    bool IsTarget() const {
+      return target_;
+    }
+
+    // Empty unless the process is a target.
+    const std::string& PackageName() const {
+      return package_name_;
+    }
+
+    pid_t Pid() const {
+      return pid_;
+    }
+
+    const std::vector<std::string>& ClassFilter() const {
+      return class_filter_;
+    }
+
+    const std::vector<std::string>& IncludedClass() const {
+      return included_class_;
+    }
+
+    const std::vector<std::string>& ForceBranches() const {
+      return force_branches_;
+    }
+
+  private:
+    CollectionConfig();
+
+    static const CollectionConfig* Publish();
+    static const CollectionConfig* NotTarget();
+
+    static Atomic<const CollectionConfig*> sCurrent;
+
+    bool target_;
+    std::string package_name_;
+    pid_t pid_;
+    std::vector<std::string> class_filter_;
+    std::vector<std::string> included_class_;
+    std::vector<std::string> force_branches_;
+
+    DISALLOW_COPY_AND_ASSIGN(CollectionConfig);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_CONFIG_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_config.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <memory>
+
+#include <gtest/gtest.h>
+
+namespace art {
+
+class CollectionConfigTest : public testing::Test {
+  protected:
+    void SetUp() OVERRIDE {
+      const char* dir = getenv("TMPDIR");
+      data_dir_ = std::string(dir != nullptr ? dir : "/tmp") + "/collection-config-XXXXXX";
+      ASSERT_TRUE(mkdtemp(&data_dir_[0]) != nullptr);
+    }
+
+    void TearDown() OVERRIDE {
+      for (const std::string& path : files_) {
+        unlink(path.c_str());
+      }
+      for (auto it = packages_.rbegin(); it != packages_.rend(); ++it) {
+        rmdir(it->c_str());
+      }
+      rmdir(data_dir_.c_str());
+    }
+
+    void WriteFile(const std::string& package, const std::string& name,
+                   const std::string& content) {
+      std::string package_dir = data_dir_ + "/" + package;
+      if (mkdir(package_dir.c_str(), 0777) == 0) {
+        packages_.push_back(package_dir);
+      }
+      std::string path = package_dir + "/" + name;
+      std::ofstream file(path);
+      file << content;
+      files_.push_back(path);
+    }
+
+    std::string data_dir_;
+    std::vector<std::string> packages_;
+    std::vector<std::string> files_;
+};
+
+TEST_F(CollectionConfigTest, DefaultFilter) {
+  std::unique_ptr<CollectionConfig> config(
+      CollectionConfig::Create("com.example.app:remote", 42, data_dir_.c_str()));
+  EXPECT_TRUE(config->IsTarget());
+  EXPECT_EQ("com.example.app", config->PackageName());
+  EXPECT_EQ(42, config->Pid());
+  EXPECT_TRUE(config->ClassFilter().empty());
+
+  std::unique_ptr<CollectionConfig> other(
+      CollectionConfig::Create("com.android.phone", 43, data_dir_.c_str()));
+  EXPECT_FALSE(other->IsTarget());
+  EXPECT_EQ("", other->PackageName());
+}
+
+TEST_F(CollectionConfigTest, RevealFilter) {
+  // A reveal_filter replaces the default substrings.
+  WriteFile("com.example.app", "reveal_filter", "org.nothing\n");
+  std::unique_ptr<CollectionConfig> excluded(
+      CollectionConfig::Create("com.example.app", 1, data_dir_.c_str()));
+  EXPECT_FALSE(excluded->IsTarget());
+
+  WriteFile("org.packed", "reveal_filter", "org.nothing\norg.pack\n");
+  WriteFile("org.packed", "class_filter", "Landroid/support/\nLcom/google/\n");
+  WriteFile("org.packed", "included_class", "Lorg/packed/");
+  WriteFile("org.packed", "force_branches", "Lorg/packed/A; run V V 4 2 0\n");
+  std::unique_ptr<CollectionConfig> config(
+      CollectionConfig::Create("org.packed", 2, data_dir_.c_str()));
+  ASSERT_TRUE(config->IsTarget());
+  EXPECT_EQ("org.packed", config->PackageName());
+  EXPECT_EQ(std::vector<std::string>({ "Landroid/support/", "Lcom/google/" }),
+            config->ClassFilter());
+  // The last line needs no newline.
+  EXPECT_EQ(std::vector<std::string>({ "Lorg/packed/" }), config->IncludedClass());
+  EXPECT_EQ(std::vector<std::string>({ "Lorg/packed/A; run V V 4 2 0" }),
+            config->ForceBranches());
+}
+
+TEST_F(CollectionConfigTest, Current) {
+  CollectionConfig::InitializeForZygote();
+  const CollectionConfig* zygote = CollectionConfig::Current();
+  EXPECT_FALSE(zygote->IsTarget());
+  EXPECT_EQ(zygote, CollectionConfig::Current());
+
+  // After a fork the process looks itself up once, then keeps the configuration it published.
+  CollectionConfig::ResetAfterFork();
+  const CollectionConfig* config = CollectionConfig::Current();
+  EXPECT_NE(zygote, config);
+  EXPECT_EQ(config, CollectionConfig::Current());
+}
+
+}  // namespace art
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_container.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+
+namespace art {
+
+static uint32_t BlockCrc(const uint8_t* header, const uint8_t* payload, uint32_t size) {
+  uLong crc = crc32(0L, Z_NULL, 0);
+  // Everything in the header after the magic and before the crc itself.
+  crc = crc32(crc, header + 4, 12);
+  return crc32(crc, payload, size);
+}
+
+DumpContainerWriter::DumpContainerWriter()
+    : file_(nullptr), buffer_(nullptr), end_(0), ends_with_footer_(false) {
+  for (Staged& staged : staged_) {
+    staged.records_ = 0;
+  }
+}
+
+DumpContainerWriter::~DumpContainerWriter() {
+  if (file_ != nullptr) {
+    fclose(file_);
+  }
+  delete[] buffer_;
+}
+
+bool DumpContainerWriter::Open(const std::string& path, size_t buffer_size) {
+  DCHECK(file_ == nullptr);
+  struct stat st;
+  bool exists = stat(path.c_str(), &st) == 0;
+  if (exists && st.st_size >= static_cast<off_t>(kDumpContainerHeaderSize)) {
+    DumpContainerReader reader;
+    std::string error_msg;
+    if (!reader.Open(path, &error_msg)) {
+      LOG(ERROR) << "not appending to " << path << ": " << error_msg;
+      return false;
+    }
+    blocks_ = reader.Blocks();
+    end_ = reader.ValidSize();
+    ends_with_footer_ = !reader.Recovered();
+    if (end_ != static_cast<uint64_t>(st.st_size) && truncate(path.c_str(), end_) != 0) {
+      PLOG(ERROR) << "truncate " << path << " failed";
+      return false;
+    }
+  } else if (exists && st.st_size != 0 && truncate(path.c_str(), 0) != 0) {
+    // A header torn by a crash; nothing after it can be valid.
+    PLOG(ERROR) << "truncate " << path << " failed";
+    return false;
+  }
+
+  file_ = fopen(path.c_str(), "ab");
+  if (file_ == nullptr) {
+    PLOG(ERROR) << "open " << path << " failed";
+    return false;
+  }
+  buffer_ = new char[buffer_size];
+  setvbuf(file_, buffer_, _IOFBF, buffer_size);
+  if (end_ == 0) {
+    uint8_t header[kDumpContainerHeaderSize];
+    memcpy(header, kDumpContainerMagic, sizeof(kDumpContainerMagic));
+    uint32_t version = kDumpContainerVersion;
+    uint32_t reserved = 0;
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &reserved, 4);
+    fwrite(header, sizeof(header), 1, file_);
+    end_ = kDumpContainerHeaderSize;
+  }
+  return true;
+}
+
+void DumpContainerWriter::WriteBlock(uint16_t kind, uint32_t records, const std::string& payload) {
+  uint8_t header[kDumpContainerBlockHeaderSize];
+  uint32_t magic = kDumpContainerBlockMagic;
+  uint16_t flags = 0;
+  uint32_t size = payload.size();
+  memcpy(header, &magic, 4);
+  memcpy(header + 4, &kind, 2);
+  memcpy(header + 6, &flags, 2);
+  memcpy(header + 8, &records, 4);
+  memcpy(header + 12, &size, 4);
+  uint32_t crc = BlockCrc(header, reinterpret_cast<const uint8_t*>(payload.data()), size);
+  memcpy(header + 16, &crc, 4);
+  fwrite(header, sizeof(header), 1, file_);
+  fwrite(payload.data(), size, 1, file_);
+  if (kind < kDumpContainerMaxKinds) {
+    DumpContainerBlock block;
+    block.kind_ = kind;
+    block.records_ = records;
+    block.offset_ = end_;
+    blocks_.push_back(block);
+  }
+  end_ += kDumpContainerBlockHeaderSize + size;
+  ends_with_footer_ = false;
+}
+
+size_t DumpContainerWriter::Append(uint16_t kind, const void* data, uint32_t size) {
+  DCHECK_LT(kind, kDumpContainerMaxKinds);
+  Staged& staged = staged_[kind];
+  staged.payload_.append(reinterpret_cast<const char*>(&size), 4);
+  staged.payload_.append(reinterpret_cast<const char*>(data), size);
+  ++staged.records_;
+  if (staged.payload_.size() >= kDumpContainerBlockBytes) {
+    WriteBlock(kind, staged.records_, staged.payload_);
+    staged.payload_.clear();
+    staged.records_ = 0;
+  }
+  return 4 + size;
+}
+
+void DumpContainerWriter::Flush(bool write_index) {
+  for (uint16_t kind = 0; kind < kDumpContainerMaxKinds; ++kind) {
+    Staged& staged = staged_[kind];
+    if (staged.records_ != 0) {
+      WriteBlock(kind, staged.records_, staged.payload_);
+      staged.payload_.clear();
+      staged.records_ = 0;
+    }
+  }
+  if (write_index && !ends_with_footer_) {
+    std::string index;
+    index.reserve(blocks_.size() * kDumpContainerIndexEntrySize);
+    for (const DumpContainerBlock& block : blocks_) {
+      uint16_t reserved = 0;
+      index.append(reinterpret_cast<const char*>(&block.kind_), 2);
+      index.append(reinterpret_cast<const char*>(&reserved), 2);
+      index.append(reinterpret_cast<const char*>(&block.records_), 4);
+      index.append(reinterpret_cast<const char*>(&block.offset_), 8);
+    }
+    uint64_t index_offset = end_;
+    WriteBlock(kDumpContainerIndexKind, blocks_.size(), index);
+    WriteBlock(kDumpContainerFooterKind, 0,
+               std::string(reinterpret_cast<const char*>(&index_offset), 8));
+    ends_with_footer_ = true;
+  }
+  fflush(file_);
+}
+
+DumpContainerReader::DumpContainerReader()
+    : begin_(nullptr), size_(0), recovered_(false), valid_size_(0) {}
+
+DumpContainerReader::~DumpContainerReader() {
+  if (begin_ != nullptr) {
+    munmap(begin_, size_);
+  }
+}
+
+bool DumpContainerReader::Open(const std::string& path, std::string* error_msg) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error_msg = StringPrintf("open %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kDumpContainerHeaderSize)) {
+    *error_msg = StringPrintf("%s is too short for a container", path.c_str());
+    close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    *error_msg = StringPrintf("mmap %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  begin_ = reinterpret_cast<uint8_t*>(map);
+  size_ = st.st_size;
+  uint32_t version;
+  memcpy(&version, begin_ + 8, 4);
+  if (memcmp(begin_, kDumpContainerMagic, sizeof(kDumpContainerMagic)) != 0 ||
+      version != kDumpContainerVersion) {
+    *error_msg = StringPrintf("%s is not a version %u container", path.c_str(),
+                              kDumpContainerVersion);
+    return false;
+  }
+  if (!ReadIndex()) {
+    blocks_.clear();
+    Scan();
+    recovered_ = true;
+  }
+  return true;
+}
+
+const uint8_t* DumpContainerReader::CheckBlock(uint64_t offset, uint16_t* kind, uint32_t* records,
+                                               uint32_t* size) const {
+  if (offset < kDumpContainerHeaderSize || offset > size_ ||
+      size_ - offset < kDumpContainerBlockHeaderSize) {
+    return nullptr;
+  }
+  const uint8_t* header = begin_ + offset;
+  uint32_t magic;
+  uint32_t crc;
+  memcpy(&magic, header, 4);
+  memcpy(kind, header + 4, 2);
+  memcpy(records, header + 8, 4);
+  memcpy(size, header + 12, 4);
+  memcpy(&crc, header + 16, 4);
+  if (magic != kDumpContainerBlockMagic ||
+      size_ - offset - kDumpContainerBlockHeaderSize < *size) {
+    return nullptr;
+  }
+  const uint8_t* payload = header + kDumpContainerBlockHeaderSize;
+  if (BlockCrc(header, payload, *size) != crc) {
+    return nullptr;
+  }
+  return payload;
+}
+
+bool DumpContainerReader::ReadIndex() {
+  if (size_ < kDumpContainerHeaderSize + kDumpContainerFooterSize) {
+    return false;
+  }
+  uint16_t kind;
+  uint32_t records;
+  uint32_t size;
+  const uint8_t* footer = CheckBlock(size_ - kDumpContainerFooterSize, &kind, &records, &size);
+  if (footer == nullptr || kind != kDumpContainerFooterKind || size != 8) {
+    return false;
+  }
+  uint64_t index_offset;
+  memcpy(&index_offset, footer, 8);
+  const uint8_t* index = CheckBlock(index_offset, &kind, &records, &size);
+  if (index == nullptr || kind != kDumpContainerIndexKind ||
+      size != records * kDumpContainerIndexEntrySize) {
+    return false;
+  }
+  for (uint32_t i = 0; i < records; ++i) {
+    const uint8_t* entry = index + i * kDumpContainerIndexEntrySize;
+    DumpContainerBlock block;
+    memcpy(&block.kind_, entry, 2);
+    memcpy(&block.records_, entry + 4, 4);
+    memcpy(&block.offset_, entry + 8, 8);
+    blocks_.push_back(block);
+  }
+  valid_size_ = size_;
+  return true;
+}
+
+void DumpContainerReader::Scan() {
+  uint64_t offset = kDumpContainerHeaderSize;
+  uint16_t kind;
+  uint32_t records;
+  uint32_t size;
+  while (CheckBlock(offset, &kind, &records, &size) != nullptr) {
+    if (kind < kDumpContainerMaxKinds) {
+      DumpContainerBlock block;
+      block.kind_ = kind;
+      block.records_ = records;
+      block.offset_ = offset;
+      blocks_.push_back(block);
+    }
+    offset += kDumpContainerBlockHeaderSize + size;
+  }
+  valid_size_ = offset;
+}
+
+bool DumpContainerReader::ReadRecords(uint16_t kind,
+                                      std::vector<DumpContainerRecord>* records) const {
+  for (const DumpContainerBlock& block : blocks_) {
+    if (block.kind_ != kind) {
+      continue;
+    }
+    uint16_t block_kind;
+    uint32_t count;
+    uint32_t size;
+    const uint8_t* payload = CheckBlock(block.offset_, &block_kind, &count, &size);
+    if (payload == nullptr || block_kind != kind || count != block.records_) {
+      return false;
+    }
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      DumpContainerRecord record;
+      if (size - pos < 4) {
+        return false;
+      }
+      memcpy(&record.size_, payload + pos, 4);
+      pos += 4;
+      if (size - pos < record.size_) {
+        return false;
+      }
+      record.data_ = payload + pos;
+      pos += record.size_;
+      records->push_back(record);
+    }
+  }
+  return true;
+}
+
+}  // namespace art
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_CONTAINER_H_
+#define ART_RUNTIME_UNPACK_CONTAINER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace art {
+
+// Collected items of one dex location are appended to a single container file:
+//
+//   container := file_header block*
+//   file_header := magic[8] version:u32 reserved:u32
+//   block := magic:u32 kind:u16 flags:u16 records:u32 size:u32 crc:u32 payload[size]
+//
+// The crc covers kind, flags, records, size and the payload. The payload of an item block is
+// `records` records of one kind, each a length:u32 followed by what DumpBase::Output() writes
+// for the item. Every explicit flush ends with an index block listing the offset of every item
+// block so far, followed by a footer block holding the offset of that index. A reader looks at
+// the footer first; when the file does not end with one, because the process died after
+// appending more blocks, it scans the blocks from the start and stops at the first one that is
+// truncated or fails its crc.
+
+static constexpr char kDumpContainerMagic[8] = { 'd', 'l', 'g', 'o', 'c', 't', 'r', '\0' };
+static constexpr uint32_t kDumpContainerVersion = 1;
+static constexpr uint32_t kDumpContainerBlockMagic = 0x4b4c4244;  // "DBLK"
+static constexpr size_t kDumpContainerHeaderSize = 16;
+static constexpr size_t kDumpContainerBlockHeaderSize = 20;
+static constexpr size_t kDumpContainerIndexEntrySize = 16;
+static constexpr size_t kDumpContainerFooterSize = kDumpContainerBlockHeaderSize + 8;
+// Item kinds are DumpItemType values and stay below this bound.
+static constexpr uint16_t kDumpContainerMaxKinds = 16;
+static constexpr uint16_t kDumpContainerIndexKind = 0xfffe;
+static constexpr uint16_t kDumpContainerFooterKind = 0xffff;
+// Staged records of one kind are emitted as a block once they reach this size.
+static constexpr size_t kDumpContainerBlockBytes = 64 * 1024;
+
+struct DumpContainerBlock {
+  uint16_t kind_;
+  uint32_t records_;
+  uint64_t offset_;
+};
+
+// Appends blocks to one container file. Not thread safe; DumpWriter serializes the calls.
+class DumpContainerWriter {
+  public:
+    DumpContainerWriter();
+    ~DumpContainerWriter();
+
+    // Opens or creates the container. An existing container is recovered first: its blocks are
+    // indexed again and whatever follows the last valid block is cut off.
+    bool Open(const std::string& path, size_t buffer_size);
+
+    // Stages one record of the given kind. Returns the bytes it adds to the file.
+    size_t Append(uint16_t kind, const void* data, uint32_t size);
+
+    // Writes every staged record and flushes the file. With write_index, also appends the index
+    // and footer, so that a reader can seek to any kind without scanning.
+    void Flush(bool write_index);
+
+    uint64_t Blocks() const {
+      return blocks_.size();
+    }
+
+  private:
+    struct Staged {
+      std::string payload_;
+      uint32_t records_;
+    };
+
+    void WriteBlock(uint16_t kind, uint32_t records, const std::string& payload);
+
+    FILE* file_;
+    char* buffer_;
+    uint64_t end_;
+    Staged staged_[kDumpContainerMaxKinds];
+    std::vector<DumpContainerBlock> blocks_;
+    // True while nothing was appended since the last footer.
+    bool ends_with_footer_;
+
+    DISALLOW_COPY_AND_ASSIGN(DumpContainerWriter);
+};
+
+struct DumpContainerRecord {
+  const uint8_t* data_;
+  uint32_t size_;
+};
+
+// Maps a container read-only and gives direct access to the records of each kind.
+class DumpContainerReader {
+  public:
+    DumpContainerReader();
+    ~DumpContainerReader();
+
+    bool Open(const std::string& path, std::string* error_msg);
+
+    // Appends the records of kind to records, in the order they were written. Returns false if a
+    // block of the kind fails its crc.
+    bool ReadRecords(uint16_t kind, std::vector<DumpContainerRecord>* records) const;
+
+    const std::vector<DumpContainerBlock>& Blocks() const {
+      return blocks_;
+    }
+
+    // True if the blocks were found by scanning because the container did not end with a footer.
+    bool Recovered() const {
+      return recovered_;
+    }
+
+    // Length of the valid prefix of the file; anything beyond it is a torn write.
+    uint64_t ValidSize() const {
+      return valid_size_;
+    }
+
+  private:
+    // Returns the payload of the valid block at offset, or nullptr.
+    const uint8_t* CheckBlock(uint64_t offset, uint16_t* kind, uint32_t* records,
+                              uint32_t* size) const;
+    bool ReadIndex();
+    void Scan();
+
+    uint8_t* begin_;
+    uint64_t size_;
+    std::vector<DumpContainerBlock> blocks_;
+    bool recovered_;
+    uint64_t valid_size_;
+
+    DISALLOW_COPY_AND_ASSIGN(DumpContainerReader);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_CONTAINER_H_
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_container.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "unpack_dump.h"
+#include "unpack_writer.h"
+
+namespace art {
+
+class DumpContainerTest : public testing::Test {
+  protected:
+    void SetUp() OVERRIDE {
+      const char* dir = getenv("TMPDIR");
+      path_ = std::string(dir != nullptr ? dir : "/tmp") + "/dump-container-XXXXXX";
+      int fd = mkstemp(&path_[0]);
+      ASSERT_NE(-1, fd);
+      close(fd);
+    }
+
+    void TearDown() OVERRIDE {
+      unlink(path_.c_str());
+    }
+
+    uint64_t FileSize() {
+      struct stat st;
+      EXPECT_EQ(0, stat(path_.c_str(), &st));
+      return st.st_size;
+    }
+
+    void AppendGarbage(size_t size) {
+      FILE* file = fopen(path_.c_str(), "ab");
+      ASSERT_TRUE(file != nullptr);
+      for (size_t i = 0; i < size; ++i) {
+        fputc(static_cast<int>(i * 7), file);
+      }
+      fclose(file);
+    }
+
+    std::string path_;
+};
+
+// The bytes DumpBase::Output() produces for item, which the container must hand back unchanged.
+static std::string OutputBytes(DumpBase* item) {
+  char* buffer = nullptr;
+  size_t size = 0;
+  FILE* stream = open_memstream(&buffer, &size);
+  size_t written = item->Output(stream);
+  fclose(stream);
+  EXPECT_EQ(written, size);
+  std::string bytes(buffer, size);
+  free(buffer);
+  return bytes;
+}
+
+static DumpBase* NewItem(uint32_t i) {
+  switch (i % 4) {
+    case 0: {
+      DumpString* s = new DumpString;
+      s->string_ = "string" + std::to_string(i);
+      s->string_length_ = s->string_.size();
+      s->array_idx_ = i;
+      return s;
+    }
+    case 1: {
+      DumpType* type = new DumpType;
+      type->descriptor_idx_ = i * 3;
+      type->array_idx_ = i;
+      return type;
+    }
+    case 2: {
+      DumpProto* proto = new DumpProto;
+      proto->shorty_idx_ = i;
+      proto->return_type_idx_ = 1;
+      proto->param_types_.assign(i % 5, 7);
+      proto->array_idx_ = i;
+      return proto;
+    }
+    default: {
+      DumpCodeItem* code = new DumpCodeItem;
+      code->method_idx_ = i;
+      code->current_clz_name_idx_ = 2;
+      code->registers_size_ = 4;
+      code->ins_size_ = 1;
+      code->outs_size_ = 2;
+      code->insns_size_in_code_units_ = 1 + i % 64;
+      code->insns_ = new uint16_t[code->insns_size_in_code_units_];
+      for (uint32_t j = 0; j < code->insns_size_in_code_units_; ++j) {
+        code->insns_[j] = static_cast<uint16_t>(i + j);
+      }
+      code->array_idx_ = i;
+      return code;
+    }
+  }
+}
+
+static void ExpectRecords(const DumpContainerReader& reader,
+                          const std::vector<std::string> (&expected)[kDumpContainerMaxKinds]) {
+  for (uint16_t kind = 0; kind < kDumpContainerMaxKinds; ++kind) {
+    std::vector<DumpContainerRecord> records;
+    ASSERT_TRUE(reader.ReadRecords(kind, &records)) << kind;
+    ASSERT_EQ(expected[kind].size(), records.size()) << kind;
+    for (size_t i = 0; i < records.size(); ++i) {
+      ASSERT_EQ(expected[kind][i],
+                std::string(reinterpret_cast<const char*>(records[i].data_), records[i].size_));
+    }
+  }
+}
+
+TEST_F(DumpContainerTest, RoundTrip) {
+  static constexpr uint32_t kItems = 20000;
+  std::vector<std::string> expected[kDumpContainerMaxKinds];
+  {
+    DumpWriter writer;
+    for (uint32_t i = 0; i < kItems; ++i) {
+      DumpBase* item = NewItem(i);
+      expected[item->dump_type_].push_back(OutputBytes(item));
+      writer.Write(path_, item);
+      delete item;
+    }
+    writer.FlushAll();
+  }
+  DumpContainerReader reader;
+  std::string error_msg;
+  ASSERT_TRUE(reader.Open(path_, &error_msg)) << error_msg;
+  EXPECT_FALSE(reader.Recovered());
+  EXPECT_EQ(FileSize(), reader.ValidSize());
+  // Enough code items for several blocks of their kind.
+  size_t code_blocks = 0;
+  for (const DumpContainerBlock& block : reader.Blocks()) {
+    code_blocks += block.kind_ == D_CODE ? 1 : 0;
+  }
+  EXPECT_GT(code_blocks, 1u);
+  ExpectRecords(reader, expected);
+}
+
+// Blocks written after the last index are found by scanning, and a torn block at the end is
+// ignored by the reader and cut off by the next writer.
+TEST_F(DumpContainerTest, RecoversTornTail) {
+  std::vector<std::string> expected[kDumpContainerMaxKinds];
+  {
+    DumpContainerWriter writer;
+    ASSERT_TRUE(writer.Open(path_, 4096));
+    for (uint32_t i = 0; i < 100; ++i) {
+      std::string record = "first" + std::to_string(i);
+      writer.Append(i % 3, record.data(), record.size());
+      expected[i % 3].push_back(record);
+    }
+    writer.Flush(true);
+    for (uint32_t i = 0; i < 100; ++i) {
+      std::string record = "second" + std::to_string(i);
+      writer.Append(i % 2, record.data(), record.size());
+      expected[i % 2].push_back(record);
+    }
+    writer.Flush(false);
+  }
+  uint64_t valid_size = FileSize();
+  AppendGarbage(kDumpContainerBlockHeaderSize + 3);
+  {
+    DumpContainerReader reader;
+    std::string error_msg;
+    ASSERT_TRUE(reader.Open(path_, &error_msg)) << error_msg;
+    EXPECT_TRUE(reader.Recovered());
+    EXPECT_EQ(valid_size, reader.ValidSize());
+    ExpectRecords(reader, expected);
+  }
+  {
+    DumpContainerWriter writer;
+    ASSERT_TRUE(writer.Open(path_, 4096));
+    std::string record = "third";
+    writer.Append(5, record.data(), record.size());
+    expected[5].push_back(record);
+    writer.Flush(true);
+  }
+  DumpContainerReader reader;
+  std::string error_msg;
+  ASSERT_TRUE(reader.Open(path_, &error_msg)) << error_msg;
+  EXPECT_FALSE(reader.Recovered());
+  ExpectRecords(reader, expected);
+}
+
+TEST_F(DumpContainerTest, DetectsCorruptBlock) {
+  {
+    DumpContainerWriter writer;
+    ASSERT_TRUE(writer.Open(path_, 4096));
+    std::string record = "payload";
+    writer.Append(1, record.data(), record.size());
+    writer.Append(2, record.data(), record.size());
+    writer.Flush(true);
+  }
+  DumpContainerBlock first;
+  {
+    DumpContainerReader reader;
+    std::string error_msg;
+    ASSERT_TRUE(reader.Open(path_, &error_msg)) << error_msg;
+    ASSERT_EQ(2u, reader.Blocks().size());
+    first = reader.Blocks()[0];
+  }
+  FILE* file = fopen(path_.c_str(), "r+b");
+  ASSERT_TRUE(file != nullptr);
+  fseek(file, first.offset_ + kDumpContainerBlockHeaderSize + 5, SEEK_SET);
+  fputc('X', file);
+  fclose(file);
+
+  DumpContainerReader reader;
+  std::string error_msg;
+  ASSERT_TRUE(reader.Open(path_, &error_msg)) << error_msg;
+  std::vector<DumpContainerRecord> records;
+  EXPECT_FALSE(reader.ReadRecords(first.kind_, &records));
+  records.clear();
+  EXPECT_TRUE(reader.ReadRecords(first.kind_ == 1 ? 2 : 1, &records));
+  EXPECT_EQ(1u, records.size());
+}
+
+}  // namespace art
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_dedup_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "unpack_hash.h"
+
+namespace art {
+
+static constexpr size_t kDumpDedupEntriesOffset =
+    kDumpDedupHeaderSize + kDumpDedupKinds * kDumpDedupKindSize;
+
+static_assert(sizeof(DumpDedupEntry) == 16, "DumpDedupEntry is written as is");
+
+DumpDedupIndex::DumpDedupIndex() : begin_(nullptr), size_(0) {}
+
+DumpDedupIndex::~DumpDedupIndex() {
+  if (begin_ != nullptr) {
+    munmap(begin_, size_);
+  }
+}
+
+bool DumpDedupIndex::Open(const std::string& path, std::string* error_msg) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error_msg = StringPrintf("open %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kDumpDedupEntriesOffset)) {
+    *error_msg = StringPrintf("%s is too short for a dedup index", path.c_str());
+    close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    *error_msg = StringPrintf("mmap %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  uint8_t* begin = reinterpret_cast<uint8_t*>(map);
+  size_t size = st.st_size;
+  uint32_t header[4];
+  memcpy(header, begin + 8, sizeof(header));
+  bool valid = memcmp(begin, kDumpDedupMagic, sizeof(kDumpDedupMagic)) == 0 &&
+      header[0] == kDumpDedupVersion && header[1] == kDumpDedupKinds;
+  if (!valid) {
+    *error_msg = StringPrintf("%s is not a version %u dedup index", path.c_str(),
+                              kDumpDedupVersion);
+  } else if (header[2] != kDumpHashFlavor) {
+    *error_msg = StringPrintf("%s was written with another hash", path.c_str());
+    valid = false;
+  } else if (crc32(crc32(0L, Z_NULL, 0), begin + kDumpDedupHeaderSize,
+                   size - kDumpDedupHeaderSize) != header[3]) {
+    *error_msg = StringPrintf("%s fails its crc", path.c_str());
+    valid = false;
+  }
+  for (uint32_t kind = 0; valid && kind < kDumpDedupKinds; ++kind) {
+    uint32_t entries;
+    uint64_t offset;
+    memcpy(&entries, begin + kDumpDedupHeaderSize + kind * kDumpDedupKindSize, 4);
+    memcpy(&offset, begin + kDumpDedupHeaderSize + kind * kDumpDedupKindSize + 8, 8);
+    if (offset < kDumpDedupEntriesOffset || offset % alignof(DumpDedupEntry) != 0 ||
+        offset > size || (size - offset) / sizeof(DumpDedupEntry) < entries) {
+      *error_msg = StringPrintf("%s has a bad entry table for kind %u", path.c_str(), kind);
+      valid = false;
+    }
+  }
+  if (!valid) {
+    munmap(map, size);
+    return false;
+  }
+  begin_ = begin;
+  size_ = size;
+  return true;
+}
+
+uint64_t DumpDedupIndex::KeyHash(uint32_t kind, const void* key, size_t size) {
+  return DumpHash(key, size, kind);
+}
+
+const DumpDedupEntry* DumpDedupIndex::EntriesOf(uint32_t kind) const {
+  uint64_t offset;
+  memcpy(&offset, begin_ + kDumpDedupHeaderSize + kind * kDumpDedupKindSize + 8, 8);
+  return reinterpret_cast<const DumpDedupEntry*>(begin_ + offset);
+}
+
+uint32_t DumpDedupIndex::Entries(uint32_t kind) const {
+  DCHECK_LT(kind, kDumpDedupKinds);
+  if (begin_ == nullptr) {
+    return 0;
+  }
+  uint32_t entries;
+  memcpy(&entries, begin_ + kDumpDedupHeaderSize + kind * kDumpDedupKindSize, 4);
+  return entries;
+}
+
+uint32_t DumpDedupIndex::NextIndex(uint32_t kind) const {
+  DCHECK_LT(kind, kDumpDedupKinds);
+  if (begin_ == nullptr) {
+    return 0;
+  }
+  uint32_t next_index;
+  memcpy(&next_index, begin_ + kDumpDedupHeaderSize + kind * kDumpDedupKindSize + 4, 4);
+  return next_index;
+}
+
+bool DumpDedupIndex::Lookup(uint32_t kind, uint64_t hash, uint32_t* index) const {
+  uint32_t entries = Entries(kind);
+  if (entries == 0) {
+    return false;
+  }
+  const DumpDedupEntry* begin = EntriesOf(kind);
+  const DumpDedupEntry* end = begin + entries;
+  DumpDedupEntry wanted;
+  wanted.hash_ = hash;
+  const DumpDedupEntry* found = std::lower_bound(begin, end, wanted);
+  if (found == end || found->hash_ != hash) {
+    return false;
+  }
+  *index = found->index_;
+  return true;
+}
+
+bool DumpDedupIndex::Save(const std::string& path,
+                          std::vector<DumpDedupEntry> added[kDumpDedupKinds],
+                          const uint32_t next_index[kDumpDedupKinds],
+                          std::string* error_msg) const {
+  std::vector<DumpDedupEntry> merged[kDumpDedupKinds];
+  std::string body(kDumpDedupKinds * kDumpDedupKindSize, '\0');
+  uint64_t offset = kDumpDedupEntriesOffset;
+  for (uint32_t kind = 0; kind < kDumpDedupKinds; ++kind) {
+    std::sort(added[kind].begin(), added[kind].end());
+    const DumpDedupEntry* old_entries = Entries(kind) != 0 ? EntriesOf(kind) : nullptr;
+    std::merge(old_entries, old_entries + Entries(kind), added[kind].begin(), added[kind].end(),
+               std::back_inserter(merged[kind]));
+    // Two keys with one hash would make lookups ambiguous; the first index wins.
+    merged[kind].erase(std::unique(merged[kind].begin(), merged[kind].end(),
+                                   [](const DumpDedupEntry& a, const DumpDedupEntry& b) {
+                                     return a.hash_ == b.hash_;
+                                   }),
+                       merged[kind].end());
+    uint32_t entries = merged[kind].size();
+    uint32_t next = std::max(next_index[kind], NextIndex(kind));
+    memcpy(&body[kind * kDumpDedupKindSize], &entries, 4);
+    memcpy(&body[kind * kDumpDedupKindSize + 4], &next, 4);
+    memcpy(&body[kind * kDumpDedupKindSize + 8], &offset, 8);
+    offset += entries * sizeof(DumpDedupEntry);
+  }
+  for (uint32_t kind = 0; kind < kDumpDedupKinds; ++kind) {
+    body.append(reinterpret_cast<const char*>(merged[kind].data()),
+                merged[kind].size() * sizeof(DumpDedupEntry));
+  }
+
+  uint32_t header[4] = {
+    kDumpDedupVersion, kDumpDedupKinds, kDumpHashFlavor,
+    static_cast<uint32_t>(crc32(crc32(0L, Z_NULL, 0),
+                                reinterpret_cast<const uint8_t*>(body.data()), body.size()))
+  };
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    *error_msg = StringPrintf("open %s: %s", temp_path.c_str(), strerror(errno));
+    return false;
+  }
+  bool written = fwrite(kDumpDedupMagic, sizeof(kDumpDedupMagic), 1, file) == 1 &&
+      fwrite(header, sizeof(header), 1, file) == 1 &&
+      fwrite(body.data(), body.size(), 1, file) == 1 &&
+      fflush(file) == 0 && fsync(fileno(file)) == 0;
+  if (fclose(file) != 0 || !written) {
+    *error_msg = StringPrintf("write %s: %s", temp_path.c_str(), strerror(errno));
+    unlink(temp_path.c_str());
+    return false;
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    *error_msg = StringPrintf("rename %s: %s", temp_path.c_str(), strerror(errno));
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace art
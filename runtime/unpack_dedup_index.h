@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_DEDUP_INDEX_H_
+#define ART_RUNTIME_UNPACK_DEDUP_INDEX_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace art {
+
+// The items every run of an app has already written, so that the next run only writes new ones:
+//
+//   index := header kind* entry*
+//   header := magic[8] version:u32 kinds:u32 hash_flavor:u32 crc:u32
+//   kind := entries:u32 next_index:u32 offset:u64
+//   entry := hash:u64 index:u32 reserved:u32
+//
+// There is a kind for every DumpItemType. The entries of a kind are sorted by hash, the 64-bit
+// DumpHash of the item's intern table key, and give the index an earlier run dumped the item at.
+// next_index is the first index no run has used. The crc covers everything after the header.
+// Indexes are only valid with the DumpHash flavour they were written with.
+
+static constexpr char kDumpDedupMagic[8] = { 'd', 'l', 'g', 'o', 'd', 'd', 'x', '\0' };
+static constexpr uint32_t kDumpDedupVersion = 1;
+static constexpr uint32_t kDumpDedupKinds = 10;
+static constexpr size_t kDumpDedupHeaderSize = 24;
+static constexpr size_t kDumpDedupKindSize = 16;
+// Longest a flush waits for queued records before giving up on updating the index.
+static constexpr uint64_t kDumpDedupDrainTimeoutMs = 2000;
+
+struct DumpDedupEntry {
+  uint64_t hash_;
+  uint32_t index_;
+  uint32_t reserved_;
+
+  bool operator<(const DumpDedupEntry& other) const {
+    return hash_ < other.hash_;
+  }
+};
+
+// Maps an index read-only. Lookups are binary searches in the mapping and take no lock. An index
+// that was never opened is empty.
+class DumpDedupIndex {
+  public:
+    DumpDedupIndex();
+    ~DumpDedupIndex();
+
+    bool Open(const std::string& path, std::string* error_msg);
+
+    // The hash entries of kind are looked up by.
+    static uint64_t KeyHash(uint32_t kind, const void* key, size_t size);
+
+    bool Lookup(uint32_t kind, uint64_t hash, uint32_t* index) const;
+
+    uint32_t Entries(uint32_t kind) const;
+    uint32_t NextIndex(uint32_t kind) const;
+
+    // Writes an index holding the entries of this one and those in added, indexed by kind, to
+    // path. The file is written next to path and renamed over it, so that a reader never sees a
+    // partial index.
+    bool Save(const std::string& path, std::vector<DumpDedupEntry> added[kDumpDedupKinds],
+              const uint32_t next_index[kDumpDedupKinds], std::string* error_msg) const;
+
+  private:
+    const DumpDedupEntry* EntriesOf(uint32_t kind) const;
+
+    uint8_t* begin_;
+    size_t size_;
+
+    DISALLOW_COPY_AND_ASSIGN(DumpDedupIndex);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_DEDUP_INDEX_H_
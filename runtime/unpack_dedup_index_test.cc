@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_dedup_index.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "unpack_intern.h"
+
+namespace art {
+
+class DumpDedupIndexTest : public testing::Test {
+  protected:
+    void SetUp() OVERRIDE {
+      const char* dir = getenv("TMPDIR");
+      path_ = std::string(dir != nullptr ? dir : "/tmp") + "/dump-dedup-XXXXXX";
+      int fd = mkstemp(&path_[0]);
+      ASSERT_NE(-1, fd);
+      close(fd);
+    }
+
+    void TearDown() OVERRIDE {
+      unlink(path_.c_str());
+    }
+
+    // One run: interns keys into a table of kind continuing from the index at path_, if any,
+    // then saves the index. Returns the indexes the keys got and which were new to the run.
+    std::vector<uint32_t> Run(uint32_t kind, const std::vector<std::string>& keys,
+                              std::vector<bool>* inserted) {
+      DumpDedupIndex index;
+      std::string error_msg;
+      index.Open(path_, &error_msg);
+      DumpInternTable table;
+      table.SetPersistent(&index, kind);
+      std::vector<uint32_t> indexes;
+      for (const std::string& key : keys) {
+        bool key_inserted;
+        indexes.push_back(table.Intern(std::hash<std::string>()(key), key, &key_inserted));
+        inserted->push_back(key_inserted);
+      }
+      std::vector<DumpDedupEntry> added[kDumpDedupKinds];
+      uint32_t next_index[kDumpDedupKinds] = {};
+      table.CollectNew(&added[kind]);
+      next_index[kind] = table.Size();
+      EXPECT_TRUE(index.Save(path_, added, next_index, &error_msg)) << error_msg;
+      return indexes;
+    }
+
+    std::string path_;
+};
+
+TEST_F(DumpDedupIndexTest, SaveAndLookup) {
+  DumpDedupIndex empty;
+  std::string error_msg;
+  // mkstemp left an empty file, which is no index.
+  EXPECT_FALSE(empty.Open(path_, &error_msg));
+  uint32_t index;
+  EXPECT_FALSE(empty.Lookup(3, 42, &index));
+  EXPECT_EQ(0u, empty.NextIndex(3));
+
+  std::vector<DumpDedupEntry> added[kDumpDedupKinds];
+  uint32_t next_index[kDumpDedupKinds] = {};
+  for (uint32_t i = 0; i < 100; ++i) {
+    added[3].push_back({ i * 7919u + 1, i, 0 });
+  }
+  added[9].push_back({ 5, 17, 0 });
+  next_index[3] = 100;
+  next_index[9] = 18;
+  ASSERT_TRUE(empty.Save(path_, added, next_index, &error_msg)) << error_msg;
+
+  DumpDedupIndex saved;
+  ASSERT_TRUE(saved.Open(path_, &error_msg)) << error_msg;
+  EXPECT_EQ(100u, saved.Entries(3));
+  EXPECT_EQ(100u, saved.NextIndex(3));
+  EXPECT_EQ(1u, saved.Entries(9));
+  EXPECT_EQ(18u, saved.NextIndex(9));
+  EXPECT_EQ(0u, saved.Entries(0));
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(saved.Lookup(3, i * 7919u + 1, &index));
+    EXPECT_EQ(i, index);
+    EXPECT_FALSE(saved.Lookup(3, i * 7919u + 2, &index));
+  }
+  // Kinds are kept apart.
+  EXPECT_FALSE(saved.Lookup(9, 1, &index));
+  ASSERT_TRUE(saved.Lookup(9, 5, &index));
+  EXPECT_EQ(17u, index);
+
+  // A flipped byte fails the crc.
+  FILE* file = fopen(path_.c_str(), "r+b");
+  ASSERT_TRUE(file != nullptr);
+  fseek(file, -3, SEEK_END);
+  fputc(0x5a, file);
+  fclose(file);
+  DumpDedupIndex damaged;
+  EXPECT_FALSE(damaged.Open(path_, &error_msg));
+  EXPECT_NE(std::string::npos, error_msg.find("crc"));
+}
+
+TEST_F(DumpDedupIndexTest, Runs) {
+  std::vector<bool> inserted;
+  std::vector<uint32_t> first = Run(4, { "a", "b", "c" }, &inserted);
+  EXPECT_EQ(std::vector<uint32_t>({ 0, 1, 2 }), first);
+  EXPECT_EQ(std::vector<bool>({ true, true, true }), inserted);
+
+  // Keys of the first run keep their indexes and are not written again; new ones follow.
+  inserted.clear();
+  std::vector<uint32_t> second = Run(4, { "d", "b", "a", "e", "d" }, &inserted);
+  EXPECT_EQ(std::vector<uint32_t>({ 3, 1, 0, 4, 3 }), second);
+  EXPECT_EQ(std::vector<bool>({ true, false, false, true, false }), inserted);
+
+  inserted.clear();
+  std::vector<uint32_t> third = Run(4, { "e", "c", "f" }, &inserted);
+  EXPECT_EQ(std::vector<uint32_t>({ 4, 2, 5 }), third);
+  EXPECT_EQ(std::vector<bool>({ false, false, true }), inserted);
+
+  DumpDedupIndex index;
+  std::string error_msg;
+  ASSERT_TRUE(index.Open(path_, &error_msg)) << error_msg;
+  EXPECT_EQ(6u, index.Entries(4));
+  EXPECT_EQ(6u, index.NextIndex(4));
+
+  DumpInternTable table;
+  table.SetPersistent(&index, 4);
+  bool key_inserted;
+  EXPECT_EQ(5u, table.Intern(1, "f", &key_inserted));
+  EXPECT_FALSE(key_inserted);
+  EXPECT_EQ(1u, table.GetStats().reused_);
+}
+
+}  // namespace art
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_dex_memo.h"
+
+#include "dex_file.h"
+
+namespace art {
+
+DumpDexMemo::DumpDexMemo(const DexFile& dex_file, uint32_t location) : location_(location) {
+  sizes_[kDumpMemoString] = dex_file.NumStringIds();
+  sizes_[kDumpMemoType] = dex_file.NumTypeIds();
+  sizes_[kDumpMemoField] = dex_file.NumFieldIds();
+  sizes_[kDumpMemoMethod] = dex_file.NumMethodIds();
+  for (int kind = 0; kind < kDumpMemoKinds; ++kind) {
+    slots_[kind] = new Atomic<uint32_t>[sizes_[kind]];
+    for (uint32_t i = 0; i < sizes_[kind]; ++i) {
+      slots_[kind][i].StoreRelaxed(kNotDumped);
+    }
+  }
+}
+
+DumpDexMemo::~DumpDexMemo() {
+  for (int kind = 0; kind < kDumpMemoKinds; ++kind) {
+    delete[] slots_[kind];
+  }
+}
+
+}  // namespace art
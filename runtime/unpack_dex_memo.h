@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_DEX_MEMO_H_
+#define ART_RUNTIME_UNPACK_DEX_MEMO_H_
+
+#include <stdint.h>
+
+#include "atomic.h"
+#include "base/logging.h"
+#include "base/macros.h"
+
+namespace art {
+
+class DexFile;
+
+enum DumpMemoKind {
+  kDumpMemoString = 0,
+  kDumpMemoType,
+  kDumpMemoField,
+  kDumpMemoMethod,
+  kDumpMemoKinds
+};
+
+// The output index each string, type, field and method id of one dex file was dumped at.
+//
+// The item DumpXxxFromDex builds for an id depends only on the dex file, and the intern tables
+// never forget an item, so the index GeneralDump returns for it never changes. Once an id has
+// been dumped, the next DumpXxxFromDex for it is a single load from the array of its kind, which
+// is sized from the dex header. Threads that miss at the same time both dump the id and store
+// the same index. Lookups write nothing shared: the Dumper counts hits and misses in the
+// per-thread DumpMetrics counters.
+class DumpDexMemo {
+  public:
+    // location is the DumpLocationTable id of the dex file's location.
+    DumpDexMemo(const DexFile& dex_file, uint32_t location);
+    ~DumpDexMemo();
+
+    uint32_t Location() const {
+      return location_;
+    }
+
+    bool Lookup(DumpMemoKind kind, uint32_t id, uint32_t* dumped_idx) {
+      DCHECK_LT(id, sizes_[kind]);
+      uint32_t slot = slots_[kind][id].LoadRelaxed();
+      if (slot == kNotDumped) {
+        return false;
+      }
+      *dumped_idx = slot - 1;
+      return true;
+    }
+
+    void Store(DumpMemoKind kind, uint32_t id, uint32_t dumped_idx) {
+      DCHECK_LT(id, sizes_[kind]);
+      slots_[kind][id].StoreRelaxed(dumped_idx + 1);
+    }
+
+  private:
+    static constexpr uint32_t kNotDumped = 0;
+
+    const uint32_t location_;
+    uint32_t sizes_[kDumpMemoKinds];
+    // Dumped index plus one, or kNotDumped.
+    Atomic<uint32_t>* slots_[kDumpMemoKinds];
+
+    DISALLOW_COPY_AND_ASSIGN(DumpDexMemo);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_DEX_MEMO_H_
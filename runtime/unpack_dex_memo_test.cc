@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_dex_memo.h"
+
+#include <string.h>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+#include "dex_file.h"
+
+namespace art {
+
+// A dex file made of a header only. DumpDexMemo looks at nothing but the id counts.
+class DumpDexMemoTest : public testing::Test {
+  protected:
+    void SetUp() OVERRIDE {
+      memset(header_, 0, sizeof(header_));
+      DexFile::Header* header = reinterpret_cast<DexFile::Header*>(header_);
+      memcpy(header->magic_, "dex\n035", 8);
+      header->string_ids_size_ = 1000;
+      header->type_ids_size_ = 100;
+      header->field_ids_size_ = 10;
+      header->method_ids_size_ = 1;
+      std::string error_msg;
+      dex_file_ = DexFile::Open(reinterpret_cast<const uint8_t*>(header_), sizeof(header_),
+                                "header.dex", 0, nullptr, &error_msg);
+      ASSERT_TRUE(dex_file_.get() != nullptr) << error_msg;
+    }
+
+    uint32_t header_[sizeof(DexFile::Header) / sizeof(uint32_t)];
+    std::unique_ptr<const DexFile> dex_file_;
+};
+
+TEST_F(DumpDexMemoTest, LookupAndStore) {
+  DumpDexMemo memo(*dex_file_, 3);
+  EXPECT_EQ(3u, memo.Location());
+  uint32_t idx = 12345;
+  EXPECT_FALSE(memo.Lookup(kDumpMemoString, 999, &idx));
+  EXPECT_EQ(12345u, idx);
+  memo.Store(kDumpMemoString, 999, 0);
+  EXPECT_TRUE(memo.Lookup(kDumpMemoString, 999, &idx));
+  EXPECT_EQ(0u, idx);
+  // Kinds are kept apart.
+  EXPECT_FALSE(memo.Lookup(kDumpMemoType, 99, &idx));
+  memo.Store(kDumpMemoType, 99, 7);
+  memo.Store(kDumpMemoField, 9, 8);
+  memo.Store(kDumpMemoMethod, 0, 9);
+  EXPECT_TRUE(memo.Lookup(kDumpMemoType, 99, &idx));
+  EXPECT_EQ(7u, idx);
+  EXPECT_TRUE(memo.Lookup(kDumpMemoField, 9, &idx));
+  EXPECT_EQ(8u, idx);
+  EXPECT_TRUE(memo.Lookup(kDumpMemoMethod, 0, &idx));
+  EXPECT_EQ(9u, idx);
+  EXPECT_FALSE(memo.Lookup(kDumpMemoString, 99, &idx));
+}
+
+}  // namespace art
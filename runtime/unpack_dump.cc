@@ -15,20 +15,29 @@
  */
 
 #include <fstream>
+#include <sstream>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "unpack_dump.h"
 
 #include "base/logging.h"
+#include "base/stringprintf.h"
 #include "dex_file-inl.h"
 #include "art_method.h"
 #include "art_method-inl.h"
 #include "leb128.h"
 #include "mirror/method.h"
 #include "mirror/abstract_method.h"
+#include "barrier.h"
+#include "runtime.h"
+#include "scoped_thread_state_change.h"
+#include "thread_list.h"
+#include "unpack_hash.h"
+#include "utils.h"
 
 namespace art {
 
@@ -47,6 +56,12 @@ namespace art {
 // #undef WRITE_FILE
 
 Dumper* Dumper::sInstance = NULL;
+// Serializes building the Dumper.
+static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void inline DumpBase::AppendKeyBytes(std::string* key, const void* data, size_t size) {
+  key->append(reinterpret_cast<const char*>(data), size);
+}
 
 size_t inline DumpBase::HashInt(uint32_t x) {
   x = ((x >> 16) ^ x) * 0x45d9f3b;
@@ -74,10 +89,11 @@ size_t DumpBase::HashValue() {
   return 17;
 }
 
-void DumpString::Output(FILE* file) {
+size_t DumpString::Output(FILE* file) {
   fwrite(&array_idx_, 4, 1, file);
   fwrite(&string_length_, 4, 1, file);
   fwrite(string_.data(), string_.size() + 1, 1, file);
+  return 4 + 4 + string_.size() + 1;
 }
 
 std::string DumpString::ToString() {
@@ -95,9 +111,15 @@ size_t DumpString::HashValue() {
   return v;
 }
 
-void DumpType::Output(FILE* file) {
+void DumpString::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &string_length_, 4);
+  key->append(string_);
+}
+
+size_t DumpType::Output(FILE* file) {
   fwrite(&array_idx_, 4, 1, file);
   fwrite(&descriptor_idx_, 4, 1, file);
+  return 4 + 4;
 }
 
 std::string DumpType::ToString() {
@@ -114,7 +136,11 @@ size_t DumpType::HashValue() {
   return v;
 }
 
-void DumpProto::Output(FILE* file) {
+void DumpType::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &descriptor_idx_, 4);
+}
+
+size_t DumpProto::Output(FILE* file) {
   fwrite(&array_idx_, 4, 1, file);
   fwrite(&shorty_idx_, 4, 1, file);
   fwrite(&return_type_idx_, 2, 1, file);
@@ -123,6 +149,7 @@ void DumpProto::Output(FILE* file) {
   for (uint16_t t : param_types_) {
     fwrite(&t, 2, 1, file);
   }
+  return 4 + 4 + 2 + 4 + 2 * sp;
 }
 
 std::string DumpProto::ToString() {
@@ -155,11 +182,18 @@ size_t DumpProto::HashValue() {
   return v;
 }
 
-void DumpField::Output(FILE* file) {
+void DumpProto::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &shorty_idx_, 4);
+  AppendKeyBytes(key, &return_type_idx_, 2);
+  AppendKeyBytes(key, param_types_.data(), 2 * param_types_.size());
+}
+
+size_t DumpField::Output(FILE* file) {
   fwrite(&array_idx_, 4, 1, file);
   fwrite(&class_idx_, 2, 1, file);
   fwrite(&type_idx_, 2, 1, file);
   fwrite(&name_idx_, 4, 1, file);
+  return 4 + 2 + 2 + 4;
 }
 
 std::string DumpField::ToString() {
@@ -179,11 +213,18 @@ size_t DumpField::HashValue() {
   return v;
 }
 
-void DumpMethod::Output(FILE* file) {
+void DumpField::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &class_idx_, 2);
+  AppendKeyBytes(key, &type_idx_, 2);
+  AppendKeyBytes(key, &name_idx_, 4);
+}
+
+size_t DumpMethod::Output(FILE* file) {
   fwrite(&array_idx_, 4, 1, file);
   fwrite(&class_idx_, 2, 1, file);
   fwrite(&proto_idx_, 2, 1, file);
   fwrite(&name_idx_, 4, 1, file);
+  return 4 + 2 + 2 + 4;
 }
 
 std::string DumpMethod::ToString() {
@@ -203,7 +244,13 @@ size_t DumpMethod::HashValue() {
   return v;
 }
 
-void DumpClassDef::Output(FILE* file) {
+void DumpMethod::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &class_idx_, 2);
+  AppendKeyBytes(key, &proto_idx_, 2);
+  AppendKeyBytes(key, &name_idx_, 4);
+}
+
+size_t DumpClassDef::Output(FILE* file) {
   fwrite(&array_idx_, 4, 1, file);
   fwrite(&class_idx_, 2, 1, file);
   fwrite(&access_flags_, 4, 1, file);
@@ -214,6 +261,7 @@ void DumpClassDef::Output(FILE* file) {
     fwrite(&idx, 2, 1, file);
   }
   fwrite(&source_file_idx_, 4, 1, file);
+  return 4 + 2 + 4 + 2 + 4 + 2 * interface_types_.size() + 4;
 }
 
 std::string DumpClassDef::ToString() {
@@ -250,15 +298,26 @@ size_t DumpClassDef::HashValue() {
   return v;
 }
 
-void DumpStaticValue::Output(FILE* file) {
+void DumpClassDef::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &class_idx_, 2);
+  AppendKeyBytes(key, &access_flags_, 4);
+  AppendKeyBytes(key, &superclass_idx_, 2);
+  AppendKeyBytes(key, &source_file_idx_, 4);
+  AppendKeyBytes(key, interface_types_.data(), 2 * interface_types_.size());
+}
+
+size_t DumpStaticValue::Output(FILE* file) {
   fwrite(&class_idx_, 4, 1, file);
-  uint32_t size = values_.size();
-  fwrite(&size, 4, 1, file);
+  uint32_t count = values_.size();
+  fwrite(&count, 4, 1, file);
+  size_t size = 4 + 4;
   for (auto item : values_) {
     fwrite(&item.first, 4, 1, file);
     fwrite(&item.second.first, 2, 1, file);
     fwrite(item.second.second, item.second.first, 1, file);
+    size += 4 + 2 + item.second.first;
   }
+  return size;
 }
 
 std::string DumpStaticValue::ToString() {
@@ -294,7 +353,23 @@ bool DumpStaticValue::operator==(const DumpStaticValue& rhs) const {
 
 size_t DumpStaticValue::HashValue() {
   size_t v = DumpBase::HashValue();
-  return CombineHash(v, class_idx_);
+  v = CombineHash(v, class_idx_);
+  // Classes of one app often share their static values' class, so the values go in as well.
+  uint64_t h = v;
+  for (auto& item : values_) {
+    h = DumpHash(&item.first, 4, h);
+    h = DumpHash(item.second.second, item.second.first, h);
+  }
+  return DumpHashToSize(h);
+}
+
+void DumpStaticValue::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &class_idx_, 4);
+  for (auto item : values_) {
+    AppendKeyBytes(key, &item.first, 4);
+    AppendKeyBytes(key, &item.second.first, 2);
+    AppendKeyBytes(key, item.second.second, item.second.first);
+  }
 }
 
 DumpStaticValue::~DumpStaticValue() {
@@ -304,7 +379,7 @@ DumpStaticValue::~DumpStaticValue() {
   values_.clear();
 }
 
-void DumpCodeItem::Output(FILE* file) {
+size_t DumpCodeItem::Output(FILE* file) {
   fwrite(&method_idx_, 4, 1, file);
   fwrite(&current_clz_name_idx_, 4, 1, file);
   fwrite(&registers_size_, 2, 1, file);
@@ -312,6 +387,7 @@ void DumpCodeItem::Output(FILE* file) {
   fwrite(&outs_size_, 2, 1, file);
   fwrite(&insns_size_in_code_units_, 4, 1, file);
   fwrite(insns_, insns_size_in_code_units_ * 2, 1, file);
+  return 4 + 4 + 2 + 2 + 2 + 4 + insns_size_in_code_units_ * 2;
 }
 
 std::string DumpCodeItem::ToString() {
@@ -342,21 +418,26 @@ size_t DumpCodeItem::HashValue() {
   v = CombineHash(v, outs_size_);
   v = CombineHash(v, insns_size_in_code_units_);
   v = CombineHash(v, method_idx_);
+  return DumpHashToSize(DumpHash(insns_, insns_size_in_code_units_ * 2, v));
+}
 
-  for (uint32_t i = 0; i < insns_size_in_code_units_; ++i) {
-    v = CombineHash(v, insns_[i]);
-  }
-  return v;
+void DumpCodeItem::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &method_idx_, 4);
+  AppendKeyBytes(key, &registers_size_, 2);
+  AppendKeyBytes(key, &ins_size_, 2);
+  AppendKeyBytes(key, &outs_size_, 2);
+  AppendKeyBytes(key, insns_, insns_size_in_code_units_ * 2);
 }
 
 DumpCodeItem::~DumpCodeItem() {
-  delete insns_;
+  delete[] insns_;
 }
 
-void DumpEncodedField::Output(FILE* file) {
+size_t DumpEncodedField::Output(FILE* file) {
   fwrite(&type_, 4, 1, file);
   fwrite(&field_idx_, 4, 1, file);
   fwrite(&access_flags_, 4, 1, file);
+  return 4 + 4 + 4;
 }
 
 std::string DumpEncodedField::ToString() {
@@ -374,10 +455,16 @@ size_t DumpEncodedField::HashValue() {
   return v;
 }
 
-void DumpEncodedMethod::Output(FILE* file) {
+void DumpEncodedField::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &type_, 4);
+  AppendKeyBytes(key, &field_idx_, 4);
+}
+
+size_t DumpEncodedMethod::Output(FILE* file) {
   fwrite(&type_, 4, 1, file);
   fwrite(&method_idx_, 4, 1, file);
   fwrite(&access_flags_, 4, 1, file);
+  return 4 + 4 + 4;
 }
 
 std::string DumpEncodedMethod::ToString() {
@@ -395,122 +482,168 @@ size_t DumpEncodedMethod::HashValue() {
   return v;
 }
 
-std::string ForceBranch::ToString() {
-  return class_ + " " + name_ + " " + shorty_ + " " + std::to_string((uint32_t)dex_pc_) + "," + std::to_string(force_offset_);
+void DumpEncodedMethod::AppendKey(std::string* key) {
+  AppendKeyBytes(key, &type_, 4);
+  AppendKeyBytes(key, &method_idx_, 4);
 }
 
-bool ForceBranch::operator==(const ForceBranch& rhs) const {
-  if (dex_pc_ != rhs.dex_pc_) {
-//    LOG(ERROR) << "different dex_pc " << std::to_string(dex_pc_) << "," << std::to_string(rhs.dex_pc_);
-    return false;
-  }
-  if (class_.compare(rhs.class_) != 0) {
-//    LOG(ERROR) << "different class_ " << class_ << "," << rhs.class_;
-    return false;
-  }
-  if (name_.compare(rhs.name_) != 0) {
-//    LOG(ERROR) << "different name_ " << name_ << "," << rhs.name_;
-    return false;
-  }
-  if (shorty_.compare(rhs.shorty_) != 0) {
-//    LOG(ERROR) << "different shorty_ " << shorty_ << "," << rhs.shorty_;
-    return false;
-  }
-  if (return_type_.compare(rhs.return_type_) != 0) {
-//    LOG(ERROR) << "different return_type_ " << return_type_ << "," << rhs.return_type_;
-    return false;
+int32_t Dumper::GetForceBranch(ArtMethod* method, uint32_t dex_pc) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  return force_branches_.LoadSequentiallyConsistent()->Take(*method->GetDexFile(), method->GetDexMethodIndex(), dex_pc);
+}
+
+bool Dumper::ResolveForceBranches(ArtMethod* method) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  EntryHookInfo* info = method->GetHookInfo();
+  ForceBranchIndex* index = force_branches_.LoadSequentiallyConsistent();
+  // The tag is the generation of the index it was resolved against, shifted left by one, with
+  // the answer in the low bit. Racing writers store the same value.
+  uint32_t tag = info->force_branches;
+  if ((tag >> 1) != index->Generation()) {
+    bool found = index->ResolveMethod(*method->GetDexFile(), method->GetDexMethodIndex());
+    tag = (index->Generation() << 1) | (found ? 1 : 0);
+    info->force_branches = tag;
   }
+  return (tag & 1) != 0;
+}
 
-
-//  if (class_.compare(rhs.class_) != 0 || name_.compare(rhs.name_) != 0 ||
-//      shorty_.compare(rhs.shorty_) != 0 || return_type_.compare(rhs.return_type_) != 0) {
-//    return false;
-//  }
-  uint32_t size = param_types_.size();
-  if (size != rhs.param_types_.size()) {
-//    LOG(ERROR) << "different param size " << std::to_string(size) << "," << std::to_string(rhs.param_types_.size());
-    return false;
-  }
-  for (uint32_t i = 0; i < size; ++i) {
-    if (param_types_[i].compare(rhs.param_types_[i]) != 0) {
-//      LOG(ERROR) << "different param " << param_types_[i] << " " << rhs.param_types_[i];
-//          << " " << std::to_string(param_types_[i].length()) << " " << std::to_string(rhs.param_types_[i].length()) <<
-//          " " << std::to_string(param_types_[i].compare(rhs.param_types_[i]));
-      return false;
+int32_t Dumper::ChooseBranch(Thread* self, const ShadowFrame& shadow_frame,
+                             const Instruction* inst, uint32_t dex_pc) {
+  ArtMethod* method = shadow_frame.GetMethod();
+  if (ResolveForceBranches(method)) {
+    int32_t offset = GetForceBranch(method, dex_pc);
+    if (offset != 0) {
+      return offset;
     }
   }
-
-  return true;
+  if (!explorer_.Enabled()) {
+    return 0;
+  }
+  return ExploreBranch(self, shadow_frame, inst, dex_pc);
 }
 
-int32_t Dumper::GetForceBranch(ArtMethod* method, uint32_t dex_pc) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-// ForceBranchRet Dumper::GetForceBranch(ArtMethod* method, uint32_t dex_pc) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  if (!ForceExecution()) {
+int32_t Dumper::ExploreBranch(Thread* self, const ShadowFrame& shadow_frame,
+                              const Instruction* inst, uint32_t dex_pc) {
+  int32_t outcomes[kExploreMaxOutcomes];
+  size_t count = ForkExplorer::BranchOutcomes(inst, shadow_frame, outcomes);
+  ArtMethod* method = shadow_frame.GetMethod();
+  if (count < 2 || !explorer_.Claim(reinterpret_cast<uintptr_t>(method->GetDexFile()),
+                                    method->GetDexMethodIndex(), dex_pc)) {
     return 0;
-//    return FORCE_NONE;
   }
-  uint32_t size = force_branches_.size();
-  if (0 == size) {
-    return 0;
-//    return FORCE_NONE;
+  // As the zygote does before forking an app: every other thread is stopped at a suspend
+  // point, where it holds no lock of the collector, and the recording thread between batches.
+  // A child has only the calling thread; whatever waits for the others there, a full GC among
+  // them, hangs until the watchdog ends it.
+  self->TransitionFromRunnableToSuspended(kSuspended);
+  ThreadList* thread_list = Runtime::Current()->GetThreadList();
+  thread_list->SuspendAll(__FUNCTION__);
+  PauseRecording();
+  int32_t taken = 0;
+  size_t slots = explorer_.Slots();
+  for (size_t i = 1; i < count && slots > 0; ++i, --slots) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      taken = outcomes[i];
+      AfterExploreFork();
+      break;
+    }
+    if (pid < 0) {
+      PLOG(ERROR) << "explore fork failed";
+      explorer_.Failed();
+      break;
+    }
+    explorer_.Started(pid);
   }
+  if (taken == 0) {
+    ResumeRecording();
+  }
+  thread_list->ResumeAll();
+  self->TransitionFromSuspendedToRunnable();
+  return taken;
+}
+
+void Dumper::PauseRecording() {
+  pthread_mutex_lock(&recording_pause_mutex_);
+  recording_pause_requested_ = true;
+  while (!recording_paused_) {
+    // The recording thread may be parked on an empty queue for a whole flush interval.
+    queue_.Interrupt();
+    timespec ts;
+    InitTimeSpec(true, CLOCK_REALTIME, 1, 0, &ts);
+    pthread_cond_timedwait(&recording_pause_cond_, &recording_pause_mutex_, &ts);
+  }
+  pthread_mutex_unlock(&recording_pause_mutex_);
+}
 
-  ForceBranch current;
-  current.dex_pc_ = dex_pc;
-  const DexFile& file = *method->GetDexFile();
-  uint32_t method_idx = method->GetDexMethodIndex();
-  uint32_t length = 0;
-
-  const DexFile::MethodId& method_id = file.GetMethodId(method_idx);
-
-  const DexFile::TypeId& class_type_id = file.GetTypeId(method_id.class_idx_);
-  const DexFile::StringId& class_string_id = file.GetStringId(class_type_id.descriptor_idx_);
-  current.class_ = std::string(file.GetStringDataAndUtf16Length(class_string_id, &length));
-
-  const DexFile::StringId& name_string_id = file.GetStringId(method_id.name_idx_);
-  current.name_ = std::string(file.GetStringDataAndUtf16Length(name_string_id, &length));
-
-  const DexFile::ProtoId& proto_id = file.GetProtoId(method_id.proto_idx_);
-
-  const DexFile::StringId& shorty_string_id = file.GetStringId(proto_id.shorty_idx_);
-  current.shorty_ = std::string(file.GetStringDataAndUtf16Length(shorty_string_id, &length));
-
-  const DexFile::TypeId& return_type_type_id = file.GetTypeId(proto_id.return_type_idx_);
-  const DexFile::StringId& return_type_string_id = file.GetStringId(return_type_type_id.descriptor_idx_);
-  current.return_type_ = std::string(file.GetStringDataAndUtf16Length(return_type_string_id, &length));
+void Dumper::ResumeRecording() {
+  pthread_mutex_lock(&recording_pause_mutex_);
+  recording_pause_requested_ = false;
+  pthread_cond_broadcast(&recording_pause_cond_);
+  pthread_mutex_unlock(&recording_pause_mutex_);
+}
 
-  if (proto_id.parameters_off_ != 0) {
-    const DexFile::TypeList* list = file.GetProtoParameters(proto_id);
-    uint32_t param_size = list->Size();
-    uint32_t idx;
-    for (idx = 0; idx < param_size; ++idx) {
-      const DexFile::TypeItem& item = list->GetTypeItem(idx);
-      const DexFile::TypeId& param_type_id = file.GetTypeId(item.type_idx_);
-      const DexFile::StringId& param_string_id = file.GetStringId(param_type_id.descriptor_idx_);
-      std::string param_string = std::string(file.GetStringDataAndUtf16Length(param_string_id, &length));
-      current.param_types_.push_back(param_string);
+void Dumper::CheckRecordingPause() {
+  pthread_mutex_lock(&recording_pause_mutex_);
+  if (recording_pause_requested_) {
+    recording_paused_ = true;
+    pthread_cond_broadcast(&recording_pause_cond_);
+    while (recording_pause_requested_) {
+      pthread_cond_wait(&recording_pause_cond_, &recording_pause_mutex_);
     }
+    recording_paused_ = false;
   }
-
-  if (!strstr(current.name_.c_str(), "jacoco")) {
-    LOG(ERROR) << "Try to find ifBranch:" << current.ToString() << " " << dex_pc;
+  pthread_mutex_unlock(&recording_pause_mutex_);
+}
+
+void Dumper::AfterExploreFork() {
+  // The recording thread of the parent is gone, maybe inside the pause lock.
+  pthread_mutex_init(&recording_pause_mutex_, NULL);
+  pthread_cond_init(&recording_pause_cond_, NULL);
+  recording_pause_requested_ = false;
+  recording_paused_ = false;
+  explorer_.EnterChild();
+
+  // Files are named after the pid; the run's random prefix is kept, grouping the files of the
+  // children with those of the parent.
+  std::string parent_tag = StringPrintf("/%d_%s_", pid_, random_prefix_.c_str());
+  pid_ = getpid();
+  locations_.Rename(parent_tag, StringPrintf("/%d_%s_", pid_, random_prefix_.c_str()));
+  // The parent writes what it queued and staged. The child's files only hold the items it
+  // collects after the fork; the intern tables it inherited skip the others.
+  DumpItem* items[kRecordingBatchSize];
+  size_t count;
+  while ((count = queue_.remove(items, kRecordingBatchSize, 0)) != 0) {
+    for (size_t i = 0; i < count; ++i) {
+      budget_.Release(kDumpBudgetQueue, items[i]->charge_);
+      delete items[i]->item_;
+      delete items[i];
+    }
   }
+  writer_.AbandonAfterFork();
+  // The parent alone updates the dedup index.
+  dedup_index_path_.clear();
 
-  for (uint32_t i = 0; i < size; ++i) {
-    ForceBranch* branch = force_branches_[i];
-    if (current == *branch) {
-      if (branch->reached_) {
-        LOG(ERROR) << "ForceBranch found, but reached";
-      } else {
-        LOG(ERROR) << "ForceBranch found:" << branch->ToString();
-        branch->reached_ = true;
-        return branch->force_offset_;
-      }
-    }
+  int rc = pthread_create(&recording_thread_, NULL, DumpRun, this);
+  if (rc) {
+    LOG(FATAL) << "create thread for recording failed! " << rc;
   }
+  pthread_t watchdog;
+  rc = pthread_create(&watchdog, NULL, ExploreWatchdog, this);
+  if (rc) {
+    LOG(FATAL) << "create thread for explore watchdog failed! " << rc;
+  }
+  pthread_detach(watchdog);
+  LOG(ERROR) << "explore child pid=" << pid_ << " depth=" << explorer_.Depth();
+}
 
-  return 0;
-//  return FORCE_NONE;
+void* Dumper::ExploreWatchdog(void* arg) {
+  Dumper* dumper = reinterpret_cast<Dumper*>(arg);
+  NanoSleep(MsToNs(dumper->explorer_.BudgetMs()));
+  bool drained = dumper->WaitForQueueDrained(kExploreDrainTimeoutMs);
+  dumper->FlushOutput();
+  dumper->LogExploreStats();
+  LOG(ERROR) << "explore child pid=" << dumper->pid_ << " out of budget drained=" << drained;
+  // Not exit(): the handlers of the runtime would run on a thread it does not know.
+  _exit(0);
 }
 
 void Dumper::ToDumpQueueUnblock(DumpItem* item) {
@@ -524,7 +657,13 @@ void Dumper::ToDumpQueueUnblock(DumpItem* item) {
 //      LOG(FATAL) << "detach thread failed! " << rc;
 //    }
 //  }
-  queue_.add(item);
+  budget_.Charge(kDumpBudgetQueue, item->charge_);
+  // Only fails under kRecordingQueueDrop; the record is lost but the caller never waits.
+  if (!queue_.add(item)) {
+    budget_.Release(kDumpBudgetQueue, item->charge_);
+    delete item->item_;
+    delete item;
+  }
 }
 
 //  void* Dumper::ToDumpQueue(void* item) {
@@ -532,59 +671,386 @@ void Dumper::ToDumpQueueUnblock(DumpItem* item) {
 //    return nullptr;
 //  }
 
-void* Dumper::DumpRun(__attribute__((unused))void* unused) {
+void* Dumper::DumpRun(void* arg) {
+  // Passed in rather than read from sInstance, which is only set once the constructor returns.
+  Dumper* dumper = reinterpret_cast<Dumper*>(arg);
+  DumpItem* items[kRecordingBatchSize];
   while (true) {
-    DumpItem* item = sInstance->queue_.remove();
-#ifdef TIME_EVALUATION
-    struct timeval t1, t2;
-    gettimeofday(&t1, NULL);
-#endif
-    FILE* dump_file = fopen(item->path_.c_str(), "ab+");
-    item->item_->Output(dump_file);
-    fflush(dump_file);
-    fclose(dump_file);
-#ifdef TIME_EVALUATION
-    gettimeofday(&t2, NULL);
-    sInstance->addTimeMeasure(t1, t2, WRITE_F);
-#endif
+    dumper->CheckRecordingPause();
+    size_t count = dumper->queue_.remove(items, kRecordingBatchSize, kDumpWriterFlushIntervalMs);
+    dumper->WriteItems(items, count);
+    if (dumper->flush_requested_) {
+      dumper->flush_requested_ = 0;
+      // App processes are mostly killed rather than exited, so this is where the dedup index is
+      // usually saved.
+      dumper->FlushOutput();
+      dumper->writer_.DumpStats();
+      RecordingQueueStats stats = dumper->queue_.GetStats();
+      LOG(ERROR) << "queue stats dequeued=" << stats.dequeued_ << " dropped=" << stats.dropped_
+          << " spilled=" << stats.spilled_ << " parked=" << stats.parked_;
+      dumper->LogInternStats();
+      dumper->LogArenaStats();
+      dumper->LogCollectionStats();
+      dumper->LogForceBranchStats();
+      dumper->LogDexMemoStats();
+      dumper->LogTraceStats();
+      dumper->LogMetrics();
+      dumper->LogBudgetStats();
+      dumper->LogExploreStats();
+    } else {
+      dumper->writer_.FlushExpired();
+    }
+  }
+}
+
+static void LogInternTable(const char* kind, DumpInternTable& table) {
+  DumpInternStats stats = table.GetStats();
+  LOG(ERROR) << "intern stats " << kind << " size=" << stats.size_ << " key_bytes=" << stats.key_bytes_
+      << " probes=" << stats.probes_ << " collisions=" << stats.collisions_
+      << " resizes=" << stats.resizes_ << " reused=" << stats.reused_;
+}
+
+void Dumper::LogInternStats() {
+  LogInternTable(STRING_FILE, strings_);
+  LogInternTable(TYPE_FILE, types_);
+  LogInternTable(PROTO_FILE, protos_);
+  LogInternTable(FIELD_FILE, fields_);
+  LogInternTable(METHOD_FILE, methods_);
+  LogInternTable(CLASS_FILE, classes_);
+  LogInternTable(STATIC_VALUE_FILE, static_values_);
+  LogInternTable(ENCODED_FIELD_FILE, encoded_fields_);
+  LogInternTable(ENCODED_METHOD_FILE, encoded_methods_);
+  LogInternTable(CODE_FILE, codes_);
+}
+
+CollectionArena* Dumper::GetCollectionArena() {
+  CollectionArena* arena = reinterpret_cast<CollectionArena*>(pthread_getspecific(arena_key_));
+  if (arena == nullptr) {
+    arena = new CollectionArena(GetTid(), Runtime::Current()->GetArenaPool());
+    pthread_setspecific(arena_key_, arena);
+    pthread_mutex_lock(&arena_mutex_);
+    arenas_.push_back(arena);
+    pthread_mutex_unlock(&arena_mutex_);
+  }
+  return arena;
+}
+
+// Runs on thread exit. By then no collected invocation of the thread is active.
+void Dumper::ReleaseCollectionArena(void* ptr) {
+  CollectionArena* arena = reinterpret_cast<CollectionArena*>(ptr);
+  pthread_mutex_lock(&sInstance->arena_mutex_);
+  auto it = std::find(sInstance->arenas_.begin(), sInstance->arenas_.end(), arena);
+  if (it != sInstance->arenas_.end()) {
+    sInstance->arenas_.erase(it);
+  }
+  pthread_mutex_unlock(&sInstance->arena_mutex_);
+  sInstance->budget_.Release(kDumpBudgetTrace, arena->charged_bytes_);
+  LOG(ERROR) << "arena stats tid=" << arena->tid_ << " exited peak=" << arena->peak_bytes_.LoadRelaxed()
+      << " invocations=" << arena->invocations_.LoadRelaxed();
+  delete arena;
+}
+
+void Dumper::LogArenaStats() {
+  pthread_mutex_lock(&arena_mutex_);
+  size_t max_peak = 0;
+  for (CollectionArena* arena : arenas_) {
+    size_t peak = arena->peak_bytes_.LoadRelaxed();
+    LOG(ERROR) << "arena stats tid=" << arena->tid_ << " peak=" << peak
+        << " invocations=" << arena->invocations_.LoadRelaxed();
+    max_peak = std::max(max_peak, peak);
+  }
+  LOG(ERROR) << "arena stats threads=" << arenas_.size() << " max_peak=" << max_peak;
+  pthread_mutex_unlock(&arena_mutex_);
+}
+
+CollectionState* Dumper::NewCollectionState() {
+  CollectionState* state = new CollectionState(sampling_);
+  pthread_mutex_lock(&collection_states_mutex_);
+  collection_states_.push_back(state);
+  pthread_mutex_unlock(&collection_states_mutex_);
+  return state;
+}
+
+void Dumper::LogCollectionStats() {
+  CollectionStateStats stats;
+  pthread_mutex_lock(&collection_states_mutex_);
+  for (CollectionState* state : collection_states_) {
+    state->AddStats(&stats);
+  }
+  pthread_mutex_unlock(&collection_states_mutex_);
+  LOG(ERROR) << "collection stats methods=" << stats.methods_ << " saturated=" << stats.saturated_
+      << " edges=" << stats.edges_ << " traced=" << stats.traced_ << " skipped=" << stats.skipped_
+      << " sampled=" << stats.sampled_ << " resumed=" << stats.resumed_;
+}
+
+DumpDexMemo* Dumper::GetDexMemo(const DexFile& file) {
+  DumpDexMemo* memo = file.GetDumpMemo();
+  if (LIKELY(memo != nullptr)) {
+    return memo;
+  }
+  std::hash<std::string> hash;
+  const std::string& location = file.GetLocation();
+  std::string path = StringPrintf("/data/data/%s/revealer/%d_%s_%zu.dlc", package_name_.c_str(),
+                                  pid_, random_prefix_.c_str(), hash(location));
+  memo = new DumpDexMemo(file, locations_.Intern(location, path));
+  if (!file.CasDumpMemo(memo)) {
+    delete memo;
+    return file.GetDumpMemo();
+  }
+  pthread_mutex_lock(&dex_memos_mutex_);
+  dex_memos_.push_back(memo);
+  pthread_mutex_unlock(&dex_memos_mutex_);
+  return memo;
+}
+
+void Dumper::LogDexMemoStats() {
+  static const char* const kKindNames[kDumpMemoKinds] = { "string", "type", "field", "method" };
+  pthread_mutex_lock(&dex_memos_mutex_);
+  size_t dex_files = dex_memos_.size();
+  pthread_mutex_unlock(&dex_memos_mutex_);
+  DumpMetricsSnapshot snapshot = metrics_.Snapshot();
+  for (int kind = 0; kind < kDumpMemoKinds; ++kind) {
+    uint64_t hits = snapshot.counters_[kDumpCounterMemoHits + kind];
+    uint64_t misses = snapshot.counters_[kDumpCounterMemoMisses + kind];
+    uint64_t lookups = hits + misses;
+    LOG(ERROR) << "dex memo stats " << kKindNames[kind] << " dex_files=" << dex_files
+        << " hits=" << hits << " misses=" << misses
+        << " hit_rate=" << (lookups == 0 ? 0 : hits * 100 / lookups) << "%";
+  }
+}
+
+void Dumper::LogTraceStats() {
+  uint64_t units = trace_units_.LoadRelaxed();
+  uint64_t left_out = trace_left_out_units_.LoadRelaxed();
+  LOG(ERROR) << "trace stats traces=" << traces_.LoadRelaxed() << " units=" << units
+      << " left_out=" << left_out << " padded_units=" << units + left_out;
+}
+
+void Dumper::LogMetrics() {
+  std::ostringstream os;
+  metrics_.Dump(os);
+  LOG(ERROR) << os.str();
+}
+
+void Dumper::LogBudgetStats() {
+  std::ostringstream os;
+  budget_.Dump(os);
+  LOG(ERROR) << os.str();
+}
+
+void Dumper::LogExploreStats() {
+  if (!explorer_.Enabled()) {
+    return;
+  }
+  ForkExplorerStats stats = explorer_.GetStats();
+  LOG(ERROR) << "explore stats depth=" << explorer_.Depth() << " claimed=" << stats.claimed_
+      << " forks=" << stats.forks_ << " busy=" << stats.busy_ << " failed=" << stats.failed_
+      << " reaped=" << stats.reaped_;
+}
+
+void Dumper::DumpForSigQuit(std::ostream& os) {
+  // Never creates the Dumper: processes that collect nothing have no metrics to show.
+  if (sInstance != nullptr) {
+    sInstance->metrics_.Dump(os);
+    sInstance->budget_.Dump(os);
+  }
+}
+
+void Dumper::LogForceBranchStats() {
+  pthread_mutex_lock(&force_branches_mutex_);
+  ForceBranchStats stats = force_branches_.LoadRelaxed()->GetStats();
+  pthread_mutex_unlock(&force_branches_mutex_);
+  LOG(ERROR) << "force branch stats branches=" << stats.branches_
+      << " dex_files=" << stats.dex_files_ << " resolved=" << stats.resolved_
+      << " lookups=" << stats.lookups_ << " forced=" << stats.forced_;
+}
+
+void Dumper::RequestFlush() {
+  flush_requested_ = 1;
+}
+
+void Dumper::FlushOutput() {
+  if (dedup_index_path_.empty()) {
+    writer_.FlushAll();
+    return;
+  }
+  // The index must not list an item whose record is not in the output, or no later run would
+  // write it either. Entries are taken before draining, so that every one of them was at least
+  // in flight to the queue, and items interned later are left for the next save.
+  std::vector<DumpDedupEntry> added[kDumpDedupKinds];
+  uint32_t next_index[kDumpDedupKinds];
+  CollectDedupEntries(added, next_index);
+  bool drained = WaitForQueueDrained(kDumpDedupDrainTimeoutMs);
+  writer_.FlushAll();
+  uint64_t dropped = queue_.GetStats().dropped_;
+  if (!drained || dropped != 0) {
+    LOG(ERROR) << "dedup index not saved drained=" << drained << " dropped=" << dropped;
+    return;
+  }
+  SaveDedupIndex(added, next_index);
+}
+
+void Dumper::WriteItems(DumpItem** items, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    DumpItem* item = items[i];
+    metrics_.Record(kDumpMetricQueueWait, NanoTime() - item->enqueued_ns_);
+    writer_.Write(locations_.Path(item->location_), item->item_);
+    budget_.Release(kDumpBudgetQueue, item->charge_);
     delete item;
   }
 }
 
-void sig_handler(int signum) {
-  LOG(ERROR) << "Received signal " << std::to_string(signum);
-  Dumper::Instance()->InitializeForceBranch();
+bool Dumper::WaitForQueueDrained(uint64_t timeout_ms) {
+  bool recording = pthread_equal(pthread_self(), recording_thread_);
+  uint64_t deadline_ms = MilliTime() + timeout_ms;
+  while (true) {
+    // An item is charged to the queue before it stops being in flight, and stays charged until
+    // its record is staged, so the two are read in this order.
+    if (dumps_in_flight_.LoadSequentiallyConsistent() == 0 &&
+        budget_.Used(kDumpBudgetQueue) == 0) {
+      return true;
+    }
+    if (MilliTime() >= deadline_ms) {
+      return false;
+    }
+    if (recording) {
+      CheckRecordingPause();
+      DumpItem* items[kRecordingBatchSize];
+      WriteItems(items, queue_.remove(items, kRecordingBatchSize, 1));
+    } else {
+      NanoSleep(MsToNs(1));
+    }
+  }
+}
+
+DumpInternTable* Dumper::TableOf(DumpItemType type) {
+  DumpInternTable* const tables[] = { &strings_, &types_, &protos_, &fields_, &methods_,
+                                      &classes_, &static_values_, &encoded_fields_,
+                                      &encoded_methods_, &codes_ };
+  static_assert(arraysize(tables) == kDumpDedupKinds, "a dedup kind for every item type");
+  return tables[type];
+}
+
+void Dumper::InitializeDedupIndex() {
+  char fname[128];
+  sprintf(fname, "/data/data/%s/dedup_index", package_name_.c_str());
+  std::ifstream config_file(fname);
+  std::string path;
+  if (!config_file.fail() && std::getline(config_file, path) && !path.empty()) {
+    std::string error_msg;
+    // A missing index is the first run of a campaign; a damaged one is replaced at exit.
+    if (access(path.c_str(), F_OK) == 0 && !dedup_index_.Open(path, &error_msg)) {
+      LOG(ERROR) << "dedup index ignored: " << error_msg;
+    }
+    dedup_index_path_ = path;
+    for (uint32_t kind = 0; kind < kDumpDedupKinds; ++kind) {
+      TableOf(static_cast<DumpItemType>(kind))->SetPersistent(&dedup_index_, kind);
+    }
+    LOG(ERROR) << "init dedup_index " << path << " codes=" << dedup_index_.Entries(D_CODE);
+  }
+  if (config_file.is_open()) {
+    config_file.close();
+  }
+}
+
+void Dumper::InitializeExplorer() {
+  std::vector<std::string> lines;
+  if (!CollectionConfig::ReadLines(StringPrintf("%s/%s/explore", kCollectionDataDir,
+                                                package_name_.c_str()), &lines)) {
+    return;
+  }
+  explorer_.Configure(lines);
+  LOG(ERROR) << "init explore max_children=" << explorer_.MaxChildren() << " budget_ms="
+      << explorer_.BudgetMs() << " max_depth=" << explorer_.MaxDepth();
+}
+
+void Dumper::InitializeSampling() {
+  std::vector<std::string> lines;
+  if (!CollectionConfig::ReadLines(StringPrintf("%s/%s/sampling", kCollectionDataDir,
+                                                package_name_.c_str()), &lines)) {
+    return;
+  }
+  sampling_.Configure(lines);
+  LOG(ERROR) << "init sampling warmup=" << sampling_.warmup_ << " halving="
+      << sampling_.halving_ << " max_period=" << sampling_.max_period_;
+}
+
+void Dumper::CollectDedupEntries(std::vector<DumpDedupEntry> added[kDumpDedupKinds],
+                                 uint32_t next_index[kDumpDedupKinds]) {
+  for (uint32_t kind = 0; kind < kDumpDedupKinds; ++kind) {
+    DumpInternTable* table = TableOf(static_cast<DumpItemType>(kind));
+    // Size() is read last: every index collected is below it.
+    table->CollectNew(&added[kind]);
+    next_index[kind] = table->Size();
+  }
+}
+
+void Dumper::SaveDedupIndex(std::vector<DumpDedupEntry> added[kDumpDedupKinds],
+                            const uint32_t next_index[kDumpDedupKinds]) {
+  size_t total = 0;
+  for (uint32_t kind = 0; kind < kDumpDedupKinds; ++kind) {
+    total += added[kind].size();
+  }
+  std::string error_msg;
+  if (!dedup_index_.Save(dedup_index_path_, added, next_index, &error_msg)) {
+    LOG(ERROR) << "dedup index not saved: " << error_msg;
+    return;
+  }
+  LOG(ERROR) << "dedup index saved " << dedup_index_path_ << " added=" << total;
+}
+
+// Only sets a flag: the recording thread performs the flush on its next wake-up.
+void flush_sig_handler(__attribute__((unused))int signum) {
+  Dumper::Instance()->RequestFlush();
+}
+
+void flush_at_exit() {
+  Dumper::Instance()->FlushOutput();
 }
 
 Dumper::Dumper() {
   package_name_ = "";
+  flush_requested_ = 0;
+  dumps_in_flight_.StoreRelaxed(0);
+  force_branches_.StoreRelaxed(nullptr);
+  pthread_mutex_init(&force_branches_mutex_, NULL);
+  force_execution_ = false;
+  pthread_mutex_init(&recording_pause_mutex_, NULL);
+  pthread_cond_init(&recording_pause_cond_, NULL);
+  recording_pause_requested_ = false;
+  recording_paused_ = false;
+  writer_.SetMetrics(&metrics_);
+  for (uint32_t kind = 0; kind < kDumpDedupKinds; ++kind) {
+    TableOf(static_cast<DumpItemType>(kind))->SetMetrics(&metrics_);
+  }
 
-  if (IsTargetProcess()) {
+  const CollectionConfig* config = CollectionConfig::Current();
+  if (IsTargetProcess(config)) {
     char path[100];
     sprintf(path, "/data/data/%s/revealer", package_name_.c_str());
     mkdir(path, 0777);
 
-    InitializeForceBranch();
-    InitializeClassFilter();
+    InitializeExplorer();
+    InitializeSampling();
+    InitializeForceBranch(config->ForceBranches());
+    InitializeClassFilter(config);
+    InitializeQueuePolicy();
+    InitializeMemoryBudget();
+    InitializeDedupIndex();
+
+    pthread_mutex_init(&arena_mutex_, NULL);
+    pthread_mutex_init(&collection_states_mutex_, NULL);
+    pthread_mutex_init(&dex_memos_mutex_, NULL);
+    int key_rc = pthread_key_create(&arena_key_, ReleaseCollectionArena);
+    if (key_rc) {
+      LOG(FATAL) << "create key for collection arena failed! " << key_rc;
+    }
 
-    int rc = pthread_create(&recording_thread_, NULL, DumpRun, NULL);
+    int rc = pthread_create(&recording_thread_, NULL, DumpRun, this);
     if (rc) {
       LOG(FATAL) << "create thread for recording failed! " << rc;
     }
-    pthread_mutex_init(&string_mutex_, NULL);
-    pthread_mutex_init(&type_mutex_, NULL);
-    pthread_mutex_init(&proto_mutex_, NULL);
-    pthread_mutex_init(&field_mutex_, NULL);
-    pthread_mutex_init(&method_mutex_, NULL);
-    pthread_mutex_init(&class_mutex_, NULL);
-    pthread_mutex_init(&static_value_mutex_, NULL);
-    pthread_mutex_init(&encoded_field_mutex_, NULL);
-    pthread_mutex_init(&encoded_method_mutex_, NULL);
-    pthread_mutex_init(&code_mutex_, NULL);
 //    pthread_mutex_init(&map_mutex_, NULL);
-#ifdef TIME_EVALUATION
-    pthread_mutex_init(&time_mutex_, NULL);
-#endif
 
     struct timeval t1;
     gettimeofday(&t1, NULL);
@@ -593,7 +1059,8 @@ Dumper::Dumper() {
     sprintf(digits, "%.6d", rand() % 1000000);
     random_prefix_ = std::string(digits);
 
-    signal(44, sig_handler);
+    signal(45, flush_sig_handler);
+    atexit(flush_at_exit);
   }
 }
 
@@ -601,62 +1068,38 @@ Dumper::~Dumper() {
   sInstance = NULL;
 }
 
-Dumper* Dumper::Instance() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  if (!sInstance) {
-    sInstance = new Dumper();
-  }
-  return sInstance;
+static void SetThreadDumper(Thread* thread, void* dumper) {
+  thread->SetDumper(reinterpret_cast<Dumper*>(dumper));
 }
 
-bool Dumper::IsTargetProcess() {
-  char fname[128];
-  char fname2[128];
-  char buff[1024];
-  pid_t pid = getpid();
-  sprintf(fname, "/proc/%d/cmdline", pid);
-  FILE *fp = fopen(fname, "r");
-  if (fp != NULL) {
-    // LOG(ERROR) << "get into get pid " << pid;
-    while (fgets(buff, 1024, fp)) {
-      LOG(ERROR) << "fgets:" << buff;
-      std::string pkg_name = std::string(buff);
-      size_t pos = pkg_name.find(":");
-      if (pos != std::string::npos) {
-        pkg_name = pkg_name.substr(0, pos);
-      }
-      sprintf(fname2, "/data/data/%s/reveal_filter", pkg_name.c_str());
-      std::ifstream filter(fname2);
-      if (filter.fail()) {
-        if (strstr(buff, "zhenyu") || strstr(buff, "ecspride") || strstr(buff, "mit")
-            || strstr(buff, "example") || strstr(buff, "cert") || strstr(buff, "snt")
-            || strstr(buff, "wayne")) {
-          LOG(ERROR) << "default filter in dumper";
-          package_name_ = std::string(pkg_name);
-          pid_ = pid;
-          return true;
-        }
-      } else {
-        LOG(ERROR) << "file filter in dumper";
-        std::string line_filter;
-        while (std::getline(filter, line_filter)) {
-          if (strstr(buff, line_filter.c_str())) {
-            package_name_ = std::string(pkg_name);
-            pid_ = pid;
-            return true;
-          }
-        }
-      }
-      if (filter.is_open()) {
-        filter.close();
-      }
-      break;
-    }
-    fclose(fp);
+bool Dumper::InitializeIfTarget() {
+  if (LIKELY(sInstance != nullptr)) {
+    return true;
+  }
+  if (!CollectionConfig::Current()->IsTarget()) {
     return false;
-  } else {
-    LOG(ERROR) << "file not found for pid " << pid;
+  }
+  pthread_mutex_lock(&instance_mutex);
+  if (sInstance == nullptr) {
+    Dumper* dumper = new Dumper();
+    Thread* self = Thread::Current();
+    MutexLock mu(self, *Locks::thread_list_lock_);
+    // Readers load sInstance or their cached copy without a barrier.
+    QuasiAtomic::ThreadFenceForConstructor();
+    sInstance = dumper;
+    Runtime::Current()->GetThreadList()->ForEach(SetThreadDumper, dumper);
+  }
+  pthread_mutex_unlock(&instance_mutex);
+  return true;
+}
+
+bool Dumper::IsTargetProcess(const CollectionConfig* config) {
+  if (!config->IsTarget()) {
     return false;
   }
+  package_name_ = config->PackageName();
+  pid_ = config->Pid();
+  return true;
 }
 
 std::vector<std::string> split(const std::string &text, char sep) {
@@ -674,79 +1117,140 @@ std::vector<std::string> split(const std::string &text, char sep) {
   return tokens;
 }
 
-void Dumper::InitializeForceBranch() {
-  force_execution_ = false;
-  force_branches_.clear();
-  char fname[128];
-  char buff[1024];
-  sprintf(fname, "/data/data/%s/force_branches", package_name_.c_str());
-  FILE *fp = fopen(fname, "r");
-  if (fp != NULL) {
-    // LOG(ERROR) << "get into get pid " << pid;
-    while (fgets(buff, 1024, fp)) {
-      std::string line = std::string(buff);
-      // remove \n
-      line = line.substr(0, line.length() - 1);
-      if (line.length() > 0) {
-        std::vector<std::string> items = split(line, ' ');
-        uint32_t item_size = items.size();
-        if (item_size > 6) {
-          uint32_t param_size = stoi(items[6]);
-          if (item_size == param_size + 7) {
-            ForceBranch* branch = new ForceBranch;
-            branch->class_ = items[0];
-            branch->name_ = items[1];
-            branch->shorty_ = items[2];
-            branch->return_type_ = items[3];
-            branch->dex_pc_ = static_cast<uint32_t>(stoi(items[4]));
-            branch->force_offset_ = static_cast<int32_t>(stoi(items[5]));
-            uint32_t idx;
-            for (idx = 0; idx < param_size; ++idx) {
-              branch->param_types_.push_back(items[7 + idx]);
-            }
-            force_branches_.push_back(branch);
-            LOG(ERROR) << "Add force Branch:" << branch->ToString();
-            force_execution_ = true;
-          } else {
-            LOG(ERROR) << "wrong param_size and item_size " << param_size << "," << item_size;
+void Dumper::InitializeForceBranch(const std::vector<std::string>& lines) {
+  std::vector<ForceBranch*> branches;
+  for (const std::string& line : lines) {
+    if (line.length() > 0) {
+      std::vector<std::string> items = split(line, ' ');
+      uint32_t item_size = items.size();
+      if (item_size > 6) {
+        uint32_t param_size = stoi(items[6]);
+        if (item_size == param_size + 7) {
+          ForceBranch* branch = new ForceBranch;
+          branch->class_ = items[0];
+          branch->name_ = items[1];
+          branch->shorty_ = items[2];
+          branch->return_type_ = items[3];
+          branch->dex_pc_ = static_cast<uint32_t>(stoi(items[4]));
+          branch->force_offset_ = static_cast<int32_t>(stoi(items[5]));
+          uint32_t idx;
+          for (idx = 0; idx < param_size; ++idx) {
+            branch->param_types_.push_back(items[7 + idx]);
           }
+          branches.push_back(branch);
+          LOG(ERROR) << "Add force Branch:" << branch->ToString();
         } else {
-          LOG(ERROR) << "too less items " << item_size;
+          LOG(ERROR) << "wrong param_size and item_size " << param_size << "," << item_size;
         }
       } else {
-        LOG(ERROR) << "empty line";
+        LOG(ERROR) << "too less items " << item_size;
+      }
+    } else {
+      LOG(ERROR) << "empty line";
+    }
+  }
+  ForceBranchIndex* index = new ForceBranchIndex(branches);
+  pthread_mutex_lock(&force_branches_mutex_);
+  ForceBranchIndex* old_index = force_branches_.LoadRelaxed();
+  if (old_index != nullptr) {
+    retired_force_branches_.push_back(old_index);
+  }
+  force_branches_.StoreSequentiallyConsistent(index);
+  // Exploring runs forced too, with every branch a candidate.
+  force_execution_ = !index->Empty() || explorer_.Enabled();
+  pthread_mutex_unlock(&force_branches_mutex_);
+}
+
+// Passed by every thread at its next suspend point. GetForceBranch() and ResolveForceBranches()
+// have none, so a thread that passed no longer reads an index retired before the request.
+class ForceBranchReclaimCheckpoint FINAL : public Closure {
+  public:
+    ForceBranchReclaimCheckpoint() : barrier_(0) {}
+
+    void Run(Thread* thread) OVERRIDE {
+      // Threads suspended at the request are run through by the requester instead.
+      if (thread->GetState() == kRunnable) {
+        barrier_.Pass(Thread::Current());
       }
     }
-    fclose(fp);
+
+    // Not timed: every runnable thread gets to a suspend point, and the checkpoint must outlive
+    // the last of them to run it.
+    void WaitForThreads(Thread* self, size_t threads_running_checkpoint) {
+      ScopedThreadStateChange tsc(self, kWaitingForCheckPointsToRun);
+      barrier_.Increment(self, threads_running_checkpoint);
+    }
+
+  private:
+    Barrier barrier_;
+};
+
+void Dumper::ReloadForceBranch(Thread* self) {
+  std::vector<std::string> lines;
+  CollectionConfig::ReadLines(StringPrintf("%s/%s/force_branches", kCollectionDataDir,
+                                           package_name_.c_str()), &lines);
+  InitializeForceBranch(lines);
+
+  pthread_mutex_lock(&force_branches_mutex_);
+  std::vector<ForceBranchIndex*> retired;
+  retired.swap(retired_force_branches_);
+  pthread_mutex_unlock(&force_branches_mutex_);
+  ForceBranchReclaimCheckpoint checkpoint;
+  ThreadList* thread_list = Runtime::Current()->GetThreadList();
+  size_t threads_running_checkpoint = thread_list->RunCheckpoint(&checkpoint);
+  if (threads_running_checkpoint != 0) {
+    checkpoint.WaitForThreads(self, threads_running_checkpoint);
+  }
+  for (ForceBranchIndex* index : retired) {
+    delete index;
+  }
+  LOG(ERROR) << "reloaded force_branches lines=" << lines.size() << " freed=" << retired.size();
+}
+
+void Dumper::InitializeClassFilter(const CollectionConfig* config) {
+  if (!config->ClassFilter().empty()) {
+    class_filter_.Build(config->ClassFilter());
+    LOG(ERROR) << "class_filter patterns=" << class_filter_.Patterns()
+        << " states=" << class_filter_.States();
+  }
+  if (!config->IncludedClass().empty()) {
+    included_class_.Build(config->IncludedClass());
+    LOG(ERROR) << "included_class patterns=" << included_class_.Patterns()
+        << " states=" << included_class_.States();
   }
 }
 
-void Dumper::InitializeClassFilter() {
+void Dumper::InitializeQueuePolicy() {
   char fname[128];
-  sprintf(fname, "/data/data/%s/class_filter", package_name_.c_str());
-  std::ifstream filter(fname);
-  if (!filter.fail()) {
-    LOG(ERROR) << "init class_filter";
-    std::string line_filter;
-    while (std::getline(filter, line_filter)) {
-      class_filter_.push_back(line_filter);
+  sprintf(fname, "/data/data/%s/queue_policy", package_name_.c_str());
+  std::ifstream policy_file(fname);
+  std::string policy;
+  if (!policy_file.fail() && std::getline(policy_file, policy)) {
+    if (policy == "drop") {
+      queue_.SetFullPolicy(kRecordingQueueDrop);
+    } else if (policy == "spill") {
+      queue_.SetFullPolicy(kRecordingQueueSpill);
+    } else {
+      LOG(ERROR) << "unknown queue_policy " << policy;
     }
+    LOG(ERROR) << "init queue_policy " << policy;
   }
-  if (filter.is_open()) {
-    filter.close();
+  if (policy_file.is_open()) {
+    policy_file.close();
   }
+}
 
-  sprintf(fname, "/data/data/%s/included_class", package_name_.c_str());
-  std::ifstream filter2(fname);
-  if (!filter2.fail()) {
-    LOG(ERROR) << "init class_filter";
-    std::string line_filter;
-    while (std::getline(filter2, line_filter)) {
-      included_class_.push_back(line_filter);
-    }
+void Dumper::InitializeMemoryBudget() {
+  char fname[128];
+  sprintf(fname, "/data/data/%s/memory_budget", package_name_.c_str());
+  std::ifstream budget_file(fname);
+  size_t megabytes;
+  if (!budget_file.fail() && (budget_file >> megabytes) && megabytes != 0) {
+    budget_.SetLimit(megabytes * 1024 * 1024);
   }
-  if (filter2.is_open()) {
-    filter2.close();
+  LOG(ERROR) << "init memory_budget " << budget_.Limit();
+  if (budget_file.is_open()) {
+    budget_file.close();
   }
 }
 
@@ -754,31 +1258,11 @@ bool Dumper::shouldDump() {
   return !package_name_.empty();
 }
 
-bool Dumper::ForceExecution() {
-  return force_execution_;
-}
-
 bool Dumper::shouldFilterClass(const char* descriptor) {
-  if (included_class_.size() > 0) {
-    bool found = false;
-    for (std::string s : included_class_) {
-      if (strstr(descriptor, s.c_str())) {
-        found = true;
-        break;
-      }
-    }
-//    LOG(ERROR) << "shouldFilterClass? " << descriptor << " " << !found;
-    return !found;
-  } else if (class_filter_.size() > 0) {
-    for (std::string s : class_filter_) {
-      if (strstr(descriptor, s.c_str())) {
-//        LOG(ERROR) << "shouldFilterClass? " << descriptor << " true";
-        return true;
-      }
-    }
+  if (!included_class_.Empty()) {
+    return !included_class_.Matches(descriptor);
   }
-//  LOG(ERROR) << "shouldFilterClass? " << descriptor << " false";
-  return false;
+  return class_filter_.Matches(descriptor);
 }
 
 ArtMethod* Dumper::GetTargetMethod(mirror::Object* obj) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
@@ -854,85 +1338,57 @@ SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   LOG(ERROR) << "copy " << location << " finished";
 }
 
-uint32_t Dumper::GeneralDump(std::string location, const char* file,
-    std::map<size_t, uint32_t>& map, DumpBase* data, pthread_mutex_t& lock) {
+uint32_t Dumper::GeneralDump(uint32_t location, DumpInternTable& table, DumpBase* data) {
   uint32_t ret;
-#ifdef TIME_EVALUATION
-  struct timeval t1, t2;
-  gettimeofday(&t1, NULL);
-#endif
-  pthread_mutex_lock(&lock);
-#ifdef TIME_EVALUATION
-  gettimeofday(&t2, NULL);
-  addTimeMeasure(t1, t2, HANDLE_L);
-  gettimeofday(&t1, NULL);
-#endif
-  size_t hash_value = data->HashValue();
-  auto it = map.find(hash_value);
-#ifdef TIME_EVALUATION
-  gettimeofday(&t2, NULL);
-  if (data->dump_type_ == D_CODE) {
-    addTimeMeasure(t1, t2, ARRAY_C);
-  } else {
-    addTimeMeasure(t1, t2, ARRAY_O);
+  std::string key;
+  data->AppendKey(&key);
+  // Counted from before the entry is visible to CollectDedupEntries() until it is queued.
+  bool in_flight = !dedup_index_path_.empty();
+  if (in_flight) {
+    dumps_in_flight_.FetchAndAddSequentiallyConsistent(1);
   }
-#endif
-  if (it != map.end()) {
-    ret = it->second;
-    // LOG(ERROR) << "found " << (uint32_t)data->dump_type_ << "," << data->ToString() << "," << hash_value << "," << ret;
+  bool inserted;
+  {
+    ScopedDumpMetric lookup(&metrics_, kDumpMetricTableLookup);
+    ret = table.Intern(data->HashValue(), key, &inserted);
+  }
+  metrics_.Count(inserted ? kDumpCounterInterned : kDumpCounterDuplicates, 1);
+  if (!inserted) {
+    // LOG(ERROR) << "found " << (uint32_t)data->dump_type_ << "," << data->ToString() << "," << ret;
     delete data;
-#ifdef TIME_EVALUATION
-    gettimeofday(&t1, NULL);
-#endif
-    pthread_mutex_unlock(&lock);
-#ifdef TIME_EVALUATION
-    gettimeofday(&t2, NULL);
-    addTimeMeasure(t1, t2, HANDLE_L);
-#endif
+    if (in_flight) {
+      dumps_in_flight_.FetchAndSubSequentiallyConsistent(1);
+    }
     return ret;
   }
 
-  ret = map.size();
   data->array_idx_ = ret;
-  map.insert(std::make_pair(hash_value, ret));
-  // LOG(ERROR) << "new " << (uint32_t)data->dump_type_ << "," << data->ToString() << "," << hash_value << "," << ret;
-#ifdef TIME_EVALUATION
-  gettimeofday(&t1, NULL);
-#endif
-  pthread_mutex_unlock(&lock);
-#ifdef TIME_EVALUATION
-  gettimeofday(&t2, NULL);
-  addTimeMeasure(t1, t2, HANDLE_L);
-#endif
+  // LOG(ERROR) << "new " << (uint32_t)data->dump_type_ << "," << data->ToString() << "," << ret;
+  budget_.Charge(kDumpBudgetIntern, key.size() + kDumpBudgetInternEntryBytes);
 
 #ifdef WRITE_FILE
-  char* path = new char[150];
-  std::hash<std::string> hash;
-  sprintf(path, "/data/data/%s/revealer/%d_%s_%zu_%s.dat", package_name_.c_str(), pid_, random_prefix_.c_str(), hash(location),
-      file);
+  // Every kind of item collected from one dex location goes to the same container.
   DumpItem* item = new DumpItem;
-  item->path_ = std::string(path);
+  item->location_ = location;
   item->item_ = data;
+  item->enqueued_ns_ = NanoTime();
+  // The key holds every field of the item, which makes its size a fair estimate of the item's.
+  item->charge_ = sizeof(DumpItem) + key.size();
   // queue_.add(item);
-#ifdef TIME_EVALUATION
-  gettimeofday(&t1, NULL);
-#endif
   ToDumpQueueUnblock(item);
-#ifdef TIME_EVALUATION
-  gettimeofday(&t2, NULL);
-  addTimeMeasure(t1, t2, ADD_Q);
-#endif
 #else
-  std::hash<std::string> hash;
-  hash(location);
+  UNUSED(location);
 #endif
+  if (in_flight) {
+    dumps_in_flight_.FetchAndSubSequentiallyConsistent(1);
+  }
 
   return ret;
 }
 
-uint32_t Dumper::StringDump(std::string location, DumpString* s) {
-  return GeneralDump(location, STRING_FILE, strings_, s, string_mutex_);
-//  return GeneralDump(location, STRING_FILE, strings_, s, map_mutex_);
+uint32_t Dumper::StringDump(uint32_t location, DumpString* s) {
+  return GeneralDump(location, strings_, s);
+//  return GeneralDump(location, strings_, s);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(strings_.begin(), strings_.end(), CompareHelper<DumpString>(s));
@@ -966,9 +1422,9 @@ uint32_t Dumper::StringDump(std::string location, DumpString* s) {
 //  return ret;
 }
 
-uint16_t Dumper::TypeDump(std::string location, DumpType* type) {
-  return GeneralDump(location, TYPE_FILE, types_, type, type_mutex_);
-//  return GeneralDump(location, TYPE_FILE, types_, type, map_mutex_);
+uint16_t Dumper::TypeDump(uint32_t location, DumpType* type) {
+  return GeneralDump(location, types_, type);
+//  return GeneralDump(location, types_, type);
 //  uint16_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(types_.begin(), types_.end(), CompareHelper<DumpType>(type));
@@ -1002,9 +1458,9 @@ uint16_t Dumper::TypeDump(std::string location, DumpType* type) {
 //  return ret;
 }
 
-uint16_t Dumper::ProtoDump(std::string location, DumpProto* proto) {
-  return GeneralDump(location, PROTO_FILE, protos_, proto, proto_mutex_);
-//  return GeneralDump(location, PROTO_FILE, protos_, proto, map_mutex_);
+uint16_t Dumper::ProtoDump(uint32_t location, DumpProto* proto) {
+  return GeneralDump(location, protos_, proto);
+//  return GeneralDump(location, protos_, proto);
 //  uint16_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(protos_.begin(), protos_.end(), CompareHelper<DumpProto>(proto));
@@ -1038,9 +1494,9 @@ uint16_t Dumper::ProtoDump(std::string location, DumpProto* proto) {
 //  return ret;
 }
 
-uint32_t Dumper::FieldDump(std::string location, DumpField* field) {
-  return GeneralDump(location, FIELD_FILE, fields_, field, field_mutex_);
-//  return GeneralDump(location, FIELD_FILE, fields_, field, map_mutex_);
+uint32_t Dumper::FieldDump(uint32_t location, DumpField* field) {
+  return GeneralDump(location, fields_, field);
+//  return GeneralDump(location, fields_, field);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(fields_.begin(), fields_.end(), CompareHelper<DumpField>(field));
@@ -1074,9 +1530,9 @@ uint32_t Dumper::FieldDump(std::string location, DumpField* field) {
 //  return ret;
 }
 
-uint32_t Dumper::MethodDump(std::string location, DumpMethod* method) {
-  return GeneralDump(location, METHOD_FILE, methods_, method, method_mutex_);
-//  return GeneralDump(location, METHOD_FILE, methods_, method, map_mutex_);
+uint32_t Dumper::MethodDump(uint32_t location, DumpMethod* method) {
+  return GeneralDump(location, methods_, method);
+//  return GeneralDump(location, methods_, method);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(methods_.begin(), methods_.end(), CompareHelper<DumpMethod>(method));
@@ -1110,9 +1566,9 @@ uint32_t Dumper::MethodDump(std::string location, DumpMethod* method) {
 //  return ret;
 }
 
-uint16_t Dumper::ClassDump(std::string location, DumpClassDef* clz) {
-  return GeneralDump(location, CLASS_FILE, classes_, clz, class_mutex_);
-//  return GeneralDump(location, CLASS_FILE, classes_, clz, map_mutex_);
+uint16_t Dumper::ClassDump(uint32_t location, DumpClassDef* clz) {
+  return GeneralDump(location, classes_, clz);
+//  return GeneralDump(location, classes_, clz);
 //  uint16_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(classes_.begin(), classes_.end(), CompareHelper<DumpClassDef>(clz));
@@ -1146,9 +1602,9 @@ uint16_t Dumper::ClassDump(std::string location, DumpClassDef* clz) {
 //  return ret;
 }
 
-uint32_t Dumper::StaticValueDump(std::string location, DumpStaticValue* sv) {
-  return GeneralDump(location, STATIC_VALUE_FILE, static_values_, sv, static_value_mutex_);
-//  return GeneralDump(location, STATIC_VALUE_FILE, static_values_, sv, map_mutex_);
+uint32_t Dumper::StaticValueDump(uint32_t location, DumpStaticValue* sv) {
+  return GeneralDump(location, static_values_, sv);
+//  return GeneralDump(location, static_values_, sv);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(static_values_.begin(), static_values_.end(), CompareHelper<DumpStaticValue>(sv));
@@ -1181,9 +1637,9 @@ uint32_t Dumper::StaticValueDump(std::string location, DumpStaticValue* sv) {
 //  return ret;
 }
 
-uint32_t Dumper::EncodedFieldDump(std::string location, DumpEncodedField* ef) {
-  return GeneralDump(location, ENCODED_FIELD_FILE, encoded_fields_, ef, encoded_field_mutex_);
-//  return GeneralDump(location, ENCODED_FIELD_FILE, encoded_fields_, ef, map_mutex_);
+uint32_t Dumper::EncodedFieldDump(uint32_t location, DumpEncodedField* ef) {
+  return GeneralDump(location, encoded_fields_, ef);
+//  return GeneralDump(location, encoded_fields_, ef);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(encoded_fields_.begin(), encoded_fields_.end(), CompareHelper<DumpEncodedField>(ef));
@@ -1216,9 +1672,9 @@ uint32_t Dumper::EncodedFieldDump(std::string location, DumpEncodedField* ef) {
 //  return ret;
 }
 
-uint32_t Dumper::EncodedMethodDump(std::string location, DumpEncodedMethod* em) {
-  return GeneralDump(location, ENCODED_METHOD_FILE, encoded_methods_, em, encoded_method_mutex_);
-//  return GeneralDump(location, ENCODED_METHOD_FILE, encoded_methods_, em, map_mutex_);
+uint32_t Dumper::EncodedMethodDump(uint32_t location, DumpEncodedMethod* em) {
+  return GeneralDump(location, encoded_methods_, em);
+//  return GeneralDump(location, encoded_methods_, em);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(encoded_methods_.begin(), encoded_methods_.end(), CompareHelper<DumpEncodedMethod>(em));
@@ -1251,9 +1707,9 @@ uint32_t Dumper::EncodedMethodDump(std::string location, DumpEncodedMethod* em)
 //  return ret;
 }
 
-uint32_t Dumper::CodeDump(std::string location, DumpCodeItem* code) {
-  return GeneralDump(location, CODE_FILE, codes_, code, code_mutex_);
-//  return GeneralDump(location, CODE_FILE, codes_, code, map_mutex_);
+uint32_t Dumper::CodeDump(uint32_t location, DumpCodeItem* code) {
+  return GeneralDump(location, codes_, code);
+//  return GeneralDump(location, codes_, code);
 //  uint32_t ret;
 //  pthread_mutex_lock(&dump_mutex_);
 //  auto it = std::find_if(codes_.begin(), codes_.end(), CompareHelper<DumpCodeItem>(code));
@@ -1287,31 +1743,57 @@ uint32_t Dumper::CodeDump(std::string location, DumpCodeItem* code) {
 }
 
 uint32_t Dumper::DumpStringFromDex(const DexFile& file, uint32_t string_idx) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  DumpDexMemo* memo = GetDexMemo(file);
+  uint32_t ret;
+  if (LookupDexMemo(memo, kDumpMemoString, string_idx, &ret)) {
+    return ret;
+  }
   DumpString* ds = new DumpString;
   const DexFile::StringId& id = file.GetStringId(string_idx);
 //  LOG(ERROR) << "DumpStringFromDex " << file.GetLocation() << "," << string_idx << "," << id.string_data_off_;
   ds->string_ = std::string(file.GetStringDataAndUtf16Length(id, &ds->string_length_));
-  return StringDump(file.GetLocation(), ds);
+  ret = StringDump(LocationOf(file), ds);
+  memo->Store(kDumpMemoString, string_idx, ret);
+  return ret;
 }
 
 uint16_t Dumper::DumpTypeFromDex(const DexFile& file, uint16_t type_idx) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  DumpDexMemo* memo = GetDexMemo(file);
+  uint32_t ret;
+  if (LookupDexMemo(memo, kDumpMemoType, type_idx, &ret)) {
+    return ret;
+  }
   DumpType* dt = new DumpType;
   const DexFile::TypeId& class_type_id = file.GetTypeId(type_idx);
   dt->descriptor_idx_ = DumpStringFromDex(file, class_type_id.descriptor_idx_);
-  return TypeDump(file.GetLocation(), dt);
+  ret = TypeDump(LocationOf(file), dt);
+  memo->Store(kDumpMemoType, type_idx, ret);
+  return ret;
 }
 
 uint32_t Dumper::DumpFieldFromDex(const DexFile& file, uint32_t field_idx) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  DumpDexMemo* memo = GetDexMemo(file);
+  uint32_t ret;
+  if (LookupDexMemo(memo, kDumpMemoField, field_idx, &ret)) {
+    return ret;
+  }
   DumpField* df = new DumpField;
   const DexFile::FieldId& field_id = file.GetFieldId(field_idx);
   df->class_idx_ = DumpTypeFromDex(file, field_id.class_idx_);
   df->type_idx_ = DumpTypeFromDex(file, field_id.type_idx_);
   df->name_idx_ = DumpStringFromDex(file, field_id.name_idx_);
 
-  return FieldDump(file.GetLocation(), df);
+  ret = FieldDump(LocationOf(file), df);
+  memo->Store(kDumpMemoField, field_idx, ret);
+  return ret;
 }
 
 uint32_t Dumper::DumpMethodFromDex(const DexFile& file, uint32_t method_idx) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  DumpDexMemo* memo = GetDexMemo(file);
+  uint32_t ret;
+  if (LookupDexMemo(memo, kDumpMemoMethod, method_idx, &ret)) {
+    return ret;
+  }
   DumpMethod* dm = new DumpMethod;
   const DexFile::MethodId& method_id = file.GetMethodId(method_idx);
   dm->class_idx_ = DumpTypeFromDex(file, method_id.class_idx_);
@@ -1331,7 +1813,7 @@ uint32_t Dumper::DumpMethodFromDex(const DexFile& file, uint32_t method_idx) SHA
     }
   }
 
-  dm->proto_idx_ = ProtoDump(file.GetLocation(), proto);
+  dm->proto_idx_ = ProtoDump(LocationOf(file), proto);
 
 //  const DexFile::TypeId& class_type_id = file.GetTypeId(method_id.class_idx_);
 //  const DexFile::StringId& class_id = file.GetStringId(class_type_id.descriptor_idx_);
@@ -1343,7 +1825,9 @@ uint32_t Dumper::DumpMethodFromDex(const DexFile& file, uint32_t method_idx) SHA
 
   dm->name_idx_ = DumpStringFromDex(file, method_id.name_idx_);
 
-  return MethodDump(file.GetLocation(), dm);
+  ret = MethodDump(LocationOf(file), dm);
+  memo->Store(kDumpMemoMethod, method_idx, ret);
+  return ret;
 }
 
 uint32_t Dumper::DumpClassFromDex(const DexFile& file,
@@ -1375,7 +1859,7 @@ uint32_t Dumper::DumpClassFromDex(const DexFile& file,
     dcd->source_file_idx_ = DexFile::kDexNoIndex;
   }
 
-  return ClassDump(file.GetLocation(), dcd);
+  return ClassDump(LocationOf(file), dcd);
 }
 
 uint32_t Dumper::DumpStaticValuesFromDex(const DexFile& file,
@@ -1481,7 +1965,7 @@ uint32_t Dumper::DumpStaticValuesFromDex(const DexFile& file,
       begin += width;
     }
 
-    return StaticValueDump(file.GetLocation(), dsv);
+    return StaticValueDump(LocationOf(file), dsv);
   }
   return DexFile::kDexNoIndex;
 }
@@ -1494,7 +1978,7 @@ uint32_t Dumper::DumpEncodedFieldFromDex(const DexFile& file, uint32_t field_idx
   def->field_idx_ = idx;
   def->access_flags_ = access_flag & 0x3ffff;
 
-  EncodedFieldDump(file.GetLocation(), def);
+  EncodedFieldDump(LocationOf(file), def);
 
   return idx;
 }
@@ -1507,7 +1991,7 @@ uint32_t Dumper::DumpEncodedMethodFromDex(const DexFile& file, uint32_t method_i
   dem->method_idx_ = idx;
   dem->access_flags_ = access_flag & 0x3ffff;
 
-  EncodedMethodDump(file.GetLocation(), dem);
+  EncodedMethodDump(LocationOf(file), dem);
 
   return idx;
 }
@@ -1551,7 +2035,7 @@ std::pair<uint32_t, uint32_t> Dumper::DumpImplicitEncodedMethod(ArtMethod* metho
 //        LOG(ERROR) << "objclz_name got " << (descriptor ? descriptor : "null");
         string->string_ = std::string(descriptor);
         string->string_length_ = string->string_.length();
-        current_cls_idx = StringDump(file->GetLocation(), string);
+        current_cls_idx = StringDump(LocationOf(*file), string);
 //        LOG(ERROR) << "current_cls_idx " << current_cls_idx << " " << string->string_;
       }
     }
@@ -1575,52 +2059,9 @@ std::pair<uint32_t, uint32_t> Dumper::DumpImplicitEncodedMethod(ArtMethod* metho
   dem->method_idx_ = idx;
   dem->access_flags_ = method->GetAccessFlags() & 0x3ffff;
 
-  EncodedMethodDump(file->GetLocation(), dem);
+  EncodedMethodDump(LocationOf(*file), dem);
 
   return std::make_pair(idx, current_cls_idx);
 }
 
-#ifdef TIME_EVALUATION
-void Dumper::addTimeMeasure(struct timeval s, struct timeval e, TimeMeasureType type) {
-  uint64_t diff = (e.tv_sec - s.tv_sec) * 1000 + (e.tv_usec - s.tv_usec) / 1000;
-
-  pthread_mutex_lock(&time_mutex_);
-
-  switch (type) {
-    case WRITE_F:
-      measure_.write_file_ += diff;
-      ++measure_.write_file_times_;
-      break;
-    case ADD_Q:
-      measure_.add_queue_ += diff;
-      ++measure_.add_queue_times_;
-      break;
-    case ARRAY_C:
-      measure_.array_find_code_ += diff;
-      ++measure_.array_find_code_times_;
-      LOG(ERROR) << "time measure: " << measure_.write_file_ << "," << measure_.add_queue_
-          << "," << measure_.array_find_code_ << "," << measure_.array_find_other_
-          << "," << measure_.process_code_ << "," << measure_.handle_lock_;
-      LOG(ERROR) << "time measure times: " << measure_.write_file_times_ << "," << measure_.add_queue_times_
-                << "," << measure_.array_find_code_times_ << "," << measure_.array_find_other_times_
-                << "," << measure_.process_code_times_ << "," << measure_.handle_lock_times_;
-      break;
-    case ARRAY_O:
-      measure_.array_find_other_ += diff;
-      ++measure_.array_find_other_times_;
-      break;
-    case PROCESS_C:
-      measure_.process_code_ += diff;
-      ++measure_.process_code_times_;
-      break;
-    case HANDLE_L:
-      measure_.handle_lock_ += diff;
-      ++measure_.handle_lock_times_;
-      break;
-  }
-
-  pthread_mutex_unlock(&time_mutex_);
-}
-#endif
-
 }  // namespace art
@@ -17,6 +17,7 @@
 #ifndef ART_RUNTIME_UNPACK_DUMP_H_
 #define ART_RUNTIME_UNPACK_DUMP_H_
 
+#include <signal.h>
 #include <map>
 
 #include "base/mutex.h"
@@ -25,12 +26,22 @@
 #include "stack.h"
 #include "dex_instruction-inl.h"
 #include "entrypoints/entrypoint_utils-inl.h"
+#include "unpack_arena.h"
+#include "unpack_budget.h"
+#include "unpack_class_filter.h"
+#include "unpack_collection_state.h"
+#include "unpack_config.h"
+#include "unpack_dedup_index.h"
+#include "unpack_dex_memo.h"
+#include "unpack_explore.h"
+#include "unpack_force_branch.h"
+#include "unpack_intern.h"
+#include "unpack_metrics.h"
 #include "unpack_recording_thread.h"
+#include "unpack_writer.h"
 
 namespace art {
 
-// #define TIME_EVALUATION
-
 enum DumpItemType {
     D_STRING, D_TYPE, D_PROTO, D_FIELD, D_METHOD, D_CLASS, D_STATIC_VALUE, D_ENCODED_FIELD, D_ENCODED_METHOD, D_CODE
 };
@@ -39,11 +50,14 @@ struct DumpBase {
   DumpItemType dump_type_;
   uint32_t array_idx_;
 
-  virtual void Output(FILE* file) = 0;
+  virtual size_t Output(FILE* file) = 0;
   virtual std::string ToString() = 0;
   virtual size_t HashValue();
+  // Appends every field operator== compares, so that equal keys mean equal items.
+  virtual void AppendKey(std::string* key) = 0;
   virtual ~DumpBase() {}
 
+  static inline void AppendKeyBytes(std::string* key, const void* data, size_t size);
   static inline size_t HashInt(uint32_t value);
   static inline size_t CombineHash(size_t h, uint16_t value);
   static inline size_t CombineHash(size_t h, uint32_t value);
@@ -58,10 +72,11 @@ struct DumpString : DumpBase {
     dump_type_ = D_STRING;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpString& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpType : DumpBase {
@@ -71,10 +86,11 @@ struct DumpType : DumpBase {
     dump_type_ = D_TYPE;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpType& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpProto : DumpBase {
@@ -86,10 +102,11 @@ struct DumpProto : DumpBase {
     dump_type_ = D_PROTO;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpProto& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpField : DumpBase {
@@ -101,10 +118,11 @@ struct DumpField : DumpBase {
     dump_type_ = D_FIELD;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpField& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpMethod : DumpBase {
@@ -116,10 +134,11 @@ struct DumpMethod : DumpBase {
     dump_type_ = D_METHOD;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpMethod& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpClassDef : DumpBase {
@@ -136,10 +155,11 @@ struct DumpClassDef : DumpBase {
     dump_type_ = D_CLASS;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpClassDef& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpStaticValue : DumpBase {
@@ -150,10 +170,11 @@ struct DumpStaticValue : DumpBase {
     dump_type_ = D_STATIC_VALUE;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpStaticValue& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
   virtual ~DumpStaticValue();
 };
 
@@ -170,10 +191,11 @@ struct DumpEncodedField : DumpBase {
     dump_type_ = D_ENCODED_FIELD;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpEncodedField& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 enum EncodedMethodType {
@@ -189,10 +211,11 @@ struct DumpEncodedMethod : DumpBase {
     dump_type_ = D_ENCODED_METHOD;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpEncodedMethod& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
 };
 
 struct DumpCodeItem : DumpBase {
@@ -215,10 +238,11 @@ struct DumpCodeItem : DumpBase {
     dump_type_ = D_CODE;
   }
 
-  virtual void Output(FILE* file);
+  virtual size_t Output(FILE* file);
   virtual std::string ToString();
   bool operator==(const DumpCodeItem& rhs) const;
   virtual size_t HashValue();
+  virtual void AppendKey(std::string* key);
   virtual ~DumpCodeItem();
 };
 
@@ -232,67 +256,29 @@ class CompareHelper {
 };
 
 struct DumpItem {
-  std::string path_;
+  uint32_t location_;  // DumpLocationTable id.
   DumpBase* item_;
+  uint64_t enqueued_ns_;
+  uint32_t charge_;  // Bytes charged to kDumpBudgetQueue while the item is queued.
 };
 
-// enum ForceBranchRet {
-//   FORCE_NONE = 0, FORCE_IF = 1, FORCE_ELSE = 2
-// };
-
-struct ForceBranch {
-  std::string class_;
-  std::string name_;
-  std::string shorty_;
-  std::string return_type_;
-  std::vector<std::string> param_types_;
-  uint32_t dex_pc_;
-
-//  ForceBranchRet force_target_ = FORCE_NONE;
-  int32_t force_offset_ = 0;
-
-  bool reached_ = false;
-
-  bool operator==(const ForceBranch& rhs) const;
-  std::string ToString();
-};
-
-#ifdef TIME_EVALUATION
-
-enum TimeMeasureType {
-  WRITE_F, ADD_Q, ARRAY_C, ARRAY_O, PROCESS_C, HANDLE_L
-};
-
-struct TimeMeasure {
-  uint64_t write_file_;
-  uint64_t add_queue_;
-  uint64_t array_find_code_;
-  uint64_t array_find_other_;
-  uint64_t process_code_;
-  uint64_t handle_lock_;
-
-  uint64_t write_file_times_;
-  uint64_t add_queue_times_;
-  uint64_t array_find_code_times_;
-  uint64_t array_find_other_times_;
-  uint64_t process_code_times_;
-  uint64_t handle_lock_times_;
-
-  TimeMeasure(): write_file_(0), add_queue_(0),
-      array_find_code_(0), array_find_other_(0),
-      process_code_(0), handle_lock_(0),
-      write_file_times_(0), add_queue_times_(0),
-      array_find_code_times_(0), array_find_other_times_(0),
-      process_code_times_(0), handle_lock_times_(0) {}
-};
-#endif
-
 class Dumper {
   public:
-    static Dumper* Instance();
+    // The Dumper of a target process, or null before InitializeIfTarget() built it. Interpreter
+    // code that has self at hand reads Thread::GetDumper() instead.
+    static Dumper* Instance() {
+      return sInstance;
+    }
+
+    // Builds the Dumper once the process is known to be a target, and hands it to every thread.
+    // Returns whether the process is a target. Thread safe; a load and a compare once built.
+    static bool InitializeIfTarget();
+
     ~Dumper();
 
-    bool ForceExecution();
+    bool ForceExecution() const {
+      return force_execution_;
+    }
 
     bool shouldDump();
     bool shouldFilterClass(const char* descriptor);
@@ -300,20 +286,32 @@ class Dumper {
     void DumpJniLibrary(const std::string location) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
     ArtMethod* GetTargetMethod(mirror::Object* obj) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
-    uint32_t GeneralDump(std::string location, const char* file,
-        std::map<size_t, uint32_t>& map, DumpBase* data, pthread_mutex_t& lock);
+    uint32_t GeneralDump(uint32_t location, DumpInternTable& table, DumpBase* data);
 
+    // Returns the offset the branch at dex_pc is forced to, or 0. Only called for methods that
+    // ResolveForceBranches() found to have an entry.
     int32_t GetForceBranch(ArtMethod* method, uint32_t dex_pc) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
-    uint32_t StringDump(std::string location, DumpString* s);
-    uint16_t TypeDump(std::string location, DumpType* type);
-    uint16_t ProtoDump(std::string location, DumpProto* proto);
-    uint32_t FieldDump(std::string location, DumpField* field);
-    uint32_t MethodDump(std::string location, DumpMethod* method);
-    uint16_t ClassDump(std::string location, DumpClassDef* clz);
-    uint32_t StaticValueDump(std::string location, DumpStaticValue* sv);
-    uint32_t EncodedFieldDump(std::string location, DumpEncodedField* ef);
-    uint32_t EncodedMethodDump(std::string location, DumpEncodedMethod* em);
-    uint32_t CodeDump(std::string location, DumpCodeItem* code);
+    // Returns whether force_branches has an entry for the hooked method. The answer is cached in
+    // its EntryHookInfo until the configuration is reloaded.
+    bool ResolveForceBranches(ArtMethod* method) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+    // Returns the offset the branch inst at dex_pc of the frame's method is forced to, or 0 to
+    // let it go its own way: the method's force_branches entry if there is one, otherwise, when
+    // exploring, what ExploreBranch() leaves this process to take.
+    int32_t ChooseBranch(Thread* self, const ShadowFrame& shadow_frame, const Instruction* inst,
+                         uint32_t dex_pc) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+    bool Exploring() const {
+      return explorer_.Enabled();
+    }
+    uint32_t StringDump(uint32_t location, DumpString* s);
+    uint16_t TypeDump(uint32_t location, DumpType* type);
+    uint16_t ProtoDump(uint32_t location, DumpProto* proto);
+    uint32_t FieldDump(uint32_t location, DumpField* field);
+    uint32_t MethodDump(uint32_t location, DumpMethod* method);
+    uint16_t ClassDump(uint32_t location, DumpClassDef* clz);
+    uint32_t StaticValueDump(uint32_t location, DumpStaticValue* sv);
+    uint32_t EncodedFieldDump(uint32_t location, DumpEncodedField* ef);
+    uint32_t EncodedMethodDump(uint32_t location, DumpEncodedMethod* em);
+    uint32_t CodeDump(uint32_t location, DumpCodeItem* code);
 
     uint32_t DumpStringFromDex(const DexFile& file, uint32_t string_idx) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
     uint16_t DumpTypeFromDex(const DexFile& file, uint16_t type_idx) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
@@ -329,27 +327,130 @@ class Dumper {
             EncodedMethodType type, uint32_t access_flag) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
     std::pair<uint32_t, uint32_t> DumpImplicitEncodedMethod(ArtMethod* method, ShadowFrame& shadow_frame, uint16_t num_reg) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
-#ifdef TIME_EVALUATION
-    void addTimeMeasure(struct timeval s, struct timeval e, TimeMeasureType type);
-#endif
-
-    void InitializeForceBranch();
-    void InitializeClassFilter();
+    // Builds the force branch index from lines in the force_branches format and publishes it.
+    void InitializeForceBranch(const std::vector<std::string>& lines);
+    // Rereads force_branches and replaces the index, then frees the indexes it replaced once
+    // every thread has passed a checkpoint. Runs on the signal catcher thread, on
+    // kForceBranchReloadSignal; interpreter threads never wait for it.
+    void ReloadForceBranch(Thread* self) LOCKS_EXCLUDED(Locks::mutator_lock_);
+    void InitializeClassFilter(const CollectionConfig* config);
+    // Reads the ring-full policy ("spill" or "drop") from queue_policy. Spill is the default.
+    // ToDumpQueueUnblock never waits on the recording thread under either.
+    void InitializeQueuePolicy();
+    // Reads the memory budget of the collector, in megabytes, from memory_budget.
+    void InitializeMemoryBudget();
+    // Reads the path of the cross-run dedup index from dedup_index and continues the numbering
+    // of the items it lists. Without the file, every run writes every item it collects.
+    void InitializeDedupIndex();
+    // Reads the limits of the fork explorer from explore. Without the file, forced runs do not
+    // fork.
+    void InitializeExplorer();
+    // Reads how saturated methods are sampled from sampling. Must run before the first
+    // NewCollectionState(); without the file, they are not.
+    void InitializeSampling();
+
+    // Requests the recording thread to flush all output files and report writer stats.
+    void RequestFlush();
+    // Flushes all output files from the calling thread, then updates the dedup index if one is
+    // used. Called at exit, and by the recording thread on a flush request.
+    void FlushOutput();
+
+    // Returns the calling thread's arena for MapAndList trees, creating it on first use.
+    CollectionArena* GetCollectionArena();
+
+    // Creates the saturation state of a method being hooked for collection.
+    CollectionState* NewCollectionState();
+
+    // Returns the memo of the indexes file's ids were dumped at, creating it on first use.
+    DumpDexMemo* GetDexMemo(const DexFile& file);
+
+    // DumpDexMemo::Lookup, counting the hit or miss in the calling thread's metrics.
+    bool LookupDexMemo(DumpDexMemo* memo, DumpMemoKind kind, uint32_t id, uint32_t* dumped_idx) {
+      bool hit = memo->Lookup(kind, id, dumped_idx);
+      int counter = hit ? kDumpCounterMemoHits : kDumpCounterMemoMisses;
+      metrics_.Count(static_cast<DumpCounter>(counter + kind), 1);
+      return hit;
+    }
+
+    // The DumpLocationTable id the *Dump functions take for items collected from file.
+    uint32_t LocationOf(const DexFile& file) {
+      return GetDexMemo(file)->Location();
+    }
+
+    // Counts a combined trace of code_units, left_out nops shorter than it would be with every
+    // instruction padded.
+    void CountTrace(uint32_t code_units, uint32_t left_out) {
+      traces_.FetchAndAddSequentiallyConsistent(1);
+      trace_units_.FetchAndAddSequentiallyConsistent(code_units);
+      trace_left_out_units_.FetchAndAddSequentiallyConsistent(left_out);
+    }
+
+    DumpMetrics* Metrics() {
+      return &metrics_;
+    }
+
+    DumpMemoryBudget* Budget() {
+      return &budget_;
+    }
+
+    // Writes the collection metrics and budget for the SIGQUIT dump, if a Dumper was created.
+    static void DumpForSigQuit(std::ostream& os);
 
   private:
     Dumper();
 
-    bool IsTargetProcess();
+    bool IsTargetProcess(const CollectionConfig* config);
 
     void ToDumpQueueUnblock(DumpItem* item);
 //    static void* ToDumpQueue(void* item);
-    static void* DumpRun(void* unused);
+    static void* DumpRun(void* arg);
+    void LogInternStats();
+    void LogArenaStats();
+    void LogCollectionStats();
+    void LogForceBranchStats();
+    void LogDexMemoStats();
+    void LogTraceStats();
+    void LogMetrics();
+    void LogBudgetStats();
+    void LogExploreStats();
+    // The intern table of items of type.
+    DumpInternTable* TableOf(DumpItemType type);
+    // Stages the records of a batch taken from the queue.
+    void WriteItems(DumpItem** items, size_t count);
+    // Waits at most timeout_ms until no item is between being interned and queued, and the
+    // recording thread has staged the record of every queued item; the recording thread itself
+    // stages them while it waits. Returns whether that happened.
+    bool WaitForQueueDrained(uint64_t timeout_ms);
+    // Adds the entries the intern tables added in this run to added, and the first unused index
+    // of every kind to next_index.
+    void CollectDedupEntries(std::vector<DumpDedupEntry> added[kDumpDedupKinds],
+                             uint32_t next_index[kDumpDedupKinds]);
+    void SaveDedupIndex(std::vector<DumpDedupEntry> added[kDumpDedupKinds],
+                        const uint32_t next_index[kDumpDedupKinds]);
+    static void ReleaseCollectionArena(void* arena);
+    // Forks a child for each outcome of the branch but the one the registers select, as far as
+    // there are slots, with every thread suspended. Returns the outcome the calling process is
+    // to take: 0 in this process, the child's own in a child.
+    int32_t ExploreBranch(Thread* self, const ShadowFrame& shadow_frame, const Instruction* inst,
+                          uint32_t dex_pc) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+    // Stops the recording thread between two batches, where it holds no lock, and returns once
+    // it has.
+    void PauseRecording();
+    void ResumeRecording();
+    // Called by the recording thread between batches; waits while a pause is requested.
+    void CheckRecordingPause();
+    // Runs in a child forked by ExploreBranch(), where only the calling thread exists: gives
+    // the child files of its own, drops what the parent queued and staged, and restarts the
+    // recording thread and the budget watchdog.
+    void AfterExploreFork();
+    // Writes the output of a forked child once its budget is spent, and ends it.
+    static void* ExploreWatchdog(void* arg);
 
     std::string path_prefix_;
     pid_t pid_;
     std::string package_name_;
-    std::vector<std::string> class_filter_;
-    std::vector<std::string> included_class_;
+    ClassFilterMatcher class_filter_;
+    ClassFilterMatcher included_class_;
 
 //    std::vector<DumpString*> strings_;
 //    std::vector<DumpType*> types_;
@@ -361,38 +462,61 @@ class Dumper {
 //    std::vector<DumpEncodedField*> encoded_fields_;
 //    std::vector<DumpEncodedMethod*> encoded_methods_;
 //    std::vector<DumpCodeItem*> codes_;
-    std::map<size_t, uint32_t> strings_;
-    std::map<size_t, uint32_t> types_;
-    std::map<size_t, uint32_t> protos_;
-    std::map<size_t, uint32_t> fields_;
-    std::map<size_t, uint32_t> methods_;
-    std::map<size_t, uint32_t> classes_;
-    std::map<size_t, uint32_t> static_values_;
-    std::map<size_t, uint32_t> encoded_fields_;
-    std::map<size_t, uint32_t> encoded_methods_;
-    std::map<size_t, uint32_t> codes_;
-    pthread_mutex_t string_mutex_;
-    pthread_mutex_t type_mutex_;
-    pthread_mutex_t proto_mutex_;
-    pthread_mutex_t field_mutex_;
-    pthread_mutex_t method_mutex_;
-    pthread_mutex_t class_mutex_;
-    pthread_mutex_t static_value_mutex_;
-    pthread_mutex_t encoded_field_mutex_;
-    pthread_mutex_t encoded_method_mutex_;
-    pthread_mutex_t code_mutex_;
+    DumpInternTable strings_;
+    DumpInternTable types_;
+    DumpInternTable protos_;
+    DumpInternTable fields_;
+    DumpInternTable methods_;
+    DumpInternTable classes_;
+    DumpInternTable static_values_;
+    DumpInternTable encoded_fields_;
+    DumpInternTable encoded_methods_;
+    DumpInternTable codes_;
 //    pthread_mutex_t map_mutex_;
     pthread_t recording_thread_;
     RecordingQueue<DumpItem*> queue_;
-
-    std::vector<ForceBranch*> force_branches_;
+    DumpWriter writer_;
+    volatile sig_atomic_t flush_requested_;
+
+    pthread_key_t arena_key_;
+    pthread_mutex_t arena_mutex_;
+    std::vector<CollectionArena*> arenas_;
+
+    pthread_mutex_t collection_states_mutex_;
+    std::vector<CollectionState*> collection_states_;
+    CollectionSampling sampling_;
+
+    Atomic<uint64_t> traces_;
+    Atomic<uint64_t> trace_units_;
+    Atomic<uint64_t> trace_left_out_units_;
+    DumpMetrics metrics_;
+    DumpMemoryBudget budget_;
+    // Empty unless a dedup index is used.
+    std::string dedup_index_path_;
+    // Items GeneralDump interned but did not queue yet. Only counted while a dedup index is used.
+    Atomic<uint32_t> dumps_in_flight_;
+    DumpDedupIndex dedup_index_;
+
+    DumpLocationTable locations_;
+    pthread_mutex_t dex_memos_mutex_;
+    std::vector<DumpDexMemo*> dex_memos_;
+
+    // Read without a lock; a reload builds a new index and swaps it in.
+    Atomic<ForceBranchIndex*> force_branches_;
+    // Serializes reloads. Guards the retired indexes, and the stats of the current one against
+    // it being retired and freed.
+    pthread_mutex_t force_branches_mutex_;
+    // Indexes replaced by a reload that a thread may still be reading.
+    std::vector<ForceBranchIndex*> retired_force_branches_;
     bool force_execution_;
     std::string random_prefix_;
 
-#ifdef TIME_EVALUATION
-    TimeMeasure measure_;
-    pthread_mutex_t time_mutex_;
-#endif
+    ForkExplorer explorer_;
+    // Guards the two flags below, through which a fork pauses the recording thread.
+    pthread_mutex_t recording_pause_mutex_;
+    pthread_cond_t recording_pause_cond_;
+    bool recording_pause_requested_;
+    bool recording_paused_;
 
     static Dumper* sInstance;
 };
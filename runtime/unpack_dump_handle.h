@@ -18,69 +18,112 @@
 #define ART_RUNTIME_UNPACK_DUMP_HANDLE_H_
 
 #include "unpack_dump.h"
-#include <sys/time.h>
+#include <algorithm>
+
+#include "base/arena_object.h"
+#include "base/scoped_arena_containers.h"
+#include "scoped_thread_state_change.h"
+#include "unpack_arena.h"
 
 namespace art {
 
+// The macros below expand inside ExecuteSwitchImpl and ExecuteGotoImpl, whose `collect`
+// template argument is true only for the instantiation run by methods hooked for collection.
+// Gating on it lets the compiler drop every collection hook from the stock instantiation.
+#define COLLECTING (collect && map_and_list != nullptr)
 
-#ifdef PERFORMANCE_EVALUATION
-#define ALLOW_TEMP_MEMORY(_fun_name_)                                               \
-    MapAndList* root_map_and_list = nullptr;                                             \
-    MapAndList* map_and_list = nullptr;                                        \
-    uint8_t last_throw = 0xff;                                                      \
-    DumpCodeItem* executed_code = nullptr;                            \
-    if (shadow_frame.GetMethod()->ShouldManipulate()) {                             \
-      gettimeofday(&start_time, NULL);      \
-      executed_code = new DumpCodeItem;   \
-      executed_code->registers_size_ = code_item->registers_size_; \
-      executed_code->ins_size_ = code_item->ins_size_;  \
-      executed_code->outs_size_ = code_item->outs_size_;  \
-      root_map_and_list = new MapAndList(nullptr, 0);                                    \
-      map_and_list = root_map_and_list;                                             \
-      LOG(ERROR) << "method start " << start_time.tv_sec << " " << start_time.tv_usec;\
-    }
-#else
 #define ALLOW_TEMP_MEMORY(_fun_name_)                                               \
+    CollectionArenaScope collection_arena_scope;                                    \
     MapAndList* root_map_and_list = nullptr;                                             \
     MapAndList* map_and_list = nullptr;                                        \
     uint8_t last_throw = 0xff;                                                      \
     int32_t force_execution_offset = 0;                                  \
     DumpCodeItem* executed_code = nullptr;                                          \
-    if (shadow_frame.GetMethod()->ShouldManipulate()) {                             \
+    CollectionState* collection_state = nullptr;                                    \
+    uint32_t new_collection_edges = 0;                                              \
+    bool force_branches = false;                                                    \
+    uint64_t trace_start_ns = 0;                                                    \
+    Dumper* dumper = nullptr;                                                       \
+    if (collect && ShouldTraceInvocation(self, shadow_frame.GetMethod(),            \
+                                         result_register, &dumper,                  \
+                                         &collection_state, &force_branches)) {     \
+      trace_start_ns = NanoTime();                                                  \
       executed_code = new DumpCodeItem;   \
       executed_code->registers_size_ = code_item->registers_size_; \
       executed_code->ins_size_ = code_item->ins_size_;  \
       executed_code->outs_size_ = code_item->outs_size_;  \
-      root_map_and_list = new MapAndList(nullptr, 0);                                    \
+      ScopedArenaAllocator* allocator = collection_arena_scope.Open();               \
+      root_map_and_list = new (allocator) MapAndList(allocator, nullptr, 0);         \
+      root_map_and_list->ReserveCodeIndex(code_item->insns_size_in_code_units_);     \
       map_and_list = root_map_and_list;                                             \
     }
-#endif
 
 #define FREE_TEMP_MEMORY()                        \
-    delete root_map_and_list;
+    delete root_map_and_list;                     \
+    collection_arena_scope.Close();
+
+// Saturation bookkeeping for a control-flow edge of a hooked method: traced invocations record
+// the edge, fast path invocations desaturate the method if they take an edge it does not know.
+#define COLLECTION_EDGE(_edge_)                                                             \
+    if (collect && collection_state) {                                                                  \
+      if (COLLECTING) {                                                                    \
+        new_collection_edges += collection_state->AddEdge(_edge_) ? 1 : 0;                 \
+      } else if (!collection_state->HasEdge(_edge_)) {                                       \
+        collection_state->Desaturate();                                                      \
+        collection_state = nullptr;                                                          \
+      }                                                                                      \
+    }
+
+#define END_COLLECTION_TRACE()                                                              \
+    if (collect && collection_state) {                                                                  \
+      collection_state->EndTrace(new_collection_edges);                                     \
+    }
+
+// The target of a quickened invoke depends on the receiver, and so does the rewritten invoke.
+#define HANDLE_INVOKE_QUICK_EDGE(_is_range_)                                                \
+    if (collect && collection_state) {                                                                  \
+      mirror::Object* edge_receiver = shadow_frame.GetVRegReference(                        \
+          (_is_range_) ? inst->VRegC_3rc() : inst->VRegC_35c());                            \
+      if (edge_receiver != nullptr) {                                                        \
+        ArtMethod* edge_target = edge_receiver->GetClass()->GetEmbeddedVTableEntry(          \
+            (_is_range_) ? inst->VRegB_3rc() : inst->VRegB_35c(), sizeof(void*));           \
+        COLLECTION_EDGE(CollectionState::Edge(dex_pc,                                        \
+            static_cast<int32_t>(reinterpret_cast<uintptr_t>(edge_target) >> 2)));          \
+      }                                                                                      \
+    }
+
+#define HANDLE_EXCEPTION_EDGE(_handler_dex_pc_)                                             \
+    COLLECTION_EDGE(CollectionState::ExceptionEdge(dex_pc, _handler_dex_pc_));
+
+#define IGNORE_EXCEPTION (COLLECTING && dumper->ForceExecution())
 
-#define IGNORE_EXCEPTION (map_and_list && Dumper::Instance()->ForceExecution())
+// Upper bound, in code units, of an instruction rewritten by the HANDLE_* macros. The rewritten
+// copy lives in a buffer of this size on the interpreter frame; HandleInstruction copies it into
+// the trace list, so it never needs to outlive the macro.
+#define MAX_REWRITTEN_INST_SIZE 8
 
+// Only methods with an entry in force_branches look their branches up, or every method while
+// exploring; for the others this is a test of a local set at method entry.
 #define FORCE_PATH()                                                                       \
     int32_t force_ret = 0;                                                                 \
-    if (map_and_list) {                                                                    \
-      force_ret = Dumper::Instance()->GetForceBranch(shadow_frame.GetMethod(), dex_pc);    \
+    if (COLLECTING && force_branches) {                                                    \
+      force_ret = dumper->ChooseBranch(self, shadow_frame, inst, dex_pc);                  \
     }
 
 #define HANDLE_INSTRUCTION(_count_)                                                         \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       HandleInstruction(map_and_list, &code_item->insns_[dex_pc], shadow_frame, _count_);  \
     }
 
 #define HANDLE_THROW_INSTRUCTION(_reg_)                                                     \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       last_throw = _reg_;                                                                   \
     }
 
 #define HANDLE_MOVE_EXCEPTION_INSTRUCTION(_reg_)                                            \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       if (last_throw != 0xff) {                                                             \
-        uint16_t* modified_inst = new uint16_t[2];                                          \
+        uint16_t modified_inst[2];                                                          \
         modified_inst[0] = 0x02 | (_reg_ << 8);                                             \
         modified_inst[1] = static_cast<uint16_t>(last_throw);                               \
         HandleInstruction(map_and_list, modified_inst, shadow_frame, 2);                   \
@@ -88,220 +131,172 @@ namespace art {
     }
 
 #define HANDLE_FILL_ARRAY_DATA_INSTRUCTION(_payload_)                                                            \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       HandleFillArrayData(map_and_list, inst_data, shadow_frame, _payload_);   \
     }
 
-#ifdef PERFORMANCE_EVALUATION
 #define HANDLE_RETURN_INSTRUCTION(_count_)                                                      \
-    if (map_and_list) {                                                                          \
+    if (COLLECTING) {                                                                          \
       HandleInstruction(map_and_list, &code_item->insns_[dex_pc], shadow_frame, _count_);      \
-      std::vector<uint16_t>* all_codes = new std::vector<uint16_t>;                             \
-      CombineCodes(root_map_and_list, all_codes);                                               \
-      HandleDump(shadow_frame, executed_code, all_codes);                                                       \
+      uint32_t left_out = CombineCodes(root_map_and_list, executed_code);                       \
+      HandleDump(dumper, shadow_frame, executed_code, left_out, trace_start_ns);                        \
+      END_COLLECTION_TRACE();                                                                   \
       FREE_TEMP_MEMORY();                                                                       \
-      struct timeval end_time; \
-      gettimeofday(&end_time, NULL);\
-      LOG(ERROR) << "normal return method time consum " << (end_time.tv_sec - start_time.tv_sec) << " " << (end_time.tv_usec - start_time.tv_usec);\
     }
-#else
-#define HANDLE_RETURN_INSTRUCTION(_count_)                                                      \
-    if (map_and_list) {                                                                          \
-      HandleInstruction(map_and_list, &code_item->insns_[dex_pc], shadow_frame, _count_);      \
-      std::vector<uint16_t>* all_codes = new std::vector<uint16_t>;                             \
-      CombineCodes(root_map_and_list, all_codes);                                               \
-      HandleDump(shadow_frame, executed_code, all_codes);                                                       \
-      FREE_TEMP_MEMORY();                                                                       \
-    }
-#endif
 
-#ifdef PERFORMANCE_EVALUATION
-#define HANDLE_EXCEPTION_RETURN()                                                              \
-    if (map_and_list) {                                                                      \
-      uint16_t* modified_inst = new uint16_t[1];                      \
-      modified_inst[0] = 0xe;                                                   \
-      HandleInstruction(map_and_list, modified_inst, shadow_frame, 1);   \
-      delete modified_inst;               \
-      std::vector<uint16_t>* all_codes = new std::vector<uint16_t>;                                  \
-      CombineCodes(root_map_and_list, all_codes);                             \
-      HandleDump(shadow_frame, executed_code, all_codes);                           \
-      FREE_TEMP_MEMORY();                                                                      \
-      struct timeval end_time; \
-      gettimeofday(&end_time, NULL);\
-      LOG(ERROR) << "exception return method time consum " << (end_time.tv_sec - start_time.tv_sec) << " " << (end_time.tv_usec - start_time.tv_usec);\
-    }
-#else
 #define HANDLE_EXCEPTION_RETURN()                                                              \
-    if (map_and_list) {                                                                      \
-      uint16_t* modified_inst = new uint16_t[1];                      \
-      modified_inst[0] = 0xe;                                                   \
-      HandleInstruction(map_and_list, modified_inst, shadow_frame, 1);   \
-      delete modified_inst;               \
-      std::vector<uint16_t>* all_codes = new std::vector<uint16_t>;                                  \
-      CombineCodes(root_map_and_list, all_codes);                             \
-      HandleDump(shadow_frame, executed_code, all_codes);                           \
+    if (COLLECTING) {                                                                      \
+      uint16_t modified_inst = 0xe;                                             \
+      HandleInstruction(map_and_list, &modified_inst, shadow_frame, 1);  \
+      uint32_t left_out = CombineCodes(root_map_and_list, executed_code);           \
+      HandleDump(dumper, shadow_frame, executed_code, left_out, trace_start_ns);                      \
+      END_COLLECTION_TRACE();                                                       \
       FREE_TEMP_MEMORY();                                                                      \
     }
-#endif
 
-#ifdef PERFORMANCE_EVALUATION
 #define HANDLE_SPECIAL_RETURN_INSTRUCTION(_count_)                                     \
-    if (map_and_list) {                                                                      \
-      uint16_t* modified_inst = new uint16_t[_count_];                      \
+    if (COLLECTING) {                                                                      \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                          \
       memcpy(modified_inst, &code_item->insns_[dex_pc], _count_ * 2);           \
       modified_inst[0] = 0xe;                                                   \
       HandleInstruction(map_and_list, modified_inst, shadow_frame, _count_);   \
-      delete modified_inst;               \
-      std::vector<uint16_t>* all_codes = new std::vector<uint16_t>;                                  \
-      CombineCodes(root_map_and_list, all_codes);                             \
-      HandleDump(shadow_frame, executed_code, all_codes);                           \
+      uint32_t left_out = CombineCodes(root_map_and_list, executed_code);           \
+      HandleDump(dumper, shadow_frame, executed_code, left_out, trace_start_ns);                      \
+      END_COLLECTION_TRACE();                                                       \
       FREE_TEMP_MEMORY();                                               \
-      struct timeval end_time; \
-      gettimeofday(&end_time, NULL);\
-      LOG(ERROR) << "special return method time consum " << (end_time.tv_sec - start_time.tv_sec) << " " << (end_time.tv_usec - start_time.tv_usec);\
     }
-#else
-#define HANDLE_SPECIAL_RETURN_INSTRUCTION(_count_)                                     \
-    if (map_and_list) {                                                                      \
-      uint16_t* modified_inst = new uint16_t[_count_];                      \
-      memcpy(modified_inst, &code_item->insns_[dex_pc], _count_ * 2);           \
-      modified_inst[0] = 0xe;                                                   \
-      HandleInstruction(map_and_list, modified_inst, shadow_frame, _count_);   \
-      delete modified_inst;               \
-      std::vector<uint16_t>* all_codes = new std::vector<uint16_t>;                                  \
-      CombineCodes(root_map_and_list, all_codes);                             \
-      HandleDump(shadow_frame, executed_code, all_codes);                           \
-      FREE_TEMP_MEMORY();                                               \
-    }
-#endif
 
 #define HANDLE_GOTO_INSTRUCTION(_offset_)                                                      \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       HandleGoto(map_and_list, shadow_frame, _offset_);                         \
     }
 
 #define HANDLE_SWITCH_INSTRUCTION(_key_, _offset_)                                             \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       HandleSwitch(map_and_list, inst_data, shadow_frame, _offset_, _key_);                                                     \
-    }
+    }                                                                                        \
+    COLLECTION_EDGE(CollectionState::Edge(dex_pc, _key_));
 
 #define HANDLE_IF_INSTRUCTION(_offset_)                                                        \
-    if (map_and_list) {                                                                      \
+    if (COLLECTING) {                                                                      \
       HandleIf(map_and_list, inst_data, shadow_frame, _offset_);           \
-    }
+    }                                                                                        \
+    COLLECTION_EDGE(CollectionState::Edge(dex_pc, _offset_));
 
 #define HANDLE_INSTRUCTION_ABOUT_STRING(_str_idx_)                                    \
-    if (map_and_list) {                                                                      \
-      uint16_t* modified_inst = HandleString(inst_data, _str_idx_, shadow_frame);                                   \
+    if (COLLECTING) {                                                                      \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                                     \
+      HandleString(inst_data, _str_idx_, shadow_frame, modified_inst);                     \
       HandleInstruction(map_and_list, modified_inst, shadow_frame, 3);   \
-      delete modified_inst;                   \
     }
 
 #define HANDLE_INSTRUCTION_ABOUT_TYPE(_type_idx_, _count_)                                     \
-    if (map_and_list) {                                                                      \
-      uint16_t* modified_inst = HandleType(&code_item->insns_[dex_pc], _type_idx_, shadow_frame, _count_);                                    \
+    if (COLLECTING) {                                                                      \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                                     \
+      HandleType(&code_item->insns_[dex_pc], _type_idx_, shadow_frame, _count_, modified_inst);  \
       HandleInstruction(map_and_list, modified_inst, shadow_frame, _count_);   \
-      delete modified_inst;               \
     }
 
 #define HANDLE_INSTRUCTION_ABOUT_FIELD(f, _is_get_) \
     if (inst_list) {                                                                      \
-      uint16_t* modified_inst;                                                              \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                                      \
       if (_is_get_) {                                                                          \
-        modified_inst = HandleFieldGet<find_type, field_type, do_access_check>(inst_list,    \
-                          shadow_frame, 2, f, is_static);                                           \
+        HandleFieldGet<find_type, field_type, do_access_check>(inst_list,                   \
+                          shadow_frame, 2, f, is_static, modified_inst);                            \
       } else {                                                                                 \
-        modified_inst = HandleFieldPut<find_type, field_type, do_access_check>(inst_list,           \
-                          shadow_frame, 2, f, is_static);                                           \
+        HandleFieldPut<find_type, field_type, do_access_check>(inst_list,                   \
+                          shadow_frame, 2, f, is_static, modified_inst);                            \
       }                                                                                        \
       HandleInstruction(map_and_list, modified_inst, shadow_frame, 2);         \
-      delete modified_inst;                       \
     }
 
 #define HANDLE_INSTRUCTION_ABOUT_FIELD_QUICK(f, _is_get_)                           \
     if (inst_list) {                                                                      \
-      uint16_t* modified_inst;                                                              \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                                      \
       if (_is_get_) {                                                                          \
-        modified_inst = HandleFieldGetQuick<field_type>(inst_list, shadow_frame, f, 2);      \
+        HandleFieldGetQuick<field_type>(inst_list, shadow_frame, f, 2, modified_inst);       \
       } else {                                                                                 \
-        modified_inst = HandleFieldPutQuick<field_type>(inst_list, shadow_frame, f, 2);      \
+        HandleFieldPutQuick<field_type>(inst_list, shadow_frame, f, 2, modified_inst);       \
       }                                                                                        \
       HandleInstruction(map_and_list, modified_inst, shadow_frame, 2);         \
-      delete modified_inst;                       \
     }
 
 #define HANDLE_INSTRUCTION_ABOUT_INVOKE()                 \
     if (inst_list) {                                                                      \
-      uint16_t* modified_inst;                                                              \
-      modified_inst = HandleInvoke<type, is_range, do_access_check>(inst_list, shadow_frame,  \
-          called_method, 3);              \
-      uint16_t count = modified_inst[0];                                            \
-      HandleInstruction(map_and_list, &(modified_inst[1]), shadow_frame, count);         \
-      delete modified_inst;                       \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                                      \
+      uint16_t count = HandleInvoke<type, is_range, do_access_check>(inst_list, shadow_frame, \
+          called_method, 3, modified_inst);                                                 \
+      HandleInstruction(map_and_list, modified_inst, shadow_frame, count);                \
     }
 
 #define HANDLE_INSTRUCTION_ABOUT_INVOKE_QUICK()                                      \
     if (inst_list) {                                                                      \
-      uint16_t* modified_inst;                                                              \
-      modified_inst = HandleInvokeQuick<is_range>(inst_list, shadow_frame, called_method, 3);          \
-      uint16_t count = modified_inst[0];                                            \
-      HandleInstruction(map_and_list, &(modified_inst[1]), shadow_frame, count);         \
-      delete modified_inst;                       \
+      uint16_t modified_inst[MAX_REWRITTEN_INST_SIZE];                                      \
+      uint16_t count = HandleInvokeQuick<is_range>(inst_list, shadow_frame, called_method, 3,  \
+          modified_inst);                                                                   \
+      HandleInstruction(map_and_list, modified_inst, shadow_frame, count);                \
     }
 
-struct DumpSwitchTable {
-  std::map<int32_t, int32_t> target_map_;
+struct DumpSwitchTable : public DeletableArenaObject<kArenaAllocMisc> {
+  ScopedArenaSafeMap<int32_t, int32_t> target_map_;
+
+  explicit DumpSwitchTable(ScopedArenaAllocator* allocator)
+      : target_map_(std::less<int32_t>(), allocator->Adapter()) {}
 };
 
-struct DumpFillArrayData {
+struct DumpFillArrayData : public DeletableArenaObject<kArenaAllocMisc> {
   uint16_t element_width_;
   uint32_t element_count_;
-  std::vector<uint8_t> datas_;
+  ScopedArenaVector<uint8_t> datas_;
+
+  explicit DumpFillArrayData(ScopedArenaAllocator* allocator) : datas_(allocator->Adapter()) {}
 };
 
 #define CODE_NO_INDEX 0xffffffff
 
-struct MapAndList {
-  std::vector<uint16_t>* code_list;
-//  CodeMap* code_map;
-  std::vector<uint32_t>* code_map_key;
-  std::vector<uint32_t>* code_map_value;
-  std::map<uint32_t, DumpSwitchTable*>* switch_table_map;
-  std::map<uint32_t, DumpFillArrayData*>* fill_array_data_map;
-  std::vector<MapAndList*>* childs;
+// A trace list and its hack branches. Lists and everything they point to are allocated from the
+// ScopedArenaAllocator of the collected invocation and are never destroyed individually: the
+// whole tree goes away when the invocation's CollectionArenaScope closes. Deleting the root only
+// runs the destructors, which debug builds need to balance the arena reference counts.
+struct MapAndList : public DeletableArenaObject<kArenaAllocMisc> {
+  ScopedArenaAllocator* allocator;
+  ScopedArenaVector<uint16_t>* code_list;
+  ScopedArenaVector<uint32_t>* code_map_key;
+  ScopedArenaVector<uint32_t>* code_map_value;
+  // Dense dex_pc -> position index over [code_index_base, code_index_base + size). Holds the
+  // position of the first push of each dex_pc, which is what the linear search used to return.
+  ScopedArenaVector<uint32_t>* code_index;
+  uint32_t code_index_base;
+  ScopedArenaSafeMap<uint32_t, DumpSwitchTable*>* switch_table_map;
+  ScopedArenaSafeMap<uint32_t, DumpFillArrayData*>* fill_array_data_map;
+  ScopedArenaVector<MapAndList*>* childs;
+  // Positions of the instructions a goto may be spliced in front of, in push order: everything
+  // but move-result. CombineCodes lays out nops only in front of the ones a hack branch starts at.
+  ScopedArenaVector<uint32_t>* pad_slots;
+  // Positions of the gotos, and of the placeholders if and switch keep for one, in push order.
+  // CombineCodes relocates their offsets over the nops it lays out.
+  ScopedArenaVector<uint32_t>* goto_slots;
+  // The pad slots CombineCodes lays out nops in front of, picked by its sizing pass.
+  ScopedArenaVector<uint32_t>* padded_slots;
   uint32_t start_pos;
   uint32_t end_pos;
   uint32_t prev_ins_pos;
   MapAndList* parent;
-  bool inited;
-
-  MapAndList() {
-//    code_list = nullptr;
-//    // code_map = nullptr;
-//    code_map_key = nullptr;
-//    code_map_value = nullptr;
-//    switch_table_map = nullptr;
-//    fill_array_data_map = nullptr;
-//    childs = nullptr;
-//    parent = nullptr;
-//    inited = false;
-    LOG(FATAL) << "unwanted constructor " << this;
-  }
 
-  MapAndList(MapAndList* p, uint32_t s) {
-    init(p, s);
-    // LOG(ERROR) << "constructor " << this;
-  }
-
-  void init(MapAndList* p, uint32_t s) {
-    inited = true;
-    code_list = new std::vector<uint16_t>;
-    // code_map = new CodeMap;
-    code_map_key = new std::vector<uint32_t>;
-    code_map_value = new std::vector<uint32_t>;
-    switch_table_map = new std::map<uint32_t, DumpSwitchTable*>;
-    fill_array_data_map = new std::map<uint32_t, DumpFillArrayData*>;
-    childs = new std::vector<MapAndList*>;
+  MapAndList(ScopedArenaAllocator* a, MapAndList* p, uint32_t s) : allocator(a) {
+    code_list = NewInArena<ScopedArenaVector<uint16_t>>(allocator->Adapter());
+    code_map_key = NewInArena<ScopedArenaVector<uint32_t>>(allocator->Adapter());
+    code_map_value = NewInArena<ScopedArenaVector<uint32_t>>(allocator->Adapter());
+    code_index = NewInArena<ScopedArenaVector<uint32_t>>(allocator->Adapter());
+    code_index_base = 0;
+    switch_table_map = NewInArena<ScopedArenaSafeMap<uint32_t, DumpSwitchTable*>>(
+        std::less<uint32_t>(), allocator->Adapter());
+    fill_array_data_map = NewInArena<ScopedArenaSafeMap<uint32_t, DumpFillArrayData*>>(
+        std::less<uint32_t>(), allocator->Adapter());
+    childs = NewInArena<ScopedArenaVector<MapAndList*>>(allocator->Adapter());
+    pad_slots = NewInArena<ScopedArenaVector<uint32_t>>(allocator->Adapter());
+    goto_slots = NewInArena<ScopedArenaVector<uint32_t>>(allocator->Adapter());
+    padded_slots = NewInArena<ScopedArenaVector<uint32_t>>(allocator->Adapter());
     start_pos = s;
     prev_ins_pos = 0;
     parent = p;
@@ -311,12 +306,48 @@ struct MapAndList {
     }
   }
 
+  ~MapAndList() {
+    for (MapAndList* child : *childs) {
+      delete child;
+    }
+    for (auto& entry : *switch_table_map) {
+      delete entry.second;
+    }
+    for (auto& entry : *fill_array_data_map) {
+      delete entry.second;
+    }
+    DeleteInArena(padded_slots);
+    DeleteInArena(goto_slots);
+    DeleteInArena(pad_slots);
+    DeleteInArena(childs);
+    DeleteInArena(fill_array_data_map);
+    DeleteInArena(switch_table_map);
+    DeleteInArena(code_index);
+    DeleteInArena(code_map_value);
+    DeleteInArena(code_map_key);
+    DeleteInArena(code_list);
+  }
+
+  // Starts a hack branch of this list at position s.
+  MapAndList* NewBranch(uint32_t s) {
+    return new (allocator) MapAndList(allocator, this, s);
+  }
+
+  // Covers dex_pcs [0, code_units) up front, so the root list never has to grow its index.
+  void ReserveCodeIndex(uint32_t code_units) {
+    if (code_index->empty()) {
+      code_index_base = 0;
+      code_index->assign(code_units, CODE_NO_INDEX);
+    }
+  }
+
   uint32_t FindCodeInCodeMap(uint32_t key) {
     // LOG(ERROR) << "FindCodeInCodeMap " << this << " " << key << " "
     //     << code_map_key->size() << " " << code_map_value->size();
     // return code_map.find(key);
-    auto it = std::find(code_map_key->begin(), code_map_key->end(), key);
-    return it == code_map_key->end() ? CODE_NO_INDEX : code_map_value->at(it - code_map_key->begin());
+    // Keys below the base wrap around to a large slot and miss as well.
+    uint32_t slot = key - code_index_base;
+    return slot < code_index->size() ? (*code_index)[slot] : CODE_NO_INDEX;
   }
 
   void PushCodeToCodeMap(uint32_t key, uint32_t value) {
@@ -325,80 +356,51 @@ struct MapAndList {
     // code_map->insert(std::make_pair(key, value));
     code_map_key->push_back(key);
     code_map_value->push_back(value);
-  }
 
-  ~MapAndList() {
-    if (inited) {
-//      LOG(ERROR) << "destructor " << this;
-    } else {
-      LOG(FATAL) << "unwanted destructor " << this;
-    }
-
-    if (code_list) {
-      code_list->clear();
-      delete code_list;
-      code_list = nullptr;
-    }
-
-//    if (code_map) {
-//      code_map->clear();
-//      delete code_map;
-//      code_map = nullptr;
-//    }
-
-    if (code_map_key) {
-      code_map_key->clear();
-      delete code_map_key;
-      code_map_key = nullptr;
-    }
-
-    if (code_map_value) {
-      code_map_value->clear();
-      delete code_map_value;
-      code_map_value = nullptr;
+    uint32_t size = code_index->size();
+    if (size == 0) {
+      // Branch lists only touch a few dex_pcs, so start the window at the first one.
+      code_index_base = key;
+      code_index->assign(1, CODE_NO_INDEX);
+    } else if (key < code_index_base) {
+      // Grow downwards at least geometrically, but not below dex_pc 0.
+      uint32_t grow = std::min(code_index_base, std::max(code_index_base - key, size));
+      code_index->insert(code_index->begin(), grow, CODE_NO_INDEX);
+      code_index_base -= grow;
+    } else if (key - code_index_base >= size) {
+      code_index->resize(std::max(key - code_index_base + 1, size * 2), CODE_NO_INDEX);
     }
-
-    if (switch_table_map) {
-      for (auto iter : *switch_table_map) {
-        delete iter.second;
-      }
-      switch_table_map->clear();
-      delete switch_table_map;
-      switch_table_map = nullptr;
+    uint32_t& pos = (*code_index)[key - code_index_base];
+    if (pos == CODE_NO_INDEX) {
+      pos = value;
     }
+  }
 
-    if (fill_array_data_map) {
-      for (auto iter : *fill_array_data_map) {
-        delete iter.second;
-      }
-      fill_array_data_map->clear();
-      delete fill_array_data_map;
-      fill_array_data_map = nullptr;
-    }
+ private:
+  template <typename T, typename... Args>
+  T* NewInArena(Args&&... args) {
+    return new (allocator->Alloc(sizeof(T), kArenaAllocMisc)) T(std::forward<Args>(args)...);
+  }
 
-    if (childs) {
-      for (auto sub_list : *childs) {
-        delete sub_list;
-      }
-      childs->clear();
-      delete childs;
-      childs = nullptr;
-    }
+  template <typename T>
+  static void DeleteInArena(T* container) {
+    container->~T();
   }
 };
 
-#define NOPS_BEFORE_EACH_INST 8
+// Room left in front of an instruction a hack branch starts at, for combining branches.
+#define NOPS_BEFORE_BRANCH_START 8
 
 static inline int32_t GetOffsetForPos(MapAndList*& list, uint32_t dex_pc, int32_t offset) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   uint32_t idx = list->FindCodeInCodeMap(dex_pc + offset);
   if (idx != CODE_NO_INDEX) {
     return idx;
   } else {
-    return list->code_list->size() + NOPS_BEFORE_EACH_INST;
+    return list->code_list->size();
   }
 }
 
-static inline bool IsSameInstruction(const uint16_t* code, std::vector<uint16_t>* list, uint32_t mapped_pos, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+static inline bool IsSameInstruction(const uint16_t* code, ScopedArenaVector<uint16_t>* list, uint32_t mapped_pos, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   bool ret = true;
   uint32_t idx = 0;
   for (idx = 0; idx < count; ++idx) {
@@ -472,7 +474,7 @@ static inline bool IsSameSwitchInstruction(MapAndList*& list, uint16_t instructi
     if (iter != switch_table->target_map_.end()) {
       return iter->second == offset;
     } else {
-      switch_table->target_map_.insert(std::pair<int32_t, int32_t>(key, offset));
+      switch_table->target_map_.Put(key, offset);
       return true;
     }
   }
@@ -509,11 +511,8 @@ static inline void PushInstructionToList(MapAndList*& list, const uint16_t* code
     uint32_t dex_pc, uint32_t count, bool is_move_result) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   uint32_t idx;
   if (!is_move_result) {
-    // Add nops before each instruction, just for convenience of combine branches
-    for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-      list->code_list->push_back(0);
-    }
-  }  // Add nops before move-result instruction is not allowed.
+    list->pad_slots->push_back(list->code_list->size());
+  }  // Splicing before move-result instruction is not allowed.
 
   list->PushCodeToCodeMap(dex_pc, list->code_list->size());
 
@@ -525,11 +524,8 @@ static inline void PushInstructionToList(MapAndList*& list, const uint16_t* code
 }
 
 static inline void PushGotoInstructionToList(MapAndList*& list, uint32_t dex_pc, int32_t offset) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  uint32_t idx;
-  // Add nops before each instruction, just for convenience of combine branches
-  for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-    list->code_list->push_back(0);
-  }
+  list->pad_slots->push_back(list->code_list->size());
+  list->goto_slots->push_back(list->code_list->size());
 
   list->PushCodeToCodeMap(dex_pc, list->code_list->size());
   list->prev_ins_pos = list->code_list->size() + offset;
@@ -541,11 +537,8 @@ static inline void PushGotoInstructionToList(MapAndList*& list, uint32_t dex_pc,
 
 static inline void PushSwitchInstructionToList(MapAndList*& list, uint16_t instruction,
     uint32_t dex_pc, int32_t offset, int32_t key, bool is_default) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  uint32_t idx;
-  // Add nops before each instruction, just for convenience of combine branches
-  for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-    list->code_list->push_back(0);
-  }
+  list->pad_slots->push_back(list->code_list->size());
+  list->goto_slots->push_back(list->code_list->size() + 3);
 
   list->PushCodeToCodeMap(dex_pc, list->code_list->size());
   list->prev_ins_pos = list->code_list->size() + offset;
@@ -568,19 +561,16 @@ static inline void PushSwitchInstructionToList(MapAndList*& list, uint16_t instr
   }
 
   // create switch table for this switch
-  DumpSwitchTable* switch_table = new DumpSwitchTable;
-  switch_table->target_map_.insert(std::pair<int32_t, int32_t>(key, offset));
+  DumpSwitchTable* switch_table = new (list->allocator) DumpSwitchTable(list->allocator);
+  switch_table->target_map_.Put(key, offset);
   // LOG(ERROR) << "insert into switch table " << list->code_list->size() - 6 << " " << key << " " << offset;
-  list->switch_table_map->insert(std::pair<uint32_t, DumpSwitchTable*>(dex_pc, switch_table));
+  list->switch_table_map->Put(dex_pc, switch_table);
 }
 
 static inline void PushFillArrayDataInstructionToList(MapAndList*& list, uint16_t instruction,
     uint32_t dex_pc, const Instruction::ArrayDataPayload* payload) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   uint32_t idx;
-  // Add nops before each instruction, just for convenience of combine branches
-  for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-    list->code_list->push_back(0);
-  }
+  list->pad_slots->push_back(list->code_list->size());
 
   list->PushCodeToCodeMap(dex_pc, list->code_list->size());
   list->prev_ins_pos = list->code_list->size();
@@ -591,7 +581,7 @@ static inline void PushFillArrayDataInstructionToList(MapAndList*& list, uint16_
   list->code_list->push_back(0);
 
   // create switch table for this switch
-  DumpFillArrayData* data = new DumpFillArrayData;
+  DumpFillArrayData* data = new (list->allocator) DumpFillArrayData(list->allocator);
   data->element_width_ = payload->element_width;
   data->element_count_ = payload->element_count;
   uint32_t total_size = data->element_width_ * data->element_count_;
@@ -600,16 +590,14 @@ static inline void PushFillArrayDataInstructionToList(MapAndList*& list, uint16_
     // LOG(ERROR) << "push " << payload->data[idx];
     data->datas_.push_back(payload->data[idx]);
   }
-  list->fill_array_data_map->insert(std::pair<uint32_t, DumpFillArrayData*>(dex_pc, data));
+  list->fill_array_data_map->Put(dex_pc, data);
 }
 
 static inline void PushIfInstructionToList(MapAndList*& list, uint16_t instruction,
     uint32_t dex_pc, int32_t offset, bool is_else) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  uint32_t idx;
-  // Add nops before each instruction, just for convenience of combine branches
-  for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-    list->code_list->push_back(0);
-  }
+  list->pad_slots->push_back(list->code_list->size());
+  list->goto_slots->push_back(list->code_list->size() + 2);
+  list->goto_slots->push_back(list->code_list->size() + 5);
 
   list->PushCodeToCodeMap(dex_pc, list->code_list->size());
   list->prev_ins_pos = list->code_list->size() + offset;
@@ -644,94 +632,190 @@ static inline void PushIfInstructionToList(MapAndList*& list, uint16_t instructi
     list->code_list->push_back(static_cast<uint16_t>((offset & 0xffff0000) >> 16));
   }
 }
-static inline void CombineCodes(MapAndList* list, std::vector<uint16_t>* codes) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+
+// Collects the positions of list CombineCodes lays out nops in front of: the pad slots a hack
+// branch of list starts at, sorted.
+static inline void CollectPaddedSlots(MapAndList* list, ScopedArenaVector<uint32_t>* padded) {
+  padded->clear();
+  for (MapAndList* child : *list->childs) {
+    if (std::binary_search(list->pad_slots->begin(), list->pad_slots->end(), child->start_pos)) {
+      padded->push_back(child->start_pos);
+    }
+  }
+  std::sort(padded->begin(), padded->end());
+  padded->erase(std::unique(padded->begin(), padded->end()), padded->end());
+}
+
+// Where position pos of a list lands in the combined code, once nops are in front of padded.
+static inline uint32_t ExpandPos(const ScopedArenaVector<uint32_t>& padded, uint32_t pos) {
+  uint32_t slots = std::upper_bound(padded.begin(), padded.end(), pos) - padded.begin();
+  return pos + slots * NOPS_BEFORE_BRANCH_START;
+}
+
+static inline int32_t ExpandOffset(const ScopedArenaVector<uint32_t>& padded, uint32_t pos,
+    int32_t offset) {
+  return static_cast<int32_t>(ExpandPos(padded, pos + offset) - ExpandPos(padded, pos));
+}
+
+// Sizing pass of CombineCodes: picks the padded slots of list and its hack branches, and returns
+// how many code units they combine to.
+static inline uint32_t SizeCombinedList(MapAndList* list) {
+  CollectPaddedSlots(list, list->padded_slots);
+  // start_pos, end_pos and the code size, then the code.
+  uint32_t size = 6 + list->code_list->size() + list->padded_slots->size() * NOPS_BEFORE_BRANCH_START;
+  // Map size, then a key and a value per entry.
+  size += 2 + list->code_map_key->size() * 4;
+  // Table count, then per table its position, kind and size, keys and targets.
+  size += 2;
+  for (auto& table_iter : *list->switch_table_map) {
+    size += 4 + table_iter.second->target_map_.size() * 4;
+  }
+  // Array count, then per array its position, kind, width and count, and the packed bytes.
+  size += 2;
+  for (auto& table_iter : *list->fill_array_data_map) {
+    size += 6 + (table_iter.second->datas_.size() + 1) / 2;
+  }
+  // Child count, then the children.
+  size += 2;
+  for (MapAndList* child : *list->childs) {
+    size += SizeCombinedList(child);
+  }
+  return size;
+}
+
+// Writes list and its hack branches at out, and moves out past them. Positions and offsets of the
+// trace are compact; they are expanded here over the nops laid out in front of branch starts.
+// parent_padded holds the padded slots of the parent list, where start_pos and end_pos point.
+// Returns how many nops were left out compared to padding every pad slot.
+static inline uint32_t CombineList(MapAndList* list, const ScopedArenaVector<uint32_t>* parent_padded,
+    uint16_t*& out) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   // LOG(ERROR) << "CombineCodes begin";
-  codes->push_back(static_cast<uint16_t>(list->start_pos & 0xffff));
-  codes->push_back(static_cast<uint16_t>((list->start_pos & 0xffff0000) >> 16));
+  const ScopedArenaVector<uint32_t>& padded = *list->padded_slots;
+
+  uint32_t start_pos = list->start_pos;
+  if (parent_padded) {
+    start_pos = ExpandPos(*parent_padded, start_pos);
+  }
+  *out++ = static_cast<uint16_t>(start_pos & 0xffff);
+  *out++ = static_cast<uint16_t>((start_pos & 0xffff0000) >> 16);
   if (!list->parent) {
     list->end_pos = 0;
   }
 
-  codes->push_back(static_cast<uint16_t>(list->end_pos & 0xffff));
-  codes->push_back(static_cast<uint16_t>((list->end_pos & 0xffff0000) >> 16));
-
-  uint32_t code_size = list->code_list->size();
-  codes->push_back(static_cast<uint16_t>(code_size & 0xffff));
-  codes->push_back(static_cast<uint16_t>((code_size & 0xffff0000) >> 16));
-  for (uint16_t code : *list->code_list) {
-    codes->push_back(code);
+  uint32_t end_pos = list->end_pos;
+  if (parent_padded && end_pos != 0xffffffff) {
+    end_pos = ExpandPos(*parent_padded, end_pos);
+  }
+  *out++ = static_cast<uint16_t>(end_pos & 0xffff);
+  *out++ = static_cast<uint16_t>((end_pos & 0xffff0000) >> 16);
+
+  uint32_t code_size = list->code_list->size() + padded.size() * NOPS_BEFORE_BRANCH_START;
+  *out++ = static_cast<uint16_t>(code_size & 0xffff);
+  *out++ = static_cast<uint16_t>((code_size & 0xffff0000) >> 16);
+  if (padded.empty()) {
+    // Nothing moves, so neither do the goto targets.
+    memcpy(out, list->code_list->data(), list->code_list->size() * sizeof(uint16_t));
+    out += list->code_list->size();
+  } else {
+    auto next_padded = padded.begin();
+    auto next_goto = list->goto_slots->begin();
+    uint32_t pos = 0;
+    while (pos < list->code_list->size()) {
+      if (next_padded != padded.end() && *next_padded == pos) {
+        memset(out, 0, NOPS_BEFORE_BRANCH_START * sizeof(uint16_t));
+        out += NOPS_BEFORE_BRANCH_START;
+        ++next_padded;
+      }
+      if (next_goto != list->goto_slots->end() && *next_goto == pos) {
+        ++next_goto;
+        // Placeholders that never became a goto are copied as they are.
+        if (list->code_list->at(pos) == DUMP_GOTO_INSTRUCTION) {
+          int32_t offset = static_cast<int32_t>(list->code_list->at(pos + 1)
+              | (list->code_list->at(pos + 2) << 16));
+          offset = ExpandOffset(padded, pos, offset);
+          *out++ = DUMP_GOTO_INSTRUCTION;
+          *out++ = static_cast<uint16_t>(offset & 0xffff);
+          *out++ = static_cast<uint16_t>((offset & 0xffff0000) >> 16);
+          pos += 3;
+          continue;
+        }
+      }
+      *out++ = list->code_list->at(pos);
+      ++pos;
+    }
   }
 
   uint32_t map_size = list->code_map_key->size() * 2;
-  codes->push_back(static_cast<uint16_t>(map_size & 0xffff));
-  codes->push_back(static_cast<uint16_t>((map_size & 0xffff0000) >> 16));
+  *out++ = static_cast<uint16_t>(map_size & 0xffff);
+  *out++ = static_cast<uint16_t>((map_size & 0xffff0000) >> 16);
 //  for (auto iter : *list->code_map_key) {
-//    codes->push_back(static_cast<uint16_t>(iter.first & 0xffff));
-//    codes->push_back(static_cast<uint16_t>((iter.first & 0xffff0000) >> 16));
-//    codes->push_back(static_cast<uint16_t>(iter.second & 0xffff));
-//    codes->push_back(static_cast<uint16_t>((iter.second & 0xffff0000) >> 16));
+//    *out++ = static_cast<uint16_t>(iter.first & 0xffff);
+//    *out++ = static_cast<uint16_t>((iter.first & 0xffff0000) >> 16);
+//    *out++ = static_cast<uint16_t>(iter.second & 0xffff);
+//    *out++ = static_cast<uint16_t>((iter.second & 0xffff0000) >> 16);
 //  }
   for (uint32_t i = 0; i < list->code_map_key->size(); ++i) {
     uint32_t key = list->code_map_key->at(i);
-    uint32_t value = list->code_map_value->at(i);
-    codes->push_back(static_cast<uint16_t>(key & 0xffff));
-    codes->push_back(static_cast<uint16_t>((key & 0xffff0000) >> 16));
-    codes->push_back(static_cast<uint16_t>(value & 0xffff));
-    codes->push_back(static_cast<uint16_t>((value & 0xffff0000) >> 16));
+    uint32_t value = ExpandPos(padded, list->code_map_value->at(i));
+    *out++ = static_cast<uint16_t>(key & 0xffff);
+    *out++ = static_cast<uint16_t>((key & 0xffff0000) >> 16);
+    *out++ = static_cast<uint16_t>(value & 0xffff);
+    *out++ = static_cast<uint16_t>((value & 0xffff0000) >> 16);
   }
 
   uint32_t table_count = list->switch_table_map->size();
-  codes->push_back(static_cast<uint16_t>(table_count & 0xffff));
-  codes->push_back(static_cast<uint16_t>((table_count & 0xffff0000) >> 16));
+  *out++ = static_cast<uint16_t>(table_count & 0xffff);
+  *out++ = static_cast<uint16_t>((table_count & 0xffff0000) >> 16);
 
   for (auto table_iter : *list->switch_table_map) {
     uint32_t switch_dex_pc = table_iter.first;
-    uint32_t switch_pos_in_list = list->FindCodeInCodeMap(switch_dex_pc);
+    uint32_t switch_pos = list->FindCodeInCodeMap(switch_dex_pc);
+    uint32_t switch_pos_in_list = ExpandPos(padded, switch_pos);
     // uint32_t table_offset = list->code_list->size() - switch_pos_in_list;
     // (*(list->code_list))[switch_pos_in_list + 1] = table_offset & 0xffff;
     // (*(list->code_list))[switch_pos_in_list + 2] = static_cast<uint16_t>((table_offset & 0xffff0000) >> 16);
 
-    codes->push_back(static_cast<uint16_t>(switch_pos_in_list & 0xffff));
-    codes->push_back(static_cast<uint16_t>((switch_pos_in_list & 0xffff0000) >> 16));
+    *out++ = static_cast<uint16_t>(switch_pos_in_list & 0xffff);
+    *out++ = static_cast<uint16_t>((switch_pos_in_list & 0xffff0000) >> 16);
 
     DumpSwitchTable* switch_table = table_iter.second;
     uint16_t ss = switch_table->target_map_.size();
 
-    codes->push_back(0x0200);
-    codes->push_back(static_cast<uint16_t>(ss));
+    *out++ = 0x0200;
+    *out++ = static_cast<uint16_t>(ss);
     // LOG(ERROR) << switch_dex_pc << " " << switch_pos_in_list << " " << switch_table->target_map_.size();
     for (auto iter : switch_table->target_map_) {
       int32_t key = iter.first;
-      codes->push_back(key & 0xffff);
-      codes->push_back(static_cast<uint16_t>((key & 0xffff0000) >> 16));
+      *out++ = key & 0xffff;
+      *out++ = static_cast<uint16_t>((key & 0xffff0000) >> 16);
       // LOG(ERROR) << "CombineCodes push key " << switch_pos_in_list << " " << key;
     }
     for (auto iter : switch_table->target_map_) {
-      int32_t target = iter.second;
-      codes->push_back(target & 0xffff);
-      codes->push_back(static_cast<uint16_t>((target & 0xffff0000) >> 16));
+      int32_t target = ExpandOffset(padded, switch_pos, iter.second);
+      *out++ = target & 0xffff;
+      *out++ = static_cast<uint16_t>((target & 0xffff0000) >> 16);
       // LOG(ERROR) << "CombineCodes push target " << switch_pos_in_list << " " << target;
     }
   }
 
   uint32_t map_count = list->fill_array_data_map->size();
-  codes->push_back(static_cast<uint16_t>(map_count & 0xffff));
-  codes->push_back(static_cast<uint16_t>((map_count & 0xffff0000) >> 16));
+  *out++ = static_cast<uint16_t>(map_count & 0xffff);
+  *out++ = static_cast<uint16_t>((map_count & 0xffff0000) >> 16);
 
   for (auto table_iter : *list->fill_array_data_map) {
     uint32_t fill_dex_pc = table_iter.first;
-    uint32_t fill_pos_in_list = list->FindCodeInCodeMap(fill_dex_pc);
+    uint32_t fill_pos_in_list = ExpandPos(padded, list->FindCodeInCodeMap(fill_dex_pc));
 
-    codes->push_back(static_cast<uint16_t>(fill_pos_in_list & 0xffff));
-    codes->push_back(static_cast<uint16_t>((fill_pos_in_list & 0xffff0000) >> 16));
+    *out++ = static_cast<uint16_t>(fill_pos_in_list & 0xffff);
+    *out++ = static_cast<uint16_t>((fill_pos_in_list & 0xffff0000) >> 16);
 
     DumpFillArrayData* fill_array_data = table_iter.second;
     uint32_t data_size = fill_array_data->datas_.size();
 
-    codes->push_back(0x0300);
-    codes->push_back(fill_array_data->element_width_);
-    codes->push_back(static_cast<uint16_t>(fill_array_data->element_count_ & 0xffff));
-    codes->push_back(static_cast<uint16_t>((fill_array_data->element_count_ & 0xffff0000) >> 16));
+    *out++ = 0x0300;
+    *out++ = fill_array_data->element_width_;
+    *out++ = static_cast<uint16_t>(fill_array_data->element_count_ & 0xffff);
+    *out++ = static_cast<uint16_t>((fill_array_data->element_count_ & 0xffff0000) >> 16);
 
     uint32_t idx = 0;
     while (idx < data_size) {
@@ -739,12 +823,12 @@ static inline void CombineCodes(MapAndList* list, std::vector<uint16_t>* codes)
         uint8_t v1 = fill_array_data->datas_.at(idx);
         uint8_t v2 = fill_array_data->datas_.at(idx + 1);
         uint16_t v = static_cast<uint16_t>(static_cast<uint16_t>(v1) | (static_cast<uint16_t>(v2) << 8));
-        codes->push_back(v);
+        *out++ = v;
         // LOG(ERROR) << "push array data " << v << " " << v1 << " " << v2;
       } else {
         uint8_t v1 = fill_array_data->datas_.at(idx);
         uint16_t v = static_cast<uint16_t>(v1);
-        codes->push_back(v);
+        *out++ = v;
         // LOG(ERROR) << "push array data " << v << " " << v1;
       }
       idx += 2;
@@ -752,52 +836,86 @@ static inline void CombineCodes(MapAndList* list, std::vector<uint16_t>* codes)
   }
 
   uint32_t child_count = list->childs->size();
-  codes->push_back(static_cast<uint16_t>(child_count & 0xffff));
-  codes->push_back(static_cast<uint16_t>((child_count & 0xffff0000) >> 16));
+  *out++ = static_cast<uint16_t>(child_count & 0xffff);
+  *out++ = static_cast<uint16_t>((child_count & 0xffff0000) >> 16);
 
+  uint32_t left_out = (list->pad_slots->size() - padded.size()) * NOPS_BEFORE_BRANCH_START;
   for (auto sub_list : *list->childs) {
-    CombineCodes(sub_list, codes);
+    left_out += CombineList(sub_list, &padded, out);
   }
+  return left_out;
 }
 
-static inline void HandleDump(ShadowFrame& shadow_frame, DumpCodeItem* executed_code,
-        std::vector<uint16_t>* codes) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  uint32_t code_size = codes->size();
+// Lays the trace of root out as the code of executed_code, sized up front and written in place.
+// Returns how many nops were left out compared to padding every instruction.
+static inline uint32_t CombineCodes(MapAndList* root, DumpCodeItem* executed_code) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  uint32_t code_size = SizeCombinedList(root);
+  executed_code->insns_size_in_code_units_ = code_size;
+  executed_code->insns_ = new uint16_t[code_size];
+  uint16_t* out = executed_code->insns_;
+  uint32_t left_out = CombineList(root, nullptr, out);
+  DCHECK_EQ(out, executed_code->insns_ + code_size);
+  return left_out;
+}
+
+// Dumps the combined trace of an invocation traced since trace_start_ns.
+static inline void HandleDump(Dumper* dumper, ShadowFrame& shadow_frame,
+        DumpCodeItem* executed_code, uint32_t left_out, uint64_t trace_start_ns)
+    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  dumper->CountTrace(executed_code->insns_size_in_code_units_, left_out);
 
   // TODO fix this
   // executed_code->tries_size_ = 0;
   // executed_code->debug_info_off_ = 0;
 
-  executed_code->insns_size_in_code_units_ = code_size;
-  executed_code->insns_ = new uint16_t[code_size];
-
-  uint32_t idx = 0;
-  for (uint16_t i : *codes) {
-    memcpy(&(executed_code->insns_[idx++]), &i, 2);
-  }
-  // LOG(ERROR) << "HandleDump " << code_size << " " << codes->size() << " "
-  //     << executed_code->insns_size_in_code_units_ << " " << idx;
-
   ArtMethod* method = shadow_frame.GetMethod();
-  std::pair<uint32_t, uint32_t> ret = Dumper::Instance()->DumpImplicitEncodedMethod(method, shadow_frame, executed_code->registers_size_);
+  std::pair<uint32_t, uint32_t> ret = dumper->DumpImplicitEncodedMethod(method, shadow_frame, executed_code->registers_size_);
   executed_code->method_idx_ = ret.first;
   executed_code->current_clz_name_idx_ = ret.second;
 
-  Dumper::Instance()->CodeDump(method->GetDexFile()->GetLocation(), executed_code);
+  dumper->CodeDump(dumper->LocationOf(*method->GetDexFile()), executed_code);
+  dumper->Metrics()->Record(kDumpMetricTraceBuild, NanoTime() - trace_start_ns);
 }
-#ifdef TIME_EVALUATION
-#define TIME_MEASURE_BEGIN \
-  struct timeval t1, t2;   \
-  gettimeofday(&t1, NULL);
-
-#define TIME_MEASURE_END \
-  gettimeofday(&t2, NULL); \
-  Dumper::Instance()->addTimeMeasure(t1, t2, PROCESS_C);
-#else
-#define TIME_MEASURE_BEGIN
-#define TIME_MEASURE_END
 
-#endif
+// Decides at method entry whether an invocation is traced. Returns false for methods not hooked
+// for collection, for saturated ones outside their samples, and for invocations left out by
+// sampling while the memory budget is under pressure; *state is set to the method's saturation
+// state, or left null when forced execution is on, since forced runs explore paths on purpose.
+// In forced runs, *force_branches tells whether the method has any branch to force or explore.
+// *dumper is set to the Dumper cached by self for every hooked method; a method is only hooked
+// once it exists. Waits for the recording thread while the memory budget is at its limit.
+static inline bool ShouldTraceInvocation(Thread* self, ArtMethod* method,
+                                         const JValue& result_register, Dumper** dumper,
+                                         CollectionState** state, bool* force_branches)
+    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  // The common case, a method nobody collects, costs a single load of its access flags.
+  if (!method->ShouldManipulate()) {
+    return false;
+  }
+  *dumper = self->GetDumper();
+  DumpMemoryBudget* budget = (*dumper)->Budget();
+  if (!budget->AdmitTrace()) {
+    return false;
+  }
+  // Backpressure, before the trace allocates anything. The thread waits suspended rather than
+  // holding off a GC, which is safe while the frame's references, roots, are the only live ones.
+  // A frame resumed by deoptimization may also have a reference in result_register, so it does
+  // not wait.
+  if (UNLIKELY(budget->ShouldWaitForQueue()) && result_register.GetJ() == 0) {
+    ScopedThreadStateChange tsc(self, kSleeping);
+    budget->WaitForQueue();
+  }
+  if ((*dumper)->ForceExecution()) {
+    *force_branches = (*dumper)->Exploring() || (*dumper)->ResolveForceBranches(method);
+    return true;
+  }
+  *state = method->GetHookInfo()->collection_state;
+  if (*state != nullptr && (*state)->IsSaturated() && !(*state)->SampleTrace()) {
+    (*state)->CountSkipped();
+    return false;
+  }
+  return true;
+}
 
 template <typename K, typename V>
 class CompareHelper2 {
@@ -808,9 +926,19 @@ class CompareHelper2 {
     const K instance;
 };
 
+// Appends a goto from the end of list back to the instruction at index, which is where the trace
+// jumped to.
+static inline void PushBackGotoToList(MapAndList*& list, uint32_t index) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+  int32_t back_offset = index - list->code_list->size();
+  list->pad_slots->push_back(list->code_list->size());
+  list->goto_slots->push_back(list->code_list->size());
+  list->code_list->push_back(DUMP_GOTO_INSTRUCTION);
+  list->code_list->push_back(static_cast<uint16_t>(back_offset & 0xffff));
+  list->code_list->push_back(static_cast<uint16_t>((back_offset & 0xffff0000) >> 16));
+}
+
 static inline void HandleInstruction(MapAndList*& list, const uint16_t* code,
     const ShadowFrame& shadow_frame, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  TIME_MEASURE_BEGIN
   uint32_t dex_pc = shadow_frame.GetDexPC();
 
   uint8_t opcode = code[0] & 0xff;
@@ -832,7 +960,7 @@ static inline void HandleInstruction(MapAndList*& list, const uint16_t* code,
       } else {
         if (!IsSameInstruction(code, list->code_list, index, count)) {
           // different instructions in same pos, switch to a hack branch
-          MapAndList* branch_list = new MapAndList(list, index);
+          MapAndList* branch_list = list->NewBranch(index);
           PushInstructionToList(branch_list, code, dex_pc, count, false);
           list = branch_list;
         }
@@ -840,30 +968,21 @@ static inline void HandleInstruction(MapAndList*& list, const uint16_t* code,
     } else {
       PushInstructionToList(list, code, dex_pc, count, true);
     }
-    TIME_MEASURE_END
     return;
   }
 
   if (index != CODE_NO_INDEX) {
     if (list->prev_ins_pos == list->code_list->size()) {
       // we jumped from the end of list to the middle.
-      int32_t back_offset = index - list->prev_ins_pos - NOPS_BEFORE_EACH_INST;
       // LOG(ERROR) << "HandleInstruction goback " << iter->second
-      //     << " " << map_and_list->prev_ins_pos << " " << back_offset;
-      uint32_t idx;
-      // Add nops before each instruction, just for convenience of combine branches
-      for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-        list->code_list->push_back(0);
-      }
-      list->code_list->push_back(DUMP_GOTO_INSTRUCTION);
-      list->code_list->push_back(static_cast<uint16_t>(back_offset & 0xffff));
-      list->code_list->push_back(static_cast<uint16_t>((back_offset & 0xffff0000) >> 16));
+      //     << " " << map_and_list->prev_ins_pos;
+      PushBackGotoToList(list, index);
     }
     list->prev_ins_pos = index;
 
     if (!IsSameInstruction(code, list->code_list, index, count)) {
       // different instructions in same pos, switch to a hack branch
-      MapAndList* branch_list = new MapAndList(list, index);
+      MapAndList* branch_list = list->NewBranch(index);
       PushInstructionToList(branch_list, code, dex_pc, count, false);
       list = branch_list;
     }
@@ -877,7 +996,6 @@ static inline void HandleInstruction(MapAndList*& list, const uint16_t* code,
           list->end_pos = index2;
           list->parent->prev_ins_pos = index2;
           list = list->parent;
-          TIME_MEASURE_END
           return;
         }  // else is still different from parent, keep in this branch.
       }  // else this instruction could not be found in parent, just keep in this branch;
@@ -885,36 +1003,25 @@ static inline void HandleInstruction(MapAndList*& list, const uint16_t* code,
     // just stay in this branch, and add the instruction to list.
     PushInstructionToList(list, code, dex_pc, count, is_move_result_ins);
   }
-
-  TIME_MEASURE_END
 }
 
 static inline void HandleFillArrayData(MapAndList*& list, uint16_t ins_data, ShadowFrame& shadow_frame,
     const Instruction::ArrayDataPayload* payload) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  TIME_MEASURE_BEGIN
   uint32_t dex_pc = shadow_frame.GetDexPC();
 
   uint32_t index = list->FindCodeInCodeMap(dex_pc);
   if (index != CODE_NO_INDEX) {
     if (list->prev_ins_pos == list->code_list->size()) {
       // we jumped from the end of list to the middle.
-      int32_t back_offset = index - list->prev_ins_pos - NOPS_BEFORE_EACH_INST;
       // LOG(ERROR) << "HandleFillArrayData goback " << iter->second
-      //     << " " << map_and_list->prev_ins_pos << " " << back_offset;
-      uint32_t idx;
-      // Add nops before each instruction, just for convenience of combine branches
-      for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-        list->code_list->push_back(0);
-      }
-      list->code_list->push_back(DUMP_GOTO_INSTRUCTION);
-      list->code_list->push_back(static_cast<uint16_t>(back_offset & 0xffff));
-      list->code_list->push_back(static_cast<uint16_t>((back_offset & 0xffff0000) >> 16));
+      //     << " " << map_and_list->prev_ins_pos;
+      PushBackGotoToList(list, index);
     }
     list->prev_ins_pos = index;
 
     if (!IsSameFillArrayDataInstruction(list, ins_data, dex_pc, index, payload)) {
       // different instructions in same pos, switch to a hack branch
-      MapAndList* branch_list = new MapAndList(list, index);
+      MapAndList* branch_list = list->NewBranch(index);
       // As now we are in a new list, the offset should be the length of this instruction, to the next instruction.
       PushFillArrayDataInstructionToList(branch_list, ins_data, dex_pc, payload);
       list = branch_list;
@@ -929,7 +1036,6 @@ static inline void HandleFillArrayData(MapAndList*& list, uint16_t ins_data, Sha
           list->end_pos = index2;
           list->parent->prev_ins_pos = index2;
           list = list->parent;
-          TIME_MEASURE_END
           return;
         }  // else is still different from parent, keep in this branch.
       }  // else this instruction could not be found in parent, just keep in this branch;
@@ -937,37 +1043,27 @@ static inline void HandleFillArrayData(MapAndList*& list, uint16_t ins_data, Sha
     // just stay in this branch, and add the instruction to list.
     PushFillArrayDataInstructionToList(list, ins_data, dex_pc, payload);
   }
-  TIME_MEASURE_END
 }
 
 static inline void HandleGoto(MapAndList*& list, ShadowFrame& shadow_frame,
     int32_t offset) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  TIME_MEASURE_BEGIN
   uint32_t dex_pc = shadow_frame.GetDexPC();
 
   uint32_t index = list->FindCodeInCodeMap(dex_pc);
   if (index != CODE_NO_INDEX) {
     if (list->prev_ins_pos == list->code_list->size()) {
       // we jumped from the end of list to the middle.
-      int32_t back_offset = index - list->prev_ins_pos - NOPS_BEFORE_EACH_INST;
       // LOG(ERROR) << "HandleGoto goback " << iter->second
-      //     << " " << map_and_list->prev_ins_pos << " " << back_offset;
-      uint32_t idx;
-      // Add nops before each instruction, just for convenience of combine branches
-      for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-        list->code_list->push_back(0);
-      }
-      list->code_list->push_back(DUMP_GOTO_INSTRUCTION);
-      list->code_list->push_back(static_cast<uint16_t>(back_offset & 0xffff));
-      list->code_list->push_back(static_cast<uint16_t>((back_offset & 0xffff0000) >> 16));
+      //     << " " << map_and_list->prev_ins_pos;
+      PushBackGotoToList(list, index);
     }
 
     int32_t offset_in_current = GetOffsetForPos(list, dex_pc, offset);
     if (!IsSameGotoInstruction(list, index, offset_in_current - index)) {
       // different instructions in same pos, switch to a hack branch
-      MapAndList* branch_list = new MapAndList(list, index);
+      MapAndList* branch_list = list->NewBranch(index);
       // As now we are in a new list, the offset should be the length of this instruction, to the next instruction.
-      PushGotoInstructionToList(branch_list, dex_pc, 3 + NOPS_BEFORE_EACH_INST);
+      PushGotoInstructionToList(branch_list, dex_pc, 3);
       list = branch_list;
     } else {
       list->prev_ins_pos = offset_in_current;
@@ -983,7 +1079,6 @@ static inline void HandleGoto(MapAndList*& list, ShadowFrame& shadow_frame,
           list->end_pos = index2;
           list->parent->prev_ins_pos = offset_in_parent;
           list = list->parent;
-          TIME_MEASURE_END
           return;
         }  // else is still different from parent, keep in this branch.
       }  // else this instruction could not be found in parent, just keep in this branch;
@@ -991,18 +1086,16 @@ static inline void HandleGoto(MapAndList*& list, ShadowFrame& shadow_frame,
     // just stay in this branch, and add the instruction to list.
     uint32_t index3 = list->FindCodeInCodeMap(dex_pc + offset);
     if (index3 != CODE_NO_INDEX) {
-      PushGotoInstructionToList(list, dex_pc, index3 - list->code_list->size() - NOPS_BEFORE_EACH_INST);
+      PushGotoInstructionToList(list, dex_pc, index3 - list->code_list->size());
     } else {
       // 3 is the length of this goto instruction
-      PushGotoInstructionToList(list, dex_pc, 3 + NOPS_BEFORE_EACH_INST);
+      PushGotoInstructionToList(list, dex_pc, 3);
     }
   }
-  TIME_MEASURE_END
 }
 
 static inline void HandleSwitch(MapAndList*& list, uint16_t ins_data,
     ShadowFrame& shadow_frame, int32_t offset, int32_t key) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  TIME_MEASURE_BEGIN
   uint32_t dex_pc = shadow_frame.GetDexPC();
 
   uint16_t instruction = DUMP_SWITCH_INSTRUCTION | (ins_data & 0xff00);
@@ -1012,24 +1105,16 @@ static inline void HandleSwitch(MapAndList*& list, uint16_t ins_data,
   if (index != CODE_NO_INDEX) {
     if (list->prev_ins_pos == list->code_list->size()) {
       // we jumped from the end of list to the middle.
-      int32_t back_offset = index - list->prev_ins_pos - NOPS_BEFORE_EACH_INST;
       // LOG(ERROR) << "HandleSwitch goback " << iter->second
-      //     << " " << map_and_list->prev_ins_pos << " " << back_offset;
-      uint32_t idx;
-      // Add nops before each instruction, just for convenience of combine branches
-      for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-        list->code_list->push_back(0);
-      }
-      list->code_list->push_back(DUMP_GOTO_INSTRUCTION);
-      list->code_list->push_back(static_cast<uint16_t>(back_offset & 0xffff));
-      list->code_list->push_back(static_cast<uint16_t>((back_offset & 0xffff0000) >> 16));
+      //     << " " << map_and_list->prev_ins_pos;
+      PushBackGotoToList(list, index);
     }
 
     int32_t offset_in_current = GetOffsetForPos(list, dex_pc, offset);
     if (!IsSameSwitchInstruction(list, instruction, dex_pc, index, offset_in_current - index, key, is_default)) {
       // different instructions in same pos, switch to a hack branch
-      MapAndList* branch_list = new MapAndList(list, index);
-      PushSwitchInstructionToList(branch_list, instruction, dex_pc, 6 + NOPS_BEFORE_EACH_INST, key, is_default);
+      MapAndList* branch_list = list->NewBranch(index);
+      PushSwitchInstructionToList(branch_list, instruction, dex_pc, 6, key, is_default);
       list = branch_list;
     } else {
       list->prev_ins_pos = index + offset_in_current;
@@ -1046,7 +1131,6 @@ static inline void HandleSwitch(MapAndList*& list, uint16_t ins_data,
           list->end_pos = index2;
           list->parent->prev_ins_pos = index2 + offset_in_parent;
           list = list->parent;
-          TIME_MEASURE_END
           return;
         }  // else is still different from parent, keep in this branch.
       }  // else this instruction could not be found in parent, just keep in this branch;
@@ -1055,18 +1139,16 @@ static inline void HandleSwitch(MapAndList*& list, uint16_t ins_data,
     uint32_t index3 = list->FindCodeInCodeMap(dex_pc + offset);
     if (index3 != CODE_NO_INDEX) {
       PushSwitchInstructionToList(list, instruction, dex_pc,
-          index3 - list->code_list->size() - NOPS_BEFORE_EACH_INST, key, is_default);
+          index3 - list->code_list->size(), key, is_default);
     } else {
       // 6 is the length of this switch instruction
-      PushSwitchInstructionToList(list, instruction, dex_pc, 6 + NOPS_BEFORE_EACH_INST, key, is_default);
+      PushSwitchInstructionToList(list, instruction, dex_pc, 6, key, is_default);
     }
   }
-  TIME_MEASURE_END
 }
 
 static inline void HandleIf(MapAndList*& list, uint16_t ins_data,
     ShadowFrame& shadow_frame, int32_t offset) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  TIME_MEASURE_BEGIN
   uint32_t dex_pc = shadow_frame.GetDexPC();
 
   bool is_else = offset == 2;
@@ -1074,24 +1156,16 @@ static inline void HandleIf(MapAndList*& list, uint16_t ins_data,
   if (index != CODE_NO_INDEX) {
     if (list->prev_ins_pos == list->code_list->size()) {
       // we jumped from the end of list to the middle.
-      int32_t back_offset = index - list->prev_ins_pos - NOPS_BEFORE_EACH_INST;
       // LOG(ERROR) << "HandleIf goback " << iter->second
-      //     << " " << map_and_list->prev_ins_pos << " " << back_offset;
-      uint32_t idx;
-      // Add nops before each instruction, just for convenience of combine branches
-      for (idx = 0; idx < NOPS_BEFORE_EACH_INST; ++idx) {
-        list->code_list->push_back(0);
-      }
-      list->code_list->push_back(DUMP_GOTO_INSTRUCTION);
-      list->code_list->push_back(static_cast<uint16_t>(back_offset & 0xffff));
-      list->code_list->push_back(static_cast<uint16_t>((back_offset & 0xffff0000) >> 16));
+      //     << " " << map_and_list->prev_ins_pos;
+      PushBackGotoToList(list, index);
     }
 
     int32_t offset_in_current = GetOffsetForPos(list, dex_pc, offset);
     if (!IsSameIfInstruction(list, ins_data, index, offset_in_current - index, is_else)) {
       // different instructions in same pos, switch to a hack branch
-      MapAndList* branch_list = new MapAndList(list, index);
-      PushIfInstructionToList(branch_list, ins_data, dex_pc, 8 + NOPS_BEFORE_EACH_INST, is_else);
+      MapAndList* branch_list = list->NewBranch(index);
+      PushIfInstructionToList(branch_list, ins_data, dex_pc, 8, is_else);
       list = branch_list;
     } else {
       list->prev_ins_pos = index + offset_in_current;
@@ -1107,7 +1181,6 @@ static inline void HandleIf(MapAndList*& list, uint16_t ins_data,
           list->end_pos = index2;
           list->parent->prev_ins_pos = index2 + offset_in_parent;
           list = list->parent;
-          TIME_MEASURE_END
           return;
         }  // else is still different from parent, keep in this branch.
       }  // else this instruction could not be found in parent, just keep in this branch;
@@ -1115,16 +1188,16 @@ static inline void HandleIf(MapAndList*& list, uint16_t ins_data,
     // just stay in this branch, and add the instruction to list.
     uint32_t index3 = list->FindCodeInCodeMap(dex_pc + offset);
     if (index3 != CODE_NO_INDEX) {
-      PushIfInstructionToList(list, ins_data, dex_pc, index3 - list->code_list->size() - NOPS_BEFORE_EACH_INST, is_else);
+      PushIfInstructionToList(list, ins_data, dex_pc, index3 - list->code_list->size(), is_else);
     } else {
       // 8 is the length of this if instruction
-      PushIfInstructionToList(list, ins_data, dex_pc, 8 + NOPS_BEFORE_EACH_INST, is_else);
+      PushIfInstructionToList(list, ins_data, dex_pc, 8, is_else);
     }
   }
-  TIME_MEASURE_END
 }
 
-static inline uint16_t* HandleString(uint16_t inst_data, uint32_t string_idx, ShadowFrame& shadow_frame) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+static inline void HandleString(uint16_t inst_data, uint32_t string_idx, ShadowFrame& shadow_frame,
+    uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   // LOG(ERROR) << "HandleString begin";
   const DexFile* dex_file = shadow_frame.GetMethod()->GetDexFile();
 
@@ -1133,16 +1206,15 @@ static inline uint16_t* HandleString(uint16_t inst_data, uint32_t string_idx, Sh
   // LOG(ERROR) << "HandleString target string " << string << ", " << string_idx << ", " << index;
   // DexFile::CodeItem* item = reinterpret_cast<DexFile::CodeItem*>(dumpedCodeItem);
   // LOG(ERROR) << "HandleString src " << inst_data << " " << string_idx;
-  uint16_t* new_inst = new uint16_t[3];
   new_inst[0] = 0x1B | (inst_data & 0xff00);
   new_inst[1] = index & 0xffff;
   new_inst[2] = static_cast<uint16_t>((index & 0xffff0000) >> 16);
   // LOG(ERROR) << "HandleString dst " << new_inst[0] << " " << new_inst[1] << " " << new_inst[2];
   // LOG(ERROR) << "HandleString end";
-  return new_inst;
 }
 
-static inline uint16_t* HandleType(const uint16_t* codes, uint32_t type_idx, ShadowFrame& shadow_frame, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+static inline void HandleType(const uint16_t* codes, uint32_t type_idx, ShadowFrame& shadow_frame, uint32_t count,
+    uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   // LOG(ERROR) << "HandleType begin";
   const DexFile* dex_file = shadow_frame.GetMethod()->GetDexFile();
 
@@ -1151,12 +1223,11 @@ static inline uint16_t* HandleType(const uint16_t* codes, uint32_t type_idx, Sha
   // LOG(ERROR) << "HandleType target string " << ds.string_ << ", " << type_idx << ", " << index;
   // DexFile::CodeItem* item = reinterpret_cast<DexFile::CodeItem*>(dumpedCodeItem);
   // LOG(ERROR) << "HandleType src " << codes[0] << " " << codes[1];
-  uint16_t* new_inst = new uint16_t[count];
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(new_inst, codes, count * 2);
   new_inst[1] = index;
   // LOG(ERROR) << "HandleType dst " << new_inst[0] << " " << new_inst[1];
   // LOG(ERROR) << "HandleType end";
-  return new_inst;
 }
 
 #ifdef ELIMINATE_REFLECTION
@@ -1398,9 +1469,10 @@ uint16_t EliminateReflection(DumpString* declaring_clz, mirror::Object* arg0, mi
 
 #endif
 
+// Writes the rewritten invoke to new_inst and returns its size in code units.
 template<InvokeType type, bool is_range, bool do_access_check>
-static inline uint16_t* HandleInvoke(const uint16_t* codes, const ShadowFrame& shadow_frame,
-    __attribute__((unused))ArtMethod* method, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+static inline uint16_t HandleInvoke(const uint16_t* codes, const ShadowFrame& shadow_frame,
+    __attribute__((unused))ArtMethod* method, uint32_t count, uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   // LOG(ERROR) << "HandleInvoke begin" << " " << self;
   // const uint32_t method_idx = (is_range) ? inst->VRegB_3rc() : inst->VRegB_35c();
   // const uint32_t vregC = (is_range) ? inst->VRegC_3rc() : inst->VRegC_35c();
@@ -1411,9 +1483,7 @@ static inline uint16_t* HandleInvoke(const uint16_t* codes, const ShadowFrame& s
 //  DumpMethodInfo* target_method_info_in_dex = new DumpMethodInfo;
 //  Dumper::Instance()->GetMethodInfo(target_method_info_in_dex, method);
 
-  uint16_t* new_inst = NULL;
   uint16_t invoke_start_index = 0;
-  bool assigned = false;
 
   /* const char* class_desc = method->GetDeclaringClassDescriptor();
   Class* declaring_class = method->GetDeclaringClass();
@@ -1650,13 +1720,7 @@ static inline uint16_t* HandleInvoke(const uint16_t* codes, const ShadowFrame& s
     }
   } */
 
-  if (!assigned) {
-    uint16_t new_size = count + 1;
-    new_inst = new uint16_t[new_size];
-    new_inst[0] = count;
-    invoke_start_index = 1;
-  }
-
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(&(new_inst[invoke_start_index]), codes, count * 2);
 
   // uint32_t index = Dumper::Instance()->DumpDexMethod(sf_method->GetDexFile()->GetLocation(), (type == kStatic || type == kDirect) ? DIRECT : VIRTUAL, method, nullptr);
@@ -1684,24 +1748,17 @@ static inline uint16_t* HandleInvoke(const uint16_t* codes, const ShadowFrame& s
   // LOG(ERROR) << "HandleInvoke InvokeType " << type << " dst " << new_inst[0] << " " << new_inst[1] << " " << new_inst[2];
   // LOG(ERROR) << "HandleInvoke end";
 
-  return new_inst;
+  return count;
 }
 
+// Writes the rewritten invoke to new_inst and returns its size in code units.
 template<bool is_range>
-static inline uint16_t* HandleInvokeQuick(const uint16_t* codes, __attribute__((unused))const ShadowFrame& shadow_frame,
-    ArtMethod* method, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+static inline uint16_t HandleInvokeQuick(const uint16_t* codes, __attribute__((unused))const ShadowFrame& shadow_frame,
+    ArtMethod* method, uint32_t count, uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   // LOG(ERROR) << "HandleInvokeQuick begin";
-  uint16_t* new_inst = NULL;
   uint16_t invoke_start_index = 0;
-  bool assigned = false;
-
-  if (!assigned) {
-    uint16_t new_size = count + 1;
-    new_inst = new uint16_t[new_size];
-    new_inst[0] = count;
-    invoke_start_index = 1;
-  }
 
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(&(new_inst[invoke_start_index]), codes, count * 2);
 
   // Dumper::Instance()->DumpDexMethod(VIRTUAL, target_method, nullptr);
@@ -1729,12 +1786,13 @@ static inline uint16_t* HandleInvokeQuick(const uint16_t* codes, __attribute__((
   new_inst[invoke_start_index + 1] = static_cast<uint16_t>(target_index);
   // LOG(ERROR) << "HandleInvokeQuick dst " << new_inst[0] << " " << new_inst[1];
   // LOG(ERROR) << "HandleInvokeQuick end";
-  return new_inst;
+  return count;
 }
 
 template<FindFieldType find_type, Primitive::Type field_type, bool do_access_check>
-uint16_t* HandleFieldGet(const uint16_t* codes, const ShadowFrame& shadow_frame,
-    uint32_t count, __attribute__((unused))ArtField* field, __attribute__((unused))bool is_static) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+void HandleFieldGet(const uint16_t* codes, const ShadowFrame& shadow_frame,
+    uint32_t count, __attribute__((unused))ArtField* field, __attribute__((unused))bool is_static,
+    uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
 //  mirror::Class* declaring_class = field->GetDeclaringClass();
 //  const DexFile& dex_file = declaring_class->GetDexFile();
   uint32_t index;
@@ -1748,17 +1806,16 @@ uint16_t* HandleFieldGet(const uint16_t* codes, const ShadowFrame& shadow_frame,
 
   // LOG(ERROR) << "HandleFieldGet FindFieldType " << find_type << " target field " << f->GetName() << ", " << index;
   // LOG(ERROR) << "HandleFieldGet FindFieldType " << find_type << " src " << codes[0] << " " << codes[1];
-  uint16_t* new_inst = new uint16_t[count];
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(new_inst, codes, count * 2);
   new_inst[1] = static_cast<uint16_t>(index);
   // LOG(ERROR) << "HandleFieldGet FindFieldType " << find_type << " dst " << new_inst[0] << " " << new_inst[1];
   // LOG(ERROR) << "HandleFieldGet end";
-  return new_inst;
 }
 
 template<Primitive::Type field_type>
-uint16_t* HandleFieldGetQuick(const uint16_t* codes, __attribute__((unused))const ShadowFrame& shadow_frame,
-    ArtField* field, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+void HandleFieldGetQuick(const uint16_t* codes, __attribute__((unused))const ShadowFrame& shadow_frame,
+    ArtField* field, uint32_t count, uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   mirror::Class* declaring_class = field->GetDeclaringClass();
   const DexFile& dex_file = declaring_class->GetDexFile();
   uint32_t index;
@@ -1781,18 +1838,18 @@ uint16_t* HandleFieldGetQuick(const uint16_t* codes, __attribute__((unused))cons
   } else {
     target_opcode = static_cast<uint8_t>(0x54);
   }
-  uint16_t* new_inst = new uint16_t[count];
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(new_inst, codes, count * 2);
   new_inst[0] = (codes[0] & 0xff00) | target_opcode;
   new_inst[1] = static_cast<uint16_t>(index);
   // LOG(ERROR) << "HandleFieldGetQuick FindFieldType " << field_type << " dst " << new_inst[0] << " " << new_inst[1];
   // LOG(ERROR) << "HandleFieldGetQuick end";
-  return new_inst;
 }
 
 template<FindFieldType find_type, Primitive::Type field_type, bool do_access_check>
-uint16_t* HandleFieldPut(const uint16_t* codes, const ShadowFrame& shadow_frame,
-    uint32_t count, __attribute__((unused))ArtField* field, __attribute__((unused))bool is_static) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+void HandleFieldPut(const uint16_t* codes, const ShadowFrame& shadow_frame,
+    uint32_t count, __attribute__((unused))ArtField* field, __attribute__((unused))bool is_static,
+    uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
 //  mirror::Class* declaring_class = field->GetDeclaringClass();
 //  const DexFile& dex_file = declaring_class->GetDexFile();
   uint32_t index;
@@ -1806,17 +1863,16 @@ uint16_t* HandleFieldPut(const uint16_t* codes, const ShadowFrame& shadow_frame,
 
   // LOG(ERROR) << "HandleFieldPut FindFieldType " << find_type << " target field " << f->GetName() << ", " << index;
   // LOG(ERROR) << "HandleFieldPut FindFieldType " << find_type << " src " << codes[0] << " " << codes[1];
-  uint16_t* new_inst = new uint16_t[count];
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(new_inst, codes, count * 2);
   new_inst[1] = static_cast<uint16_t>(index);
   // LOG(ERROR) << "HandleFieldPut FindFieldType " << find_type << " dst " << new_inst[0] << " " << new_inst[1];
   // LOG(ERROR) << "HandleFieldPut end";
-  return new_inst;
 }
 
 template<Primitive::Type field_type>
-uint16_t* HandleFieldPutQuick(const uint16_t* codes, __attribute__((unused))const ShadowFrame& shadow_frame,
-    ArtField* field, uint32_t count) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+void HandleFieldPutQuick(const uint16_t* codes, __attribute__((unused))const ShadowFrame& shadow_frame,
+    ArtField* field, uint32_t count, uint16_t* new_inst) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
   mirror::Class* declaring_class = field->GetDeclaringClass();
   const DexFile& dex_file = declaring_class->GetDexFile();
   uint32_t index;
@@ -1839,20 +1895,19 @@ uint16_t* HandleFieldPutQuick(const uint16_t* codes, __attribute__((unused))cons
   } else {
     target_opcode = static_cast<uint8_t>(0x5B);
   }
-  uint16_t* new_inst = new uint16_t[count];
+  DCHECK_LE(count, static_cast<uint32_t>(MAX_REWRITTEN_INST_SIZE));
   memcpy(new_inst, codes, count * 2);
   new_inst[0] = (codes[0] & 0xff00) | target_opcode;
   new_inst[1] = static_cast<uint16_t>(index);
   // LOG(ERROR) << "HandleFieldGetQuick FindFieldType " << field_type << " dst " << new_inst[0] << " " << new_inst[1];
   // LOG(ERROR) << "HandleFieldPutQuick end";
-  return new_inst;
 }
 
 // Explicitly instantiate all DoInvoke functions.
 #define EXPLICIT_HANDLE_INVOKE_TEMPLATE_DECL(_type, _is_range, _do_check)                                         \
   template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)                                                            \
-  uint16_t* HandleInvoke<_type, _is_range, _do_check>(const uint16_t* code, const ShadowFrame& shadow_frame,     \
-      ArtMethod* method, uint32_t count)
+  uint16_t HandleInvoke<_type, _is_range, _do_check>(const uint16_t* code, const ShadowFrame& shadow_frame,      \
+      ArtMethod* method, uint32_t count, uint16_t* new_inst)
 
 #define EXPLICIT_HANDLE_INVOKE_ALL_TEMPLATE_DECL(_type)       \
   EXPLICIT_HANDLE_INVOKE_TEMPLATE_DECL(_type, false, false);  \
@@ -1871,8 +1926,8 @@ EXPLICIT_HANDLE_INVOKE_ALL_TEMPLATE_DECL(kInterface);   // invoke-interface/rang
 // Explicitly instantiate all DoInvokeVirtualQuick functions.
 #define EXPLICIT_HANDLE_INVOKE_VIRTUAL_QUICK_TEMPLATE_DECL(_is_range)                    \
   template SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)                               \
-  uint16_t* HandleInvokeQuick<_is_range>(const uint16_t* code, const ShadowFrame& shadow_frame,      \
-      ArtMethod* method, uint32_t count)
+  uint16_t HandleInvokeQuick<_is_range>(const uint16_t* code, const ShadowFrame& shadow_frame,       \
+      ArtMethod* method, uint32_t count, uint16_t* new_inst)
 
 EXPLICIT_HANDLE_INVOKE_VIRTUAL_QUICK_TEMPLATE_DECL(false);  // invoke-virtual-quick.
 EXPLICIT_HANDLE_INVOKE_VIRTUAL_QUICK_TEMPLATE_DECL(true);   // invoke-virtual-quick-range.
@@ -1880,9 +1935,10 @@ EXPLICIT_HANDLE_INVOKE_VIRTUAL_QUICK_TEMPLATE_DECL(true);   // invoke-virtual-qu
 
 // Explicitly instantiate all DoFieldGet functions.
 #define EXPLICIT_HANDLE_FIELD_GET_TEMPLATE_DECL(_find_type, _field_type, _do_check) \
-  template uint16_t* HandleFieldGet<_find_type, _field_type, _do_check>(const uint16_t* code, \
+  template void HandleFieldGet<_find_type, _field_type, _do_check>(const uint16_t* code, \
       const ShadowFrame& shadow_frame, \
-                                                               uint32_t count, ArtField* field, bool is_static)
+                                                               uint32_t count, ArtField* field, bool is_static, \
+                                                               uint16_t* new_inst)
 
 #define EXPLICIT_HANDLE_FIELD_GET_ALL_TEMPLATE_DECL(_find_type, _field_type)  \
     EXPLICIT_HANDLE_FIELD_GET_TEMPLATE_DECL(_find_type, _field_type, false);  \
@@ -1911,7 +1967,8 @@ EXPLICIT_HANDLE_FIELD_GET_ALL_TEMPLATE_DECL(StaticObjectRead, Primitive::kPrimNo
 
 // Explicitly instantiate all DoIGetQuick functions.
 #define EXPLICIT_HANDLE_IGET_QUICK_TEMPLATE_DECL(_field_type) \
-  template uint16_t* HandleFieldGetQuick<_field_type>(const uint16_t* code, const ShadowFrame& shadow_frame, ArtField* field, uint32_t count)
+  template void HandleFieldGetQuick<_field_type>(const uint16_t* code, const ShadowFrame& shadow_frame, ArtField* field, uint32_t count, \
+      uint16_t* new_inst)
 
 EXPLICIT_HANDLE_IGET_QUICK_TEMPLATE_DECL(Primitive::kPrimInt);    // iget-quick.
 EXPLICIT_HANDLE_IGET_QUICK_TEMPLATE_DECL(Primitive::kPrimLong);   // iget-wide-quick.
@@ -1924,8 +1981,8 @@ EXPLICIT_HANDLE_IGET_QUICK_TEMPLATE_DECL(Primitive::kPrimShort);  // iget-short-
 
 // Explicitly instantiate all DoFieldPut functions.
 #define EXPLICIT_HANDLE_FIELD_PUT_TEMPLATE_DECL(_find_type, _field_type, _do_check) \
-  template uint16_t* HandleFieldPut<_find_type, _field_type, _do_check>(const uint16_t* code, \
-      const ShadowFrame& shadow_frame, uint32_t count, ArtField* field, bool is_static)
+  template void HandleFieldPut<_find_type, _field_type, _do_check>(const uint16_t* code, \
+      const ShadowFrame& shadow_frame, uint32_t count, ArtField* field, bool is_static, uint16_t* new_inst)
 
 #define EXPLICIT_HANDLE_FIELD_PUT_ALL_TEMPLATE_DECL(_find_type, _field_type)  \
     EXPLICIT_HANDLE_FIELD_PUT_TEMPLATE_DECL(_find_type, _field_type, false);  \
@@ -1954,8 +2011,8 @@ EXPLICIT_HANDLE_FIELD_PUT_ALL_TEMPLATE_DECL(StaticObjectWrite, Primitive::kPrimN
 
 // Explicitly instantiate all DoIPutQuick functions.
 #define EXPLICIT_HANDLE_IPUT_QUICK_TEMPLATE_DECL(_field_type) \
-  template uint16_t* HandleFieldPutQuick<_field_type>(const uint16_t* code, const ShadowFrame& shadow_frame, \
-      ArtField* field, uint32_t count)
+  template void HandleFieldPutQuick<_field_type>(const uint16_t* code, const ShadowFrame& shadow_frame, \
+      ArtField* field, uint32_t count, uint16_t* new_inst)
 
 EXPLICIT_HANDLE_IPUT_QUICK_TEMPLATE_DECL(Primitive::kPrimInt);    // iget-quick.
 EXPLICIT_HANDLE_IPUT_QUICK_TEMPLATE_DECL(Primitive::kPrimLong);   // iget-wide-quick.
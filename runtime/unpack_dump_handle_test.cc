@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_dump_handle.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "base/arena_allocator.h"
+#include "base/scoped_arena_allocator.h"
+#include "dex_instruction-inl.h"
+#include "gc_root-inl.h"
+#include "stack.h"
+
+namespace art {
+
+// The lookup MapAndList used before the dense index, which the dense index must agree with.
+static uint32_t LinearFindCodeInCodeMap(MapAndList* list, uint32_t key) {
+  auto it = std::find(list->code_map_key->begin(), list->code_map_key->end(), key);
+  return it == list->code_map_key->end() ? CODE_NO_INDEX
+                                         : list->code_map_value->at(it - list->code_map_key->begin());
+}
+
+TEST(MapAndListTest, FirstPushWins) {
+  ArenaPool pool;
+  ArenaStack stack(&pool);
+  ScopedArenaAllocator allocator(&stack);
+  MapAndList list(&allocator, nullptr, 0);
+  list.PushCodeToCodeMap(4, 10);
+  list.PushCodeToCodeMap(4, 20);
+  EXPECT_EQ(10u, list.FindCodeInCodeMap(4));
+  EXPECT_EQ(CODE_NO_INDEX, list.FindCodeInCodeMap(5));
+  // Both pushes are still serialized.
+  EXPECT_EQ(2u, list.code_map_key->size());
+}
+
+TEST(MapAndListTest, WindowGrowsBothWays) {
+  ArenaPool pool;
+  ArenaStack stack(&pool);
+  ScopedArenaAllocator allocator(&stack);
+  MapAndList root(&allocator, nullptr, 0);
+  MapAndList* branch = root.NewBranch(0);
+  ASSERT_EQ(1u, root.childs->size());
+  EXPECT_EQ(branch, root.childs->at(0));
+  branch->PushCodeToCodeMap(1000, 1);
+  branch->PushCodeToCodeMap(1003, 2);
+  branch->PushCodeToCodeMap(10, 3);
+  branch->PushCodeToCodeMap(0, 4);
+  branch->PushCodeToCodeMap(5000, 5);
+  EXPECT_EQ(1u, branch->FindCodeInCodeMap(1000));
+  EXPECT_EQ(2u, branch->FindCodeInCodeMap(1003));
+  EXPECT_EQ(3u, branch->FindCodeInCodeMap(10));
+  EXPECT_EQ(4u, branch->FindCodeInCodeMap(0));
+  EXPECT_EQ(5u, branch->FindCodeInCodeMap(5000));
+  EXPECT_EQ(CODE_NO_INDEX, branch->FindCodeInCodeMap(1001));
+  EXPECT_EQ(CODE_NO_INDEX, branch->FindCodeInCodeMap(0xfffffffe));
+  EXPECT_EQ(CODE_NO_INDEX, root.FindCodeInCodeMap(1000));
+}
+
+TEST(MapAndListTest, MatchesLinearSearch) {
+  ArenaPool pool;
+  ArenaStack stack(&pool);
+  ScopedArenaAllocator allocator(&stack);
+  MapAndList list(&allocator, nullptr, 0);
+  list.ReserveCodeIndex(512);
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < 2000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    // Mostly inside the reserved range, some keys beyond it.
+    list.PushCodeToCodeMap((seed >> 8) % 600, i);
+  }
+  for (uint32_t key = 0; key < 700; ++key) {
+    ASSERT_EQ(LinearFindCodeInCodeMap(&list, key), list.FindCodeInCodeMap(key)) << key;
+  }
+}
+
+// A tree built and thrown away per invocation leaves the arena where it started, so the next
+// invocation reuses the same memory.
+TEST(MapAndListTest, ScopeRewindsArena) {
+  ArenaPool pool;
+  ArenaStack stack(&pool);
+  size_t first_peak = 0;
+  for (int run = 0; run < 3; ++run) {
+    EXPECT_EQ(0u, stack.BytesInUse());
+    {
+      ScopedArenaAllocator allocator(&stack);
+      MapAndList* root = new (&allocator) MapAndList(&allocator, nullptr, 0);
+      root->switch_table_map->Put(0, new (&allocator) DumpSwitchTable(&allocator));
+      root->ReserveCodeIndex(256);
+      for (uint32_t dex_pc = 0; dex_pc < 256; ++dex_pc) {
+        root->code_list->push_back(dex_pc);
+        root->PushCodeToCodeMap(dex_pc, dex_pc);
+        if (dex_pc % 16 == 0) {
+          root->NewBranch(dex_pc)->PushCodeToCodeMap(dex_pc + 1, 0);
+        }
+      }
+      EXPECT_EQ(16u, root->childs->size());
+      size_t peak = stack.BytesInUse();
+      delete root;
+      EXPECT_GT(peak, 0u);
+      if (run == 0) {
+        first_peak = peak;
+      } else {
+        EXPECT_EQ(first_peak, peak);
+      }
+    }
+  }
+  EXPECT_EQ(0u, stack.BytesInUse());
+}
+
+// add-int/lit8 v0, v0, #+1; if-lt v0, v1, -2; return-void
+static const uint16_t kCountingLoop[] = { 0x00d8, 0x0100, 0x1034, 0xfffe, 0x000e };
+
+// The counting loop as ExecuteSwitchImpl ran it before the DexLego hooks.
+static int32_t RunStockCountingLoop(ShadowFrame& shadow_frame, const DexFile::CodeItem* code_item)
+    NO_THREAD_SAFETY_ANALYSIS {
+  const Instruction* inst = Instruction::At(code_item->insns_);
+  while (true) {
+    uint16_t inst_data = inst->Fetch16(0);
+    switch (inst->Opcode(inst_data)) {
+      case Instruction::ADD_INT_LIT8:
+        shadow_frame.SetVReg(inst->VRegA_22b(inst_data),
+                             shadow_frame.GetVReg(inst->VRegB_22b()) + inst->VRegC_22b());
+        inst = inst->Next_2xx();
+        break;
+      case Instruction::IF_LT:
+        if (shadow_frame.GetVReg(inst->VRegA_22t(inst_data)) <
+            shadow_frame.GetVReg(inst->VRegB_22t(inst_data))) {
+          inst = inst->RelativeAt(inst->VRegC_22t());
+        } else {
+          inst = inst->Next_2xx();
+        }
+        break;
+      default:
+        return shadow_frame.GetVReg(0);
+    }
+  }
+}
+
+// The same loop with the collection macros expanded the way ExecuteSwitchImpl expands them.
+template<bool collect>
+static int32_t RunCountingLoop(ShadowFrame& shadow_frame, const DexFile::CodeItem* code_item)
+    NO_THREAD_SAFETY_ANALYSIS {
+  // The method is not hooked, so the thread is never asked for its Dumper.
+  Thread* self = nullptr;
+  JValue result_register;
+  ALLOW_TEMP_MEMORY("RunCountingLoop");
+  const Instruction* inst = Instruction::At(code_item->insns_);
+  while (true) {
+    uint32_t dex_pc = inst->GetDexPc(code_item->insns_);
+    uint16_t inst_data = inst->Fetch16(0);
+    switch (inst->Opcode(inst_data)) {
+      case Instruction::ADD_INT_LIT8:
+        HANDLE_INSTRUCTION(2);
+        shadow_frame.SetVReg(inst->VRegA_22b(inst_data),
+                             shadow_frame.GetVReg(inst->VRegB_22b()) + inst->VRegC_22b());
+        inst = inst->Next_2xx();
+        break;
+      case Instruction::IF_LT:
+        if (shadow_frame.GetVReg(inst->VRegA_22t(inst_data)) <
+            shadow_frame.GetVReg(inst->VRegB_22t(inst_data))) {
+          int16_t offset = inst->VRegC_22t();
+          HANDLE_IF_INSTRUCTION(offset);
+          inst = inst->RelativeAt(offset);
+        } else {
+          HANDLE_IF_INSTRUCTION(2);
+          inst = inst->Next_2xx();
+        }
+        break;
+      default:
+        HANDLE_RETURN_INSTRUCTION(1);
+        return shadow_frame.GetVReg(0);
+    }
+  }
+}
+
+// A method nobody collects runs the same in the stock loop and in both instantiations.
+TEST(MapAndListTest, CollectParity) {
+  static constexpr int32_t kIterations = 100;
+  std::vector<uint8_t> code_memory(sizeof(DexFile::CodeItem) + sizeof(kCountingLoop));
+  DexFile::CodeItem* code_item = reinterpret_cast<DexFile::CodeItem*>(code_memory.data());
+  code_item->registers_size_ = 2;
+  code_item->insns_size_in_code_units_ = arraysize(kCountingLoop);
+  memcpy(code_item->insns_, kCountingLoop, sizeof(kCountingLoop));
+  ArtMethod method;
+  ASSERT_FALSE(method.ShouldManipulate());
+  std::vector<uint8_t> frame_memory(ShadowFrame::ComputeSize(2));
+  ShadowFrame* shadow_frame = ShadowFrame::Create(2, nullptr, &method, 0, frame_memory.data());
+  for (int variant = 0; variant < 3; ++variant) {
+    shadow_frame->SetVReg(0, 0);
+    shadow_frame->SetVReg(1, kIterations);
+    int32_t count = variant == 0 ? RunStockCountingLoop(*shadow_frame, code_item)
+        : variant == 1 ? RunCountingLoop<true>(*shadow_frame, code_item)
+        : RunCountingLoop<false>(*shadow_frame, code_item);
+    EXPECT_EQ(kIterations, count) << variant;
+  }
+}
+
+// Reads the 32-bit value CombineCodes wrote at codes[pos] and codes[pos + 1].
+static uint32_t CombinedWord(const std::vector<uint16_t>& codes, size_t pos) {
+  return codes[pos] | (codes[pos + 1] << 16);
+}
+
+// Runs the counting loop's trace through the Handle* functions: three rounds of add-int/lit8 and
+// if-lt, the last falling through to return-void.
+static void TraceCountingLoop(MapAndList*& list, ShadowFrame* shadow_frame) NO_THREAD_SAFETY_ANALYSIS {
+  for (int round = 0; round < 3; ++round) {
+    shadow_frame->SetDexPC(0);
+    HandleInstruction(list, &kCountingLoop[0], *shadow_frame, 2);
+    shadow_frame->SetDexPC(2);
+    HandleIf(list, kCountingLoop[2], *shadow_frame, round < 2 ? -2 : 2);
+  }
+  shadow_frame->SetDexPC(4);
+  HandleInstruction(list, &kCountingLoop[4], *shadow_frame, 1);
+}
+
+static uint32_t CombineTrace(MapAndList* root, std::vector<uint16_t>* codes)
+    NO_THREAD_SAFETY_ANALYSIS {
+  DumpCodeItem code_item;
+  uint32_t left_out = CombineCodes(root, &code_item);
+  codes->assign(code_item.insns_, code_item.insns_ + code_item.insns_size_in_code_units_);
+  return left_out;
+}
+
+TEST(MapAndListTest, CombineLeavesOutPadding) {
+  ArenaPool pool;
+  ArenaStack stack(&pool);
+  ScopedArenaAllocator allocator(&stack);
+  ArtMethod method;
+  std::vector<uint8_t> frame_memory(ShadowFrame::ComputeSize(2));
+  ShadowFrame* shadow_frame = ShadowFrame::Create(2, nullptr, &method, 0, frame_memory.data());
+  MapAndList* root = new (&allocator) MapAndList(&allocator, nullptr, 0);
+  MapAndList* list = root;
+  TraceCountingLoop(list, shadow_frame);
+  ASSERT_EQ(root, list);
+  // add-int/lit8, the 8-unit if, return-void: no nops in memory.
+  EXPECT_EQ(11u, root->code_list->size());
+
+  std::vector<uint16_t> codes;
+  // Three instructions that would each have had nops in front of them.
+  EXPECT_EQ(3u * NOPS_BEFORE_BRANCH_START, CombineTrace(root, &codes));
+  EXPECT_EQ(0u, CombinedWord(codes, 0));
+  EXPECT_EQ(0u, CombinedWord(codes, 2));
+  ASSERT_EQ(11u, CombinedWord(codes, 4));
+  const uint16_t* code = &codes[6];
+  EXPECT_EQ(kCountingLoop[0], code[0]);
+  EXPECT_EQ(kCountingLoop[2], code[2]);
+  EXPECT_EQ(5, code[3]);
+  // The else goto falls through to return-void, the if goto jumps back to add-int/lit8.
+  EXPECT_EQ(DUMP_GOTO_INSTRUCTION, code[4]);
+  EXPECT_EQ(6u, CombinedWord(codes, 6 + 5));
+  EXPECT_EQ(DUMP_GOTO_INSTRUCTION, code[7]);
+  EXPECT_EQ(static_cast<uint32_t>(-7), CombinedWord(codes, 6 + 8));
+  EXPECT_EQ(kCountingLoop[4], code[10]);
+  ASSERT_EQ(6u, CombinedWord(codes, 17));
+  EXPECT_EQ(4u, CombinedWord(codes, 19 + 8));
+  EXPECT_EQ(10u, CombinedWord(codes, 19 + 10));
+  delete root;
+}
+
+// iget at 0, then goto 0, twice, then return-void. The second time the iget rewrites
+// differently, which starts a hack branch at 0 that ends at the goto.
+static const uint16_t kFirstIget[] = { 0x1052, 0x0001 };
+static const uint16_t kSecondIget[] = { 0x1052, 0x0002 };
+
+static void TraceBranchingLoop(MapAndList*& list, ShadowFrame* shadow_frame) NO_THREAD_SAFETY_ANALYSIS {
+  static const uint16_t kReturn[] = { 0x000e };
+  shadow_frame->SetDexPC(0);
+  HandleInstruction(list, kFirstIget, *shadow_frame, 2);
+  shadow_frame->SetDexPC(2);
+  HandleGoto(list, *shadow_frame, -2);
+  shadow_frame->SetDexPC(0);
+  HandleInstruction(list, kSecondIget, *shadow_frame, 2);
+  EXPECT_NE(nullptr, list->parent);
+  shadow_frame->SetDexPC(2);
+  HandleGoto(list, *shadow_frame, -2);
+  shadow_frame->SetDexPC(4);
+  HandleInstruction(list, kReturn, *shadow_frame, 1);
+}
+
+TEST(MapAndListTest, CombinePadsBranchStarts) {
+  ArenaPool pool;
+  ArenaStack stack(&pool);
+  ScopedArenaAllocator allocator(&stack);
+  ArtMethod method;
+  std::vector<uint8_t> frame_memory(ShadowFrame::ComputeSize(2));
+  ShadowFrame* shadow_frame = ShadowFrame::Create(2, nullptr, &method, 0, frame_memory.data());
+  MapAndList* root = new (&allocator) MapAndList(&allocator, nullptr, 0);
+  MapAndList* list = root;
+  TraceBranchingLoop(list, shadow_frame);
+  ASSERT_EQ(root, list);
+  ASSERT_EQ(1u, root->childs->size());
+  ASSERT_EQ(6u, root->code_list->size());
+
+  std::vector<uint16_t> codes;
+  // The goto and return-void in the root and the iget in the branch go without nops.
+  EXPECT_EQ(3u * NOPS_BEFORE_BRANCH_START, CombineTrace(root, &codes));
+  ASSERT_EQ(6u + NOPS_BEFORE_BRANCH_START, CombinedWord(codes, 4));
+  const uint16_t* code = &codes[6];
+  for (uint32_t i = 0; i < NOPS_BEFORE_BRANCH_START; ++i) {
+    EXPECT_EQ(0u, code[i]);
+  }
+  EXPECT_EQ(kFirstIget[1], code[NOPS_BEFORE_BRANCH_START + 1]);
+  // The goto still lands on the iget, behind the nops.
+  EXPECT_EQ(DUMP_GOTO_INSTRUCTION, code[NOPS_BEFORE_BRANCH_START + 2]);
+  EXPECT_EQ(static_cast<uint32_t>(-2), CombinedWord(codes, 6 + NOPS_BEFORE_BRANCH_START + 3));
+  size_t map = 6 + 6 + NOPS_BEFORE_BRANCH_START;
+  ASSERT_EQ(6u, CombinedWord(codes, map));
+  EXPECT_EQ(NOPS_BEFORE_BRANCH_START, CombinedWord(codes, map + 4));
+  EXPECT_EQ(NOPS_BEFORE_BRANCH_START + 2u, CombinedWord(codes, map + 8));
+  EXPECT_EQ(NOPS_BEFORE_BRANCH_START + 5u, CombinedWord(codes, map + 12));
+  size_t children = map + 2 + 12 + 2 + 2;
+  ASSERT_EQ(1u, CombinedWord(codes, children));
+  // The branch starts at the iget and rejoins at the goto, in combined positions.
+  EXPECT_EQ(NOPS_BEFORE_BRANCH_START, CombinedWord(codes, children + 2));
+  EXPECT_EQ(NOPS_BEFORE_BRANCH_START + 2u, CombinedWord(codes, children + 4));
+  ASSERT_EQ(2u, CombinedWord(codes, children + 6));
+  EXPECT_EQ(kSecondIget[1], codes[children + 9]);
+  delete root;
+}
+
+}  // namespace art
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_explore.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+
+#include "base/logging.h"
+#include "dex_instruction-inl.h"
+#include "stack.h"
+
+namespace art {
+
+static size_t OnlineCores() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? static_cast<size_t>(cores) : 1;
+}
+
+ForkExplorer::ForkExplorer()
+    : enabled_(false), max_children_(OnlineCores()), budget_ms_(kExploreDefaultBudgetMs),
+      max_depth_(kExploreDefaultMaxDepth), depth_(0) {
+  pthread_mutex_init(&lock_, NULL);
+}
+
+ForkExplorer::~ForkExplorer() {
+  pthread_mutex_destroy(&lock_);
+}
+
+void ForkExplorer::Configure(const std::vector<std::string>& lines) {
+  for (const std::string& line : lines) {
+    std::istringstream fields(line);
+    std::string key;
+    uint64_t value;
+    if (!(fields >> key)) {
+      continue;
+    }
+    if (!(fields >> value)) {
+      LOG(ERROR) << "explore line without a value: " << line;
+    } else if (key == "max_children") {
+      max_children_ = std::min(static_cast<size_t>(value), OnlineCores());
+    } else if (key == "budget_ms") {
+      budget_ms_ = value;
+    } else if (key == "max_depth") {
+      max_depth_ = static_cast<uint32_t>(value);
+    } else {
+      LOG(ERROR) << "unknown explore key " << key;
+    }
+  }
+  enabled_ = true;
+}
+
+// Adds outcome unless it is there already. Returns false once outcomes is full.
+static bool AddOutcome(int32_t outcome, int32_t* outcomes, size_t* count) {
+  if (std::find(outcomes, outcomes + *count, outcome) == outcomes + *count) {
+    if (*count == kExploreMaxOutcomes) {
+      return false;
+    }
+    outcomes[(*count)++] = outcome;
+  }
+  return true;
+}
+
+size_t ForkExplorer::BranchOutcomes(const Instruction* inst, const ShadowFrame& frame,
+                                    int32_t* outcomes) {
+  size_t count = 0;
+  Instruction::Code opcode = inst->Opcode();
+  switch (opcode) {
+    case Instruction::IF_EQ:
+    case Instruction::IF_NE:
+    case Instruction::IF_LT:
+    case Instruction::IF_GE:
+    case Instruction::IF_GT:
+    case Instruction::IF_LE: {
+      int32_t a = frame.GetVReg(inst->VRegA_22t());
+      int32_t b = frame.GetVReg(inst->VRegB_22t());
+      bool taken = opcode == Instruction::IF_EQ ? a == b :
+                   opcode == Instruction::IF_NE ? a != b :
+                   opcode == Instruction::IF_LT ? a < b :
+                   opcode == Instruction::IF_GE ? a >= b :
+                   opcode == Instruction::IF_GT ? a > b : a <= b;
+      int32_t offset = inst->VRegC_22t();
+      AddOutcome(taken ? offset : 2, outcomes, &count);
+      AddOutcome(taken ? 2 : offset, outcomes, &count);
+      return count;
+    }
+    case Instruction::IF_EQZ:
+    case Instruction::IF_NEZ:
+    case Instruction::IF_LTZ:
+    case Instruction::IF_GEZ:
+    case Instruction::IF_GTZ:
+    case Instruction::IF_LEZ: {
+      int32_t a = frame.GetVReg(inst->VRegA_21t());
+      bool taken = opcode == Instruction::IF_EQZ ? a == 0 :
+                   opcode == Instruction::IF_NEZ ? a != 0 :
+                   opcode == Instruction::IF_LTZ ? a < 0 :
+                   opcode == Instruction::IF_GEZ ? a >= 0 :
+                   opcode == Instruction::IF_GTZ ? a > 0 : a <= 0;
+      int32_t offset = inst->VRegB_21t();
+      AddOutcome(taken ? offset : 2, outcomes, &count);
+      AddOutcome(taken ? 2 : offset, outcomes, &count);
+      return count;
+    }
+    case Instruction::PACKED_SWITCH:
+    case Instruction::SPARSE_SWITCH: {
+      // The payload layouts are those DoPackedSwitch() and DoSparseSwitch() read.
+      const uint16_t* switch_data = reinterpret_cast<const uint16_t*>(inst) + inst->VRegB_31t();
+      int32_t test_val = frame.GetVReg(inst->VRegA_31t());
+      uint16_t size = switch_data[1];
+      const int32_t* keys = reinterpret_cast<const int32_t*>(&switch_data[2]);
+      const int32_t* targets;
+      int32_t natural = 3;
+      if (opcode == Instruction::PACKED_SWITCH) {
+        targets = reinterpret_cast<const int32_t*>(&switch_data[4]);
+        int32_t index = size == 0 ? -1 : test_val - keys[0];
+        if (index >= 0 && index < size) {
+          natural = targets[index];
+        }
+      } else {
+        targets = keys + size;
+        const int32_t* key = std::lower_bound(keys, keys + size, test_val);
+        if (key != keys + size && *key == test_val) {
+          natural = targets[key - keys];
+        }
+      }
+      AddOutcome(natural, outcomes, &count);
+      AddOutcome(3, outcomes, &count);
+      for (uint16_t i = 0; i < size; ++i) {
+        if (!AddOutcome(targets[i], outcomes, &count)) {
+          break;
+        }
+      }
+      return count;
+    }
+    default:
+      return 0;
+  }
+}
+
+bool ForkExplorer::Claim(uintptr_t dex_file, uint32_t method_idx, uint32_t dex_pc) {
+  std::tuple<uintptr_t, uint32_t, uint32_t> branch(dex_file, method_idx, dex_pc);
+  pthread_mutex_lock(&lock_);
+  bool claimed = false;
+  if (claimed_.find(branch) == claimed_.end()) {
+    if (SlotsLocked() == 0) {
+      ++stats_.busy_;
+    } else {
+      claimed_.insert(branch);
+      ++stats_.claimed_;
+      claimed = true;
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+  return claimed;
+}
+
+size_t ForkExplorer::SlotsLocked() {
+  if (depth_ >= max_depth_) {
+    return 0;
+  }
+  for (auto it = children_.begin(); it != children_.end();) {
+    if (waitpid(*it, nullptr, WNOHANG) != 0) {
+      // Exited, or not a child of this process at all.
+      it = children_.erase(it);
+      ++stats_.reaped_;
+    } else {
+      ++it;
+    }
+  }
+  return max_children_ - std::min(max_children_, children_.size());
+}
+
+size_t ForkExplorer::Slots() {
+  pthread_mutex_lock(&lock_);
+  size_t slots = SlotsLocked();
+  pthread_mutex_unlock(&lock_);
+  return slots;
+}
+
+void ForkExplorer::Started(pid_t pid) {
+  pthread_mutex_lock(&lock_);
+  children_.push_back(pid);
+  ++stats_.forks_;
+  pthread_mutex_unlock(&lock_);
+}
+
+void ForkExplorer::Failed() {
+  pthread_mutex_lock(&lock_);
+  ++stats_.failed_;
+  pthread_mutex_unlock(&lock_);
+}
+
+void ForkExplorer::EnterChild() {
+  pthread_mutex_lock(&lock_);
+  ++depth_;
+  children_.clear();
+  stats_ = ForkExplorerStats();
+  pthread_mutex_unlock(&lock_);
+}
+
+ForkExplorerStats ForkExplorer::GetStats() {
+  pthread_mutex_lock(&lock_);
+  ForkExplorerStats stats = stats_;
+  pthread_mutex_unlock(&lock_);
+  return stats;
+}
+
+}  // namespace art
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_EXPLORE_H_
+#define ART_RUNTIME_UNPACK_EXPLORE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace art {
+
+class Instruction;
+class ShadowFrame;
+
+// Most outcomes of one branch that are explored; further switch targets are left out.
+static constexpr size_t kExploreMaxOutcomes = 16;
+// How long a forked process runs its path before it writes its output and exits.
+static constexpr uint64_t kExploreDefaultBudgetMs = 10000;
+// Forked processes fork no further by default, so that at most max_children run at a time.
+static constexpr uint32_t kExploreDefaultMaxDepth = 1;
+// Longest a forked process out of budget waits for its queued records before writing.
+static constexpr uint64_t kExploreDrainTimeoutMs = 1000;
+
+struct ForkExplorerStats {
+  uint64_t claimed_;  // Branches explored, each once per process.
+  uint64_t forks_;
+  uint64_t busy_;     // New branches met while no child could be forked.
+  uint64_t failed_;   // fork() failures.
+  uint64_t reaped_;
+
+  ForkExplorerStats() : claimed_(0), forks_(0), busy_(0), failed_(0), reaped_(0) {}
+};
+
+// Bookkeeping for exploring the outcomes of a branch in parallel: the process stays on the
+// outcome it would take anyway, and a forked child follows each of the others with the state of
+// the app at the branch. Each branch is explored once per process; a child inherits the branches
+// its parent already explored. Children run for a time budget, at most max_children at once, and
+// fork again only up to max_depth. The Dumper does the forking; this class decides whether it
+// may.
+class ForkExplorer {
+  public:
+    ForkExplorer();
+    ~ForkExplorer();
+
+    // Enables exploring, with limits read from lines of the form "max_children <n>",
+    // "budget_ms <n>" and "max_depth <n>". max_children defaults to the number of online cores
+    // and is never above it.
+    void Configure(const std::vector<std::string>& lines);
+
+    bool Enabled() const {
+      return enabled_;
+    }
+
+    size_t MaxChildren() const {
+      return max_children_;
+    }
+
+    uint64_t BudgetMs() const {
+      return budget_ms_;
+    }
+
+    uint32_t MaxDepth() const {
+      return max_depth_;
+    }
+
+    // 0 in the process that was not forked for exploring.
+    uint32_t Depth() const {
+      return depth_;
+    }
+
+    // Stores the distinct outcomes of the if-* or switch instruction inst into outcomes, as the
+    // offsets the interpreter's forced branches take: 2 falls through an if-*, 3 a switch.
+    // outcomes[0] is the outcome the registers of frame select. Returns the number of outcomes,
+    // at most kExploreMaxOutcomes, or 0 if inst is not a branch.
+    static size_t BranchOutcomes(const Instruction* inst, const ShadowFrame& frame,
+                                 int32_t* outcomes);
+
+    // Claims the branch at dex_pc of the method for exploring. Returns false if this process
+    // explored it already, or if no child may be forked now; the branch is then left unclaimed,
+    // for a later visit to explore.
+    bool Claim(uintptr_t dex_file, uint32_t method_idx, uint32_t dex_pc);
+
+    // Reaps exited children and returns how many more may be forked now.
+    size_t Slots();
+
+    void Started(pid_t pid);
+    void Failed();
+
+    // Called in a forked child: it is one level deeper and has no children of its own yet.
+    void EnterChild();
+
+    ForkExplorerStats GetStats();
+
+  private:
+    // Must be called with lock_ held.
+    size_t SlotsLocked();
+
+    bool enabled_;
+    size_t max_children_;
+    uint64_t budget_ms_;
+    uint32_t max_depth_;
+    uint32_t depth_;
+    pthread_mutex_t lock_;
+    std::set<std::tuple<uintptr_t, uint32_t, uint32_t>> claimed_;
+    std::vector<pid_t> children_;
+    ForkExplorerStats stats_;
+
+    DISALLOW_COPY_AND_ASSIGN(ForkExplorer);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_EXPLORE_H_
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_explore.h"
+
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "base/time_utils.h"
+#include "dex_instruction-inl.h"
+#include "stack.h"
+
+namespace art {
+
+static constexpr uint32_t kFrameVRegs = 4;
+
+class ForkExplorerTest : public testing::Test {
+  protected:
+    void SetUp() OVERRIDE {
+      memory_.resize(ShadowFrame::ComputeSize(kFrameVRegs));
+      frame_ = ShadowFrame::Create(kFrameVRegs, nullptr, nullptr, 0, &memory_[0]);
+    }
+
+    std::vector<int32_t> Outcomes(const uint16_t* insns) {
+      int32_t outcomes[kExploreMaxOutcomes];
+      size_t count = ForkExplorer::BranchOutcomes(Instruction::At(insns), *frame_, outcomes);
+      return std::vector<int32_t>(outcomes, outcomes + count);
+    }
+
+    std::vector<uint8_t> memory_;
+    ShadowFrame* frame_;
+};
+
+TEST_F(ForkExplorerTest, IfOutcomes) {
+  // if-lt v1, v2, +7
+  const uint16_t if_lt[] = { static_cast<uint16_t>(Instruction::IF_LT | 1 << 8 | 2 << 12), 7 };
+  frame_->SetVReg(1, 3);
+  frame_->SetVReg(2, 5);
+  EXPECT_EQ(std::vector<int32_t>({ 7, 2 }), Outcomes(if_lt));
+  frame_->SetVReg(1, 5);
+  EXPECT_EQ(std::vector<int32_t>({ 2, 7 }), Outcomes(if_lt));
+
+  // if-nez v3, -4
+  const uint16_t if_nez[] = { static_cast<uint16_t>(Instruction::IF_NEZ | 3 << 8), 0xfffc };
+  frame_->SetVReg(3, 0);
+  EXPECT_EQ(std::vector<int32_t>({ 2, -4 }), Outcomes(if_nez));
+
+  // A branch to the next instruction has a single outcome.
+  const uint16_t if_eqz[] = { static_cast<uint16_t>(Instruction::IF_EQZ | 3 << 8), 2 };
+  EXPECT_EQ(std::vector<int32_t>({ 2 }), Outcomes(if_eqz));
+
+  const uint16_t nop[] = { 0 };
+  EXPECT_TRUE(Outcomes(nop).empty());
+}
+
+TEST_F(ForkExplorerTest, SwitchOutcomes) {
+  // packed-switch v0, +4 with keys 10..12 going to +20, +3 and +20. The payload is 4-aligned.
+  alignas(4) const uint16_t packed[] = {
+    static_cast<uint16_t>(Instruction::PACKED_SWITCH), 4, 0, 0,
+    0x0100, 3, 10, 0, 20, 0, 3, 0, 20, 0
+  };
+  frame_->SetVReg(0, 11);
+  EXPECT_EQ(std::vector<int32_t>({ 3, 20 }), Outcomes(packed));
+  frame_->SetVReg(0, 12);
+  EXPECT_EQ(std::vector<int32_t>({ 20, 3 }), Outcomes(packed));
+  frame_->SetVReg(0, 99);
+  EXPECT_EQ(std::vector<int32_t>({ 3, 20 }), Outcomes(packed));
+
+  // sparse-switch v0, +4 with keys -1, 7 and 1000 going to +30, +40 and +50.
+  alignas(4) const uint16_t sparse[] = {
+    static_cast<uint16_t>(Instruction::SPARSE_SWITCH), 4, 0, 0,
+    0x0200, 3, 0xffff, 0xffff, 7, 0, 1000, 0, 30, 0, 40, 0, 50, 0
+  };
+  frame_->SetVReg(0, 1000);
+  EXPECT_EQ(std::vector<int32_t>({ 50, 3, 30, 40 }), Outcomes(sparse));
+  frame_->SetVReg(0, -1);
+  EXPECT_EQ(std::vector<int32_t>({ 30, 3, 40, 50 }), Outcomes(sparse));
+  frame_->SetVReg(0, 8);
+  EXPECT_EQ(std::vector<int32_t>({ 3, 30, 40, 50 }), Outcomes(sparse));
+}
+
+TEST_F(ForkExplorerTest, ClaimAndSlots) {
+  ForkExplorer explorer;
+  EXPECT_FALSE(explorer.Enabled());
+  explorer.Configure({ "max_children 1", "budget_ms 250", "", "max_depth 2", "bogus 3" });
+  EXPECT_TRUE(explorer.Enabled());
+  EXPECT_EQ(1u, explorer.MaxChildren());
+  EXPECT_EQ(250u, explorer.BudgetMs());
+  EXPECT_EQ(2u, explorer.MaxDepth());
+
+  EXPECT_TRUE(explorer.Claim(0x1000, 5, 12));
+  EXPECT_FALSE(explorer.Claim(0x1000, 5, 12));
+  EXPECT_TRUE(explorer.Claim(0x1000, 5, 14));
+  EXPECT_TRUE(explorer.Claim(0x2000, 5, 12));
+
+  ASSERT_EQ(1u, explorer.Slots());
+  pid_t pid = fork();
+  if (pid == 0) {
+    NanoSleep(MsToNs(50));
+    _exit(0);
+  }
+  ASSERT_GT(pid, 0);
+  explorer.Started(pid);
+  EXPECT_EQ(0u, explorer.Slots());
+  // A branch met while the only slot is taken stays unclaimed.
+  EXPECT_FALSE(explorer.Claim(0x3000, 1, 0));
+  // The slot frees up once the child exits.
+  size_t slots = 0;
+  for (int i = 0; i < 1000 && slots == 0; ++i) {
+    NanoSleep(MsToNs(5));
+    slots = explorer.Slots();
+  }
+  EXPECT_EQ(1u, slots);
+  ForkExplorerStats stats = explorer.GetStats();
+  EXPECT_EQ(3u, stats.claimed_);
+  EXPECT_EQ(1u, stats.forks_);
+  EXPECT_EQ(1u, stats.busy_);
+  EXPECT_EQ(1u, stats.reaped_);
+
+  // A child inherits the claims but not the children, and forks no deeper than max_depth.
+  explorer.EnterChild();
+  EXPECT_EQ(1u, explorer.Depth());
+  EXPECT_FALSE(explorer.Claim(0x1000, 5, 14));
+  EXPECT_TRUE(explorer.Claim(0x3000, 1, 0));
+  explorer.EnterChild();
+  EXPECT_EQ(0u, explorer.Slots());
+  EXPECT_FALSE(explorer.Claim(0x3000, 1, 2));
+}
+
+}  // namespace art
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_force_branch.h"
+
+#include <string.h>
+
+#include "atomic.h"
+#include "base/logging.h"
+#include "dex_file-inl.h"
+
+namespace art {
+
+static Atomic<uint32_t> next_force_branch_generation(1);
+
+std::string ForceBranch::ToString() {
+  return class_ + " " + name_ + " " + shorty_ + " " + std::to_string((uint32_t)dex_pc_) + "," + std::to_string(force_offset_);
+}
+
+ForceBranchIndex::ForceBranchIndex(const std::vector<ForceBranch*>& branches)
+    : generation_(next_force_branch_generation.FetchAndAddSequentiallyConsistent(1)),
+      branches_(branches), resolved_files_(nullptr), dex_files_(0), resolved_(0), lookups_(0),
+      forced_(0) {
+  pthread_mutex_init(&lock_, NULL);
+}
+
+ForceBranchIndex::~ForceBranchIndex() {
+  const ResolvedDexFile* file = resolved_files_.LoadRelaxed();
+  while (file != nullptr) {
+    const ResolvedDexFile* next = file->next_;
+    delete file;
+    file = next;
+  }
+  for (ForceBranch* branch : branches_) {
+    delete branch;
+  }
+  pthread_mutex_destroy(&lock_);
+}
+
+static const DexFile::TypeId* FindType(const DexFile& dex_file, const std::string& descriptor) {
+  const DexFile::StringId* string_id = dex_file.FindStringId(descriptor.c_str());
+  if (string_id == nullptr) {
+    return nullptr;
+  }
+  return dex_file.FindTypeId(dex_file.GetIndexForStringId(*string_id));
+}
+
+bool ForceBranchIndex::FindMethod(const DexFile& dex_file, const ForceBranch& branch,
+                                  uint32_t* method_idx) {
+  const DexFile::TypeId* class_type_id = FindType(dex_file, branch.class_);
+  const DexFile::StringId* name_string_id = dex_file.FindStringId(branch.name_.c_str());
+  const DexFile::TypeId* return_type_id = FindType(dex_file, branch.return_type_);
+  if (class_type_id == nullptr || name_string_id == nullptr || return_type_id == nullptr) {
+    return false;
+  }
+  std::vector<uint16_t> param_type_idxs;
+  for (const std::string& param_type : branch.param_types_) {
+    const DexFile::TypeId* param_type_id = FindType(dex_file, param_type);
+    if (param_type_id == nullptr) {
+      return false;
+    }
+    param_type_idxs.push_back(dex_file.GetIndexForTypeId(*param_type_id));
+  }
+  const DexFile::ProtoId* proto_id = dex_file.FindProtoId(dex_file.GetIndexForTypeId(*return_type_id),
+                                                          param_type_idxs.data(),
+                                                          param_type_idxs.size());
+  if (proto_id == nullptr ||
+      strcmp(dex_file.StringDataByIdx(proto_id->shorty_idx_), branch.shorty_.c_str()) != 0) {
+    return false;
+  }
+  const DexFile::MethodId* method_id = dex_file.FindMethodId(*class_type_id, *name_string_id,
+                                                             *proto_id);
+  if (method_id == nullptr) {
+    return false;
+  }
+  *method_idx = dex_file.GetIndexForMethodId(*method_id);
+  return true;
+}
+
+const ForceBranchIndex::ResolvedDexFile* ForceBranchIndex::Find(const DexFile& dex_file) const {
+  for (const ResolvedDexFile* file = resolved_files_.load(std::memory_order_acquire);
+       file != nullptr; file = file->next_) {
+    if (file->dex_file_ == &dex_file) {
+      return file;
+    }
+  }
+  return nullptr;
+}
+
+const ForceBranchIndex::ResolvedDexFile* ForceBranchIndex::Resolve(const DexFile& dex_file) {
+  const ResolvedDexFile* found = Find(dex_file);
+  if (LIKELY(found != nullptr)) {
+    return found;
+  }
+  pthread_mutex_lock(&lock_);
+  // Another thread may have resolved it while this one waited.
+  found = Find(dex_file);
+  if (found == nullptr) {
+    ResolvedDexFile* file = new ResolvedDexFile;
+    file->dex_file_ = &dex_file;
+    file->next_ = resolved_files_.LoadRelaxed();
+    for (ForceBranch* branch : branches_) {
+      uint32_t method_idx;
+      if (FindMethod(dex_file, *branch, &method_idx)) {
+        file->methods_.insert(method_idx);
+        file->branches_[(static_cast<uint64_t>(method_idx) << 32) | branch->dex_pc_]
+            .push_back(branch);
+        ++resolved_;
+      }
+    }
+    ++dex_files_;
+    // Publishes the filled map to lock-free readers.
+    resolved_files_.StoreRelease(file);
+    found = file;
+  }
+  pthread_mutex_unlock(&lock_);
+  return found;
+}
+
+bool ForceBranchIndex::ResolveMethod(const DexFile& dex_file, uint32_t method_idx) {
+  const ResolvedDexFile* file = Resolve(dex_file);
+  return file->methods_.find(method_idx) != file->methods_.end();
+}
+
+int32_t ForceBranchIndex::Take(const DexFile& dex_file, uint32_t method_idx, uint32_t dex_pc) {
+  lookups_.fetch_add(1, std::memory_order_relaxed);
+  const ResolvedDexFile* file = Find(dex_file);
+  if (file == nullptr) {
+    return 0;
+  }
+  auto it = file->branches_.find((static_cast<uint64_t>(method_idx) << 32) | dex_pc);
+  if (it == file->branches_.end()) {
+    return 0;
+  }
+  for (ForceBranch* branch : it->second) {
+    // A cheap load first, so that spent entries are not written again.
+    if (!branch->reached_.LoadRelaxed() &&
+        !branch->reached_.exchange(true, std::memory_order_relaxed)) {
+      LOG(ERROR) << "ForceBranch found:" << branch->ToString();
+      forced_.fetch_add(1, std::memory_order_relaxed);
+      return branch->force_offset_;
+    }
+  }
+  return 0;
+}
+
+ForceBranchStats ForceBranchIndex::GetStats() {
+  ForceBranchStats stats;
+  pthread_mutex_lock(&lock_);
+  stats.branches_ = branches_.size();
+  stats.dex_files_ = dex_files_;
+  stats.resolved_ = resolved_;
+  pthread_mutex_unlock(&lock_);
+  stats.lookups_ = lookups_.LoadRelaxed();
+  stats.forced_ = forced_.LoadRelaxed();
+  return stats;
+}
+
+}  // namespace art
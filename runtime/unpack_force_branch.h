@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_FORCE_BRANCH_H_
+#define ART_RUNTIME_UNPACK_FORCE_BRANCH_H_
+
+#include <pthread.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "atomic.h"
+#include "base/macros.h"
+
+namespace art {
+
+class DexFile;
+
+// Sent by an exploration driver to make a target process reread force_branches. Blocked in every
+// thread and taken by the signal catcher with sigwait(), like SIGQUIT.
+static constexpr int kForceBranchReloadSignal = 44;
+
+// enum ForceBranchRet {
+//   FORCE_NONE = 0, FORCE_IF = 1, FORCE_ELSE = 2
+// };
+
+// One line of force_branches: the branch at dex_pc of the named method is forced to
+// force_offset_ the first time it is reached, by whichever thread consumes it.
+struct ForceBranch {
+  std::string class_;
+  std::string name_;
+  std::string shorty_;
+  std::string return_type_;
+  std::vector<std::string> param_types_;
+  uint32_t dex_pc_;
+
+//  ForceBranchRet force_target_ = FORCE_NONE;
+  int32_t force_offset_ = 0;
+
+  Atomic<bool> reached_;
+
+  std::string ToString();
+};
+
+struct ForceBranchStats {
+  uint64_t branches_;
+  uint64_t dex_files_;   // Dex files the branches were resolved against.
+  uint64_t resolved_;    // Branches found in one of them.
+  uint64_t lookups_;     // Branches reached by methods that have an entry.
+  uint64_t forced_;
+
+  ForceBranchStats() : branches_(0), dex_files_(0), resolved_(0), lookups_(0), forced_(0) {}
+};
+
+// The configured branches, keyed by (dex file, method_idx, dex_pc).
+//
+// An entry names its method by descriptors. Instead of rebuilding those strings from the dex file
+// at every branch, the index matches all entries against a dex file once, when the first method
+// of it is linked, by looking the descriptors up in its string, type and proto ids. Methods learn
+// at that point whether they have an entry at all, so the others never look the index up.
+// Every index has its own generation: after a reload, methods linked against an older index
+// resolve again on their next invocation.
+//
+// Lookups take no lock. The entries of a dex file are resolved once, under the lock, into an
+// immutable map that is published at the head of a list of resolved files; readers walk the list
+// and search the map. Entries are consumed with an atomic exchange.
+class ForceBranchIndex {
+  public:
+    // Takes ownership of the branches.
+    explicit ForceBranchIndex(const std::vector<ForceBranch*>& branches);
+    ~ForceBranchIndex();
+
+    bool Empty() const {
+      return branches_.empty();
+    }
+
+    // Never 0, so that a zeroed tag in EntryHookInfo matches no index.
+    uint32_t Generation() const {
+      return generation_;
+    }
+
+    // Returns whether the method has an entry, resolving the entries against dex_file first if
+    // no method of it asked before.
+    bool ResolveMethod(const DexFile& dex_file, uint32_t method_idx);
+
+    // Returns the offset the branch at dex_pc is forced to, or 0 to let it take its own outcome.
+    // Each entry is used once; later visits of the branch run normally.
+    int32_t Take(const DexFile& dex_file, uint32_t method_idx, uint32_t dex_pc);
+
+    ForceBranchStats GetStats();
+
+  private:
+    // The entries of one dex file. Never changed once published.
+    struct ResolvedDexFile {
+      const DexFile* dex_file_;
+      const ResolvedDexFile* next_;
+      std::unordered_set<uint32_t> methods_;
+      // Keyed by method_idx << 32 | dex_pc. Entries for the same branch, in the order
+      // force_branches lists them.
+      std::unordered_map<uint64_t, std::vector<ForceBranch*>> branches_;
+    };
+
+    // Finds the method_id the branch names in dex_file. Fails if any of its descriptors is not
+    // in the file, which is the case for every dex file but the one defining the method.
+    static bool FindMethod(const DexFile& dex_file, const ForceBranch& branch,
+                           uint32_t* method_idx);
+    // Returns the entries of dex_file, or null if it was not resolved yet.
+    const ResolvedDexFile* Find(const DexFile& dex_file) const;
+    const ResolvedDexFile* Resolve(const DexFile& dex_file);
+
+    const uint32_t generation_;
+    std::vector<ForceBranch*> branches_;
+    Atomic<const ResolvedDexFile*> resolved_files_;
+    // Serializes resolution. Guards dex_files_ and resolved_.
+    pthread_mutex_t lock_;
+    uint64_t dex_files_;
+    uint64_t resolved_;
+    Atomic<uint64_t> lookups_;
+    Atomic<uint64_t> forced_;
+
+    DISALLOW_COPY_AND_ASSIGN(ForceBranchIndex);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_FORCE_BRANCH_H_
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_force_branch.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "base/logging.h"
+#include "dex_file-inl.h"
+
+namespace art {
+
+static const uint8_t kBase64Map[256] = {
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+  52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255,
+  255, 254, 255, 255, 255,   0,   1,   2,   3,   4,   5,   6,
+    7,   8,   9,  10,  11,  12,  13,  14,  15,  16,  17,  18,  // NOLINT
+   19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,  // NOLINT
+  255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,
+   37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  // NOLINT
+   49,  50,  51, 255, 255, 255, 255, 255, 255, 255, 255, 255,  // NOLINT
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255
+};
+
+static inline uint8_t* DecodeBase64(const char* src, size_t* dst_size) {
+  std::vector<uint8_t> tmp;
+  uint32_t t = 0, y = 0;
+  int g = 3;
+  for (size_t i = 0; src[i] != '\0'; ++i) {
+    uint8_t c = kBase64Map[src[i] & 0xFF];
+    if (c == 255) continue;
+    // the final = symbols are read and used to trim the remaining bytes
+    if (c == 254) {
+      c = 0;
+      // prevent g < 0 which would potentially allow an overflow later
+      if (--g < 0) {
+        *dst_size = 0;
+        return nullptr;
+      }
+    } else if (g != 3) {
+      // we only allow = to be at the end
+      *dst_size = 0;
+      return nullptr;
+    }
+    t = (t << 6) | c;
+    if (++y == 4) {
+      tmp.push_back((t >> 16) & 255);
+      if (g > 1) {
+        tmp.push_back((t >> 8) & 255);
+      }
+      if (g > 2) {
+        tmp.push_back(t & 255);
+      }
+      y = t = 0;
+    }
+  }
+  if (y != 0) {
+    *dst_size = 0;
+    return nullptr;
+  }
+  std::unique_ptr<uint8_t[]> dst(new uint8_t[tmp.size()]);
+  if (dst_size != nullptr) {
+    *dst_size = tmp.size();
+  } else {
+    *dst_size = 0;
+  }
+  std::copy(tmp.begin(), tmp.end(), dst.get());
+  return dst.release();
+}
+
+// class Nested {
+//     class Inner {
+//     }
+// }
+static const char kRawDex[] =
+  "ZGV4CjAzNQAQedgAe7gM1B/WHsWJ6L7lGAISGC7yjD2IAwAAcAAAAHhWNBIAAAAAAAAAAMQCAAAP"
+  "AAAAcAAAAAcAAACsAAAAAgAAAMgAAAABAAAA4AAAAAMAAADoAAAAAgAAAAABAABIAgAAQAEAAK4B"
+  "AAC2AQAAvQEAAM0BAADXAQAA+wEAABsCAAA+AgAAUgIAAF8CAABiAgAAZgIAAHMCAAB5AgAAgQIA"
+  "AAIAAAADAAAABAAAAAUAAAAGAAAABwAAAAkAAAAJAAAABgAAAAAAAAAKAAAABgAAAKgBAAAAAAEA"
+  "DQAAAAAAAQAAAAAAAQAAAAAAAAAFAAAAAAAAAAAAAAAAAAAABQAAAAAAAAAIAAAAiAEAAKsCAAAA"
+  "AAAAAQAAAAAAAAAFAAAAAAAAAAgAAACYAQAAuAIAAAAAAAACAAAAlAIAAJoCAAABAAAAowIAAAIA"
+  "AgABAAAAiAIAAAYAAABbAQAAcBACAAAADgABAAEAAQAAAI4CAAAEAAAAcBACAAAADgBAAQAAAAAA"
+  "AAAAAAAAAAAATAEAAAAAAAAAAAAAAAAAAAEAAAABAAY8aW5pdD4ABUlubmVyAA5MTmVzdGVkJElu"
+  "bmVyOwAITE5lc3RlZDsAIkxkYWx2aWsvYW5ub3RhdGlvbi9FbmNsb3NpbmdDbGFzczsAHkxkYWx2"
+  "aWsvYW5ub3RhdGlvbi9Jbm5lckNsYXNzOwAhTGRhbHZpay9hbm5vdGF0aW9uL01lbWJlckNsYXNz"
+  "ZXM7ABJMamF2YS9sYW5nL09iamVjdDsAC05lc3RlZC5qYXZhAAFWAAJWTAALYWNjZXNzRmxhZ3MA"
+  "BG5hbWUABnRoaXMkMAAFdmFsdWUAAgEABw4AAQAHDjwAAgIBDhgBAgMCCwQADBcBAgQBDhwBGAAA"
+  "AQEAAJAgAICABNQCAAABAAGAgATwAgAAEAAAAAAAAAABAAAAAAAAAAEAAAAPAAAAcAAAAAIAAAAH"
+  "AAAArAAAAAMAAAACAAAAyAAAAAQAAAABAAAA4AAAAAUAAAADAAAA6AAAAAYAAAACAAAAAAEAAAMQ"
+  "AAACAAAAQAEAAAEgAAACAAAAVAEAAAYgAAACAAAAiAEAAAEQAAABAAAAqAEAAAIgAAAPAAAArgEA"
+  "AAMgAAACAAAAiAIAAAQgAAADAAAAlAIAAAAgAAACAAAAqwIAAAAQAAABAAAAxAIAAA==";
+
+static ForceBranch* NewBranch(const char* clazz, const char* name, const char* shorty,
+                              const char* return_type, std::vector<std::string> param_types,
+                              uint32_t dex_pc, int32_t force_offset) {
+  ForceBranch* branch = new ForceBranch;
+  branch->class_ = clazz;
+  branch->name_ = name;
+  branch->shorty_ = shorty;
+  branch->return_type_ = return_type;
+  branch->param_types_ = param_types;
+  branch->dex_pc_ = dex_pc;
+  branch->force_offset_ = force_offset;
+  return branch;
+}
+
+class ForceBranchIndexTest : public testing::Test {
+  protected:
+    void SetUp() OVERRIDE {
+      size_t size;
+      bytes_.reset(DecodeBase64(kRawDex, &size));
+      ASSERT_TRUE(bytes_.get() != nullptr);
+      std::string error_msg;
+      dex_file_ = DexFile::Open(bytes_.get(), size, "Nested.dex", 0x00d87910U, nullptr, &error_msg);
+      ASSERT_TRUE(dex_file_.get() != nullptr) << error_msg;
+      ASSERT_EQ(3u, dex_file_->NumMethodIds());
+    }
+
+    // Index of the method_id of the given class named name.
+    uint32_t MethodIdx(const char* descriptor, const char* name) {
+      for (uint32_t i = 0; i < dex_file_->NumMethodIds(); ++i) {
+        const DexFile::MethodId& method_id = dex_file_->GetMethodId(i);
+        if (strcmp(dex_file_->GetMethodDeclaringClassDescriptor(method_id), descriptor) == 0 &&
+            strcmp(dex_file_->GetMethodName(method_id), name) == 0) {
+          return i;
+        }
+      }
+      ADD_FAILURE() << descriptor << " " << name;
+      return 0;
+    }
+
+    std::unique_ptr<uint8_t[]> bytes_;
+    std::unique_ptr<const DexFile> dex_file_;
+};
+
+TEST_F(ForceBranchIndexTest, Resolve) {
+  std::vector<ForceBranch*> branches;
+  branches.push_back(NewBranch("LNested$Inner;", "<init>", "VL", "V", {"LNested;"}, 2, 4));
+  branches.push_back(NewBranch("LNested$Inner;", "<init>", "VL", "V", {"LNested;"}, 2, 6));
+  branches.push_back(NewBranch("LNested;", "<init>", "V", "V", {}, 0, 3));
+  // Right names, wrong parameters or shorty, or a class the file does not have.
+  branches.push_back(NewBranch("LNested;", "<init>", "VL", "V", {"LNested;"}, 0, 5));
+  branches.push_back(NewBranch("LNested;", "<init>", "VL", "V", {}, 0, 5));
+  branches.push_back(NewBranch("LOther;", "<init>", "V", "V", {}, 0, 5));
+  ForceBranchIndex index(branches);
+  EXPECT_FALSE(index.Empty());
+  EXPECT_NE(0u, index.Generation());
+
+  uint32_t inner_init = MethodIdx("LNested$Inner;", "<init>");
+  uint32_t nested_init = MethodIdx("LNested;", "<init>");
+  uint32_t object_init = MethodIdx("Ljava/lang/Object;", "<init>");
+  EXPECT_TRUE(index.ResolveMethod(*dex_file_, inner_init));
+  EXPECT_TRUE(index.ResolveMethod(*dex_file_, nested_init));
+  EXPECT_FALSE(index.ResolveMethod(*dex_file_, object_init));
+
+  // Both entries of the branch are used, in order, and then it runs normally.
+  EXPECT_EQ(0, index.Take(*dex_file_, inner_init, 0));
+  EXPECT_EQ(4, index.Take(*dex_file_, inner_init, 2));
+  EXPECT_EQ(6, index.Take(*dex_file_, inner_init, 2));
+  EXPECT_EQ(0, index.Take(*dex_file_, inner_init, 2));
+  EXPECT_EQ(3, index.Take(*dex_file_, nested_init, 0));
+  EXPECT_EQ(0, index.Take(*dex_file_, nested_init, 0));
+
+  ForceBranchStats stats = index.GetStats();
+  EXPECT_EQ(6u, stats.branches_);
+  EXPECT_EQ(1u, stats.dex_files_);
+  EXPECT_EQ(3u, stats.resolved_);
+  EXPECT_EQ(6u, stats.lookups_);
+  EXPECT_EQ(3u, stats.forced_);
+
+  std::vector<ForceBranch*> none;
+  ForceBranchIndex reloaded(none);
+  EXPECT_TRUE(reloaded.Empty());
+  EXPECT_NE(index.Generation(), reloaded.Generation());
+  EXPECT_FALSE(reloaded.ResolveMethod(*dex_file_, inner_init));
+}
+
+static constexpr size_t kTakeThreads = 4;
+static constexpr size_t kTakeEntries = 64;
+
+struct TakeArgs {
+  ForceBranchIndex* index_;
+  const DexFile* dex_file_;
+  uint32_t method_idx_;
+  size_t taken_;
+};
+
+static void* TakeAll(void* arg) {
+  TakeArgs* args = reinterpret_cast<TakeArgs*>(arg);
+  CHECK(args->index_->ResolveMethod(*args->dex_file_, args->method_idx_));
+  for (size_t i = 0; i < kTakeEntries; ++i) {
+    args->taken_ += args->index_->Take(*args->dex_file_, args->method_idx_, 0);
+  }
+  return nullptr;
+}
+
+TEST_F(ForceBranchIndexTest, ConcurrentTake) {
+  std::vector<ForceBranch*> branches;
+  for (size_t i = 0; i < kTakeEntries; ++i) {
+    branches.push_back(NewBranch("LNested;", "<init>", "V", "V", {}, 0, 1));
+  }
+  ForceBranchIndex index(branches);
+
+  // Threads resolve the file and take entries together; each entry is taken exactly once.
+  pthread_t threads[kTakeThreads];
+  TakeArgs args[kTakeThreads];
+  for (size_t i = 0; i < kTakeThreads; ++i) {
+    args[i] = { &index, dex_file_.get(), MethodIdx("LNested;", "<init>"), 0 };
+    CHECK_PTHREAD_CALL(pthread_create, (&threads[i], nullptr, TakeAll, &args[i]), "take");
+  }
+  size_t taken = 0;
+  for (size_t i = 0; i < kTakeThreads; ++i) {
+    CHECK_PTHREAD_CALL(pthread_join, (threads[i], nullptr), "take");
+    taken += args[i].taken_;
+  }
+  EXPECT_EQ(kTakeEntries, taken);
+
+  ForceBranchStats stats = index.GetStats();
+  EXPECT_EQ(1u, stats.dex_files_);
+  EXPECT_EQ(kTakeEntries, stats.resolved_);
+  EXPECT_EQ(kTakeThreads * kTakeEntries, stats.lookups_);
+  EXPECT_EQ(kTakeEntries, stats.forced_);
+}
+
+}  // namespace art
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_HASH_H_
+#define ART_RUNTIME_UNPACK_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define DUMP_HASH_CRC32C 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define DUMP_HASH_CRC32C 1
+#endif
+
+namespace art {
+
+#ifdef DUMP_HASH_CRC32C
+static constexpr uint32_t kDumpHashFlavor = 1;
+#else
+static constexpr uint32_t kDumpHashFlavor = 0;
+#endif
+
+// 64-bit hash of size bytes at data, continuing from seed, for the intern table buckets of
+// collected items. Reads eight bytes at a time. Where the compiler targets SSE4.2 or the ARMv8 CRC
+// extension, two interleaved CRC32C lanes do the mixing, otherwise multiply-rotate rounds do.
+// The two flavours give different values; hashes kept across runs record kDumpHashFlavor.
+static inline uint64_t DumpHash(const void* data, size_t size, uint64_t seed) {
+  static constexpr uint64_t kPrime1 = 0x9e3779b185ebca87ULL;
+  static constexpr uint64_t kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  uint64_t lane1 = seed ^ kPrime1;
+  uint64_t lane2 = (seed + size) * kPrime2;
+  uint64_t word1;
+  uint64_t word2;
+  while (size >= 16) {
+    memcpy(&word1, bytes, 8);
+    memcpy(&word2, bytes + 8, 8);
+#ifdef DUMP_HASH_CRC32C
+#if defined(__SSE4_2__)
+    lane1 = _mm_crc32_u64(lane1, word1);
+    lane2 = _mm_crc32_u64(lane2, word2);
+#else
+    lane1 = __crc32cd(static_cast<uint32_t>(lane1), word1);
+    lane2 = __crc32cd(static_cast<uint32_t>(lane2), word2);
+#endif
+#else
+    lane1 = (lane1 ^ (word1 * kPrime2)) * kPrime1;
+    lane1 = (lane1 << 31) | (lane1 >> 33);
+    lane2 = (lane2 ^ (word2 * kPrime2)) * kPrime1;
+    lane2 = (lane2 << 31) | (lane2 >> 33);
+#endif
+    bytes += 16;
+    size -= 16;
+  }
+  // The tail, up to 15 bytes, zero padded.
+  word1 = 0;
+  word2 = 0;
+  memcpy(&word1, bytes, size < 8 ? size : 8);
+  if (size > 8) {
+    memcpy(&word2, bytes + 8, size - 8);
+  }
+  uint64_t h = (lane1 * kPrime1) ^ ((lane2 << 32) | (lane2 >> 32)) ^ (word1 * kPrime2);
+  h = (h ^ (h >> 29) ^ word2) * kPrime1;
+  h ^= h >> 32;
+  h *= kPrime2;
+  h ^= h >> 29;
+  return h;
+}
+
+// DumpHash folded to the width of the intern table's hashes.
+static inline size_t DumpHashToSize(uint64_t h) {
+  return static_cast<size_t>(h ^ (h >> 32));
+}
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_HASH_H_
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_hash.h"
+
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace art {
+
+// Code items shaped like collected traces: a common body of rewritten instructions, one of whose
+// string, type or method indexes differs from item to item.
+static std::vector<std::vector<uint16_t>> MakeTraces(uint32_t count, uint32_t units) {
+  std::vector<uint16_t> body;
+  for (uint32_t i = 0; body.size() < units; ++i) {
+    static const uint16_t kShapes[][3] = {
+      { 0x011b, 0x0007, 0x0000 },  // const-string/jumbo
+      { 0x206e, 0x0009, 0x0010 },  // invoke-virtual
+      { 0x0012, 0x0000, 0x0000 },  // const/4 and two nops
+    };
+    body.insert(body.end(), kShapes[i % 3], kShapes[i % 3] + 3);
+  }
+  body.resize(units);
+  std::vector<std::vector<uint16_t>> traces(count, body);
+  for (uint32_t i = 0; i < count; ++i) {
+    // Vary the index of an instruction spread over the body, to values the body does not use.
+    uint32_t pos = 1 + (i % (units / 3)) * 3;
+    traces[i][pos] = static_cast<uint16_t>(0x8000 + i / (units / 3));
+  }
+  return traces;
+}
+
+TEST(DumpHashTest, EveryByteCounts) {
+  uint8_t bytes[40];
+  for (size_t i = 0; i < sizeof(bytes); ++i) {
+    bytes[i] = static_cast<uint8_t>(i * 7);
+  }
+  for (size_t size = 0; size <= sizeof(bytes); ++size) {
+    uint64_t base = DumpHash(bytes, size, 17);
+    EXPECT_EQ(base, DumpHash(bytes, size, 17));
+    EXPECT_NE(base, DumpHash(bytes, size, 18)) << size;
+    // Trailing zeros change the size, so the hash.
+    if (size < sizeof(bytes)) {
+      uint8_t saved = bytes[size];
+      bytes[size] = 0;
+      EXPECT_NE(base, DumpHash(bytes, size + 1, 17)) << size;
+      bytes[size] = saved;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      for (int bit = 0; bit < 8; ++bit) {
+        bytes[i] ^= 1 << bit;
+        ASSERT_NE(base, DumpHash(bytes, size, 17)) << size << " " << i << " " << bit;
+        bytes[i] ^= 1 << bit;
+      }
+    }
+  }
+}
+
+TEST(DumpHashTest, NoCollisionsOnTraces) {
+  std::vector<std::vector<uint16_t>> traces = MakeTraces(1 << 16, 96);
+  std::set<size_t> hashes;
+  for (const std::vector<uint16_t>& trace : traces) {
+    hashes.insert(DumpHashToSize(DumpHash(trace.data(), trace.size() * 2, 17)));
+  }
+  EXPECT_EQ(traces.size(), hashes.size());
+}
+
+}  // namespace art
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_intern.h"
+
+#include <string.h>
+
+#include "base/logging.h"
+#include "unpack_metrics.h"
+
+namespace art {
+
+DumpInternTable::DumpInternTable()
+    : next_index_(0), metrics_(nullptr), persistent_(nullptr), persistent_kind_(0),
+      first_index_(0) {
+  for (Shard& shard : shards_) {
+    Table* table = NewTable(kDumpInternInitialCapacity);
+    shard.table_.StoreRelaxed(table);
+    shard.tables_.push_back(table);
+    shard.size_ = 0;
+    pthread_mutex_init(&shard.lock_, NULL);
+    shard.chunk_pos_ = nullptr;
+    shard.chunk_left_ = 0;
+    shard.key_bytes_ = 0;
+    shard.probes_ = 0;
+    shard.resizes_ = 0;
+    shard.reused_ = 0;
+  }
+}
+
+DumpInternTable::~DumpInternTable() {
+  for (Shard& shard : shards_) {
+    for (Table* table : shard.tables_) {
+      delete[] table->entries_;
+      delete table;
+    }
+    for (uint8_t* chunk : shard.chunks_) {
+      delete[] chunk;
+    }
+    pthread_mutex_destroy(&shard.lock_);
+  }
+}
+
+DumpInternTable::Table* DumpInternTable::NewTable(size_t capacity) {
+  Table* table = new Table;
+  table->mask_ = capacity - 1;
+  table->entries_ = new Entry[capacity];
+  for (size_t i = 0; i < capacity; ++i) {
+    table->entries_[i].hash_.StoreRelaxed(0);
+  }
+  return table;
+}
+
+const DumpInternTable::Entry* DumpInternTable::Find(Shard* shard, Table* table, size_t hash,
+                                                    const std::string& key, Entry** empty,
+                                                    bool count_probes) {
+  for (size_t i = hash & table->mask_; ; i = (i + 1) & table->mask_) {
+    Entry* entry = &table->entries_[i];
+    size_t entry_hash = entry->hash_.load(std::memory_order_acquire);
+    if (entry_hash == 0) {
+      if (empty != nullptr) {
+        *empty = entry;
+      }
+      return nullptr;
+    }
+    if (entry_hash == hash) {
+      if (entry->key_size_ == key.size() && memcmp(entry->key_, key.data(), key.size()) == 0) {
+        return entry;
+      }
+      if (count_probes) {
+        shard->collisions_.FetchAndAddSequentiallyConsistent(1);
+      }
+    } else if (count_probes) {
+      ++shard->probes_;
+    }
+  }
+}
+
+const uint8_t* DumpInternTable::CopyKey(Shard* shard, const std::string& key) {
+  size_t size = key.size();
+  uint8_t* dest;
+  if (size > kDumpInternArenaChunkSize / 4) {
+    // Large keys (mostly code items) get their own chunk so they do not waste the current one.
+    dest = new uint8_t[size];
+    shard->chunks_.push_back(dest);
+  } else {
+    if (size > shard->chunk_left_) {
+      shard->chunk_pos_ = new uint8_t[kDumpInternArenaChunkSize];
+      shard->chunk_left_ = kDumpInternArenaChunkSize;
+      shard->chunks_.push_back(shard->chunk_pos_);
+    }
+    dest = shard->chunk_pos_;
+    shard->chunk_pos_ += size;
+    shard->chunk_left_ -= size;
+  }
+  memcpy(dest, key.data(), size);
+  shard->key_bytes_ += size;
+  return dest;
+}
+
+void DumpInternTable::Grow(Shard* shard) {
+  Table* old_table = shard->table_.LoadRelaxed();
+  Table* new_table = NewTable((old_table->mask_ + 1) * 2);
+  for (size_t i = 0; i <= old_table->mask_; ++i) {
+    Entry* old_entry = &old_table->entries_[i];
+    size_t hash = old_entry->hash_.LoadRelaxed();
+    if (hash == 0) {
+      continue;
+    }
+    size_t j = hash & new_table->mask_;
+    while (new_table->entries_[j].hash_.LoadRelaxed() != 0) {
+      j = (j + 1) & new_table->mask_;
+    }
+    Entry* entry = &new_table->entries_[j];
+    entry->index_ = old_entry->index_;
+    entry->key_size_ = old_entry->key_size_;
+    entry->key_ = old_entry->key_;
+    entry->hash_.StoreRelaxed(hash);
+  }
+  // Publishes the filled table to lock-free readers.
+  shard->table_.StoreRelease(new_table);
+  shard->tables_.push_back(new_table);
+  ++shard->resizes_;
+}
+
+uint32_t DumpInternTable::Intern(size_t hash, const std::string& key, bool* inserted) {
+  hash = Fix(hash);
+  Shard* shard = ShardFor(hash);
+  const Entry* found =
+      Find(shard, shard->table_.load(std::memory_order_acquire), hash, key, nullptr, false);
+  if (found != nullptr) {
+    *inserted = false;
+    return found->index_;
+  }
+
+  pthread_mutex_lock(&shard->lock_);
+  ScopedDumpMetric lock_hold(metrics_, kDumpMetricLockHold);
+  Table* table = shard->table_.LoadRelaxed();
+  Entry* empty = nullptr;
+  found = Find(shard, table, hash, key, &empty, true);
+  if (found != nullptr) {
+    pthread_mutex_unlock(&shard->lock_);
+    *inserted = false;
+    return found->index_;
+  }
+  // Keep the load factor at or below one half so probe sequences stay short.
+  if ((shard->size_ + 1) * 2 > table->mask_ + 1) {
+    Grow(shard);
+    table = shard->table_.LoadRelaxed();
+    Find(shard, table, hash, key, &empty, false);
+  }
+  uint32_t index;
+  bool known = persistent_ != nullptr &&
+      persistent_->Lookup(persistent_kind_,
+                          DumpDedupIndex::KeyHash(persistent_kind_, key.data(), key.size()),
+                          &index);
+  if (known) {
+    ++shard->reused_;
+  } else {
+    index = next_index_.FetchAndAddSequentiallyConsistent(1);
+  }
+  empty->index_ = index;
+  empty->key_size_ = key.size();
+  empty->key_ = CopyKey(shard, key);
+  empty->hash_.StoreRelease(hash);
+  ++shard->size_;
+  pthread_mutex_unlock(&shard->lock_);
+  *inserted = !known;
+  return index;
+}
+
+void DumpInternTable::SetPersistent(const DumpDedupIndex* index, uint32_t kind) {
+  DCHECK_EQ(next_index_.LoadRelaxed(), 0u);
+  persistent_ = index;
+  persistent_kind_ = kind;
+  first_index_ = index->NextIndex(kind);
+  next_index_.StoreRelaxed(first_index_);
+}
+
+void DumpInternTable::CollectNew(std::vector<DumpDedupEntry>* entries) {
+  for (Shard& shard : shards_) {
+    pthread_mutex_lock(&shard.lock_);
+    Table* table = shard.table_.LoadRelaxed();
+    for (size_t i = 0; i <= table->mask_; ++i) {
+      const Entry& entry = table->entries_[i];
+      if (entry.hash_.LoadRelaxed() != 0 && entry.index_ >= first_index_) {
+        DumpDedupEntry dedup_entry;
+        dedup_entry.hash_ = DumpDedupIndex::KeyHash(persistent_kind_, entry.key_, entry.key_size_);
+        dedup_entry.index_ = entry.index_;
+        dedup_entry.reserved_ = 0;
+        entries->push_back(dedup_entry);
+      }
+    }
+    pthread_mutex_unlock(&shard.lock_);
+  }
+}
+
+DumpInternStats DumpInternTable::GetStats() {
+  DumpInternStats stats;
+  for (Shard& shard : shards_) {
+    pthread_mutex_lock(&shard.lock_);
+    stats.size_ += shard.size_;
+    stats.key_bytes_ += shard.key_bytes_;
+    stats.probes_ += shard.probes_;
+    stats.resizes_ += shard.resizes_;
+    stats.reused_ += shard.reused_;
+    pthread_mutex_unlock(&shard.lock_);
+    stats.collisions_ += shard.collisions_.LoadRelaxed();
+  }
+  return stats;
+}
+
+DumpLocationTable::DumpLocationTable() {
+  pthread_mutex_init(&lock_, NULL);
+}
+
+DumpLocationTable::~DumpLocationTable() {
+  pthread_mutex_destroy(&lock_);
+}
+
+uint32_t DumpLocationTable::Intern(const std::string& location, const std::string& path) {
+  pthread_mutex_lock(&lock_);
+  auto result = ids_.insert(std::make_pair(location, static_cast<uint32_t>(paths_.size())));
+  if (result.second) {
+    paths_.push_back(path);
+  }
+  uint32_t id = result.first->second;
+  pthread_mutex_unlock(&lock_);
+  return id;
+}
+
+const std::string& DumpLocationTable::Path(uint32_t id) {
+  pthread_mutex_lock(&lock_);
+  DCHECK_LT(id, paths_.size());
+  const std::string& path = paths_[id];
+  pthread_mutex_unlock(&lock_);
+  return path;
+}
+
+size_t DumpLocationTable::Size() {
+  pthread_mutex_lock(&lock_);
+  size_t size = paths_.size();
+  pthread_mutex_unlock(&lock_);
+  return size;
+}
+
+void DumpLocationTable::Rename(const std::string& from, const std::string& to) {
+  pthread_mutex_lock(&lock_);
+  for (std::string& path : paths_) {
+    size_t pos = path.find(from);
+    if (pos != std::string::npos) {
+      path.replace(pos, from.size(), to);
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+}  // namespace art
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_INTERN_H_
+#define ART_RUNTIME_UNPACK_INTERN_H_
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+#include "unpack_dedup_index.h"
+
+namespace art {
+
+class DumpMetrics;
+
+static constexpr size_t kDumpInternShards = 16;
+static constexpr size_t kDumpInternInitialCapacity = 64;  // Slots per shard, power of two.
+static constexpr size_t kDumpInternArenaChunkSize = 64 * 1024;
+
+struct DumpInternStats {
+  uint64_t size_;
+  uint64_t key_bytes_;
+  uint64_t probes_;      // Occupied slots with a different hash walked past while inserting.
+  uint64_t collisions_;  // Equal hashes whose keys differed.
+  uint64_t resizes_;
+  uint64_t reused_;      // Entries given the index an earlier run dumped them at.
+
+  DumpInternStats()
+      : size_(0), key_bytes_(0), probes_(0), collisions_(0), resizes_(0), reused_(0) {}
+};
+
+// Assigns dense indexes to dump items. An item is identified by its hash and by its key, the
+// bytes of every field its operator== looks at, so items whose hashes collide still get distinct
+// indexes. The keys are copied into the table because the items themselves are freed by the
+// recording thread once written.
+//
+// The table is split into shards by hash. Each shard is an open-addressing table that readers
+// probe without a lock; inserts and resizes take the shard lock and publish entries through a
+// release store of their hash. Tables replaced by a resize stay alive until the DumpInternTable
+// is destroyed, since a reader may still be probing them.
+class DumpInternTable {
+  public:
+    DumpInternTable();
+    ~DumpInternTable();
+
+    // Returns the index of the entry equal to key, adding one with the next free index if there
+    // is none. *inserted is set to whether a new entry was added that no earlier run knew.
+    uint32_t Intern(size_t hash, const std::string& key, bool* inserted);
+
+    // One past the highest index handed out, counting those of earlier runs.
+    size_t Size() const {
+      return next_index_.LoadRelaxed();
+    }
+
+    DumpInternStats GetStats();
+
+    // Where the time shard locks are held to insert is recorded, or null.
+    void SetMetrics(DumpMetrics* metrics) {
+      metrics_ = metrics;
+    }
+
+    // Makes the table continue the numbering of earlier runs, as recorded under kind in index.
+    // A key the index knows keeps the index it had and is reported as not inserted, since it
+    // was written before; new keys are numbered from where the index stops. Must be called
+    // before the first Intern().
+    void SetPersistent(const DumpDedupIndex* index, uint32_t kind);
+
+    // Appends the dedup entry of every key added since SetPersistent() that the index did not
+    // know.
+    void CollectNew(std::vector<DumpDedupEntry>* entries);
+
+  private:
+    struct Entry {
+      Atomic<size_t> hash_;  // 0 while the slot is empty.
+      uint32_t index_;
+      uint32_t key_size_;
+      const uint8_t* key_;
+    };
+
+    struct Table {
+      size_t mask_;
+      Entry* entries_;
+    };
+
+    struct Shard {
+      Atomic<Table*> table_;
+      size_t size_;
+      pthread_mutex_t lock_;
+      std::vector<Table*> tables_;
+      std::vector<uint8_t*> chunks_;
+      uint8_t* chunk_pos_;
+      size_t chunk_left_;
+      uint64_t key_bytes_;
+      uint64_t probes_;
+      uint64_t resizes_;
+      uint64_t reused_;
+      Atomic<uint64_t> collisions_;
+    };
+
+    static size_t Fix(size_t hash) {
+      return hash == 0 ? 1 : hash;
+    }
+
+    Shard* ShardFor(size_t hash) {
+      return &shards_[(hash ^ (hash >> 16)) & (kDumpInternShards - 1)];
+    }
+
+    // Walks the probe sequence of hash in table. Returns the matching entry, or nullptr when an
+    // empty slot is reached. Sets *empty to the first empty slot if one was found.
+    const Entry* Find(Shard* shard, Table* table, size_t hash, const std::string& key,
+                      Entry** empty, bool count_probes);
+
+    static Table* NewTable(size_t capacity);
+    void Grow(Shard* shard);
+    const uint8_t* CopyKey(Shard* shard, const std::string& key);
+
+    Shard shards_[kDumpInternShards];
+    Atomic<uint32_t> next_index_;
+    DumpMetrics* metrics_;
+    const DumpDedupIndex* persistent_;
+    uint32_t persistent_kind_;
+    // First index handed out by this run.
+    uint32_t first_index_;
+};
+
+// Dense ids for the dex locations items are collected from, so that items carry a number instead
+// of a copy of the location. Each id also names the output path of its location. Ids are handed
+// out once per DexFile, when its DumpDexMemo is created, and are never reused.
+class DumpLocationTable {
+  public:
+    DumpLocationTable();
+    ~DumpLocationTable();
+
+    // Returns the id of location, assigning the next one and recording path for it if location
+    // is new.
+    uint32_t Intern(const std::string& location, const std::string& path);
+
+    // The path recorded for id. The reference stays valid for the lifetime of the table.
+    const std::string& Path(uint32_t id);
+
+    size_t Size();
+
+    // Replaces the first occurrence of from with to in every recorded path, so that a forked
+    // process writes files of its own. References returned by Path() see the new paths.
+    void Rename(const std::string& from, const std::string& to);
+
+  private:
+    pthread_mutex_t lock_;
+    std::map<std::string, uint32_t> ids_;
+    // A deque, so that references returned by Path() survive later inserts.
+    std::deque<std::string> paths_;
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_INTERN_H_
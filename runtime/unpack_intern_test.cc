@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_intern.h"
+
+#include <pthread.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "base/logging.h"
+
+namespace art {
+
+TEST(DumpInternTableTest, SameKeySameIndex) {
+  DumpInternTable table;
+  bool inserted;
+  EXPECT_EQ(0u, table.Intern(42, "a", &inserted));
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ(1u, table.Intern(43, "b", &inserted));
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ(0u, table.Intern(42, "a", &inserted));
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(2u, table.Size());
+}
+
+// The old std::map<size_t, uint32_t> handed both of these the same index.
+TEST(DumpInternTableTest, CollidingHashesGetDistinctIndexes) {
+  DumpInternTable table;
+  bool inserted;
+  uint32_t first = table.Intern(7, "first", &inserted);
+  uint32_t second = table.Intern(7, "second", &inserted);
+  EXPECT_TRUE(inserted);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(first, table.Intern(7, "first", &inserted));
+  EXPECT_EQ(second, table.Intern(7, "second", &inserted));
+  EXPECT_GE(table.GetStats().collisions_, 1u);
+}
+
+TEST(DumpInternTableTest, Grow) {
+  DumpInternTable table;
+  bool inserted;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    // Few distinct hash values, so probe chains and collisions are exercised too.
+    ASSERT_EQ(i, table.Intern(i % 97, std::to_string(i), &inserted));
+  }
+  for (uint32_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ(i, table.Intern(i % 97, std::to_string(i), &inserted));
+    ASSERT_FALSE(inserted);
+  }
+  DumpInternStats stats = table.GetStats();
+  EXPECT_EQ(10000u, stats.size_);
+  EXPECT_GT(stats.resizes_, 0u);
+}
+
+struct InternArgs {
+  DumpInternTable* table_;
+  std::vector<uint32_t> indexes_;
+};
+
+static constexpr uint32_t kKeys = 20000;
+
+static void* InternAll(void* arg) {
+  InternArgs* args = reinterpret_cast<InternArgs*>(arg);
+  bool inserted;
+  for (uint32_t i = 0; i < kKeys; ++i) {
+    args->indexes_.push_back(args->table_->Intern(i * 2654435761u, std::to_string(i), &inserted));
+  }
+  return nullptr;
+}
+
+TEST(DumpInternTableTest, ConcurrentIntern) {
+  static constexpr size_t kThreads = 8;
+  DumpInternTable table;
+  pthread_t threads[kThreads];
+  InternArgs args[kThreads];
+  for (size_t i = 0; i < kThreads; ++i) {
+    args[i].table_ = &table;
+    CHECK_PTHREAD_CALL(pthread_create, (&threads[i], nullptr, InternAll, &args[i]), "intern");
+  }
+  for (size_t i = 0; i < kThreads; ++i) {
+    CHECK_PTHREAD_CALL(pthread_join, (threads[i], nullptr), "intern");
+  }
+  // Every thread saw the same index for each key, and the indexes are dense.
+  EXPECT_EQ(kKeys, table.Size());
+  std::set<uint32_t> seen(args[0].indexes_.begin(), args[0].indexes_.end());
+  EXPECT_EQ(kKeys, seen.size());
+  EXPECT_EQ(kKeys - 1, *seen.rbegin());
+  for (size_t i = 1; i < kThreads; ++i) {
+    EXPECT_EQ(args[0].indexes_, args[i].indexes_);
+  }
+}
+
+TEST(DumpLocationTableTest, DenseIds) {
+  DumpLocationTable table;
+  EXPECT_EQ(0u, table.Intern("/data/app/a.apk", "a.dlc"));
+  EXPECT_EQ(1u, table.Intern("/data/app/b.apk", "b.dlc"));
+  const std::string& a_path = table.Path(0);
+  // A known location keeps its id and its first path.
+  EXPECT_EQ(0u, table.Intern("/data/app/a.apk", "other.dlc"));
+  for (uint32_t i = 0; i < 1000; ++i) {
+    table.Intern("/data/data/p/" + std::to_string(i) + ".dex", std::to_string(i) + ".dlc");
+  }
+  EXPECT_EQ(1002u, table.Size());
+  EXPECT_EQ("a.dlc", a_path);
+  EXPECT_EQ("b.dlc", table.Path(1));
+  EXPECT_EQ("999.dlc", table.Path(1001));
+}
+
+TEST(DumpLocationTableTest, Rename) {
+  DumpLocationTable table;
+  table.Intern("/data/app/a.apk", "/data/data/p/revealer/100_000042_7.dlc");
+  table.Intern("/data/app/b.apk", "/data/data/p/revealer/other.dlc");
+  const std::string& a_path = table.Path(0);
+  table.Rename("/100_000042_", "/2317_000042_");
+  EXPECT_EQ("/data/data/p/revealer/2317_000042_7.dlc", a_path);
+  EXPECT_EQ("/data/data/p/revealer/other.dlc", table.Path(1));
+}
+
+}  // namespace art
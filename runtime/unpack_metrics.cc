@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_metrics.h"
+
+#include "base/logging.h"
+#include "utils.h"
+
+namespace art {
+
+static const char* const kDumpMetricNames[kDumpMetrics] = {
+  "queue_wait", "table_lookup", "lock_hold", "trace_build", "serialize", "write"
+};
+
+static const char* const kDumpCounterNames[kDumpCounters] = {
+  "interned", "duplicates", "record_bytes",
+  "memo_string_hits", "memo_type_hits", "memo_field_hits", "memo_method_hits",
+  "memo_string_misses", "memo_type_misses", "memo_field_misses", "memo_method_misses"
+};
+
+DumpMetricsSnapshot::DumpMetricsSnapshot() : threads_(0) {
+  for (int counter = 0; counter < kDumpCounters; ++counter) {
+    counters_[counter] = 0;
+  }
+  for (int metric = 0; metric < kDumpMetrics; ++metric) {
+    for (size_t bucket = 0; bucket < kDumpMetricBuckets; ++bucket) {
+      buckets_[metric][bucket] = 0;
+    }
+    count_[metric] = 0;
+    sum_ns_[metric] = 0;
+    max_ns_[metric] = 0;
+  }
+}
+
+uint64_t DumpMetricsSnapshot::Percentile(DumpMetric metric, double fraction) const {
+  uint64_t wanted = static_cast<uint64_t>(count_[metric] * fraction);
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < kDumpMetricBuckets; ++bucket) {
+    seen += buckets_[metric][bucket];
+    if (seen > wanted || bucket == kDumpMetricBuckets - 1) {
+      uint64_t bound = bucket == 0 ? 0 : (UINT64_C(1) << bucket) - 1;
+      return bound < max_ns_[metric] ? bound : max_ns_[metric];
+    }
+  }
+  return 0;
+}
+
+DumpMetrics::DumpMetrics() {
+  int rc = pthread_key_create(&key_, Release);
+  if (rc) {
+    LOG(FATAL) << "create key for collection metrics failed! " << rc;
+  }
+  pthread_mutex_init(&lock_, NULL);
+}
+
+DumpMetrics::~DumpMetrics() {
+  pthread_key_delete(key_);
+  for (DumpMetricsBlock* block : blocks_) {
+    delete block;
+  }
+  pthread_mutex_destroy(&lock_);
+}
+
+DumpMetricsBlock* DumpMetrics::Register() {
+  DumpMetricsBlock* block = nullptr;
+  pthread_mutex_lock(&lock_);
+  // Counts are totals, so a new thread simply keeps adding to the block of an exited one.
+  for (DumpMetricsBlock* exited : blocks_) {
+    if (exited->tid_ == 0) {
+      block = exited;
+      break;
+    }
+  }
+  if (block == nullptr) {
+    block = new DumpMetricsBlock;
+    block->owner_ = this;
+    for (int counter = 0; counter < kDumpCounters; ++counter) {
+      block->counters_[counter].StoreRelaxed(0);
+    }
+    for (int metric = 0; metric < kDumpMetrics; ++metric) {
+      for (size_t bucket = 0; bucket < kDumpMetricBuckets; ++bucket) {
+        block->buckets_[metric][bucket].StoreRelaxed(0);
+      }
+      block->sum_ns_[metric].StoreRelaxed(0);
+      block->max_ns_[metric].StoreRelaxed(0);
+    }
+    blocks_.push_back(block);
+  }
+  block->tid_ = GetTid();
+  pthread_mutex_unlock(&lock_);
+  pthread_setspecific(key_, block);
+  return block;
+}
+
+void DumpMetrics::Release(void* ptr) {
+  DumpMetricsBlock* block = reinterpret_cast<DumpMetricsBlock*>(ptr);
+  pthread_mutex_lock(&block->owner_->lock_);
+  block->tid_ = 0;
+  pthread_mutex_unlock(&block->owner_->lock_);
+}
+
+DumpMetricsSnapshot DumpMetrics::Snapshot() {
+  DumpMetricsSnapshot snapshot;
+  pthread_mutex_lock(&lock_);
+  for (DumpMetricsBlock* block : blocks_) {
+    if (block->tid_ != 0) {
+      ++snapshot.threads_;
+    }
+    for (int counter = 0; counter < kDumpCounters; ++counter) {
+      snapshot.counters_[counter] += block->counters_[counter].LoadRelaxed();
+    }
+    for (int metric = 0; metric < kDumpMetrics; ++metric) {
+      for (size_t bucket = 0; bucket < kDumpMetricBuckets; ++bucket) {
+        uint64_t samples = block->buckets_[metric][bucket].LoadRelaxed();
+        snapshot.buckets_[metric][bucket] += samples;
+        snapshot.count_[metric] += samples;
+      }
+      snapshot.sum_ns_[metric] += block->sum_ns_[metric].LoadRelaxed();
+      uint64_t max_ns = block->max_ns_[metric].LoadRelaxed();
+      if (max_ns > snapshot.max_ns_[metric]) {
+        snapshot.max_ns_[metric] = max_ns;
+      }
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+  return snapshot;
+}
+
+void DumpMetrics::Dump(std::ostream& os) {
+  DumpMetricsSnapshot snapshot = Snapshot();
+  os << "collection metrics threads=" << snapshot.threads_;
+  for (int counter = 0; counter < kDumpCounters; ++counter) {
+    os << " " << kDumpCounterNames[counter] << "=" << snapshot.counters_[counter];
+  }
+  os << "\n";
+  for (int metric = 0; metric < kDumpMetrics; ++metric) {
+    DumpMetric m = static_cast<DumpMetric>(metric);
+    uint64_t count = snapshot.count_[metric];
+    os << "collection metrics " << kDumpMetricNames[metric] << " count=" << count
+        << " mean=" << (count != 0 ? snapshot.sum_ns_[metric] / count : 0) << "ns"
+        << " p50=" << snapshot.Percentile(m, 0.5) << "ns"
+        << " p90=" << snapshot.Percentile(m, 0.9) << "ns"
+        << " p99=" << snapshot.Percentile(m, 0.99) << "ns"
+        << " max=" << snapshot.max_ns_[metric] << "ns\n";
+  }
+}
+
+}  // namespace art
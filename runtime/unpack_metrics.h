@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_METRICS_H_
+#define ART_RUNTIME_UNPACK_METRICS_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <ostream>
+#include <vector>
+
+#include "atomic.h"
+#include "base/macros.h"
+#include "base/time_utils.h"
+#include "unpack_dex_memo.h"
+
+namespace art {
+
+class DumpMetrics;
+
+enum DumpMetric {
+  kDumpMetricQueueWait = 0,  // A record waiting in the queue for the recording thread.
+  kDumpMetricTableLookup,    // DumpInternTable::Intern called from GeneralDump.
+  kDumpMetricLockHold,       // An intern table shard lock held to insert an entry.
+  kDumpMetricTraceBuild,     // A traced invocation, from entry until its code item is dumped.
+  kDumpMetricSerialize,      // Rendering a record and staging it in its container.
+  kDumpMetricWrite,          // Writing out the staged blocks of a container.
+  kDumpMetrics
+};
+
+enum DumpCounter {
+  kDumpCounterInterned = 0,  // Items GeneralDump added to an intern table.
+  kDumpCounterDuplicates,    // Items GeneralDump found already interned.
+  kDumpCounterRecordBytes,   // Bytes of records staged in containers.
+  // Ids DumpXxxFromDex found in, or had to dump past, the dex memo: one counter per DumpMemoKind.
+  kDumpCounterMemoHits,
+  kDumpCounterMemoMisses = kDumpCounterMemoHits + kDumpMemoKinds,
+  kDumpCounters = kDumpCounterMemoMisses + kDumpMemoKinds
+};
+
+// Latencies are counted in log2 buckets of nanoseconds: bucket 0 holds 0ns, bucket i holds
+// [2^(i-1), 2^i) and the last bucket everything longer.
+static constexpr size_t kDumpMetricBuckets = 40;
+
+// The samples of one thread. Only the owning thread writes, with relaxed stores; readers may see
+// a sample in a bucket before it shows in the sum.
+struct DumpMetricsBlock {
+  DumpMetrics* owner_;
+  pid_t tid_;  // 0 once the thread exited. The block then goes to the next thread to register.
+  Atomic<uint64_t> counters_[kDumpCounters];
+  Atomic<uint64_t> buckets_[kDumpMetrics][kDumpMetricBuckets];
+  Atomic<uint64_t> sum_ns_[kDumpMetrics];
+  Atomic<uint64_t> max_ns_[kDumpMetrics];
+};
+
+struct DumpMetricsSnapshot {
+  uint32_t threads_;
+  uint64_t counters_[kDumpCounters];
+  uint64_t buckets_[kDumpMetrics][kDumpMetricBuckets];
+  uint64_t count_[kDumpMetrics];
+  uint64_t sum_ns_[kDumpMetrics];
+  uint64_t max_ns_[kDumpMetrics];
+
+  DumpMetricsSnapshot();
+
+  // Upper bound, in ns, of the latency below which fraction of the samples of metric fall.
+  uint64_t Percentile(DumpMetric metric, double fraction) const;
+};
+
+// Counters and latency histograms of the collection pipeline. Every thread records into its own
+// DumpMetricsBlock, found through a pthread key, so recording a sample never takes a lock or
+// shares a cache line. The blocks are only summed when a snapshot is asked for, on SIGQUIT or
+// when the recording thread is asked to flush.
+class DumpMetrics {
+  public:
+    DumpMetrics();
+    ~DumpMetrics();
+
+    void Record(DumpMetric metric, uint64_t ns) {
+      DumpMetricsBlock* block = Current();
+      Add(&block->buckets_[metric][Bucket(ns)], 1);
+      Add(&block->sum_ns_[metric], ns);
+      if (ns > block->max_ns_[metric].LoadRelaxed()) {
+        block->max_ns_[metric].StoreRelaxed(ns);
+      }
+    }
+
+    void Count(DumpCounter counter, uint64_t n) {
+      Add(&Current()->counters_[counter], n);
+    }
+
+    DumpMetricsSnapshot Snapshot();
+
+    // Writes a line for the counters and one for each metric.
+    void Dump(std::ostream& os);
+
+    static size_t Bucket(uint64_t ns) {
+      if (ns == 0) {
+        return 0;
+      }
+      size_t bits = 64 - __builtin_clzll(ns);
+      return bits < kDumpMetricBuckets ? bits : kDumpMetricBuckets - 1;
+    }
+
+  private:
+    static void Add(Atomic<uint64_t>* value, uint64_t n) {
+      value->StoreRelaxed(value->LoadRelaxed() + n);
+    }
+
+    DumpMetricsBlock* Current() {
+      DumpMetricsBlock* block = reinterpret_cast<DumpMetricsBlock*>(pthread_getspecific(key_));
+      return LIKELY(block != nullptr) ? block : Register();
+    }
+
+    DumpMetricsBlock* Register();
+    static void Release(void* block);
+
+    pthread_key_t key_;
+    pthread_mutex_t lock_;
+    std::vector<DumpMetricsBlock*> blocks_;
+
+    DISALLOW_COPY_AND_ASSIGN(DumpMetrics);
+};
+
+// Records the time from construction to destruction under metric. Does nothing when metrics is
+// null.
+class ScopedDumpMetric {
+  public:
+    ScopedDumpMetric(DumpMetrics* metrics, DumpMetric metric)
+        : metrics_(metrics), metric_(metric), start_ns_(metrics != nullptr ? NanoTime() : 0) {}
+
+    ~ScopedDumpMetric() {
+      if (metrics_ != nullptr) {
+        metrics_->Record(metric_, NanoTime() - start_ns_);
+      }
+    }
+
+  private:
+    DumpMetrics* const metrics_;
+    const DumpMetric metric_;
+    const uint64_t start_ns_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedDumpMetric);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_METRICS_H_
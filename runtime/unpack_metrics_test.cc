@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_metrics.h"
+
+#include <pthread.h>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace art {
+
+TEST(DumpMetricsTest, Buckets) {
+  EXPECT_EQ(0u, DumpMetrics::Bucket(0));
+  EXPECT_EQ(1u, DumpMetrics::Bucket(1));
+  EXPECT_EQ(2u, DumpMetrics::Bucket(2));
+  EXPECT_EQ(2u, DumpMetrics::Bucket(3));
+  EXPECT_EQ(11u, DumpMetrics::Bucket(1024));
+  EXPECT_EQ(kDumpMetricBuckets - 1, DumpMetrics::Bucket(UINT64_C(1) << 50));
+}
+
+TEST(DumpMetricsTest, Snapshot) {
+  DumpMetrics metrics;
+  for (uint64_t ns = 1; ns <= 100; ++ns) {
+    metrics.Record(kDumpMetricTableLookup, ns);
+  }
+  metrics.Record(kDumpMetricWrite, 5000);
+  metrics.Count(kDumpCounterInterned, 3);
+  metrics.Count(kDumpCounterInterned, 4);
+  metrics.Count(static_cast<DumpCounter>(kDumpCounterMemoMisses + kDumpMemoField), 2);
+
+  DumpMetricsSnapshot snapshot = metrics.Snapshot();
+  EXPECT_EQ(1u, snapshot.threads_);
+  EXPECT_EQ(7u, snapshot.counters_[kDumpCounterInterned]);
+  EXPECT_EQ(0u, snapshot.counters_[kDumpCounterDuplicates]);
+  EXPECT_EQ(100u, snapshot.count_[kDumpMetricTableLookup]);
+  EXPECT_EQ(5050u, snapshot.sum_ns_[kDumpMetricTableLookup]);
+  EXPECT_EQ(100u, snapshot.max_ns_[kDumpMetricTableLookup]);
+  // Half of 1..100 is below 64, the bucket bound above 50.
+  EXPECT_EQ(63u, snapshot.Percentile(kDumpMetricTableLookup, 0.5));
+  // Bounds never exceed the largest sample.
+  EXPECT_EQ(100u, snapshot.Percentile(kDumpMetricTableLookup, 0.99));
+  EXPECT_EQ(5000u, snapshot.Percentile(kDumpMetricWrite, 0.5));
+  EXPECT_EQ(0u, snapshot.count_[kDumpMetricQueueWait]);
+  EXPECT_EQ(0u, snapshot.Percentile(kDumpMetricQueueWait, 0.5));
+
+  std::ostringstream os;
+  metrics.Dump(os);
+  std::string dump = os.str();
+  EXPECT_NE(std::string::npos, dump.find("collection metrics threads=1 interned=7 duplicates=0"));
+  EXPECT_NE(std::string::npos, dump.find("table_lookup count=100 mean=50ns p50=63ns"));
+  EXPECT_NE(std::string::npos, dump.find("write count=1 mean=5000ns"));
+  // Memo counters follow DumpMemoKind.
+  EXPECT_NE(std::string::npos, dump.find("memo_method_hits=0 memo_string_misses=0"));
+  EXPECT_NE(std::string::npos, dump.find("memo_field_misses=2 memo_method_misses=0"));
+}
+
+static constexpr uint32_t kThreadSamples = 1000;
+
+static void* RecordSamples(void* arg) {
+  DumpMetrics* metrics = reinterpret_cast<DumpMetrics*>(arg);
+  for (uint32_t i = 0; i < kThreadSamples; ++i) {
+    metrics->Record(kDumpMetricSerialize, i);
+    metrics->Count(kDumpCounterRecordBytes, 2);
+  }
+  return nullptr;
+}
+
+TEST(DumpMetricsTest, Threads) {
+  static constexpr int kThreads = 4;
+  DumpMetrics metrics;
+  pthread_t threads[kThreads];
+  for (int i = 0; i < kThreads; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], nullptr, RecordSamples, &metrics));
+  }
+  for (int i = 0; i < kThreads; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], nullptr));
+  }
+  // Samples of exited threads are kept.
+  DumpMetricsSnapshot snapshot = metrics.Snapshot();
+  EXPECT_EQ(0u, snapshot.threads_);
+  EXPECT_EQ(kThreads * kThreadSamples, snapshot.count_[kDumpMetricSerialize]);
+  EXPECT_EQ(kThreads * kThreadSamples * 2, snapshot.counters_[kDumpCounterRecordBytes]);
+
+  // Later threads reuse the blocks of exited ones.
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, nullptr, RecordSamples, &metrics));
+  ASSERT_EQ(0, pthread_join(thread, nullptr));
+  snapshot = metrics.Snapshot();
+  EXPECT_EQ((kThreads + 1) * kThreadSamples, snapshot.count_[kDumpMetricSerialize]);
+  EXPECT_EQ(kThreadSamples - 1, snapshot.max_ns_[kDumpMetricSerialize]);
+}
+
+}  // namespace art
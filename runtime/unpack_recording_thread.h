@@ -17,45 +17,270 @@
 #ifndef ART_RUNTIME_UNPACK_RECORDING_THREAD_H_
 #define ART_RUNTIME_UNPACK_RECORDING_THREAD_H_
 
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <list>
 
+#include "atomic.h"
+#include "base/logging.h"
+#include "base/mutex-inl.h"
+#include "base/time_utils.h"
+
 namespace art {
 
+// What add() does when every slot of the ring is taken. Producers never wait: they are
+// interpreter threads that hold the mutator lock, and the memory budget bounds the queue instead.
+enum RecordingQueueFullPolicy {
+  kRecordingQueueSpill,  // Push the item to an unbounded, locked overflow list.
+  kRecordingQueueDrop,   // Refuse the item; add() returns false and the drop is counted.
+};
+
+static constexpr size_t kRecordingQueueDefaultCapacity = 16 * 1024;
+// Items the recording thread takes from the queue per wake-up.
+static constexpr size_t kRecordingBatchSize = 64;
+
+struct RecordingQueueStats {
+  uint64_t dequeued_;
+  uint64_t dropped_;
+  uint64_t spilled_;
+  uint64_t parked_;
+
+  RecordingQueueStats() : dequeued_(0), dropped_(0), spilled_(0), parked_(0) {}
+};
+
+// Bounded multi-producer/single-consumer ring. Producers claim a slot with one CAS on tail_ and
+// publish it through the slot sequence number, so add() never allocates or takes a lock unless
+// the ring is full. The consumer drains in batches and only parks on a futex when the ring and
+// the overflow list are both empty. T must be cheap to copy (the recording thread passes
+// pointers).
 template <typename T> class RecordingQueue {
   public:
-    RecordingQueue() {
-      pthread_mutex_init(&mutex_, NULL);
-      pthread_cond_init(&cond_, NULL);
+    explicit RecordingQueue(size_t capacity = kRecordingQueueDefaultCapacity,
+                            RecordingQueueFullPolicy policy = kRecordingQueueSpill)
+        : policy_(policy), head_(0), dequeued_(0), parked_(0) {
+      CHECK_GT(capacity, 1u);
+      CHECK_EQ(capacity & (capacity - 1), 0u) << "capacity must be a power of two";
+      capacity_ = capacity;
+      mask_ = capacity - 1;
+      slots_ = new Slot[capacity];
+      for (size_t i = 0; i < capacity; ++i) {
+        slots_[i].sequence_.StoreRelaxed(static_cast<uint32_t>(i));
+      }
+      pthread_mutex_init(&overflow_mutex_, NULL);
+#if !ART_USE_FUTEXES
+      pthread_mutex_init(&park_mutex_, NULL);
+      pthread_cond_init(&park_cond_, NULL);
+#endif
     }
 
     ~RecordingQueue() {
-      pthread_mutex_destroy(&mutex_);
-      pthread_cond_destroy(&cond_);
+      delete[] slots_;
+      pthread_mutex_destroy(&overflow_mutex_);
+#if !ART_USE_FUTEXES
+      pthread_mutex_destroy(&park_mutex_);
+      pthread_cond_destroy(&park_cond_);
+#endif
+    }
+
+    // Must be called before the first add().
+    void SetFullPolicy(RecordingQueueFullPolicy policy) {
+      policy_ = policy;
+    }
+
+    RecordingQueueFullPolicy GetFullPolicy() const {
+      return policy_;
     }
 
-    void add(T item) {
-      pthread_mutex_lock(&mutex_);
-      queue_.push_back(item);
-      pthread_cond_signal(&cond_);
-      pthread_mutex_unlock(&mutex_);
+    // Returns false only when the policy is kRecordingQueueDrop and the ring is full; the caller
+    // still owns the item in that case.
+    bool add(T item) {
+      if (TryPush(item)) {
+        WakeConsumer();
+        return true;
+      }
+      switch (policy_) {
+        case kRecordingQueueDrop:
+          dropped_.FetchAndAddSequentiallyConsistent(1);
+          return false;
+        case kRecordingQueueSpill:
+          pthread_mutex_lock(&overflow_mutex_);
+          overflow_.push_back(item);
+          overflow_size_.FetchAndAddSequentiallyConsistent(1);
+          pthread_mutex_unlock(&overflow_mutex_);
+          spilled_.FetchAndAddSequentiallyConsistent(1);
+          WakeConsumer();
+          return true;
+      }
+      return false;
     }
 
-    T remove() {
-      pthread_mutex_lock(&mutex_);
-      while (queue_.size() == 0) {
-        pthread_cond_wait(&cond_, &mutex_);
+    // Moves up to max_items into items, waiting at most timeout_ms for the first one. Returns
+    // the number of items moved, 0 if the queue stayed empty. Only one thread may call this.
+    size_t remove(T* items, size_t max_items, int64_t timeout_ms) {
+      size_t count = Drain(items, max_items);
+      if (count != 0) {
+        return count;
+      }
+      int32_t ticket = wake_seq_.LoadSequentiallyConsistent();
+      consumer_waiting_.StoreSequentiallyConsistent(1);
+      QuasiAtomic::ThreadFenceSequentiallyConsistent();
+      count = Drain(items, max_items);
+      if (count == 0) {
+        ++parked_;
+        Park(&wake_seq_, ticket, timeout_ms);
+        count = Drain(items, max_items);
       }
-      T item = queue_.front();
-      queue_.pop_front();
-      pthread_mutex_unlock(&mutex_);
-      return item;
+      consumer_waiting_.StoreRelaxed(0);
+      return count;
+    }
+
+    // Waits at most timeout_ms for an item. Returns false if the queue stayed empty.
+    bool remove(T* item, int64_t timeout_ms) {
+      return remove(item, 1, timeout_ms) == 1;
+    }
+
+    // Makes a remove() parked on an empty queue return early. The consumer may miss a wake-up
+    // that races with it going to sleep, so callers waiting on it should interrupt again.
+    void Interrupt() {
+      WakeConsumer();
+    }
+
+    // Counters are cumulative. Call from the consumer thread to get an exact dequeued_ count.
+    RecordingQueueStats GetStats() const {
+      RecordingQueueStats stats;
+      stats.dequeued_ = dequeued_;
+      stats.dropped_ = dropped_.LoadRelaxed();
+      stats.spilled_ = spilled_.LoadRelaxed();
+      stats.parked_ = parked_;
+      return stats;
     }
 
   private:
-    std::list<T> queue_;
-    pthread_mutex_t mutex_;
-    pthread_cond_t cond_;
+    // Slot i is free for the producer holding ticket pos when sequence_ == pos, and holds a
+    // published item for the consumer at position pos when sequence_ == pos + 1.
+    struct Slot {
+      Atomic<uint32_t> sequence_;
+      T value_;
+    };
+
+    bool TryPush(T item) {
+      uint32_t pos = tail_.LoadRelaxed();
+      Slot* slot;
+      while (true) {
+        slot = &slots_[pos & mask_];
+        uint32_t seq = slot->sequence_.load(std::memory_order_acquire);
+        int32_t diff = static_cast<int32_t>(seq - pos);
+        if (diff == 0) {
+          if (tail_.CompareExchangeWeakRelaxed(pos, pos + 1)) {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        }
+        pos = tail_.LoadRelaxed();
+      }
+      slot->value_ = item;
+      slot->sequence_.StoreRelease(pos + 1);
+      return true;
+    }
+
+    size_t Drain(T* items, size_t max_items) {
+      size_t count = 0;
+      while (count < max_items) {
+        Slot* slot = &slots_[head_ & mask_];
+        if (slot->sequence_.load(std::memory_order_acquire) != head_ + 1) {
+          break;
+        }
+        items[count++] = slot->value_;
+        slot->sequence_.StoreRelease(head_ + static_cast<uint32_t>(capacity_));
+        ++head_;
+      }
+      // Spilled items are drained after the ring, so they may be written out of order with
+      // respect to items enqueued later. Every record carries its own index, so this is fine.
+      if (count < max_items && overflow_size_.LoadRelaxed() != 0) {
+        pthread_mutex_lock(&overflow_mutex_);
+        while (count < max_items && !overflow_.empty()) {
+          items[count++] = overflow_.front();
+          overflow_.pop_front();
+          overflow_size_.FetchAndSubSequentiallyConsistent(1);
+        }
+        pthread_mutex_unlock(&overflow_mutex_);
+      }
+      dequeued_ += count;
+      return count;
+    }
+
+    // Only the producer that clears consumer_waiting_ issues the wake, so a burst of adds while
+    // the consumer is still being scheduled costs one syscall rather than one per item.
+    void WakeConsumer() {
+      QuasiAtomic::ThreadFenceSequentiallyConsistent();
+      if (consumer_waiting_.LoadRelaxed() != 0 &&
+          consumer_waiting_.CompareExchangeStrongSequentiallyConsistent(1, 0)) {
+        wake_seq_.FetchAndAddSequentiallyConsistent(1);
+        Wake(&wake_seq_, 1);
+      }
+    }
+
+    // Sleeps while *word still equals ticket, for at most timeout_ms.
+    void Park(AtomicInteger* word, int32_t ticket, int64_t timeout_ms) {
+      timespec ts;
+#if ART_USE_FUTEXES
+      InitTimeSpec(false, CLOCK_MONOTONIC, timeout_ms, 0, &ts);
+      if (futex(word->Address(), FUTEX_WAIT, ticket, &ts, nullptr, 0) != 0 &&
+          errno != ETIMEDOUT && errno != EAGAIN && errno != EINTR) {
+        PLOG(FATAL) << "futex wait failed";
+      }
+#else
+      InitTimeSpec(true, CLOCK_REALTIME, timeout_ms, 0, &ts);
+      pthread_mutex_lock(&park_mutex_);
+      if (word->LoadSequentiallyConsistent() == ticket) {
+        pthread_cond_timedwait(&park_cond_, &park_mutex_, &ts);
+      }
+      pthread_mutex_unlock(&park_mutex_);
+#endif
+    }
+
+    void Wake(AtomicInteger* word, int count) {
+#if ART_USE_FUTEXES
+      futex(word->Address(), FUTEX_WAKE, count, nullptr, nullptr, 0);
+#else
+      UNUSED(word);
+      UNUSED(count);
+      pthread_mutex_lock(&park_mutex_);
+      pthread_cond_broadcast(&park_cond_);
+      pthread_mutex_unlock(&park_mutex_);
+#endif
+    }
+
+    Slot* slots_;
+    size_t capacity_;
+    size_t mask_;
+    RecordingQueueFullPolicy policy_;
+
+    // Producer side. Padded so producers claiming slots do not bounce the consumer's line.
+    char pad0_[64];
+    Atomic<uint32_t> tail_;
+    Atomic<uint64_t> dropped_;
+    Atomic<uint64_t> spilled_;
+
+    // Consumer side, only touched by the recording thread except for the futex words.
+    char pad1_[64];
+    uint32_t head_;
+    uint64_t dequeued_;
+    uint64_t parked_;
+    AtomicInteger consumer_waiting_;
+    AtomicInteger wake_seq_;
+
+    char pad2_[64];
+    std::list<T> overflow_;
+    AtomicInteger overflow_size_;
+    pthread_mutex_t overflow_mutex_;
+#if !ART_USE_FUTEXES
+    pthread_mutex_t park_mutex_;
+    pthread_cond_t park_cond_;
+#endif
   };
 
 }  // namespace art
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_recording_thread.h"
+
+#include <pthread.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "base/time_utils.h"
+
+namespace art {
+
+struct ProducerArgs {
+  RecordingQueue<uint64_t>* queue_;
+  uint64_t first_;
+  uint64_t count_;
+};
+
+static void* ProduceRange(void* arg) {
+  ProducerArgs* args = reinterpret_cast<ProducerArgs*>(arg);
+  for (uint64_t i = 0; i < args->count_; ++i) {
+    args->queue_->add(args->first_ + i);
+  }
+  return nullptr;
+}
+
+// Pushes 1..total through the queue from num_producers threads and drains it on the calling
+// thread.
+static void RunProducers(RecordingQueue<uint64_t>* queue, size_t num_producers, uint64_t total) {
+  std::vector<pthread_t> threads(num_producers);
+  std::vector<ProducerArgs> args(num_producers);
+  uint64_t per_producer = total / num_producers;
+  for (size_t i = 0; i < num_producers; ++i) {
+    args[i].queue_ = queue;
+    args[i].first_ = 1 + i * per_producer;
+    args[i].count_ = per_producer;
+    CHECK_PTHREAD_CALL(pthread_create, (&threads[i], nullptr, ProduceRange, &args[i]), "producer");
+  }
+  uint64_t expected = per_producer * num_producers;
+  uint64_t received = 0;
+  uint64_t sum = 0;
+  uint64_t items[kRecordingBatchSize];
+  while (received < expected) {
+    size_t count = queue->remove(items, kRecordingBatchSize, 100);
+    for (size_t i = 0; i < count; ++i) {
+      sum += items[i];
+    }
+    received += count;
+  }
+  for (size_t i = 0; i < num_producers; ++i) {
+    CHECK_PTHREAD_CALL(pthread_join, (threads[i], nullptr), "producer");
+  }
+  EXPECT_EQ(expected, received);
+  EXPECT_EQ(expected * (expected + 1) / 2, sum);
+}
+
+TEST(RecordingQueueTest, SingleProducerFifo) {
+  RecordingQueue<uint64_t> queue(16);
+  for (uint64_t i = 0; i < 10; ++i) {
+    ASSERT_TRUE(queue.add(i));
+  }
+  uint64_t items[16];
+  ASSERT_EQ(10u, queue.remove(items, 16, 0));
+  for (uint64_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(i, items[i]);
+  }
+  // Wraps around the ring several times.
+  for (uint64_t round = 0; round < 10; ++round) {
+    for (uint64_t i = 0; i < 12; ++i) {
+      ASSERT_TRUE(queue.add(round * 100 + i));
+    }
+    ASSERT_EQ(12u, queue.remove(items, 16, 0));
+    for (uint64_t i = 0; i < 12; ++i) {
+      EXPECT_EQ(round * 100 + i, items[i]);
+    }
+  }
+}
+
+TEST(RecordingQueueTest, TimedRemoveOnEmpty) {
+  RecordingQueue<uint64_t> queue(16);
+  uint64_t item;
+  uint64_t start = MilliTime();
+  EXPECT_FALSE(queue.remove(&item, 20));
+  EXPECT_GE(MilliTime() - start, 10u);
+  EXPECT_EQ(1u, queue.GetStats().parked_);
+}
+
+TEST(RecordingQueueTest, DropWhenFull) {
+  RecordingQueue<uint64_t> queue(4, kRecordingQueueDrop);
+  for (uint64_t i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.add(i));
+  }
+  EXPECT_FALSE(queue.add(4));
+  EXPECT_FALSE(queue.add(5));
+  EXPECT_EQ(2u, queue.GetStats().dropped_);
+  uint64_t items[8];
+  EXPECT_EQ(4u, queue.remove(items, 8, 0));
+  EXPECT_TRUE(queue.add(6));
+}
+
+TEST(RecordingQueueTest, SpillWhenFull) {
+  RecordingQueue<uint64_t> queue(4, kRecordingQueueSpill);
+  for (uint64_t i = 0; i < 7; ++i) {
+    EXPECT_TRUE(queue.add(i));
+  }
+  EXPECT_EQ(3u, queue.GetStats().spilled_);
+  uint64_t items[8];
+  ASSERT_EQ(7u, queue.remove(items, 8, 0));
+  for (uint64_t i = 0; i < 7; ++i) {
+    EXPECT_EQ(i, items[i]);
+  }
+  EXPECT_EQ(0u, queue.remove(items, 8, 0));
+}
+
+TEST(RecordingQueueTest, ManyProducersSmallRing) {
+  RecordingQueue<uint64_t> queue(64, kRecordingQueueSpill);
+  RunProducers(&queue, 8, 80000);
+  EXPECT_EQ(80000u, queue.GetStats().dequeued_);
+}
+
+}  // namespace art
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unpack_writer.h"
+
+#include <stdlib.h>
+
+#include "base/logging.h"
+#include "base/time_utils.h"
+#include "unpack_dump.h"
+#include "unpack_metrics.h"
+
+namespace art {
+
+DumpWriter::DumpWriter()
+    : record_buffer_(nullptr), record_buffer_size_(0), metrics_(nullptr) {
+  record_stream_ = open_memstream(&record_buffer_, &record_buffer_size_);
+  pthread_mutex_init(&lock_, NULL);
+}
+
+DumpWriter::~DumpWriter() {
+  pthread_mutex_lock(&lock_);
+  for (auto iter : files_) {
+    delete iter.second;
+  }
+  files_.clear();
+  pthread_mutex_unlock(&lock_);
+  pthread_mutex_destroy(&lock_);
+  fclose(record_stream_);
+  free(record_buffer_);
+}
+
+DumpWriter::DumpFile* DumpWriter::GetOrOpen(const std::string& path) {
+  auto it = files_.find(path);
+  if (it != files_.end()) {
+    return it->second;
+  }
+
+  DumpFile* dump_file = new DumpFile;
+  if (!dump_file->container_.Open(path, kDumpWriterBufferSize)) {
+    delete dump_file;
+    return nullptr;
+  }
+  dump_file->pending_bytes_ = 0;
+  dump_file->pending_since_ms_ = 0;
+  files_.insert(std::make_pair(path, dump_file));
+  return dump_file;
+}
+
+void DumpWriter::Flush(DumpFile* dump_file, bool write_index) {
+  if (dump_file->pending_bytes_ == 0 && !write_index) {
+    return;
+  }
+  {
+    ScopedDumpMetric write(metrics_, kDumpMetricWrite);
+    dump_file->container_.Flush(write_index);
+  }
+  dump_file->pending_bytes_ = 0;
+  ++dump_file->stats_.flushes_;
+}
+
+void DumpWriter::Write(const std::string& path, DumpBase* item) {
+  pthread_mutex_lock(&lock_);
+  DumpFile* dump_file = GetOrOpen(path);
+  if (dump_file != nullptr) {
+    if (dump_file->pending_bytes_ == 0) {
+      dump_file->pending_since_ms_ = MilliTime();
+    }
+    size_t size;
+    {
+      ScopedDumpMetric serialize(metrics_, kDumpMetricSerialize);
+      rewind(record_stream_);
+      size_t record_size = item->Output(record_stream_);
+      fflush(record_stream_);
+      size = dump_file->container_.Append(item->dump_type_, record_buffer_, record_size);
+    }
+    if (metrics_ != nullptr) {
+      metrics_->Count(kDumpCounterRecordBytes, size);
+    }
+    dump_file->pending_bytes_ += size;
+    dump_file->stats_.bytes_ += size;
+    ++dump_file->stats_.records_;
+    if (dump_file->pending_bytes_ >= kDumpWriterFlushBytes) {
+      Flush(dump_file, false);
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void DumpWriter::FlushExpired() {
+  pthread_mutex_lock(&lock_);
+  uint64_t now = MilliTime();
+  for (auto iter : files_) {
+    DumpFile* dump_file = iter.second;
+    if (dump_file->pending_bytes_ != 0 &&
+        now - dump_file->pending_since_ms_ >= kDumpWriterFlushIntervalMs) {
+      Flush(dump_file, false);
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void DumpWriter::FlushAll() {
+  pthread_mutex_lock(&lock_);
+  for (auto iter : files_) {
+    Flush(iter.second, true);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void DumpWriter::AbandonAfterFork() {
+  pthread_mutex_lock(&lock_);
+  // Leaked rather than deleted: closing a container would write its staged blocks and index
+  // through the shared descriptor.
+  files_.clear();
+  pthread_mutex_unlock(&lock_);
+}
+
+void DumpWriter::DumpStats() {
+  pthread_mutex_lock(&lock_);
+  uint64_t total_bytes = 0;
+  uint64_t total_records = 0;
+  for (auto iter : files_) {
+    const DumpFileStats& stats = iter.second->stats_;
+    LOG(ERROR) << "writer stats " << iter.first << " bytes=" << stats.bytes_
+        << " records=" << stats.records_ << " blocks=" << iter.second->container_.Blocks()
+        << " flushes=" << stats.flushes_;
+    total_bytes += stats.bytes_;
+    total_records += stats.records_;
+  }
+  LOG(ERROR) << "writer stats total files=" << files_.size() << " bytes=" << total_bytes
+      << " records=" << total_records;
+  pthread_mutex_unlock(&lock_);
+}
+
+}  // namespace art
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_UNPACK_WRITER_H_
+#define ART_RUNTIME_UNPACK_WRITER_H_
+
+#include <pthread.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+
+#include "unpack_container.h"
+
+namespace art {
+
+struct DumpBase;
+class DumpMetrics;
+
+// Size of the stdio buffer attached to every output container.
+static constexpr size_t kDumpWriterBufferSize = 256 * 1024;
+// Pending bytes after which a file is flushed even if its buffer is not full.
+static constexpr size_t kDumpWriterFlushBytes = 256 * 1024;
+// Maximum time written records may stay in a buffer before being flushed.
+static constexpr uint64_t kDumpWriterFlushIntervalMs = 2000;
+
+struct DumpFileStats {
+  uint64_t bytes_;
+  uint64_t records_;
+  uint64_t flushes_;
+
+  DumpFileStats() : bytes_(0), records_(0), flushes_(0) {}
+};
+
+// Keeps one container per output file open for the lifetime of the process, instead of opening
+// and closing the file for every record. Only the recording thread writes; the lock protects
+// against FlushAll() being called from an exit handler at the same time.
+class DumpWriter {
+  public:
+    DumpWriter();
+    ~DumpWriter();
+
+    // Appends the record to the container at path, opening it on first use.
+    void Write(const std::string& path, DumpBase* item);
+
+    // Writes out every container whose oldest staged record is older than the flush interval.
+    void FlushExpired();
+
+    // Writes out every container and appends its index.
+    void FlushAll();
+
+    // Forgets every container without writing what it staged. Called in a process forked from
+    // the one that opened them, which shares their file offsets and still writes them.
+    void AbandonAfterFork();
+
+    // Logs bytes, records, blocks and flushes for every file.
+    void DumpStats();
+
+    // Where serializing and writing times are recorded, or null.
+    void SetMetrics(DumpMetrics* metrics) {
+      metrics_ = metrics;
+    }
+
+  private:
+    struct DumpFile {
+      DumpContainerWriter container_;
+      size_t pending_bytes_;
+      uint64_t pending_since_ms_;
+      DumpFileStats stats_;
+    };
+
+    DumpFile* GetOrOpen(const std::string& path);
+    void Flush(DumpFile* dump_file, bool write_index);
+
+    std::map<std::string, DumpFile*> files_;
+    // DumpBase::Output() writes to a FILE; records are rendered into this memory stream before
+    // being staged in their container.
+    FILE* record_stream_;
+    char* record_buffer_;
+    size_t record_buffer_size_;
+    DumpMetrics* metrics_;
+    pthread_mutex_t lock_;
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_UNPACK_WRITER_H_